@@ -238,6 +238,108 @@ int64_t Throttle::put(int64_t c)
   return count.read();
 }
 
+ShardedThrottle::ShardedThrottle(CephContext *cct, const std::string& n,
+				 int64_t m)
+  : throttle(cct, n, m),
+    batch(std::max<int64_t>(m / (num_shards * 4), 1))
+{
+}
+
+ShardedThrottle::shard_t& ShardedThrottle::_get_shard()
+{
+  // threads are handed the shards round robin on first use
+  static ceph::atomic_t next_shard;
+  static __thread int shard = -1;
+  if (shard < 0)
+    shard = next_shard.inc() % num_shards;
+  return shards[shard];
+}
+
+void ShardedThrottle::_drain()
+{
+  for (unsigned i = 0; i < num_shards; ++i) {
+    std::lock_guard<std::mutex> l(shards[i].lock);
+    if (shards[i].spare) {
+      throttle.put(shards[i].spare);
+      shards[i].spare = 0;
+    }
+  }
+}
+
+int64_t ShardedThrottle::get_current() const
+{
+  int64_t cur = throttle.get_current();
+  for (unsigned i = 0; i < num_shards; ++i) {
+    std::lock_guard<std::mutex> l(shards[i].lock);
+    cur -= shards[i].spare;
+  }
+  return cur;
+}
+
+void ShardedThrottle::take(int64_t c)
+{
+  if (0 == throttle.get_max())
+    return;
+  shard_t& s = _get_shard();
+  {
+    std::lock_guard<std::mutex> l(s.lock);
+    if (s.spare >= c) {
+      s.spare -= c;
+      return;
+    }
+  }
+  throttle.take(c);
+}
+
+bool ShardedThrottle::get_or_fail(int64_t c)
+{
+  if (0 == throttle.get_max())
+    return true;
+  shard_t& s = _get_shard();
+  std::lock_guard<std::mutex> l(s.lock);
+  if (s.spare >= c) {
+    s.spare -= c;
+    return true;
+  }
+  // don't stock up on slots somebody is waiting for.  get() bumps
+  // waiters before draining our shard, which is what makes reading it
+  // under our shard lock sufficient.
+  if (!waiters.read() && c + batch <= throttle.get_max() &&
+      throttle.get_or_fail(c + batch)) {
+    s.spare += batch;
+    return true;
+  }
+  return throttle.get_or_fail(c);
+}
+
+bool ShardedThrottle::get(int64_t c)
+{
+  if (get_or_fail(c))
+    return false;
+  waiters.inc();
+  _drain();
+  bool waited = throttle.get(c);
+  waiters.dec();
+  return waited;
+}
+
+void ShardedThrottle::put(int64_t c)
+{
+  if (0 == throttle.get_max() || 0 == c)
+    return;
+  shard_t& s = _get_shard();
+  std::lock_guard<std::mutex> l(s.lock);
+  if (waiters.read()) {
+    throttle.put(c);
+    return;
+  }
+  s.spare += c;
+  if (s.spare > 2 * batch) {
+    throttle.put(s.spare - batch);
+    s.spare = batch;
+  }
+}
+
 bool BackoffThrottle::set_params(
   double _low_threshhold,
   double _high_threshhold,
@@ -8,6 +8,7 @@
 #include "Cond.h"
 #include <list>
 #include <map>
+#include <mutex>
 #include <iostream>
 #include <condition_variable>
 #include <chrono>
@@ -114,6 +115,57 @@ public:
   }
 };
 
+/**
+ * @class ShardedThrottle
+ * A Throttle for limits that many threads get and put at a high rate.
+ *
+ * Every get and put of a Throttle takes its lock.  Here each thread
+ * keeps some spare slots in a shard of its own, so most gets and puts
+ * only touch that shard and the underlying Throttle is only used to
+ * refill or trim a shard in batches.  A thread that has to block
+ * first returns the spare slots of all shards, and while anybody is
+ * blocked puts go straight back to the Throttle, so slots can't sit
+ * unused in a shard while someone waits for them.
+ *
+ * Slots may be put back by any thread, not just the one that got them.
+ */
+class ShardedThrottle {
+  static const unsigned num_shards = 16;
+
+  struct shard_t {
+    std::mutex lock;
+    int64_t spare = 0;
+  } __attribute__((aligned(64)));
+
+  Throttle throttle;
+  const int64_t batch;   ///< slots a shard refills with, and keeps at most 2x
+  mutable shard_t shards[num_shards];
+  ceph::atomic_t waiters;
+
+  shard_t& _get_shard();
+  void _drain();
+
+public:
+  ShardedThrottle(CephContext *cct, const std::string& n, int64_t m);
+
+  /// the number of slots taken, not counting the shards' spares
+  int64_t get_current() const;
+  int64_t get_max() const {
+    return throttle.get_max();
+  }
+
+  /// take c slots regardless of the throttling
+  void take(int64_t c = 1);
+  /**
+   * @returns true if it got c slots, or false if it would block or
+   * the free slots are spares of other shards (which get() reclaims)
+   */
+  bool get_or_fail(int64_t c = 1);
+  /// @returns true if this request was blocked by the throttling
+  bool get(int64_t c = 1);
+  void put(int64_t c = 1);
+};
+
 /**
  * BackoffThrottle
  *
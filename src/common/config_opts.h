@@ -206,6 +206,8 @@ OPTION(ms_async_set_affinity, OPT_BOOL, true)
 // core
 OPTION(ms_async_affinity_cores, OPT_STR, "")
 OPTION(ms_async_send_inline, OPT_BOOL, true)
+OPTION(ms_async_zerocopy_min_bytes, OPT_U64, 0)  // send with MSG_ZEROCOPY when at least this many bytes go in one sendmsg (0 = never; linux >= 4.14)
+OPTION(ms_async_zerocopy_debug_keep_copied, OPT_BOOL, false)  // keep zerocopy on even when the kernel copies (e.g. loopback); for testing
 
 OPTION(inject_early_sigterm, OPT_BOOL, false)
 
@@ -216,6 +218,7 @@ OPTION(mon_compact_on_start, OPT_BOOL, false)  // compact leveldb on ceph-mon st
 OPTION(mon_compact_on_bootstrap, OPT_BOOL, false)  // trigger leveldb compaction on bootstrap
 OPTION(mon_compact_on_trim, OPT_BOOL, true)       // compact (a prefix) when we trim old states
 OPTION(mon_osd_cache_size, OPT_INT, 10)  // the size of osdmaps cache, not to rely on underlying store's cache
+OPTION(mon_osd_cache_variant_size, OPT_INT, 10)  // osdmaps re-encoded for older peers, per encoding and epoch
 
 OPTION(mon_tick_interval, OPT_INT, 5)
 OPTION(mon_session_timeout, OPT_INT, 300)    // must send keepalive or subscribe
@@ -252,6 +255,7 @@ OPTION(mon_clock_drift_warn_backoff, OPT_FLOAT, 5) // exponential backoff for cl
 OPTION(mon_timecheck_interval, OPT_FLOAT, 300.0) // on leader, timecheck (clock drift check) interval (seconds)
 OPTION(mon_timecheck_skew_interval, OPT_FLOAT, 30.0) // on leader, timecheck (clock drift check) interval when in presence of a skew (seconds)
 OPTION(mon_pg_create_interval, OPT_FLOAT, 30.0) // no more than every 30s
+OPTION(mon_pg_stat_background, OPT_BOOL, true) // keep a second pgmap off the mon lock for pg dump and stuck pg counts
 OPTION(mon_pg_stuck_threshold, OPT_INT, 300) // number of seconds after which pgs can be considered inactive, unclean, or stale (see doc/control.rst under dump_stuck for more info)
 OPTION(mon_pg_min_inactive, OPT_U64, 1) // the number of PGs which have to be inactive longer than 'mon_pg_stuck_threshold' before health goes into ERR. 0 means disabled, never go into ERR.
 OPTION(mon_pg_warn_min_per_osd, OPT_INT, 30)  // min # pgs per (in) osd before we warn the admin
@@ -427,6 +431,8 @@ OPTION(objecter_timeout, OPT_DOUBLE, 10.0)    // before we ask for a map
 OPTION(objecter_inflight_op_bytes, OPT_U64, 1024*1024*100) // max in-flight data (both directions)
 OPTION(objecter_inflight_ops, OPT_U64, 1024)               // max in-flight ios
 OPTION(objecter_completion_locks_per_session, OPT_U64, 32) // num of completion locks per each session, for serializing same object responses
+OPTION(objecter_op_batch_max_ops, OPT_INT, 64)  // most ops op_submit_batch sends an osd in one message
+OPTION(objecter_cache_mapping, OPT_BOOL, false)  // precompute pg -> up/acting for the newest map (see osd_map_cache_mapping)
 OPTION(objecter_inject_no_watch_ping, OPT_BOOL, false)   // suppress watch pings
 
 // Max number of deletes at once in a single Filer::purge call
@@ -678,6 +684,8 @@ OPTION(osd_tier_default_cache_hit_set_search_last_n, OPT_INT, 1)
 OPTION(osd_map_dedup, OPT_BOOL, true)
 OPTION(osd_map_max_advance, OPT_INT, 150) // make this < cache_size!
 OPTION(osd_map_cache_size, OPT_INT, 200)
+OPTION(osd_map_cache_mapping, OPT_BOOL, true)  // precompute pg -> up/acting for each new map epoch
+OPTION(osd_map_mapping_threads, OPT_INT, 4)  // threads used to compute a full mapping
 OPTION(osd_map_message_max, OPT_INT, 100)  // max maps per MOSDMap message
 OPTION(osd_map_share_max_epochs, OPT_INT, 100)  // cap on # of inc maps we send to peers, clients
 OPTION(osd_inject_bad_map_crc_probability, OPT_FLOAT, 0)
@@ -697,13 +705,32 @@ OPTION(osd_recovery_threads, OPT_INT, 1)
 OPTION(osd_recover_clone_overlap, OPT_BOOL, true)   // preserve clone_overlap during recovery/migration
 OPTION(osd_op_num_threads_per_shard, OPT_INT, 2)
 OPTION(osd_op_num_shards, OPT_INT, 5)
-OPTION(osd_op_queue, OPT_STR, "prio") // PrioritzedQueue (prio), Weighted Priority Queue (wpq), or debug_random
+OPTION(osd_op_queue, OPT_STR, "prio") // PrioritzedQueue (prio), Weighted Priority Queue (wpq), mClock by op class (mclock_opclass), or debug_random
 OPTION(osd_op_queue_cut_off, OPT_STR, "low") // Min priority to go to strict queue. (low, high, debug_random)
+// mclock_opclass reservation (ops/sec), weight and limit (ops/sec) per
+// class; 0 means no reservation/limit.  each applies to the class as a
+// whole, not to each client/peer.
+OPTION(osd_op_queue_mclock_client_op_res, OPT_DOUBLE, 1000.0)
+OPTION(osd_op_queue_mclock_client_op_wgt, OPT_DOUBLE, 500.0)
+OPTION(osd_op_queue_mclock_client_op_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_osd_subop_res, OPT_DOUBLE, 1000.0)
+OPTION(osd_op_queue_mclock_osd_subop_wgt, OPT_DOUBLE, 500.0)
+OPTION(osd_op_queue_mclock_osd_subop_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_snap_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_snap_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_snap_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_recov_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_recov_wgt, OPT_DOUBLE, 5.0)
+OPTION(osd_op_queue_mclock_recov_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_scrub_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_scrub_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_scrub_lim, OPT_DOUBLE, 0.0)
 
 // Set to true for testing.  Users should NOT set this.
 // If set to true even after reading enough shards to
 // decode the object, any error will be reported.
 OPTION(osd_read_ec_check_for_errors, OPT_BOOL, false) // return error if any ec shard has an error
+OPTION(osd_ec_stripe_cache_bytes, OPT_U64, 256 << 10) // per pg, recently written stripes kept for partial-stripe overwrites
 
 // Only use clone_overlap for recovery if there are fewer than
 // osd_recover_clone_overlap_limit entries in the overlap set
@@ -749,6 +776,12 @@ OPTION(osd_auto_mark_unfound_lost, OPT_BOOL, false)
 OPTION(osd_recovery_delay_start, OPT_FLOAT, 0)
 OPTION(osd_recovery_max_active, OPT_U64, 3)
 OPTION(osd_recovery_max_single_start, OPT_U64, 1)
+// if > 0, raise the number of active recovery ops above
+// osd_recovery_max_active (up to osd_recovery_max_active_limit) while
+// client ops wait in the op queue for less than this many seconds;
+// needs perf counters, and holds at osd_recovery_max_active without them
+OPTION(osd_recovery_client_latency_target, OPT_FLOAT, 0)
+OPTION(osd_recovery_max_active_limit, OPT_U64, 32)
 OPTION(osd_recovery_max_chunk, OPT_U64, 8<<20)  // max size of push chunk
 OPTION(osd_copyfrom_max_chunk, OPT_U64, 8<<20)   // max size of a COPYFROM chunk
 OPTION(osd_push_per_object_cost, OPT_U64, 1000)  // push cost per object
@@ -765,12 +798,17 @@ OPTION(osd_scrub_interval_randomize_ratio, OPT_FLOAT, 0.5) // randomize the sche
 OPTION(osd_scrub_chunk_min, OPT_INT, 5)
 OPTION(osd_scrub_chunk_max, OPT_INT, 25)
 OPTION(osd_scrub_sleep, OPT_FLOAT, 0)   // sleep between [deep]scrub ops
+// when < 1, sleep between chunks long enough that scrubbing takes at most this fraction of the time; slow (busy) disks make chunks slower and scrub backs off
+OPTION(osd_scrub_duty_cycle, OPT_FLOAT, 1.0)
+OPTION(osd_scrub_max_sleep, OPT_FLOAT, 10)   // upper bound for the osd_scrub_duty_cycle sleep
 OPTION(osd_scrub_auto_repair, OPT_BOOL, false)   // whether auto-repair inconsistencies upon deep-scrubbing
 OPTION(osd_scrub_auto_repair_num_errors, OPT_U32, 5)   // only auto-repair when number of errors is below this threshold
 OPTION(osd_deep_scrub_interval, OPT_FLOAT, 60*60*24*7) // once a week
 OPTION(osd_deep_scrub_randomize_ratio, OPT_FLOAT, 0.15) // scrubs will randomly become deep scrubs at this rate (0.15 -> 15% of scrubs are deep)
 OPTION(osd_deep_scrub_stride, OPT_INT, 524288)
 OPTION(osd_deep_scrub_update_digest_min_age, OPT_INT, 2*60*60)   // objects must be this old (seconds) before we update the whole-object digest on scrub
+// re-read objects unchanged since the last deep scrub on only one deep scrub in this many (1 = every time)
+OPTION(osd_deep_scrub_unchanged_sample_period, OPT_U32, 1)
 OPTION(osd_scan_list_ping_tp_interval, OPT_U64, 100)
 OPTION(osd_class_dir, OPT_STR, CEPH_LIBDIR "/rados-classes") // where rados plugins are stored
 OPTION(osd_open_classes_on_start, OPT_BOOL, true)
@@ -910,6 +948,8 @@ OPTION(bdev_inject_crash_flush_delay, OPT_INT, 2) // wait N more seconds on flus
 OPTION(bdev_aio, OPT_BOOL, true)
 OPTION(bdev_aio_poll_ms, OPT_INT, 250)  // milliseconds
 OPTION(bdev_aio_max_queue_depth, OPT_INT, 32)
+OPTION(bdev_aio_reap_threads, OPT_INT, 1)  // threads polling for aio completions
+OPTION(bdev_aio_submit_batch, OPT_BOOL, true)  // submit aios queued by concurrent callers in one io_submit
 OPTION(bdev_block_size, OPT_INT, 4096)
 
 // if yes, osd will unbind all NVMe devices from kernel driver and bind them
@@ -952,8 +992,18 @@ OPTION(bluestore_block_preallocate_file, OPT_BOOL, false) //whether preallocate
 OPTION(bluestore_min_alloc_size, OPT_U32, 64*1024)
 OPTION(bluestore_onode_map_size, OPT_U32, 1024)   // onodes per collection
 OPTION(bluestore_cache_tails, OPT_BOOL, true)   // cache tail blocks in Onode
+OPTION(bluestore_buffer_cache_size, OPT_U64, 4*1024*1024)  // bytes of object data cached per collection
+OPTION(bluestore_buffer_cache_writes, OPT_BOOL, true)  // cache newly written data
+OPTION(bluestore_buffer_cache_readahead, OPT_U64, 0)  // min bytes to read (and cache) on a miss
+OPTION(bluestore_csum_type, OPT_STR, "crc32c")  // none|crc32c|xxhash32|xxhash64
+OPTION(bluestore_csum_chunk_order, OPT_INT, 12)  // checksum every 4k
+OPTION(bluestore_compression, OPT_STR, "none")  // none, passive (only if hinted compressible), aggressive (unless hinted incompressible), force
+OPTION(bluestore_compression_algorithm, OPT_STR, "snappy")
+OPTION(bluestore_compression_required_ratio, OPT_DOUBLE, .875)  // keep compressed result only if allocated size shrinks at least this much
+OPTION(bluestore_compression_max_blob_size, OPT_U64, 128*1024)  // max extent size to allocate (and compress) at once
 OPTION(bluestore_kvbackend, OPT_STR, "rocksdb")
-OPTION(bluestore_allocator, OPT_STR, "stupid")  // or "bitmap"
+OPTION(bluestore_allocator, OPT_STR, "stupid")  // or "bitmap" or "sharded"
+OPTION(bluestore_allocator_shards, OPT_INT, 8)  // zones for the sharded allocator
 OPTION(bluestore_freelist_type, OPT_STR, "bitmap")
 OPTION(bluestore_freelist_blocks_per_key, OPT_INT, 128)
 OPTION(bluestore_rocksdb_options, OPT_STR, "compression=kNoCompression,max_write_buffer_number=16,min_write_buffer_number_to_merge=3,recycle_log_file_num=16")
@@ -963,12 +1013,15 @@ OPTION(bluestore_sync_transaction, OPT_BOOL, false)  // perform kv txn synchrono
 OPTION(bluestore_sync_submit_transaction, OPT_BOOL, false)
 OPTION(bluestore_sync_wal_apply, OPT_BOOL, true)     // perform initial wal work synchronously (possibly in combination with aio so we only *queue* ios)
 OPTION(bluestore_wal_threads, OPT_INT, 4)
+OPTION(bluestore_finisher_shards, OPT_INT, 1)  // completion threads; each sequencer always uses the same one
 OPTION(bluestore_wal_thread_timeout, OPT_INT, 30)
 OPTION(bluestore_wal_thread_suicide_timeout, OPT_INT, 120)
 OPTION(bluestore_max_ops, OPT_U64, 512)
 OPTION(bluestore_max_bytes, OPT_U64, 64*1024*1024)
 OPTION(bluestore_wal_max_ops, OPT_U64, 512)
 OPTION(bluestore_wal_max_bytes, OPT_U64, 128*1024*1024)
+OPTION(bluestore_wal_batch_bytes, OPT_U64, 0)  // coalesce wal writes from many txcs into sorted device writes once this much is queued (0 = apply each txc on its own)
+OPTION(bluestore_wal_batch_max_delay, OPT_DOUBLE, .005)  // seconds a partial wal batch may wait for more txcs
 OPTION(bluestore_nid_prealloc, OPT_INT, 1024)
 OPTION(bluestore_overlay_max_length, OPT_INT, 65536)
 OPTION(bluestore_overlay_max, OPT_INT, 0)
@@ -0,0 +1,391 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef MCLOCK_QUEUE_H
+#define MCLOCK_QUEUE_H
+
+#include "OpQueue.h"
+#include "common/Clock.h"
+#include "common/Formatter.h"
+#include "include/assert.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <list>
+#include <map>
+
+/**
+ * mClock scheduler (Gulati et al., OSDI '10)
+ *
+ * Every client (K) has a reservation (ops/sec it is always given), a
+ * weight (its share of whatever capacity is left) and a limit (ops/sec
+ * it may not exceed while others are waiting).  Each request is tagged
+ * with a reservation, limit and proportional tag spaced 1/rate apart
+ * from the client's previous request.  dequeue() first serves the
+ * smallest reservation tag that is due, then the smallest proportional
+ * tag among clients under their limit.
+ *
+ * A reservation or limit of 0 means none.  Client parameters are looked
+ * up through client_info_f each time a request is tagged, so they can
+ * change at runtime.  Because OpQueue::dequeue() must return an item,
+ * the queue is work conserving: when every client is over its limit the
+ * one that becomes eligible first is served.
+ *
+ * Only the head request of each client is tagged; tags of queued
+ * requests are computed when they reach the head, using their arrival
+ * time.  Strict items bypass mClock and are served first, highest
+ * priority first.
+ *
+ * As in dmClock, a client that runs out of requests keeps its tags,
+ * so it cannot improve its position by briefly going idle.  Only once
+ * it has been idle for idle_age seconds (or is new) are its
+ * proportional tags shifted, when it becomes active again, to line up
+ * with the lowest one among the active clients; that way it neither
+ * jumps ahead of them nor has to catch up on tags they accumulated
+ * while it was away.  Clients idle for erase_age are forgotten.
+ */
+
+template <typename T, typename K>
+class mClockQueue : public OpQueue <T, K>
+{
+public:
+  struct ClientInfo {
+    double reservation;
+    double weight;
+    double limit;
+    ClientInfo(double r = 0, double w = 1, double l = 0)
+      : reservation(r), weight(w), limit(l) {}
+  };
+  typedef std::function<ClientInfo(const K&)> client_info_func_t;
+  typedef std::function<double()> clock_func_t;
+
+private:
+  struct Request {
+    T item;
+    double arrival;
+    bool tagged = false;
+    double r_tag = 0, l_tag = 0, p_tag = 0;
+    Request(T& i, double a) : item(i), arrival(a) {}
+  };
+
+  struct Client {
+    ClientInfo info;
+    double prev_r = 0, prev_l = 0, prev_p = 0;  ///< last tags handed out
+    double prop_delta = 0;  ///< shift applied to p tags since reactivation
+    bool seen = false;      ///< has been active before
+    double idle_since = 0;
+    std::list<Request> requests;
+
+    bool idle() const {
+      return requests.empty();
+    }
+    double head_p_tag() const {
+      return requests.front().p_tag + prop_delta;
+    }
+  };
+
+  typedef std::map<K, Client> ClientMap;
+  typedef typename ClientMap::iterator Cit;
+  typedef std::list<std::pair<K, T> > StrictList;
+
+  ClientMap clients;  ///< clients with queued requests, and idle ones
+  unsigned num_active = 0;  ///< clients with queued requests
+  std::map<unsigned, StrictList> strict;
+  unsigned strict_size = 0;
+  unsigned size = 0;
+  client_info_func_t client_info_f;
+  clock_func_t clock_f;
+  double idle_age;   ///< recalibrate clients idle for longer than this
+  double erase_age;  ///< forget clients idle for longer than this
+  double last_prune = 0;
+
+  static double now_default() {
+    return (double)ceph_clock_now(NULL);
+  }
+
+  void tag_head(const K& k, Client& c) {
+    Request& r = c.requests.front();
+    if (r.tagged)
+      return;
+    c.info = client_info_f(k);
+    if (c.info.reservation > 0) {
+      r.r_tag = std::max(c.prev_r + 1.0 / c.info.reservation, r.arrival);
+      c.prev_r = r.r_tag;
+    } else {
+      r.r_tag = std::numeric_limits<double>::infinity();
+    }
+    if (c.info.limit > 0) {
+      r.l_tag = std::max(c.prev_l + 1.0 / c.info.limit, r.arrival);
+      c.prev_l = r.l_tag;
+    } else {
+      r.l_tag = r.arrival;
+    }
+    double w = std::max(c.info.weight, 0.001);
+    r.p_tag = std::max(c.prev_p + 1.0 / w, r.arrival);
+    c.prev_p = r.p_tag;
+    r.tagged = true;
+  }
+
+  void activate(Client& c) {
+    ++num_active;
+    double now = clock_f();
+    if (c.seen && now - c.idle_since < idle_age)
+      return;
+    c.seen = true;
+    double lowest = std::numeric_limits<double>::infinity();
+    for (auto& i : clients) {
+      if (!i.second.idle() && i.second.requests.front().tagged)
+	lowest = std::min(lowest, i.second.head_p_tag());
+    }
+    c.prop_delta = lowest < std::numeric_limits<double>::infinity() ?
+      lowest - now : 0;
+  }
+
+  void deactivate(Client& c, double now) {
+    c.idle_since = now;
+    --num_active;
+  }
+
+  /// drop clients that have been idle for a long time
+  void prune(double now) {
+    if (now - last_prune < erase_age)
+      return;
+    last_prune = now;
+    for (Cit i = clients.begin(); i != clients.end();) {
+      if (i->second.idle() && now - i->second.idle_since >= erase_age)
+	clients.erase(i++);
+      else
+	++i;
+    }
+  }
+
+  void insert(K cl, T& item, bool front) {
+    Client& c = clients[cl];
+    if (c.idle())
+      activate(c);
+    if (front) {
+      c.requests.push_front(Request(item, clock_f()));
+      tag_head(cl, c);
+    } else {
+      c.requests.push_back(Request(item, clock_f()));
+      if (c.requests.size() == 1)
+	tag_head(cl, c);
+    }
+    ++size;
+  }
+
+  Cit pick(double now, bool *reserved) {
+    // constraint-based phase: any reservation that is due
+    Cit best = clients.end();
+    for (Cit i = clients.begin(); i != clients.end(); ++i) {
+      if (i->second.idle())
+	continue;
+      const Request& r = i->second.requests.front();
+      if (r.r_tag <= now &&
+	  (best == clients.end() ||
+	   r.r_tag < best->second.requests.front().r_tag))
+	best = i;
+    }
+    *reserved = best != clients.end();
+    if (*reserved)
+      return best;
+
+    // weight-based phase among clients under their limit
+    for (Cit i = clients.begin(); i != clients.end(); ++i) {
+      if (i->second.idle())
+	continue;
+      const Request& r = i->second.requests.front();
+      if (r.l_tag <= now &&
+	  (best == clients.end() ||
+	   i->second.head_p_tag() < best->second.head_p_tag()))
+	best = i;
+    }
+    if (best != clients.end())
+      return best;
+
+    // everyone is over their limit
+    for (Cit i = clients.begin(); i != clients.end(); ++i) {
+      if (i->second.idle())
+	continue;
+      const Request& r = i->second.requests.front();
+      if (best == clients.end() ||
+	  r.l_tag < best->second.requests.front().l_tag)
+	best = i;
+    }
+    return best;
+  }
+
+  unsigned filter_strict(std::function<bool (const std::pair<K, T>&)> f,
+			 std::list<T> *out) {
+    unsigned count = 0;
+    for (auto p = strict.begin(); p != strict.end();) {
+      for (auto i = p->second.begin(); i != p->second.end();) {
+	if (f(*i)) {
+	  if (out)
+	    out->push_back(i->second);
+	  i = p->second.erase(i);
+	  ++count;
+	} else {
+	  ++i;
+	}
+      }
+      if (p->second.empty())
+	strict.erase(p++);
+      else
+	++p;
+    }
+    strict_size -= count;
+    return count;
+  }
+
+public:
+  explicit mClockQueue(client_info_func_t info_f,
+		       clock_func_t c = &mClockQueue::now_default,
+		       double idle = 300, double erase = 600)
+    : client_info_f(info_f), clock_f(c), idle_age(idle), erase_age(erase) {}
+
+  unsigned length() const override final {
+    return strict_size + size;
+  }
+
+  void remove_by_filter(std::function<bool (T)> f) override final {
+    remove_by_filter(f, NULL);
+  }
+
+  /// remove matching items, appending them to *out (if given) in
+  /// queue order for each client
+  void remove_by_filter(std::function<bool (T)> f, std::list<T> *out) {
+    filter_strict([&f](const std::pair<K, T>& i) { return f(i.second); },
+		  out);
+    double now = clock_f();
+    for (Cit i = clients.begin(); i != clients.end(); ++i) {
+      std::list<Request>& q = i->second.requests;
+      if (q.empty())
+	continue;
+      for (auto r = q.begin(); r != q.end();) {
+	if (f(r->item)) {
+	  if (out)
+	    out->push_back(r->item);
+	  r = q.erase(r);
+	  --size;
+	} else {
+	  ++r;
+	}
+      }
+      if (q.empty())
+	deactivate(i->second, now);
+      else
+	tag_head(i->first, i->second);
+    }
+  }
+
+  void remove_by_class(K cl, std::list<T> *out = 0) override final {
+    filter_strict([&cl](const std::pair<K, T>& i) { return i.first == cl; },
+		  out);
+    Cit i = clients.find(cl);
+    if (i == clients.end() || i->second.idle())
+      return;
+    for (auto& r : i->second.requests) {
+      if (out)
+	out->push_back(r.item);
+      --size;
+    }
+    i->second.requests.clear();
+    deactivate(i->second, clock_f());
+  }
+
+  bool empty() const override final {
+    return !(strict_size + size);
+  }
+
+  void enqueue_strict(K cl, unsigned p, T item) override final {
+    strict[p].push_back(std::make_pair(cl, item));
+    ++strict_size;
+  }
+
+  void enqueue_strict_front(K cl, unsigned p, T item) override final {
+    strict[p].push_front(std::make_pair(cl, item));
+    ++strict_size;
+  }
+
+  void enqueue(K cl, unsigned p, unsigned cost, T item) override final {
+    insert(cl, item, false);
+  }
+
+  void enqueue_front(K cl, unsigned p, unsigned cost, T item) override final {
+    insert(cl, item, true);
+  }
+
+  T dequeue() override final {
+    assert(strict_size + size > 0);
+    if (strict_size) {
+      auto p = --strict.end();
+      T ret = p->second.front().second;
+      p->second.pop_front();
+      if (p->second.empty())
+	strict.erase(p);
+      --strict_size;
+      return ret;
+    }
+
+    bool reserved;
+    double now = clock_f();
+    Cit i = pick(now, &reserved);
+    assert(i != clients.end());
+    Client& c = i->second;
+    T ret = c.requests.front().item;
+    c.requests.pop_front();
+    --size;
+    if (!reserved && c.info.reservation > 0) {
+      // served out of its weight share; that doesn't count against
+      // the reservation, so pull the client's reservation tags back.
+      double d = 1.0 / c.info.reservation;
+      c.prev_r -= d;
+      if (!c.requests.empty() && c.requests.front().tagged)
+	c.requests.front().r_tag -= d;
+    }
+    if (c.requests.empty()) {
+      deactivate(c, now);
+      prune(now);
+    } else {
+      tag_head(i->first, c);
+    }
+    return ret;
+  }
+
+  void dump(ceph::Formatter *f) const override final {
+    f->dump_int("strict_size", strict_size);
+    f->dump_int("size", size);
+    f->dump_int("num_clients", num_active);
+    f->dump_int("num_idle_clients", clients.size() - num_active);
+    f->open_array_section("clients");
+    for (auto& i : clients) {
+      if (i.second.idle())
+	continue;
+      const Request& r = i.second.requests.front();
+      f->open_object_section("client");
+      f->dump_int("queued", i.second.requests.size());
+      f->dump_float("reservation", i.second.info.reservation);
+      f->dump_float("weight", i.second.info.weight);
+      f->dump_float("limit", i.second.info.limit);
+      if (i.second.info.reservation > 0)
+	f->dump_float("r_tag", r.r_tag);
+      f->dump_float("l_tag", r.l_tag);
+      f->dump_float("p_tag", r.p_tag + i.second.prop_delta);
+      f->close_section();
+    }
+    f->close_section();
+  }
+};
+
+#endif
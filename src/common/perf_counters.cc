@@ -22,6 +22,8 @@
 
 #include <errno.h>
 #include <map>
+#include <new>
+#include <stdlib.h>
 #include <sstream>
 #include <stdint.h>
 #include <string.h>
@@ -112,12 +114,15 @@ bool PerfCountersCollection::reset(const std::string &name)
  * @param counter name of counter within subsystem, e.g. "num_strays",
  *                may be empty.
  * @param schema if true, output schema instead of current data.
+ * @param histograms if true, output the histograms instead of the
+ *                   other counters.
  */
 void PerfCountersCollection::dump_formatted(
     Formatter *f,
     bool schema,
     const std::string &logger,
-    const std::string &counter)
+    const std::string &counter,
+    bool histograms)
 {
   Mutex::Locker lck(m_lock);
   f->open_object_section("perfcounter_collection");
@@ -126,7 +131,7 @@ void PerfCountersCollection::dump_formatted(
        l != m_loggers.end(); ++l) {
     // Optionally filter on logger name, pass through counter filter
     if (logger.empty() || (*l)->get_name() == logger) {
-      (*l)->dump_formatted(f, schema, counter);
+      (*l)->dump_formatted(f, schema, counter, histograms);
     }
   }
   f->close_section();
@@ -136,6 +141,25 @@ void PerfCountersCollection::dump_formatted(
 
 PerfCounters::~PerfCounters()
 {
+  for (perf_counter_data_vec_t::iterator d = m_data.begin();
+       d != m_data.end(); ++d) {
+    if (d->shards) {
+      for (int i = 0; i < PERFCOUNTER_SHARDS; ++i)
+	d->shards[i].~perf_counter_shard_d();
+      free(d->shards);
+    }
+    delete d->histogram;
+  }
+}
+
+int PerfCounters::perf_counter_data_any_d::shard_index()
+{
+  // threads are handed the shards round robin on their first update
+  static atomic_t next_shard;
+  static __thread int shard = -1;
+  if (shard < 0)
+    shard = next_shard.inc() % PERFCOUNTER_SHARDS;
+  return shard;
 }
 
 void PerfCounters::inc(int idx, uint64_t amt)
@@ -148,13 +172,7 @@ void PerfCounters::inc(int idx, uint64_t amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  if (data.type & PERFCOUNTER_LONGRUNAVG) {
-    data.avgcount.inc();
-    data.u64.add(amt);
-    data.avgcount2.inc();
-  } else {
-    data.u64.add(amt);
-  }
+  data.add(amt);
 }
 
 void PerfCounters::dec(int idx, uint64_t amt)
@@ -168,7 +186,7 @@ void PerfCounters::dec(int idx, uint64_t amt)
   assert(!(data.type & PERFCOUNTER_LONGRUNAVG));
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  data.u64.sub(amt);
+  data.sub(amt);
 }
 
 void PerfCounters::set(int idx, uint64_t amt)
@@ -181,6 +199,7 @@ void PerfCounters::set(int idx, uint64_t amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return;
+  assert(!(data.type & PERFCOUNTER_SHARDED));
 
   ANNOTATE_BENIGN_RACE_SIZED(&data.u64, sizeof(data.u64),
                              "perf counter atomic");
@@ -203,7 +222,7 @@ uint64_t PerfCounters::get(int idx) const
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return 0;
-  return data.u64.read();
+  return data.read_u64();
 }
 
 void PerfCounters::tinc(int idx, utime_t amt)
@@ -216,13 +235,7 @@ void PerfCounters::tinc(int idx, utime_t amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
-  if (data.type & PERFCOUNTER_LONGRUNAVG) {
-    data.avgcount.inc();
-    data.u64.add(amt.to_nsec());
-    data.avgcount2.inc();
-  } else {
-    data.u64.add(amt.to_nsec());
-  }
+  data.add(amt.to_nsec());
 }
 
 void PerfCounters::tinc(int idx, ceph::timespan amt)
@@ -235,13 +248,7 @@ void PerfCounters::tinc(int idx, ceph::timespan amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
-  if (data.type & PERFCOUNTER_LONGRUNAVG) {
-    data.avgcount.inc();
-    data.u64.add(amt.count());
-    data.avgcount2.inc();
-  } else {
-    data.u64.add(amt.count());
-  }
+  data.add(amt.count());
 }
 
 void PerfCounters::tset(int idx, utime_t amt)
@@ -254,6 +261,7 @@ void PerfCounters::tset(int idx, utime_t amt)
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
+  assert(!(data.type & PERFCOUNTER_SHARDED));
   data.u64.set(amt.to_nsec());
   if (data.type & PERFCOUNTER_LONGRUNAVG)
     assert(0);
@@ -269,10 +277,23 @@ utime_t PerfCounters::tget(int idx) const
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return utime_t();
-  uint64_t v = data.u64.read();
+  uint64_t v = data.read_u64();
   return utime_t(v / 1000000000ull, v % 1000000000ull);
 }
 
+void PerfCounters::hinc(int idx, int64_t x, int64_t y)
+{
+  if (!m_cct->_conf->perf)
+    return;
+
+  assert(idx > m_lower_bound);
+  assert(idx < m_upper_bound);
+  perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
+  if (!(data.type & PERFCOUNTER_HISTOGRAM))
+    return;
+  data.histogram->inc(x, y);
+}
+
 pair<uint64_t, uint64_t> PerfCounters::get_tavg_ms(int idx) const
 {
   if (!m_cct->_conf->perf)
@@ -301,7 +322,7 @@ void PerfCounters::reset()
 }
 
 void PerfCounters::dump_formatted(Formatter *f, bool schema,
-    const std::string &counter)
+    const std::string &counter, bool histograms)
 {
   f->open_object_section(m_name.c_str());
   
@@ -311,10 +332,14 @@ void PerfCounters::dump_formatted(Formatter *f, bool schema,
       // Optionally filter on counter name
       continue;
     }
+    if (histograms != !!(d->type & PERFCOUNTER_HISTOGRAM))
+      continue;
 
     if (schema) {
       f->open_object_section(d->name);
       f->dump_int("type", d->type);
+      if (d->histogram)
+	d->histogram->dump_formatted_axes(f);
 
       if (d->description) {
         f->dump_string("description", d->description);
@@ -328,6 +353,10 @@ void PerfCounters::dump_formatted(Formatter *f, bool schema,
         f->dump_string("nick", "");
       }
       f->close_section();
+    } else if (d->histogram) {
+      f->open_object_section(d->name);
+      d->histogram->dump_formatted_values(f);
+      f->close_section();
     } else {
       if (d->type & PERFCOUNTER_LONGRUNAVG) {
 	f->open_object_section(d->name);
@@ -345,7 +374,7 @@ void PerfCounters::dump_formatted(Formatter *f, bool schema,
 	}
 	f->close_section();
       } else {
-	uint64_t v = d->u64.read();
+	uint64_t v = d->read_u64();
 	if (d->type & PERFCOUNTER_U64) {
 	  f->dump_unsigned(d->name, v);
 	} else if (d->type & PERFCOUNTER_TIME) {
@@ -421,6 +450,31 @@ void PerfCountersBuilder::add_time_avg(int idx, const char *name,
   add_impl(idx, name, description, nick, PERFCOUNTER_TIME | PERFCOUNTER_LONGRUNAVG);
 }
 
+void PerfCountersBuilder::add_u64_counter_sharded(int idx, const char *name,
+    const char *description, const char *nick)
+{
+  add_impl(idx, name, description, nick,
+	   PERFCOUNTER_U64 | PERFCOUNTER_COUNTER | PERFCOUNTER_SHARDED);
+}
+
+void PerfCountersBuilder::add_time_avg_sharded(int idx, const char *name,
+    const char *description, const char *nick)
+{
+  add_impl(idx, name, description, nick,
+	   PERFCOUNTER_TIME | PERFCOUNTER_LONGRUNAVG | PERFCOUNTER_SHARDED);
+}
+
+void PerfCountersBuilder::add_histogram(int idx, const char *name,
+    const PerfHistogram::axis_config_d &x_axis,
+    const PerfHistogram::axis_config_d &y_axis,
+    const char *description, const char *nick)
+{
+  add_impl(idx, name, description, nick, PERFCOUNTER_HISTOGRAM);
+  PerfCounters::perf_counter_data_any_d &data(
+    m_perf_counters->m_data[idx - m_perf_counters->m_lower_bound - 1]);
+  data.histogram = new PerfHistogram(x_axis, y_axis);
+}
+
 void PerfCountersBuilder::add_impl(int idx, const char *name,
     const char *description, const char *nick, int ty)
 {
@@ -434,6 +488,16 @@ void PerfCountersBuilder::add_impl(int idx, const char *name,
   data.description = description;
   data.nick = nick;
   data.type = (enum perfcounter_type_d)ty;
+  if (ty & PERFCOUNTER_SHARDED) {
+    void *p;
+    int r = posix_memalign(&p, sizeof(PerfCounters::perf_counter_shard_d),
+			   PERFCOUNTER_SHARDS *
+			   sizeof(PerfCounters::perf_counter_shard_d));
+    assert(r == 0);
+    data.shards = static_cast<PerfCounters::perf_counter_shard_d*>(p);
+    for (int i = 0; i < PERFCOUNTER_SHARDS; ++i)
+      new (&data.shards[i]) PerfCounters::perf_counter_shard_d();
+  }
 }
 
 PerfCounters *PerfCountersBuilder::create_perf_counters()
@@ -23,6 +23,7 @@
 #include "common/config_obs.h"
 #include "common/Mutex.h"
 #include "common/ceph_time.h"
+#include "common/perf_histogram.h"
 
 #include <stdint.h>
 #include <string>
@@ -39,8 +40,13 @@ enum perfcounter_type_d
   PERFCOUNTER_U64 = 0x2,
   PERFCOUNTER_LONGRUNAVG = 0x4,
   PERFCOUNTER_COUNTER = 0x8,
+  PERFCOUNTER_SHARDED = 0x10,
+  PERFCOUNTER_HISTOGRAM = 0x20,
 };
 
+/// number of slots of a sharded counter; threads are spread over them
+#define PERFCOUNTER_SHARDS 16
+
 /*
  * A PerfCounters object is usually associated with a single subsystem.
  * It contains counters which we modify to track performance and throughput
@@ -64,6 +70,14 @@ enum perfcounter_type_d
  * For the time average, it returns the current value and
  * the "avgcount" member when read off. avgcount is incremented when you call
  * tinc. Calling tset on an average is an error and will assert out.
+ *
+ * Counters updated by many threads at once can be sharded: each thread
+ * updates its own cache line and readers add the shards up.  They can't
+ * be set, only incremented and decremented.
+ *
+ * Histograms count (x, y) pairs passed to hinc(), e.g. latency and size
+ * of each op. They are only dumped by "perf histogram dump", so that
+ * "perf dump" keeps its format.
  */
 class PerfCounters
 {
@@ -98,9 +112,11 @@ public:
   void tinc(int idx, ceph::timespan v);
   utime_t tget(int idx) const;
 
+  void hinc(int idx, int64_t x, int64_t y);
+
   void reset();
   void dump_formatted(ceph::Formatter *f, bool schema,
-      const std::string &counter = "");
+      const std::string &counter = "", bool histograms = false);
   pair<uint64_t, uint64_t> get_tavg_ms(int idx) const;
 
   const std::string& get_name() const;
@@ -114,6 +130,13 @@ private:
   PerfCounters(const PerfCounters &rhs);
   PerfCounters& operator=(const PerfCounters &rhs);
 
+  /** One thread's slot of a sharded counter, alone on its cache line */
+  struct perf_counter_shard_d {
+    atomic64_t u64;
+    atomic64_t avgcount;
+    atomic64_t avgcount2;
+  } __attribute__((aligned(64)));
+
   /** Represents a PerfCounters data element. */
   struct perf_counter_data_any_d {
     perf_counter_data_any_d()
@@ -123,14 +146,20 @@ private:
 	type(PERFCOUNTER_NONE),
 	u64(0),
 	avgcount(0),
-	avgcount2(0)
+	avgcount2(0),
+	shards(NULL),
+	histogram(NULL)
     {}
     perf_counter_data_any_d(const perf_counter_data_any_d& other)
       : name(other.name),
         description(other.description),
         nick(other.nick),
 	type(other.type),
-	u64(other.u64.read()) {
+	u64(other.u64.read()),
+	shards(NULL),
+	histogram(NULL) {
+      // only copied while m_data is sized, before anything is allocated
+      assert(!other.shards && !other.histogram);
       pair<uint64_t,uint64_t> a = other.read_avg();
       u64.set(a.first);
       avgcount.set(a.second);
@@ -144,6 +173,8 @@ private:
     atomic64_t u64;
     atomic64_t avgcount;
     atomic64_t avgcount2;
+    perf_counter_shard_d *shards;  ///< PERFCOUNTER_SHARDS slots if sharded
+    PerfHistogram *histogram;
 
     void reset()
     {
@@ -152,9 +183,54 @@ private:
 	avgcount.set(0);
 	avgcount2.set(0);
       }
+      if (shards) {
+	for (int i = 0; i < PERFCOUNTER_SHARDS; ++i) {
+	  shards[i].u64.set(0);
+	  shards[i].avgcount.set(0);
+	  shards[i].avgcount2.set(0);
+	}
+      }
+      if (histogram)
+	histogram->reset();
+    }
+
+    /// add v to the sum, and count it if this is an average
+    void add(uint64_t v) {
+      atomic64_t *sum = &u64, *count = &avgcount, *count2 = &avgcount2;
+      if (shards) {
+	perf_counter_shard_d &s = shards[shard_index()];
+	sum = &s.u64;
+	count = &s.avgcount;
+	count2 = &s.avgcount2;
+      }
+      if (type & PERFCOUNTER_LONGRUNAVG) {
+	count->inc();
+	sum->add(v);
+	count2->inc();
+      } else {
+	sum->add(v);
+      }
+    }
+
+    void sub(uint64_t v) {
+      if (shards)
+	shards[shard_index()].u64.sub(v);
+      else
+	u64.sub(v);
+    }
+
+    uint64_t read_u64() const {
+      if (!shards)
+	return u64.read();
+      uint64_t sum = 0;
+      for (int i = 0; i < PERFCOUNTER_SHARDS; ++i)
+	sum += shards[i].u64.read();
+      return sum;
     }
 
     perf_counter_data_any_d& operator=(const perf_counter_data_any_d& other) {
+      assert(!other.shards && !other.histogram);
+      assert(!shards && !histogram);
       name = other.name;
       description = other.description;
       nick = other.nick;
@@ -168,6 +244,22 @@ private:
 
     /// read <sum, count> safely
     pair<uint64_t,uint64_t> read_avg() const {
+      if (shards) {
+	pair<uint64_t,uint64_t> total(0, 0);
+	for (int i = 0; i < PERFCOUNTER_SHARDS; ++i) {
+	  pair<uint64_t,uint64_t> a = read_avg(shards[i].u64, shards[i].avgcount,
+					       shards[i].avgcount2);
+	  total.first += a.first;
+	  total.second += a.second;
+	}
+	return total;
+      }
+      return read_avg(u64, avgcount, avgcount2);
+    }
+
+    static pair<uint64_t,uint64_t> read_avg(const atomic64_t &u64,
+					    const atomic64_t &avgcount,
+					    const atomic64_t &avgcount2) {
       uint64_t sum, count;
       do {
 	count = avgcount.read();
@@ -175,6 +267,8 @@ private:
       } while (avgcount2.read() != count);
       return make_pair(sum, count);
     }
+
+    static int shard_index();
   };
   typedef std::vector<perf_counter_data_any_d> perf_counter_data_vec_t;
 
@@ -217,7 +311,8 @@ public:
       ceph::Formatter *f,
       bool schema,
       const std::string &logger = "",
-      const std::string &counter = "");
+      const std::string &counter = "",
+      bool histograms = false);
 private:
   CephContext *m_cct;
 
@@ -253,6 +348,14 @@ public:
       const char *description=NULL, const char *nick = NULL);
   void add_time_avg(int key, const char *name,
       const char *description=NULL, const char *nick = NULL);
+  void add_u64_counter_sharded(int key, const char *name,
+      const char *description=NULL, const char *nick = NULL);
+  void add_time_avg_sharded(int key, const char *name,
+      const char *description=NULL, const char *nick = NULL);
+  void add_histogram(int key, const char *name,
+      const PerfHistogram::axis_config_d &x_axis,
+      const PerfHistogram::axis_config_d &y_axis,
+      const char *description=NULL, const char *nick = NULL);
   PerfCounters* create_perf_counters();
 private:
   PerfCountersBuilder(const PerfCountersBuilder &rhs);
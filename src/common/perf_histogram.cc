@@ -0,0 +1,114 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/perf_histogram.h"
+#include "common/Formatter.h"
+#include "include/assert.h"
+
+PerfHistogram::PerfHistogram(const axis_config_d &x, const axis_config_d &y)
+{
+  m_axes[0] = x;
+  m_axes[1] = y;
+  for (int i = 0; i < 2; ++i) {
+    assert(m_axes[i].buckets >= 3);
+    assert(m_axes[i].quant_size > 0);
+  }
+  m_buckets = new ceph::atomic64_t[x.buckets * y.buckets];
+}
+
+PerfHistogram::~PerfHistogram()
+{
+  delete[] m_buckets;
+}
+
+int32_t PerfHistogram::get_bucket(const axis_config_d &ac, int64_t value)
+{
+  if (value < ac.min)
+    return 0;
+  uint64_t quants = (value - ac.min) / ac.quant_size;
+  uint64_t bucket;
+  if (ac.scale_type == SCALE_LINEAR) {
+    bucket = 1 + quants;
+  } else {
+    // quants in [2^(b-2), 2^(b-1)) lands in bucket b
+    bucket = quants ? 2 + (63 - __builtin_clzll(quants)) : 1;
+  }
+  return bucket < (uint64_t)ac.buckets - 1 ? bucket : ac.buckets - 1;
+}
+
+void PerfHistogram::inc(int64_t x, int64_t y)
+{
+  int32_t xb = get_bucket(m_axes[0], x);
+  int32_t yb = get_bucket(m_axes[1], y);
+  m_buckets[xb * m_axes[1].buckets + yb].inc();
+}
+
+uint64_t PerfHistogram::read(int32_t x_bucket, int32_t y_bucket) const
+{
+  assert(x_bucket < m_axes[0].buckets);
+  assert(y_bucket < m_axes[1].buckets);
+  return m_buckets[x_bucket * m_axes[1].buckets + y_bucket].read();
+}
+
+void PerfHistogram::reset()
+{
+  for (int32_t i = 0; i < m_axes[0].buckets * m_axes[1].buckets; ++i)
+    m_buckets[i].set(0);
+}
+
+void PerfHistogram::dump_formatted_axes(ceph::Formatter *f) const
+{
+  f->open_array_section("axes");
+  for (int i = 0; i < 2; ++i) {
+    const axis_config_d &ac = m_axes[i];
+    f->open_object_section("axis");
+    f->dump_string("name", ac.name);
+    f->dump_string("scale_type",
+		   ac.scale_type == SCALE_LINEAR ? "linear" : "log2");
+    f->dump_int("min", ac.min);
+    f->dump_int("quant_size", ac.quant_size);
+    f->dump_int("buckets", ac.buckets);
+    f->open_array_section("ranges");
+    int64_t lower = ac.min;
+    for (int32_t b = 0; b < ac.buckets; ++b) {
+      f->open_object_section("bucket");
+      if (b == 0) {
+	f->dump_int("max", ac.min - 1);
+      } else if (b == ac.buckets - 1) {
+	f->dump_int("min", lower);
+      } else {
+	int64_t width = ac.quant_size;
+	if (ac.scale_type == SCALE_LOG2 && b > 1)
+	  width = ac.quant_size << (b - 2);
+	f->dump_int("min", lower);
+	f->dump_int("max", lower + width - 1);
+	lower += width;
+      }
+      f->close_section();
+    }
+    f->close_section();
+    f->close_section();
+  }
+  f->close_section();
+}
+
+void PerfHistogram::dump_formatted_values(ceph::Formatter *f) const
+{
+  f->open_array_section("values");
+  for (int32_t x = 0; x < m_axes[0].buckets; ++x) {
+    f->open_array_section("x");
+    for (int32_t y = 0; y < m_axes[1].buckets; ++y)
+      f->dump_unsigned("y", read(x, y));
+    f->close_section();
+  }
+  f->close_section();
+}
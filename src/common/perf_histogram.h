@@ -0,0 +1,73 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_PERF_HISTOGRAM_H
+#define CEPH_COMMON_PERF_HISTOGRAM_H
+
+#include "include/atomic.h"
+#include "include/int_types.h"
+
+namespace ceph {
+  class Formatter;
+}
+
+/**
+ * Two dimensional histogram, e.g. of op latency by op size.
+ *
+ * Each axis has an underflow bucket for values below min, buckets - 2
+ * regular buckets and an overflow bucket.  With SCALE_LINEAR the
+ * regular buckets are all quant_size wide; with SCALE_LOG2 the first
+ * one is quant_size wide and each following one twice as wide as the
+ * previous, so a handful of buckets covers microseconds to seconds.
+ *
+ * Buckets are plain atomic counters: concurrent inc() calls only
+ * contend when they land in the same cell.
+ */
+class PerfHistogram
+{
+public:
+  enum scale_type_d {
+    SCALE_LINEAR = 1,
+    SCALE_LOG2 = 2,
+  };
+
+  struct axis_config_d {
+    const char *name;
+    scale_type_d scale_type;
+    int64_t min;
+    int64_t quant_size;
+    int32_t buckets;
+  };
+
+  PerfHistogram(const axis_config_d &x, const axis_config_d &y);
+  ~PerfHistogram();
+
+  void inc(int64_t x, int64_t y);
+  uint64_t read(int32_t x_bucket, int32_t y_bucket) const;
+  void reset();
+
+  /// axes and the [min, max] range of each of their buckets
+  void dump_formatted_axes(ceph::Formatter *f) const;
+  /// values[x][y] bucket counts
+  void dump_formatted_values(ceph::Formatter *f) const;
+
+  static int32_t get_bucket(const axis_config_d &ac, int64_t value);
+
+private:
+  PerfHistogram(const PerfHistogram &rhs);
+  PerfHistogram& operator=(const PerfHistogram &rhs);
+
+  axis_config_d m_axes[2];
+  ceph::atomic64_t *m_buckets;
+};
+
+#endif
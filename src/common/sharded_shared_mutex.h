@@ -0,0 +1,94 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_SHARDED_SHARED_MUTEX_H
+#define CEPH_COMMON_SHARDED_SHARED_MUTEX_H
+
+#include <boost/thread/shared_mutex.hpp>
+
+#include "include/atomic.h"
+
+namespace ceph {
+
+/**
+ * A reader/writer lock for data that is read all the time and rarely
+ * written.
+ *
+ * Even a shared lock of a single shared_mutex writes to the mutex, so
+ * readers on different cpus keep stealing its cache line from each
+ * other.  Here each thread takes its shared locks on one of N shards,
+ * each on its own cache line, and an exclusive lock takes all of them
+ * in order.  Readers in different threads therefore don't touch the
+ * same memory, at the price of more expensive exclusive locks.
+ *
+ * A shared lock must be released by the thread that took it.  Shared
+ * locks are not recursive, exactly as with boost::shared_mutex: a
+ * second shared lock can block behind a waiting writer.
+ *
+ * Meets the SharedLockable requirements, so it works with
+ * std::unique_lock, boost::shared_lock and ceph::shunique_lock.
+ */
+template<unsigned N = 16>
+class sharded_shared_mutex {
+  struct shard_t {
+    boost::shared_mutex lock;
+  } __attribute__((aligned(64)));
+
+  shard_t shards[N];
+
+  static unsigned shard_index() {
+    // threads are handed the shards round robin on their first lock
+    static atomic_t next_shard;
+    static __thread int shard = -1;
+    if (shard < 0)
+      shard = next_shard.inc() % N;
+    return shard;
+  }
+
+public:
+  sharded_shared_mutex() = default;
+  sharded_shared_mutex(const sharded_shared_mutex&) = delete;
+  sharded_shared_mutex& operator=(const sharded_shared_mutex&) = delete;
+
+  void lock() {
+    for (unsigned i = 0; i < N; ++i)
+      shards[i].lock.lock();
+  }
+  bool try_lock() {
+    for (unsigned i = 0; i < N; ++i) {
+      if (!shards[i].lock.try_lock()) {
+	while (i > 0)
+	  shards[--i].lock.unlock();
+	return false;
+      }
+    }
+    return true;
+  }
+  void unlock() {
+    for (unsigned i = N; i > 0; --i)
+      shards[i - 1].lock.unlock();
+  }
+
+  void lock_shared() {
+    shards[shard_index()].lock.lock_shared();
+  }
+  bool try_lock_shared() {
+    return shards[shard_index()].lock.try_lock_shared();
+  }
+  void unlock_shared() {
+    shards[shard_index()].lock.unlock_shared();
+  }
+};
+
+} // namespace ceph
+
+#endif
@@ -4,9 +4,13 @@
 #include "include/stringify.h"
 #include "CrushTester.h"
 #include "CrushTreeDumper.h"
+#include "common/Clock.h"
+#include "crush/hash_simd.h"
 
 #include <algorithm>
+#include <cmath>
 #include <stdlib.h>
+#include <thread>
 #include <boost/lexical_cast.hpp>
 // to workaround https://svn.boost.org/trac/boost/ticket/9501
 #ifdef _LIBCPP_VERSION
@@ -498,24 +502,13 @@ void CrushTester::check_overlapped_rules() const
   }
 }
 
-int CrushTester::test()
+void CrushTester::get_device_weights(vector<__u32>& weight)
 {
-  if (min_rule < 0 || max_rule < 0) {
-    min_rule = 0;
-    max_rule = crush.get_max_rules() - 1;
-  }
-  if (min_x < 0 || max_x < 0) {
-    min_x = 0;
-    max_x = 1023;
-  }
-
-  // initial osd weights
-  vector<__u32> weight;
-
   /*
    * note device weight is set by crushtool
    * (likely due to a given a command line option)
    */
+  weight.clear();
   for (int o = 0; o < crush.get_max_devices(); o++) {
     if (device_weight.count(o)) {
       weight.push_back(device_weight[o]);
@@ -525,6 +518,196 @@ int CrushTester::test()
       weight.push_back(0);
     }
   }
+}
+
+void CrushTester::count_placements(int ruleno, int num_rep,
+				   const vector<__u32>& weight,
+				   unsigned threads, vector<int> *per)
+{
+  // do_rule serializes on the map's mapper_lock, so each thread maps
+  // with a private copy
+  bufferlist bl;
+  crush.encode(bl);
+  if (threads < 1)
+    threads = 1;
+  vector<vector<int> > counts(threads, vector<int>(per->size()));
+  auto work = [&](unsigned t) {
+    CrushWrapper c;
+    bufferlist::iterator p = bl.begin();
+    c.decode(p);
+    vector<int> out;
+    for (int x = min_x + t; x <= max_x; x += threads) {
+      uint32_t real_x = x;
+      if (pool_id != -1)
+	real_x = crush_hash32_2(CRUSH_HASH_RJENKINS1, x, (uint32_t)pool_id);
+      c.do_rule(ruleno, real_x, out, num_rep, weight);
+      for (unsigned i = 0; i < out.size(); i++)
+	if (out[i] != CRUSH_ITEM_NONE && out[i] < (int)per->size())
+	  counts[t][out[i]]++;
+    }
+  };
+  vector<std::thread> workers;
+  for (unsigned t = 1; t < threads; t++)
+    workers.push_back(std::thread(work, t));
+  work(0);
+  for (unsigned t = 0; t < workers.size(); t++)
+    workers[t].join();
+
+  std::fill(per->begin(), per->end(), 0);
+  for (unsigned t = 0; t < threads; t++)
+    for (unsigned i = 0; i < per->size(); i++)
+      (*per)[i] += counts[t][i];
+}
+
+namespace {
+  struct placement_stats_t {
+    double stddev;     ///< of the placements vs. the expected count
+    double max_ratio;  ///< placements / expected of the fullest device
+    int max_device;
+  };
+
+  placement_stats_t get_placement_stats(const vector<int>& per,
+					const vector<double>& expected)
+  {
+    placement_stats_t s = { 0, 0, -1 };
+    int n = 0;
+    for (unsigned i = 0; i < per.size(); i++) {
+      if (expected[i] <= 0)
+	continue;
+      double d = per[i] - expected[i];
+      s.stddev += d * d;
+      ++n;
+      if (per[i] / expected[i] > s.max_ratio) {
+	s.max_ratio = per[i] / expected[i];
+	s.max_device = i;
+      }
+    }
+    if (n)
+      s.stddev = sqrt(s.stddev / n);
+    return s;
+  }
+
+  ostream& operator<<(ostream& out, const placement_stats_t& s)
+  {
+    return out << "stddev " << s.stddev
+	       << ", fullest osd." << s.max_device
+	       << " at " << s.max_ratio << "x its share";
+  }
+}
+
+int CrushTester::optimize_weights(CephContext *cct, int iterations,
+				  float max_change, unsigned threads)
+{
+  if (min_x < 0 || max_x < 0) {
+    min_x = 0;
+    max_x = 1023;
+  }
+  int r = min_rule >= 0 ? min_rule : 0;
+  for (; r < crush.get_max_rules(); r++) {
+    if (crush.rule_exists(r) &&
+	(ruleset < 0 || crush.get_rule_mask_ruleset(r) == ruleset))
+      break;
+  }
+  if (r >= crush.get_max_rules()) {
+    err << "no rule to optimize for" << std::endl;
+    return -ENOENT;
+  }
+  int nr = min_rep;
+  if (nr < 0)
+    nr = min(max(3, crush.get_rule_mask_min_size(r)),
+	     crush.get_rule_mask_max_size(r));
+
+  vector<__u32> weight;
+  get_device_weights(weight);
+
+  // only the devices under the rule's take steps can get placements;
+  // leave the others (e.g. those under another root) alone
+  map<int,float> reachable;
+  crush.get_rule_weight_osd_map(r, &reachable);
+
+  // each device's share of the placements follows its original weight
+  vector<int> orig(crush.get_max_devices(), 0);
+  int64_t total_weight = 0;
+  for (unsigned i = 0; i < orig.size(); i++) {
+    if (reachable.count(i) && crush.check_item_present(i)) {
+      orig[i] = crush.get_item_weight(i);
+      if (weight[i])
+	total_weight += orig[i];
+    }
+  }
+  if (total_weight == 0) {
+    err << "no weighted devices" << std::endl;
+    return -EINVAL;
+  }
+
+  vector<int> per(orig.size());
+  count_placements(r, nr, weight, threads, &per);
+  int64_t total = 0;
+  for (unsigned i = 0; i < per.size(); i++)
+    total += per[i];
+  vector<double> expected(orig.size(), 0);
+  for (unsigned i = 0; i < orig.size(); i++)
+    if (weight[i])
+      expected[i] = (double)total * orig[i] / total_weight;
+
+  placement_stats_t before = get_placement_stats(per, expected);
+  placement_stats_t best = before;
+  vector<int> cur(orig), best_weights(orig);
+  err << "rule " << r << " (" << crush.get_rule_name(r) << ") num_rep " << nr
+      << ", x = " << min_x << ".." << max_x << std::endl;
+  err << "before: " << before << std::endl;
+
+  for (int it = 0; it < iterations; it++) {
+    for (unsigned i = 0; i < cur.size(); i++) {
+      if (expected[i] <= 0 || cur[i] <= 0)
+	continue;
+      double factor = per[i] ? expected[i] / per[i] : 1 + max_change;
+      factor = max(1.0 - max_change, min(1.0 + max_change, factor));
+      int w = max(1, (int)(cur[i] * factor));
+      if (w != cur[i]) {
+	crush.adjust_item_weight(cct, i, w);
+	cur[i] = w;
+      }
+    }
+    count_placements(r, nr, weight, threads, &per);
+    placement_stats_t s = get_placement_stats(per, expected);
+    if (output_statistics)
+      err << "iteration " << it << ": " << s << std::endl;
+    if (s.stddev < best.stddev) {
+      best = s;
+      best_weights = cur;
+    }
+  }
+
+  int changed = 0;
+  for (unsigned i = 0; i < cur.size(); i++) {
+    if (cur[i] != best_weights[i])
+      crush.adjust_item_weight(cct, i, best_weights[i]);
+    if (best_weights[i] != orig[i]) {
+      if (output_utilization)
+	err << "  device " << i << ":\t" << (float)orig[i] / 0x10000
+	    << " -> " << (float)best_weights[i] / 0x10000 << std::endl;
+      ++changed;
+    }
+  }
+  err << "after:  " << best << std::endl;
+  return changed;
+}
+
+int CrushTester::test()
+{
+  if (min_rule < 0 || max_rule < 0) {
+    min_rule = 0;
+    max_rule = crush.get_max_rules() - 1;
+  }
+  if (min_x < 0 || max_x < 0) {
+    min_x = 0;
+    max_x = 1023;
+  }
+
+  // initial osd weights
+  vector<__u32> weight;
+  get_device_weights(weight);
 
   if (output_utilization_all)
     err << "devices weights (hex): " << hex << weight << dec << std::endl;
@@ -618,6 +801,7 @@ int CrushTester::test()
       for (unsigned i = 0; i < num_devices; i++)
         num_objects_expected[i] = (proportional_weights[i]*expected_objects);
 
+      utime_t start = ceph_clock_now(NULL);
       for (int current_batch = 0; current_batch < num_batches; current_batch++) {
         if (current_batch == (num_batches - 1)) {
           batch_max = max_x;
@@ -681,6 +865,18 @@ int CrushTester::test()
         batch_max = batch_min + objects_per_batch - 1;
       }
 
+      if (output_timing) {
+        double elapsed = ceph_clock_now(NULL) - start;
+        err << "rule " << r << " (" << crush.get_rule_name(r) << ") num_rep " << nr
+            << " mapped " << num_objects << " in " << elapsed << "s: "
+            << (elapsed > 0 ? (uint64_t)(num_objects / elapsed) : 0)
+            << " mappings/sec"
+#ifdef CRUSH_HASH_SIMD
+            << " (" << crush_hash_simd_name() << " straw2 hashing)"
+#endif
+            << std::endl;
+      }
+
       for (unsigned i = 0; i < per.size(); i++)
         if (output_utilization && !output_statistics)
           err << "  device " << i
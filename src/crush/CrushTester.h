@@ -32,6 +32,7 @@ class CrushTester {
   bool output_mappings;
   bool output_bad_mappings;
   bool output_choose_tries;
+  bool output_timing;
 
   bool output_data_file;
   bool output_csv;
@@ -76,6 +77,17 @@ class CrushTester {
    */
   int random_placement(int ruleno, vector<int>& out, int maxout, vector<__u32>& weight);
 
+  /// reweight vector for do_rule: 1.0, or what --weight set
+  void get_device_weights(vector<__u32>& weight);
+
+  /*
+   * Count how many times each device comes out of ruleno for the
+   * [min_x, max_x] inputs.  The inputs are spread across threads, each
+   * mapping with its own copy of the map.
+   */
+  void count_placements(int ruleno, int num_rep, const vector<__u32>& weight,
+			unsigned threads, vector<int> *per);
+
   // scaffolding to store data for off-line processing
    struct tester_data_set {
      vector <string> device_utilization;
@@ -184,6 +196,7 @@ public:
       output_mappings(false),
       output_bad_mappings(false),
       output_choose_tries(false),
+      output_timing(false),
       output_data_file(false),
       output_csv(false),
       output_data_file_name("")
@@ -253,6 +266,13 @@ public:
     return output_choose_tries;
   }
 
+  void set_output_timing(bool b) {
+    output_timing = b;
+  }
+  bool get_output_timing() const {
+    return output_timing;
+  }
+
   void set_batches(int b) {
     num_batches = b;
   }
@@ -359,6 +379,17 @@ public:
    */
   void check_overlapped_rules() const;
   int test();
+  /**
+   * adjust the crush weights of the devices so that the number of
+   * placements of each is as close as possible to its share of the
+   * original weight, for a single rule and num_rep.  Each iteration
+   * moves each weight by at most max_change (a fraction), and the best
+   * set of weights seen is kept in the map.
+   *
+   * @return the number of reweighted devices, or a negative error code
+   */
+  int optimize_weights(CephContext *cct, int iterations, float max_change,
+		       unsigned threads);
   int test_with_crushtool(const char *crushtool_cmd = "crushtool",
 			  int max_id = -1,
 			  int timeout = 0,
@@ -2,6 +2,7 @@
 # include <linux/crush/hash.h>
 #else
 # include "hash.h"
+# include "hash_simd.h"
 #endif
 
 /*
@@ -120,6 +121,19 @@ __u32 crush_hash32_3(int type, __u32 a, __u32 b, __u32 c)
 	}
 }
 
+void crush_hash32_3_batch(int type, __u32 a, const __s32 *b, __u32 c,
+			  unsigned int n, __u32 *out)
+{
+	unsigned int i = 0;
+
+#ifdef CRUSH_HASH_SIMD
+	if (type == CRUSH_HASH_RJENKINS1)
+		i = crush_hash32_rjenkins1_3_simd(a, b, c, n, out);
+#endif
+	for (; i < n; i++)
+		out[i] = crush_hash32_3(type, a, b[i], c);
+}
+
 __u32 crush_hash32_4(int type, __u32 a, __u32 b, __u32 c, __u32 d)
 {
 	switch (type) {
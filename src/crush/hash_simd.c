@@ -0,0 +1,136 @@
+/*
+ * Vectorized rjenkins1 hashing of many items at once.
+ *
+ * crush_hash32_rjenkins1_3 only uses 32-bit add, sub, xor and shifts,
+ * so it maps directly onto SSE2 (4 lanes, always there on x86_64) and
+ * AVX2 (8 lanes, used when the cpu has it) and gives bit-identical
+ * results to the scalar version in hash.c.
+ */
+
+#include "hash_simd.h"
+
+#if defined(CRUSH_HASH_SIMD)
+
+#include <immintrin.h>
+
+#define crush_hash_seed 1315423911
+
+/*
+ * one line of crush_hashmix: a = a-b;  a = a-c;  a = a^(c SHIFT n);
+ * P is the intrinsic prefix, X the suffix of the bitwise ops
+ */
+#define crush_hashmix_step(P, X, a, b, c, shift, n)			\
+	a = P##_sub_epi32(a, b);					\
+	a = P##_sub_epi32(a, c);					\
+	a = P##_xor_##X(a, P##_##shift##_epi32(c, n))
+
+#define crush_hashmix_vec(P, X, a, b, c) do {				\
+		crush_hashmix_step(P, X, a, b, c, srli, 13);		\
+		crush_hashmix_step(P, X, b, c, a, slli, 8);		\
+		crush_hashmix_step(P, X, c, a, b, srli, 13);		\
+		crush_hashmix_step(P, X, a, b, c, srli, 12);		\
+		crush_hashmix_step(P, X, b, c, a, slli, 16);		\
+		crush_hashmix_step(P, X, c, a, b, srli, 5);		\
+		crush_hashmix_step(P, X, a, b, c, srli, 3);		\
+		crush_hashmix_step(P, X, b, c, a, slli, 10);		\
+		crush_hashmix_step(P, X, c, a, b, srli, 15);		\
+	} while (0)
+
+static unsigned int crush_hash32_rjenkins1_3_sse2(__u32 a, const __s32 *b,
+						  __u32 c, unsigned int n,
+						  __u32 *out)
+{
+	unsigned int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i va = _mm_set1_epi32(a);
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+		__m128i vc = _mm_set1_epi32(c);
+		__m128i x = _mm_set1_epi32(231232);
+		__m128i y = _mm_set1_epi32(1232);
+		__m128i hash = _mm_xor_si128(
+			_mm_set1_epi32(crush_hash_seed ^ a ^ c), vb);
+
+		crush_hashmix_vec(_mm, si128, va, vb, hash);
+		crush_hashmix_vec(_mm, si128, vc, x, hash);
+		crush_hashmix_vec(_mm, si128, y, va, hash);
+		crush_hashmix_vec(_mm, si128, vb, x, hash);
+		crush_hashmix_vec(_mm, si128, y, vc, hash);
+		_mm_storeu_si128((__m128i *)(out + i), hash);
+	}
+	return i;
+}
+
+#if defined(CRUSH_HASH_AVX2)
+
+__attribute__((target("avx2")))
+static unsigned int crush_hash32_rjenkins1_3_avx2(__u32 a, const __s32 *b,
+						  __u32 c, unsigned int n,
+						  __u32 *out)
+{
+	unsigned int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i va = _mm256_set1_epi32(a);
+		__m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+		__m256i vc = _mm256_set1_epi32(c);
+		__m256i x = _mm256_set1_epi32(231232);
+		__m256i y = _mm256_set1_epi32(1232);
+		__m256i hash = _mm256_xor_si256(
+			_mm256_set1_epi32(crush_hash_seed ^ a ^ c), vb);
+
+		crush_hashmix_vec(_mm256, si256, va, vb, hash);
+		crush_hashmix_vec(_mm256, si256, vc, x, hash);
+		crush_hashmix_vec(_mm256, si256, y, va, hash);
+		crush_hashmix_vec(_mm256, si256, vb, x, hash);
+		crush_hashmix_vec(_mm256, si256, y, vc, hash);
+		_mm256_storeu_si256((__m256i *)(out + i), hash);
+	}
+	/* leave the remainder to the narrower version */
+	return i + crush_hash32_rjenkins1_3_sse2(a, b + i, c, n - i, out + i);
+}
+
+#endif /* CRUSH_HASH_AVX2 */
+
+/*
+ * choose an implementation on first use.  This is racy but harmless:
+ * every thread comes to the same conclusion.
+ */
+typedef unsigned int (*crush_hash_simd_func_t)(__u32 a, const __s32 *b,
+					       __u32 c, unsigned int n,
+					       __u32 *out);
+static crush_hash_simd_func_t crush_hash_simd_func;
+
+static crush_hash_simd_func_t crush_hash_simd_choose(void)
+{
+#if defined(CRUSH_HASH_AVX2)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return crush_hash32_rjenkins1_3_avx2;
+#endif
+	return crush_hash32_rjenkins1_3_sse2;
+}
+
+unsigned int crush_hash32_rjenkins1_3_simd(__u32 a, const __s32 *b, __u32 c,
+					   unsigned int n, __u32 *out)
+{
+	crush_hash_simd_func_t f = crush_hash_simd_func;
+
+	if (!f) {
+		f = crush_hash_simd_choose();
+		crush_hash_simd_func = f;
+	}
+	return f(a, b, c, n, out);
+}
+
+const char *crush_hash_simd_name(void)
+{
+#if defined(CRUSH_HASH_AVX2)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return "avx2";
+#endif
+	return "sse2";
+}
+
+#endif /* CRUSH_HASH_SIMD */
@@ -0,0 +1,41 @@
+#ifndef CEPH_CRUSH_HASH_SIMD_H
+#define CEPH_CRUSH_HASH_SIMD_H
+
+#include "crush_compat.h"
+
+/*
+ * SSE2 is part of x86_64; AVX2 is picked at runtime and needs a
+ * compiler that accepts its intrinsics in target("avx2") functions.
+ */
+#if !defined(__KERNEL__) && defined(__x86_64__) && defined(__GNUC__)
+# define CRUSH_HASH_SIMD 1
+# if defined(__clang__) || __GNUC__ > 4 || \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#  define CRUSH_HASH_AVX2 1
+# endif
+#endif
+
+#ifdef CRUSH_HASH_SIMD
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * out[i] = crush_hash32_rjenkins1_3(a, b[i], c) for as many leading
+ * items as fit in whole vectors; returns how many it did
+ */
+extern unsigned int crush_hash32_rjenkins1_3_simd(__u32 a, const __s32 *b,
+						  __u32 c, unsigned int n,
+						  __u32 *out);
+
+/* name of the implementation in use */
+extern const char *crush_hash_simd_name(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#endif
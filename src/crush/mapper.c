@@ -292,8 +292,12 @@ static __u64 crush_ln(unsigned int xin)
  *
  * http://en.wikipedia.org/wiki/Exponential_distribution#Distribution_of_the_minimum_of_exponential_random_variables
  *
+ * the item hashes are computed a batch at a time so that they can be
+ * vectorized (see crush_hash32_3_batch).
  */
 
+#define CRUSH_STRAW2_HASH_BATCH 64
+
 static int bucket_straw2_choose(struct crush_bucket_straw2 *bucket,
 				int x, int r)
 {
@@ -301,12 +305,21 @@ static int bucket_straw2_choose(struct crush_bucket_straw2 *bucket,
 	unsigned int u;
 	unsigned int w;
 	__s64 ln, draw, high_draw = 0;
+	__u32 hashes[CRUSH_STRAW2_HASH_BATCH];
 
 	for (i = 0; i < bucket->h.size; i++) {
+		if (i % CRUSH_STRAW2_HASH_BATCH == 0) {
+			unsigned int n = bucket->h.size - i;
+
+			if (n > CRUSH_STRAW2_HASH_BATCH)
+				n = CRUSH_STRAW2_HASH_BATCH;
+			crush_hash32_3_batch(bucket->h.hash, x,
+					     bucket->h.items + i, r, n,
+					     hashes);
+		}
 		w = bucket->item_weights[i];
 		if (w) {
-			u = crush_hash32_3(bucket->h.hash, x,
-					   bucket->h.items[i], r);
+			u = hashes[i % CRUSH_STRAW2_HASH_BATCH];
 			u &= 0xffff;
 
 			/*
@@ -25,6 +25,8 @@
 #include "include/buffer.h"
 
 const unsigned ErasureCode::SIMD_ALIGN = 32;
+// keeps the k + m regions of a batch within the L2 cache of most cpus
+const unsigned ErasureCode::ENCODE_BATCH_SIZE = 64 * 1024;
 
 int ErasureCode::sanity_check_k(int k, ostream *ss)
 {
@@ -72,6 +74,25 @@ int ErasureCode::minimum_to_decode_with_cost(const set<int> &want_to_read,
   return minimum_to_decode(want_to_read, available_chunks, minimum);
 }
 
+int ErasureCode::minimum_to_decode_with_cost(
+  const set<int> &want_to_read,
+  const map<int, int> &available,
+  map<int, vector<pair<int, int> > > *minimum)
+{
+  set<int> minimum_chunks;
+  int r = minimum_to_decode_with_cost(want_to_read, available,
+				      &minimum_chunks);
+  if (r < 0)
+    return r;
+  vector<pair<int, int> > all;
+  all.push_back(make_pair(0, get_sub_chunk_count()));
+  for (set<int>::iterator i = minimum_chunks.begin();
+       i != minimum_chunks.end();
+       ++i)
+    (*minimum)[*i] = all;
+  return 0;
+}
+
 int ErasureCode::encode_prepare(const bufferlist &raw,
                                 map<int, bufferlist> &encoded) const
 {
@@ -132,6 +153,62 @@ int ErasureCode::encode_chunks(const set<int> &want_to_encode,
 {
   assert("ErasureCode::encode_chunks not implemented" == 0);
 }
+
+int ErasureCode::encode_stripes(const set<int> &want_to_encode,
+                                const bufferlist &in,
+                                unsigned stripe_count,
+                                map<int, bufferlist> *encoded)
+{
+  assert(stripe_count > 0);
+  assert(in.length() % stripe_count == 0);
+  unsigned int k = get_data_chunk_count();
+  unsigned int n = get_chunk_count();
+  unsigned stripe_width = in.length() / stripe_count;
+  unsigned blocksize = get_chunk_size(stripe_width);
+  assert(blocksize * k == stripe_width);
+
+  if (!can_batch_stripes()) {
+    for (unsigned s = 0; s < stripe_count; s++) {
+      bufferlist stripe;
+      stripe.substr_of(in, s * stripe_width, stripe_width);
+      map<int, bufferlist> chunks;
+      int r = encode(want_to_encode, stripe, &chunks);
+      if (r)
+	return r;
+      for (map<int, bufferlist>::iterator i = chunks.begin();
+	   i != chunks.end();
+	   ++i)
+	(*encoded)[i->first].claim_append(i->second);
+    }
+    return 0;
+  }
+
+  unsigned batch = std::max(1u, ENCODE_BATCH_SIZE / blocksize);
+  bufferlist::const_iterator p = in.begin();
+  for (unsigned s = 0; s < stripe_count; s += batch) {
+    unsigned count = std::min(batch, stripe_count - s);
+    map<int, bufferlist> chunks;
+    vector<char*> data(k);
+    for (unsigned int i = 0; i < n; i++) {
+      bufferptr buf(buffer::create_aligned(count * blocksize, SIMD_ALIGN));
+      if (i < k)
+	data[i] = buf.c_str();
+      chunks[chunk_index(i)].push_back(std::move(buf));
+    }
+    // gather chunk i of every stripe of the batch into region i
+    for (unsigned j = 0; j < count; j++)
+      for (unsigned int i = 0; i < k; i++)
+	p.copy(blocksize, data[i] + j * blocksize);
+    int r = encode_chunks(want_to_encode, &chunks);
+    if (r)
+      return r;
+    for (set<int>::const_iterator i = want_to_encode.begin();
+	 i != want_to_encode.end();
+	 ++i)
+      (*encoded)[*i].claim_append(chunks[*i]);
+  }
+  return 0;
+}
  
 int ErasureCode::decode(const set<int> &want_to_read,
                         const map<int, bufferlist> &chunks,
@@ -168,6 +245,15 @@ int ErasureCode::decode(const set<int> &want_to_read,
   return decode_chunks(want_to_read, chunks, decoded);
 }
 
+int ErasureCode::decode(const set<int> &want_to_read,
+                        const map<int, bufferlist> &chunks,
+                        map<int, bufferlist> *decoded,
+                        int chunk_size)
+{
+  // scalar codes always read whole chunks
+  return decode(want_to_read, chunks, decoded);
+}
+
 int ErasureCode::decode_chunks(const set<int> &want_to_read,
                                const map<int, bufferlist> &chunks,
                                map<int, bufferlist> *decoded)
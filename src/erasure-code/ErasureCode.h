@@ -31,6 +31,8 @@ namespace ceph {
   class ErasureCode : public ErasureCodeInterface {
   public:
     static const unsigned SIMD_ALIGN;
+    /// largest chunk region encode_stripes() hands to encode_chunks()
+    static const unsigned ENCODE_BATCH_SIZE;
 
     vector<int> chunk_mapping;
     ErasureCodeProfile _profile;
@@ -60,6 +62,15 @@ namespace ceph {
                                             const map<int, int> &available,
                                             set<int> *minimum);
 
+    virtual int get_sub_chunk_count() {
+      return 1;
+    }
+
+    virtual int minimum_to_decode_with_cost(
+      const set<int> &want_to_read,
+      const map<int, int> &available,
+      map<int, vector<pair<int, int> > > *minimum);
+
     int encode_prepare(const bufferlist &raw,
                        map<int, bufferlist> &encoded) const;
 
@@ -70,10 +81,20 @@ namespace ceph {
     virtual int encode_chunks(const set<int> &want_to_encode,
                               map<int, bufferlist> *encoded);
 
+    virtual int encode_stripes(const set<int> &want_to_encode,
+                               const bufferlist &in,
+                               unsigned stripe_count,
+                               map<int, bufferlist> *encoded);
+
     virtual int decode(const set<int> &want_to_read,
                        const map<int, bufferlist> &chunks,
                        map<int, bufferlist> *decoded);
 
+    virtual int decode(const set<int> &want_to_read,
+                       const map<int, bufferlist> &chunks,
+                       map<int, bufferlist> *decoded,
+                       int chunk_size);
+
     virtual int decode_chunks(const set<int> &want_to_read,
                               const map<int, bufferlist> &chunks,
                               map<int, bufferlist> *decoded);
@@ -108,6 +129,12 @@ namespace ceph {
     int parse(const ErasureCodeProfile &profile,
 	      ostream *ss);
 
+    /// true if encode_chunks() on chunks made of the chunks of
+    /// several stripes gives the chunks of each stripe
+    virtual bool can_batch_stripes() const {
+      return false;
+    }
+
   private:
     int chunk_index(unsigned int i) const;
   };
@@ -316,6 +316,40 @@ namespace ceph {
                                             const map<int, int> &available,
                                             set<int> *minimum) = 0;
 
+    /**
+     * Return the number of sub-chunks each chunk is divided into.
+     * Vector codes (such as regenerating codes) split every chunk in
+     * **get_sub_chunk_count()** sub-chunks of equal size and may
+     * decode some chunks from a subset of the sub-chunks of the
+     * others. Scalar codes return 1.
+     *
+     * @return the number of sub-chunks in a chunk
+     */
+    virtual int get_sub_chunk_count() = 0;
+
+    /**
+     * Same as **minimum_to_decode_with_cost** but also tells which
+     * sub-chunks of each chunk need to be retrieved. Each chunk in
+     * **minimum** maps to a list of (first sub-chunk, count) ranges,
+     * in increasing order. A chunk that must be read entirely maps to
+     * [(0, get_sub_chunk_count())].
+     *
+     * When only a part of a chunk is read, the sub-chunks listed are
+     * concatenated, in order, and the result is given to **decode**
+     * together with the **chunk_size**.
+     *
+     * @param [in] want_to_read chunk indexes to be decoded
+     * @param [in] available map chunk indexes containing valid data
+     *             to their retrieval cost
+     * @param [out] minimum map chunk indexes to retrieve to the
+     *             sub-chunk ranges to read from them
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int minimum_to_decode_with_cost(
+      const set<int> &want_to_read,
+      const map<int, int> &available,
+      map<int, vector<pair<int, int> > > *minimum) = 0;
+
     /**
      * Encode the content of **in** and store the result in
      * **encoded**. All buffers pointed to by **encoded** have the
@@ -359,6 +393,35 @@ namespace ceph {
     virtual int encode_chunks(const set<int> &want_to_encode,
                               map<int, bufferlist> *encoded) = 0;
 
+    /**
+     * Encode **stripe_count** stripes stored back to back in **in**,
+     * as if **encode** was called on each of them, and store in
+     * **encoded** the chunks of all stripes: encoded[i] is the
+     * concatenation of chunk i of the first stripe, chunk i of the
+     * second stripe, etc.
+     *
+     * The length of **in** must be a multiple of **stripe_count**
+     * and each stripe must be get_data_chunk_count() times
+     * get_chunk_size(stripe width) bytes long, i.e. need no padding.
+     * Codes that can treat the chunks of many stripes as one larger
+     * chunk encode them all with a single call to **encode_chunks**,
+     * amortizing the per stripe overhead over large regions.
+     *
+     * The **encoded** map is expected to be a pointer to an empty
+     * map and only contains the chunks in **want_to_encode** on
+     * return.
+     *
+     * @param [in] want_to_encode chunk indexes to be encoded
+     * @param [in] in stripes to be encoded
+     * @param [in] stripe_count number of stripes in **in**
+     * @param [out] encoded map chunk indexes to chunk data
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int encode_stripes(const set<int> &want_to_encode,
+                               const bufferlist &in,
+                               unsigned stripe_count,
+                               map<int, bufferlist> *encoded) = 0;
+
     /**
      * Decode the **chunks** and store at least **want_to_read**
      * chunks in **decoded**.
@@ -396,6 +459,24 @@ namespace ceph {
                        const map<int, bufferlist> &chunks,
                        map<int, bufferlist> *decoded) = 0;
 
+    /**
+     * Same as **decode** but the **chunks** may only contain the
+     * sub-chunks returned by the sub-chunk variant of
+     * **minimum_to_decode_with_cost**, in which case their length is
+     * smaller than **chunk_size**. The chunks in **decoded** are
+     * **chunk_size** long.
+     *
+     * @param [in] want_to_read chunk indexes to be decoded
+     * @param [in] chunks map chunk indexes to chunk data
+     * @param [out] decoded map chunk indexes to chunk data
+     * @param [in] chunk_size the size of a complete chunk
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int decode(const set<int> &want_to_read,
+                       const map<int, bufferlist> &chunks,
+                       map<int, bufferlist> *decoded,
+                       int chunk_size) = 0;
+
     virtual int decode_chunks(const set<int> &want_to_read,
                               const map<int, bufferlist> &chunks,
                               map<int, bufferlist> *decoded) = 0;
@@ -0,0 +1,612 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+#include "common/debug.h"
+#include "include/buffer.h"
+#include "include/intarith.h"
+#include "include/stringify.h"
+#include "crush/CrushWrapper.h"
+#include "osd/osd_types.h"
+#include "erasure-code/ErasureCodePlugin.h"
+#include "ErasureCodeClay.h"
+
+#define dout_subsys ceph_subsys_osd
+#undef dout_prefix
+#define dout_prefix _prefix(_dout)
+
+static ostream& _prefix(std::ostream* _dout)
+{
+  return *_dout << "ErasureCodeClay: ";
+}
+
+const string ErasureCodeClay::DEFAULT_K("4");
+const string ErasureCodeClay::DEFAULT_M("2");
+const string ErasureCodeClay::DEFAULT_RULESET_ROOT("default");
+const string ErasureCodeClay::DEFAULT_RULESET_FAILURE_DOMAIN("host");
+
+// GF(2^8) region helpers for the pairwise transform
+static void gf_mul_region(char *dst, const char *src, const uint8_t *table,
+			  unsigned len)
+{
+  uint8_t *d = (uint8_t*)dst;
+  const uint8_t *s = (const uint8_t*)src;
+  for (unsigned i = 0; i < len; ++i)
+    d[i] = table[s[i]];
+}
+
+static void gf_mul_xor_region(char *dst, const char *src,
+			      const uint8_t *table, unsigned len)
+{
+  uint8_t *d = (uint8_t*)dst;
+  const uint8_t *s = (const uint8_t*)src;
+  for (unsigned i = 0; i < len; ++i)
+    d[i] ^= table[s[i]];
+}
+
+static void xor_region(char *dst, const char *src, unsigned len)
+{
+  unsigned i = 0;
+  for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    uint64_t a, b;
+    memcpy(&a, dst + i, sizeof(a));
+    memcpy(&b, src + i, sizeof(b));
+    a ^= b;
+    memcpy(dst + i, &a, sizeof(a));
+  }
+  for (; i < len; ++i)
+    dst[i] ^= src[i];
+}
+
+void ErasureCodeClay::init_tables()
+{
+  // GF(2^8) with the polynomial used by jerasure and isa-l
+  uint8_t gf_exp[510];
+  int gf_log[256];
+  int x = 1;
+  for (int i = 0; i < 255; ++i) {
+    gf_exp[i] = x;
+    gf_log[x] = i;
+    x <<= 1;
+    if (x & 0x100)
+      x ^= 0x11d;
+  }
+  for (int i = 255; i < 510; ++i)
+    gf_exp[i] = gf_exp[i - 255];
+  gf_log[0] = 0;
+
+  // any gamma outside {0, 1} keeps the transform invertible
+  const int gamma = 2;
+  const int delta = 1 ^ gf_exp[2 * gf_log[gamma]];
+  const int gamma_inv = gf_exp[255 - gf_log[gamma]];
+  const int delta_inv = gf_exp[255 - gf_log[delta]];
+  for (int v = 0; v < 256; ++v) {
+    if (v == 0) {
+      mul_gamma[v] = mul_gamma_inv[v] = mul_delta[v] = mul_delta_inv[v] = 0;
+      continue;
+    }
+    mul_gamma[v] = gf_exp[gf_log[v] + gf_log[gamma]];
+    mul_gamma_inv[v] = gf_exp[gf_log[v] + gf_log[gamma_inv]];
+    mul_delta[v] = gf_exp[gf_log[v] + gf_log[delta]];
+    mul_delta_inv[v] = gf_exp[gf_log[v] + gf_log[delta_inv]];
+  }
+}
+
+int ErasureCodeClay::create_ruleset(const string &name,
+				    CrushWrapper &crush,
+				    ostream *ss) const
+{
+  int ruleid = crush.add_simple_ruleset(name, ruleset_root,
+					ruleset_failure_domain,
+					"indep", pg_pool_t::TYPE_ERASURE, ss);
+  if (ruleid < 0)
+    return ruleid;
+  crush.set_rule_mask_max_size(ruleid, get_chunk_count());
+  return crush.get_rule_mask_ruleset(ruleid);
+}
+
+int ErasureCodeClay::init(ErasureCodeProfile &profile, ostream *ss)
+{
+  int err = 0;
+  err |= to_string("ruleset-root", profile,
+		   &ruleset_root,
+		   DEFAULT_RULESET_ROOT, ss);
+  err |= to_string("ruleset-failure-domain", profile,
+		   &ruleset_failure_domain,
+		   DEFAULT_RULESET_FAILURE_DOMAIN, ss);
+  err |= parse(profile, ss);
+  if (err)
+    return err;
+  ErasureCodePluginRegistry &registry = ErasureCodePluginRegistry::instance();
+  err = registry.factory(mds_profile["plugin"],
+			 directory,
+			 mds_profile,
+			 &mds,
+			 ss);
+  if (err)
+    return err;
+  init_tables();
+  ErasureCode::init(profile, ss);
+  return 0;
+}
+
+int ErasureCodeClay::parse(ErasureCodeProfile &profile,
+			   ostream *ss)
+{
+  int err = ErasureCode::parse(profile, ss);
+  err |= to_int("k", profile, &k, DEFAULT_K, ss);
+  err |= to_int("m", profile, &m, DEFAULT_M, ss);
+  err |= sanity_check_k(k, ss);
+  if (err)
+    return err;
+  if (chunk_mapping.size() > 0) {
+    *ss << "mapping " << profile.find("mapping")->second
+	<< " is not supported by the clay plugin" << std::endl;
+    chunk_mapping.clear();
+    return -EINVAL;
+  }
+  if (m < 1) {
+    *ss << "m=" << m << " must be >= 1" << std::endl;
+    return -EINVAL;
+  }
+  err = to_int("d", profile, &d, stringify(k + m - 1), ss);
+  if (err)
+    return err;
+  if (d < k || d > k + m - 1) {
+    *ss << "d=" << d << " must be within [" << k << "," << k + m - 1
+	<< "]" << std::endl;
+    return -EINVAL;
+  }
+
+  q = d - k + 1;
+  nu = (k + m) % q ? q - (k + m) % q : 0;
+  t = (k + m + nu) / q;
+  int64_t planes = 1;
+  for (int y = 0; y < t; ++y) {
+    planes *= q;
+    if (planes > 65536) {
+      *ss << "k=" << k << " m=" << m << " d=" << d
+	  << " need more than 65536 sub-chunks per chunk" << std::endl;
+      return -EINVAL;
+    }
+  }
+  sub_chunk_no = planes;
+  plane_stride.resize(t);
+  for (int y = t - 1, s = 1; y >= 0; --y, s *= q)
+    plane_stride[y] = s;
+
+  string mds_plugin, technique;
+  to_string("scalar_mds", profile, &mds_plugin, "jerasure", ss);
+  to_string("technique", profile, &technique, "reed_sol_van", ss);
+  mds_profile.clear();
+  mds_profile["plugin"] = mds_plugin;
+  mds_profile["technique"] = technique;
+  mds_profile["k"] = stringify(k + nu);
+  mds_profile["m"] = stringify(m);
+  mds_profile["w"] = "8";
+  dout(10) << __func__ << " k=" << k << " m=" << m << " d=" << d
+	   << " q=" << q << " t=" << t << " nu=" << nu
+	   << " sub_chunk_no=" << sub_chunk_no
+	   << " scalar_mds=" << mds_profile << dendl;
+  return 0;
+}
+
+unsigned int ErasureCodeClay::get_chunk_size(unsigned int object_size) const
+{
+  // every sub-chunk must be a valid chunk of the scalar code
+  unsigned alignment = sub_chunk_no * k * mds->get_chunk_size(1);
+  return ROUND_UP_TO(object_size, alignment) / k;
+}
+
+int ErasureCodeClay::plane_digit(int z, int y) const
+{
+  return (z / plane_stride[y]) % q;
+}
+
+int ErasureCodeClay::plane_replace(int z, int y, int x) const
+{
+  return z + (x - plane_digit(z, y)) * plane_stride[y];
+}
+
+bool ErasureCodeClay::is_repair(const set<int> &want_to_read,
+				const set<int> &available) const
+{
+  if (q < 2 || want_to_read.size() != 1 ||
+      available.count(*want_to_read.begin()) ||
+      available.size() < (unsigned)d)
+    return false;
+  int lost = chunk_to_node(*want_to_read.begin());
+  int y0 = lost / q;
+  for (int x = 0; x < q; ++x) {
+    int node = y0 * q + x;
+    if (node == lost || is_virtual(node))
+      continue;
+    if (!available.count(node_to_chunk(node)))
+      return false;
+  }
+  return true;
+}
+
+void ErasureCodeClay::get_repair_subchunks(
+  int lost, vector<pair<int, int> > *ranges) const
+{
+  int node = chunk_to_node(lost);
+  int x0 = node % q;
+  int y0 = node / q;
+  int run = plane_stride[y0];
+  for (int z = x0 * run; z < sub_chunk_no; z += q * run)
+    ranges->push_back(make_pair(z, run));
+}
+
+int ErasureCodeClay::minimum_to_repair(const set<int> &want_to_read,
+				       const set<int> &available,
+				       set<int> *minimum) const
+{
+  int lost = chunk_to_node(*want_to_read.begin());
+  int y0 = lost / q;
+  for (int x = 0; x < q; ++x) {
+    int node = y0 * q + x;
+    if (node == lost || is_virtual(node))
+      continue;
+    if (!available.count(node_to_chunk(node)))
+      return -EIO;
+    minimum->insert(node_to_chunk(node));
+  }
+  for (set<int>::const_iterator i = available.begin();
+       i != available.end() && minimum->size() < (unsigned)d;
+       ++i)
+    minimum->insert(*i);
+  if (minimum->size() < (unsigned)d)
+    return -EIO;
+  return 0;
+}
+
+int ErasureCodeClay::minimum_to_decode_with_cost(
+  const set<int> &want_to_read,
+  const map<int, int> &available,
+  map<int, vector<pair<int, int> > > *minimum)
+{
+  set<int> available_chunks;
+  for (map<int, int>::const_iterator i = available.begin();
+       i != available.end();
+       ++i)
+    available_chunks.insert(i->first);
+  if (!is_repair(want_to_read, available_chunks))
+    return ErasureCode::minimum_to_decode_with_cost(want_to_read, available,
+						    minimum);
+
+  // the column of the lost chunk must help, then the cheapest others
+  vector<pair<int, int> > by_cost;
+  for (map<int, int>::const_iterator i = available.begin();
+       i != available.end();
+       ++i)
+    by_cost.push_back(make_pair(i->second, i->first));
+  sort(by_cost.begin(), by_cost.end());
+  int lost = chunk_to_node(*want_to_read.begin());
+  set<int> helpers;
+  for (vector<pair<int, int> >::iterator i = by_cost.begin();
+       i != by_cost.end();
+       ++i) {
+    if (chunk_to_node(i->second) / q == lost / q)
+      helpers.insert(i->second);
+  }
+  for (vector<pair<int, int> >::iterator i = by_cost.begin();
+       i != by_cost.end() && helpers.size() < (unsigned)d;
+       ++i)
+    helpers.insert(i->second);
+  set<int> chosen;
+  int r = minimum_to_repair(want_to_read, helpers, &chosen);
+  if (r < 0)
+    return r;
+
+  vector<pair<int, int> > ranges;
+  get_repair_subchunks(*want_to_read.begin(), &ranges);
+  for (set<int>::iterator i = chosen.begin(); i != chosen.end(); ++i)
+    (*minimum)[*i] = ranges;
+  return 0;
+}
+
+int ErasureCodeClay::encode_chunks(const set<int> &want_to_encode,
+				   map<int, bufferlist> *encoded)
+{
+  unsigned chunk_size = (*encoded)[0].length();
+  bufferptr zero(buffer::create_aligned(chunk_size, SIMD_ALIGN));
+  zero.zero();
+  vector<char*> C(k + m + nu, zero.c_str());
+  set<int> erased;
+  for (int i = 0; i < k + m; ++i) {
+    C[chunk_to_node(i)] = (*encoded)[i].c_str();
+    if (i >= k)
+      erased.insert(chunk_to_node(i));
+  }
+  return decode_layered(erased, C, chunk_size);
+}
+
+int ErasureCodeClay::decode(const set<int> &want_to_read,
+			    const map<int, bufferlist> &chunks,
+			    map<int, bufferlist> *decoded,
+			    int chunk_size)
+{
+  set<int> available;
+  for (map<int, bufferlist>::const_iterator i = chunks.begin();
+       i != chunks.end();
+       ++i)
+    available.insert(i->first);
+  if (is_repair(want_to_read, available) &&
+      (unsigned)chunk_size > chunks.begin()->second.length())
+    return repair(*want_to_read.begin(), chunks, decoded, chunk_size);
+  return ErasureCode::decode(want_to_read, chunks, decoded);
+}
+
+int ErasureCodeClay::decode_chunks(const set<int> &want_to_read,
+				   const map<int, bufferlist> &chunks,
+				   map<int, bufferlist> *decoded)
+{
+  unsigned chunk_size = decoded->begin()->second.length();
+  bufferptr zero(buffer::create_aligned(chunk_size, SIMD_ALIGN));
+  zero.zero();
+  vector<char*> C(k + m + nu, zero.c_str());
+  set<int> erased;
+  for (int i = 0; i < k + m; ++i) {
+    C[chunk_to_node(i)] = (*decoded)[i].c_str();
+    if (!chunks.count(i))
+      erased.insert(chunk_to_node(i));
+  }
+  if (erased.size() > (unsigned)m)
+    return -EIO;
+  return decode_layered(erased, C, chunk_size);
+}
+
+int ErasureCodeClay::decode_uncoupled(const set<int> &erased, int z,
+				      vector<char*> &U, unsigned sub_size)
+{
+  map<int, bufferlist> known, all;
+  bool parity_only = true;
+  for (int i = 0; i < k + m + nu; ++i) {
+    bufferlist bl;
+    bl.append(buffer::create_static(sub_size, U[i] + z * sub_size));
+    if (erased.count(i))
+      parity_only = parity_only && i >= k + nu;
+    else
+      known[i] = bl;
+    all[i].claim(bl);
+  }
+  if (parity_only && erased.size() == (unsigned)m)
+    return mds->encode_chunks(erased, &all);
+  return mds->decode_chunks(erased, known, &all);
+}
+
+int ErasureCodeClay::decode_layered(const set<int> &erased,
+				    vector<char*> &C,
+				    unsigned chunk_size)
+{
+  assert(chunk_size % sub_chunk_no == 0);
+  const unsigned sub_size = chunk_size / sub_chunk_no;
+  const int nodes = k + m + nu;
+  bufferptr ubuf(buffer::create_aligned(nodes * chunk_size, SIMD_ALIGN));
+  vector<char*> U(nodes);
+  for (int i = 0; i < nodes; ++i)
+    U[i] = ubuf.c_str() + i * chunk_size;
+
+  // planes by the number of erased nodes on their diagonal
+  vector<vector<int> > by_score(t + 1);
+  for (int z = 0; z < sub_chunk_no; ++z) {
+    int score = 0;
+    for (int y = 0; y < t; ++y)
+      score += erased.count(y * q + plane_digit(z, y));
+    by_score[score].push_back(z);
+  }
+
+  for (int s = 0; s <= t; ++s) {
+    for (vector<int>::iterator p = by_score[s].begin();
+	 p != by_score[s].end();
+	 ++p) {
+      int z = *p;
+      for (int node = 0; node < nodes; ++node) {
+	if (erased.count(node))
+	  continue;
+	int x = node % q, y = node / q, zy = plane_digit(z, y);
+	char *u = U[node] + z * sub_size;
+	char *c = C[node] + z * sub_size;
+	if (zy == x) {
+	  memcpy(u, c, sub_size);
+	  continue;
+	}
+	int companion = y * q + zy;
+	int zc = plane_replace(z, y, x);
+	if (erased.count(companion)) {
+	  // its plane has one less erasure on the diagonal: done already
+	  memcpy(u, c, sub_size);
+	  gf_mul_xor_region(u, U[companion] + zc * sub_size, mul_gamma,
+			    sub_size);
+	} else {
+	  gf_mul_region(u, C[companion] + zc * sub_size, mul_gamma, sub_size);
+	  xor_region(u, c, sub_size);
+	  gf_mul_region(u, u, mul_delta_inv, sub_size);
+	}
+      }
+      int r = decode_uncoupled(erased, z, U, sub_size);
+      if (r < 0)
+	return r;
+    }
+    // erased companions pair up within the same score
+    for (vector<int>::iterator p = by_score[s].begin();
+	 p != by_score[s].end();
+	 ++p) {
+      int z = *p;
+      for (set<int>::const_iterator i = erased.begin();
+	   i != erased.end();
+	   ++i) {
+	int node = *i;
+	int x = node % q, y = node / q, zy = plane_digit(z, y);
+	char *u = U[node] + z * sub_size;
+	char *c = C[node] + z * sub_size;
+	if (zy == x) {
+	  memcpy(c, u, sub_size);
+	  continue;
+	}
+	int companion = y * q + zy;
+	int zc = plane_replace(z, y, x);
+	if (erased.count(companion)) {
+	  memcpy(c, u, sub_size);
+	  gf_mul_xor_region(c, U[companion] + zc * sub_size, mul_gamma,
+			    sub_size);
+	} else {
+	  gf_mul_region(c, u, mul_delta, sub_size);
+	  gf_mul_xor_region(c, C[companion] + zc * sub_size, mul_gamma,
+			    sub_size);
+	}
+      }
+    }
+  }
+  return 0;
+}
+
+int ErasureCodeClay::repair(int lost,
+			    const map<int, bufferlist> &chunks,
+			    map<int, bufferlist> *decoded,
+			    int chunk_size)
+{
+  assert(chunk_size % sub_chunk_no == 0);
+  const unsigned sub_size = chunk_size / sub_chunk_no;
+  const int nodes = k + m + nu;
+  const int lost_node = chunk_to_node(lost);
+  const int x0 = lost_node % q;
+  const int y0 = lost_node / q;
+  const unsigned repair_size = sub_size * (sub_chunk_no / q);
+
+  // index of each repair plane within what the helpers sent
+  vector<int> plane_index(sub_chunk_no, -1);
+  vector<int> planes;
+  vector<pair<int, int> > ranges;
+  get_repair_subchunks(lost, &ranges);
+  for (vector<pair<int, int> >::iterator i = ranges.begin();
+       i != ranges.end();
+       ++i) {
+    for (int z = i->first; z < i->first + i->second; ++z) {
+      plane_index[z] = planes.size();
+      planes.push_back(z);
+    }
+  }
+
+  bufferptr zero(buffer::create_aligned(sub_size, SIMD_ALIGN));
+  zero.zero();
+  map<int, bufferlist> helpers;
+  vector<const char*> H(nodes, (const char*)NULL);
+  set<int> erased, aloof;
+  for (int node = 0; node < nodes; ++node) {
+    if (is_virtual(node)) {
+      continue;
+    } else if (node == lost_node) {
+      erased.insert(node);
+      continue;
+    }
+    map<int, bufferlist>::const_iterator c = chunks.find(node_to_chunk(node));
+    if (c == chunks.end()) {
+      aloof.insert(node);
+      erased.insert(node);
+      continue;
+    }
+    if (c->second.length() != repair_size) {
+      dout(0) << __func__ << " chunk " << c->first << " is "
+	      << c->second.length() << " bytes, expected " << repair_size
+	      << dendl;
+      return -EINVAL;
+    }
+    bufferlist &bl = helpers[node];
+    bl = c->second;
+    H[node] = bl.c_str();
+  }
+  // the whole column of the lost node is unknown in the uncoupled code
+  for (int x = 0; x < q; ++x)
+    erased.insert(y0 * q + x);
+  if (erased.size() > (unsigned)m)
+    return -EIO;
+
+  bufferptr ubuf(buffer::create_aligned(nodes * repair_size, SIMD_ALIGN));
+  vector<char*> U(nodes);
+  for (int i = 0; i < nodes; ++i)
+    U[i] = ubuf.c_str() + i * repair_size;
+  bufferptr out(buffer::create_aligned(chunk_size, SIMD_ALIGN));
+  bufferptr tmp(buffer::create_aligned(sub_size, SIMD_ALIGN));
+
+#define CLAY_C(node, z) (is_virtual(node) ? zero.c_str() :		\
+			 H[node] + plane_index[z] * sub_size)
+#define CLAY_U(node, z) (U[node] + plane_index[z] * sub_size)
+
+  // repair planes by the number of aloof nodes on their diagonal
+  vector<vector<int> > by_score(t + 1);
+  for (vector<int>::iterator p = planes.begin(); p != planes.end(); ++p) {
+    int score = 0;
+    for (int y = 0; y < t; ++y)
+      score += aloof.count(y * q + plane_digit(*p, y));
+    by_score[score].push_back(*p);
+  }
+
+  for (int s = 0; s <= t; ++s) {
+    for (vector<int>::iterator p = by_score[s].begin();
+	 p != by_score[s].end();
+	 ++p) {
+      int z = *p;
+      for (int node = 0; node < nodes; ++node) {
+	if (erased.count(node))
+	  continue;
+	int x = node % q, y = node / q, zy = plane_digit(z, y);
+	char *u = CLAY_U(node, z);
+	if (zy == x) {
+	  memcpy(u, CLAY_C(node, z), sub_size);
+	  continue;
+	}
+	int companion = y * q + zy;
+	int zc = plane_replace(z, y, x);
+	if (aloof.count(companion)) {
+	  memcpy(u, CLAY_C(node, z), sub_size);
+	  gf_mul_xor_region(u, CLAY_U(companion, zc), mul_gamma, sub_size);
+	} else {
+	  gf_mul_region(u, CLAY_C(companion, zc), mul_gamma, sub_size);
+	  xor_region(u, CLAY_C(node, z), sub_size);
+	  gf_mul_region(u, u, mul_delta_inv, sub_size);
+	}
+      }
+      vector<char*> plane(nodes);
+      for (int i = 0; i < nodes; ++i)
+	plane[i] = CLAY_U(i, z);
+      int r = decode_uncoupled(erased, 0, plane, sub_size);
+      if (r < 0)
+	return r;
+
+      // the lost sub-chunk of this plane is on the diagonal
+      memcpy(out.c_str() + z * sub_size, CLAY_U(lost_node, z), sub_size);
+      // and each column mate gives the lost sub-chunk of another plane
+      for (int x = 0; x < q; ++x) {
+	if (x == x0)
+	  continue;
+	int mate = y0 * q + x;
+	int zc = plane_replace(z, y0, x);
+	char *c = out.c_str() + zc * sub_size;
+	memcpy(tmp.c_str(), CLAY_U(mate, z), sub_size);
+	xor_region(tmp.c_str(), CLAY_C(mate, z), sub_size);
+	gf_mul_region(tmp.c_str(), tmp.c_str(), mul_gamma_inv, sub_size);
+	gf_mul_region(c, CLAY_U(mate, z), mul_gamma, sub_size);
+	xor_region(c, tmp.c_str(), sub_size);
+      }
+    }
+  }
+#undef CLAY_C
+#undef CLAY_U
+
+  (*decoded)[lost].push_back(out);
+  return 0;
+}
@@ -0,0 +1,158 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_ERASURE_CODE_CLAY_H
+#define CEPH_ERASURE_CODE_CLAY_H
+
+#include "include/err.h"
+#include "include/buffer_fwd.h"
+#include "erasure-code/ErasureCode.h"
+
+/**
+ * Coupled-layer (Clay) minimum storage regenerating code
+ * (Vajha et al., FAST '18).
+ *
+ * The n = k + m chunks, plus nu virtual all-zero chunks that make
+ * n + nu a multiple of q = d - k + 1, are arranged in a q x t grid,
+ * t = (n + nu) / q, chunk (x, y) sitting in column y.  Every chunk is
+ * split in q^t sub-chunks, one per plane z = (z_0, ..., z_t-1), z_y in
+ * [0, q).
+ *
+ * The sub-chunks of an uncoupled code U form, plane by plane, the
+ * codewords of a [n + nu, k + nu] scalar MDS code (the **scalar_mds**
+ * plugin).  The stored sub-chunk C(x, y, z) is U(x, y, z) when
+ * z_y == x and otherwise the pairwise transform
+ *
+ *   C(x, y, z)   = U(x, y, z) + gamma U(z_y, y, z')
+ *   C(z_y, y, z') = gamma U(x, y, z) + U(z_y, y, z')
+ *
+ * of it with its companion, z' being z with z_y replaced by x.
+ * Decoding visits the planes by increasing number of erased chunks
+ * on their diagonal, so that companions of known chunks are always
+ * known by the time they are needed.
+ *
+ * A single lost chunk (x0, y0) is rebuilt from d helpers, which must
+ * include the q - 1 other chunks of column y0, by reading only the
+ * q^(t-1) planes with z_y0 == x0 from each of them: the repair
+ * bandwidth is d / (q (d - k + 1)) chunks instead of k.
+ */
+class ErasureCodeClay : public ErasureCode {
+public:
+  static const string DEFAULT_K;
+  static const string DEFAULT_M;
+  static const string DEFAULT_RULESET_ROOT;
+  static const string DEFAULT_RULESET_FAILURE_DOMAIN;
+
+  string directory;
+  int k, m, d;
+  int q, t, nu;
+  int sub_chunk_no;  ///< q^t
+  string ruleset_root;
+  string ruleset_failure_domain;
+  ErasureCodeProfile mds_profile;
+  ErasureCodeInterfaceRef mds;
+
+  explicit ErasureCodeClay(const std::string &dir)
+    : directory(dir),
+      k(0), m(0), d(0), q(0), t(0), nu(0), sub_chunk_no(0),
+      ruleset_root(DEFAULT_RULESET_ROOT),
+      ruleset_failure_domain(DEFAULT_RULESET_FAILURE_DOMAIN) {}
+
+  virtual ~ErasureCodeClay() {}
+
+  virtual int create_ruleset(const string &name,
+			     CrushWrapper &crush,
+			     ostream *ss) const;
+
+  virtual unsigned int get_chunk_count() const {
+    return k + m;
+  }
+
+  virtual unsigned int get_data_chunk_count() const {
+    return k;
+  }
+
+  virtual int get_sub_chunk_count() {
+    return sub_chunk_no;
+  }
+
+  virtual unsigned int get_chunk_size(unsigned int object_size) const;
+
+  using ErasureCode::minimum_to_decode_with_cost;
+  virtual int minimum_to_decode_with_cost(
+    const set<int> &want_to_read,
+    const map<int, int> &available,
+    map<int, vector<pair<int, int> > > *minimum);
+
+  virtual int encode_chunks(const set<int> &want_to_encode,
+			    map<int, bufferlist> *encoded);
+
+  using ErasureCode::decode;
+  virtual int decode(const set<int> &want_to_read,
+		     const map<int, bufferlist> &chunks,
+		     map<int, bufferlist> *decoded,
+		     int chunk_size);
+
+  virtual int decode_chunks(const set<int> &want_to_read,
+			    const map<int, bufferlist> &chunks,
+			    map<int, bufferlist> *decoded);
+
+  virtual int init(ErasureCodeProfile &profile, ostream *ss);
+
+  virtual int parse(ErasureCodeProfile &profile, ostream *ss);
+
+  /// true if want_to_read is a single chunk that can be repaired
+  /// from a fraction of the available ones
+  bool is_repair(const set<int> &want_to_read,
+		 const set<int> &available) const;
+  /// (first, count) ranges of the planes helpers send to repair lost
+  void get_repair_subchunks(int lost,
+			    vector<pair<int, int> > *ranges) const;
+
+private:
+  vector<int> plane_stride;    ///< q^(t-1-y), the weight of digit y
+  uint8_t mul_gamma[256];      ///< x -> gamma x
+  uint8_t mul_gamma_inv[256];  ///< x -> x / gamma
+  uint8_t mul_delta[256];      ///< x -> (1 + gamma^2) x
+  uint8_t mul_delta_inv[256];  ///< x -> x / (1 + gamma^2)
+
+  void init_tables();
+
+  int chunk_to_node(int chunk) const {
+    return chunk < k ? chunk : chunk + nu;
+  }
+  int node_to_chunk(int node) const {
+    return node < k ? node : (node < k + nu ? -1 : node - nu);
+  }
+  bool is_virtual(int node) const {
+    return node >= k && node < k + nu;
+  }
+  /// digit y of plane z
+  int plane_digit(int z, int y) const;
+  /// plane z with digit y replaced by x
+  int plane_replace(int z, int y, int x) const;
+
+  int minimum_to_repair(const set<int> &want_to_read,
+			const set<int> &available,
+			set<int> *minimum) const;
+
+  /// uncoupled sub-chunks of the erased nodes of plane z
+  int decode_uncoupled(const set<int> &erased, int z,
+		       vector<char*> &U, unsigned sub_size);
+  /// rebuild the erased nodes of C, all of them chunk_size long
+  int decode_layered(const set<int> &erased, vector<char*> &C,
+		     unsigned chunk_size);
+  int repair(int lost, const map<int, bufferlist> &chunks,
+	     map<int, bufferlist> *decoded, int chunk_size);
+};
+
+#endif
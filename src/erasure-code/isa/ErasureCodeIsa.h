@@ -110,6 +110,12 @@ public:
 
   virtual void prepare() = 0;
 
+ protected:
+  virtual bool can_batch_stripes() const
+  {
+    return true;
+  }
+
  private:
   virtual int parse(ErasureCodeProfile &profile,
                     ostream *ss) = 0;
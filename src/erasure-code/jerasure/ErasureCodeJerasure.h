@@ -86,6 +86,9 @@ public:
   static bool is_prime(int value);
 protected:
   virtual int parse(ErasureCodeProfile &profile, ostream *ss);
+  virtual bool can_batch_stripes() const {
+    return true;
+  }
 };
 
 class ErasureCodeJerasureReedSolomonVandermonde : public ErasureCodeJerasure {
@@ -121,6 +121,11 @@ public:
                                  char **data_ptrs, char **coding_ptrs, int size);
   virtual int* shec_reedsolomon_coding_matrix(int is_single);
 
+protected:
+  virtual bool can_batch_stripes() const {
+    return true;
+  }
+
 private:
   virtual int parse(const ErasureCodeProfile &profile) = 0;
 
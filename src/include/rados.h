@@ -473,6 +473,8 @@ enum {
 	CEPH_OSD_ALLOC_HINT_FLAG_IMMUTABLE = 32,
 	CEPH_OSD_ALLOC_HINT_FLAG_SHORTLIVED = 64,
 	CEPH_OSD_ALLOC_HINT_FLAG_LONGLIVED = 128,
+	CEPH_OSD_ALLOC_HINT_FLAG_COMPRESSIBLE = 256,
+	CEPH_OSD_ALLOC_HINT_FLAG_INCOMPRESSIBLE = 512,
 };
 
 const char *ceph_osd_alloc_hint_flag_name(int f);
@@ -142,6 +142,8 @@ enum {
   LIBRADOS_ALLOC_HINT_FLAG_IMMUTABLE = 32,
   LIBRADOS_ALLOC_HINT_FLAG_SHORTLIVED = 64,
   LIBRADOS_ALLOC_HINT_FLAG_LONGLIVED = 128,
+  LIBRADOS_ALLOC_HINT_FLAG_COMPRESSIBLE = 256,
+  LIBRADOS_ALLOC_HINT_FLAG_INCOMPRESSIBLE = 512,
 };
 /** @} */
 
@@ -292,6 +292,8 @@ namespace librados
     ALLOC_HINT_FLAG_IMMUTABLE = 32,
     ALLOC_HINT_FLAG_SHORTLIVED = 64,
     ALLOC_HINT_FLAG_LONGLIVED = 128,
+    ALLOC_HINT_FLAG_COMPRESSIBLE = 256,
+    ALLOC_HINT_FLAG_INCOMPRESSIBLE = 512,
   };
 
   /*
@@ -1013,6 +1015,37 @@ namespace librados
 		    ObjectReadOperation *op, int flags,
 		    bufferlist *pbl);
 
+    /**
+     * Schedule many async write operations at once
+     *
+     * Same as calling aio_operate(oids[i], cs[i], ops[i], flags) for
+     * every i, in order, but with the client's map lock taken once for
+     * the whole batch.  Operations bound for the same OSD are sent
+     * together, up to objecter_op_batch_max_ops per message, to OSDs
+     * that support it.  Each completion still fires on its own.
+     *
+     * @param oids the objects to operate on
+     * @param cs what to do when each operation is complete and safe
+     * @param ops which operations to perform on each object
+     * @param flags flags to apply to all of the operations
+     * @returns 0 on success, negative error code on failure
+     */
+    int aio_operate_batch(const std::vector<std::string>& oids,
+			  const std::vector<AioCompletion*>& cs,
+			  const std::vector<ObjectWriteOperation*>& ops,
+			  int flags);
+    /**
+     * Schedule many async read operations at once
+     *
+     * Like the write version; the result of ops[i] is stored in
+     * pbls[i].
+     */
+    int aio_operate_batch(const std::vector<std::string>& oids,
+			  const std::vector<AioCompletion*>& cs,
+			  const std::vector<ObjectReadOperation*>& ops,
+			  int flags,
+			  const std::vector<bufferlist*>& pbls);
+
     // watch/notify
     int watch2(const std::string& o, uint64_t *handle,
 	       librados::WatchCtx2 *ctx);
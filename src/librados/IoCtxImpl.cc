@@ -788,6 +788,62 @@ int librados::IoCtxImpl::aio_operate(const object_t& oid,
   return 0;
 }
 
+int librados::IoCtxImpl::aio_operate_read_batch(
+  const vector<object_t>& oids,
+  const vector< ::ObjectOperation*>& o,
+  const vector<AioCompletionImpl*>& c,
+  int flags, const vector<bufferlist*>& pbls)
+{
+  vector<Objecter::Op*> ops;
+  vector<ceph_tid_t*> tids;
+  ops.reserve(oids.size());
+  tids.reserve(oids.size());
+  for (size_t i = 0; i < oids.size(); ++i) {
+    Context *onack = new C_aio_Ack(c[i]);
+
+    c[i]->is_read = true;
+    c[i]->io = this;
+
+    ops.push_back(objecter->prepare_read_op(oids[i], oloc,
+		    *o[i], snap_seq, pbls[i], flags,
+		    onack, &c[i]->objver));
+    tids.push_back(&c[i]->tid);
+  }
+  objecter->op_submit_batch(ops, tids);
+  return 0;
+}
+
+int librados::IoCtxImpl::aio_operate_batch(
+  const vector<object_t>& oids,
+  const vector< ::ObjectOperation*>& o,
+  const vector<AioCompletionImpl*>& c,
+  const SnapContext& snap_context, int flags)
+{
+  auto ut = ceph::real_clock::now(client->cct);
+  /* can't write to a snapshot */
+  if (snap_seq != CEPH_NOSNAP)
+    return -EROFS;
+
+  vector<Objecter::Op*> ops;
+  vector<ceph_tid_t*> tids;
+  ops.reserve(oids.size());
+  tids.reserve(oids.size());
+  for (size_t i = 0; i < oids.size(); ++i) {
+    Context *onack = new C_aio_Ack(c[i]);
+    Context *oncommit = new C_aio_Safe(c[i]);
+
+    c[i]->io = this;
+    queue_aio_write(c[i]);
+
+    ops.push_back(objecter->prepare_mutate_op(
+      oids[i], oloc, *o[i], snap_context, ut, flags, onack,
+      oncommit, &c[i]->objver));
+    tids.push_back(&c[i]->tid);
+  }
+  objecter->op_submit_batch(ops, tids);
+  return 0;
+}
+
 int librados::IoCtxImpl::aio_read(const object_t oid, AioCompletionImpl *c,
 				  bufferlist *pbl, size_t len, uint64_t off,
 				  uint64_t snapid)
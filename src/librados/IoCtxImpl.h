@@ -161,6 +161,14 @@ struct librados::IoCtxImpl {
 		  int flags);
   int aio_operate_read(const object_t& oid, ::ObjectOperation *o,
 		       AioCompletionImpl *c, int flags, bufferlist *pbl);
+  int aio_operate_batch(const vector<object_t>& oids,
+			const vector< ::ObjectOperation*>& o,
+			const vector<AioCompletionImpl*>& c,
+			const SnapContext& snap_context, int flags);
+  int aio_operate_read_batch(const vector<object_t>& oids,
+			     const vector< ::ObjectOperation*>& o,
+			     const vector<AioCompletionImpl*>& c,
+			     int flags, const vector<bufferlist*>& pbls);
 
   struct C_aio_Ack : public Context {
     librados::AioCompletionImpl *c;
@@ -1514,6 +1514,48 @@ int librados::IoCtx::aio_operate(const std::string& oid, AioCompletion *c,
 				       translate_flags(flags), pbl);
 }
 
+int librados::IoCtx::aio_operate_batch(const std::vector<std::string>& oids,
+				       const std::vector<AioCompletion*>& cs,
+				       const std::vector<ObjectWriteOperation*>& ops,
+				       int flags)
+{
+  if (cs.size() != oids.size() || ops.size() != oids.size())
+    return -EINVAL;
+  vector<object_t> objs(oids.begin(), oids.end());
+  vector< ::ObjectOperation*> o;
+  vector<AioCompletionImpl*> c;
+  o.reserve(ops.size());
+  c.reserve(cs.size());
+  for (size_t i = 0; i < oids.size(); ++i) {
+    o.push_back(&ops[i]->impl->o);
+    c.push_back(cs[i]->pc);
+  }
+  return io_ctx_impl->aio_operate_batch(objs, o, c, io_ctx_impl->snapc,
+					translate_flags(flags));
+}
+
+int librados::IoCtx::aio_operate_batch(const std::vector<std::string>& oids,
+				       const std::vector<AioCompletion*>& cs,
+				       const std::vector<ObjectReadOperation*>& ops,
+				       int flags,
+				       const std::vector<bufferlist*>& pbls)
+{
+  if (cs.size() != oids.size() || ops.size() != oids.size() ||
+      pbls.size() != oids.size())
+    return -EINVAL;
+  vector<object_t> objs(oids.begin(), oids.end());
+  vector< ::ObjectOperation*> o;
+  vector<AioCompletionImpl*> c;
+  o.reserve(ops.size());
+  c.reserve(cs.size());
+  for (size_t i = 0; i < oids.size(); ++i) {
+    o.push_back(&ops[i]->impl->o);
+    c.push_back(cs[i]->pc);
+  }
+  return io_ctx_impl->aio_operate_read_batch(objs, o, c,
+					     translate_flags(flags), pbls);
+}
+
 
 void librados::IoCtx::snap_set_read(snap_t seq)
 {
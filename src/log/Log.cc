@@ -30,6 +30,9 @@
 #define DEFAULT_MAX_NEW    100
 #define DEFAULT_MAX_RECENT 10000
 
+// formatted lines are batched up to this size before hitting the fd
+#define WRITE_BUF_SIZE     (64 * 1024)
+
 #define PREALLOC 1000000
 
 
@@ -51,7 +54,9 @@ Log::Log(SubsystemMap *s)
     m_subs(s),
     m_queue_mutex_holder(0),
     m_flush_mutex_holder(0),
-    m_new(), m_recent(),
+    m_new_head(NULL),
+    m_new_len(0),
+    m_recent(),
     m_fd(-1),
     m_uid(0),
     m_gid(0),
@@ -91,6 +96,11 @@ Log::~Log()
   }
 
   assert(!is_started());
+
+  // drop anything submitted after the last flush
+  EntryQueue t;
+  _take_new(&t);
+
   if (m_fd >= 0)
     VOID_TEMP_FAILURE_RETRY(::close(m_fd));
 
@@ -213,20 +223,58 @@ void Log::stop_graylog()
 
 void Log::submit_entry(Entry *e)
 {
-  pthread_mutex_lock(&m_queue_mutex);
-  m_queue_mutex_holder = pthread_self();
-
   if (m_inject_segv)
     *(volatile int *)(0) = 0xdead;
 
-  // wait for flush to catch up
-  while (m_new.m_len > m_max_new)
-    pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
+  // wait for flush to catch up; only the slow path takes the lock
+  if (m_new_len.load(std::memory_order_relaxed) > m_max_new) {
+    pthread_mutex_lock(&m_queue_mutex);
+    m_queue_mutex_holder = pthread_self();
+    while (m_new_len.load() > m_max_new)
+      pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
+    m_queue_mutex_holder = 0;
+    pthread_mutex_unlock(&m_queue_mutex);
+  }
+
+  m_new_len++;
+  Entry *head = m_new_head.load(std::memory_order_relaxed);
+  do {
+    e->m_next = head;
+  } while (!m_new_head.compare_exchange_weak(head, e,
+					      std::memory_order_release,
+					      std::memory_order_relaxed));
+
+  // the flusher only sleeps once it found the list empty, so only
+  // whoever makes it non-empty again needs to wake it up.  Signalling
+  // under the lock pairs with the check the flusher does under it.
+  if (!head) {
+    pthread_mutex_lock(&m_queue_mutex);
+    pthread_cond_signal(&m_cond_flusher);
+    pthread_mutex_unlock(&m_queue_mutex);
+  }
+}
 
-  m_new.enqueue(e);
-  pthread_cond_signal(&m_cond_flusher);
-  m_queue_mutex_holder = 0;
-  pthread_mutex_unlock(&m_queue_mutex);
+void Log::_take_new(EntryQueue *q)
+{
+  Entry *e = m_new_head.exchange(NULL, std::memory_order_acquire);
+
+  // entries were pushed newest first
+  Entry *prev = NULL;
+  int n = 0;
+  while (e) {
+    Entry *next = e->m_next;
+    e->m_next = prev;
+    prev = e;
+    e = next;
+    ++n;
+  }
+  while (prev) {
+    Entry *next = prev->m_next;
+    prev->m_next = NULL;
+    q->enqueue(prev);
+    prev = next;
+  }
+  m_new_len -= n;
 }
 
 
@@ -272,10 +320,10 @@ void Log::flush()
 {
   pthread_mutex_lock(&m_flush_mutex);
   m_flush_mutex_holder = pthread_self();
+  EntryQueue t;
+  _take_new(&t);
   pthread_mutex_lock(&m_queue_mutex);
   m_queue_mutex_holder = pthread_self();
-  EntryQueue t;
-  t.swap(m_new);
   pthread_cond_broadcast(&m_cond_loggers);
   m_queue_mutex_holder = 0;
   pthread_mutex_unlock(&m_queue_mutex);
@@ -339,14 +387,9 @@ void Log::_flush(EntryQueue *t, EntryQueue *requeue, bool crash)
       }
       if (do_fd) {
         buf[buflen] = '\n';
-        int r = safe_write(m_fd, buf, buflen+1);
-	if (r != m_fd_last_error) {
-	  if (r < 0)
-	    cerr << "problem writing to " << m_log_file
-		 << ": " << cpp_strerror(r)
-		 << std::endl;
-	  m_fd_last_error = r;
-	}
+	if (m_write_buf.size() + buflen + 1 > WRITE_BUF_SIZE)
+	  _write_buf_flush();
+	m_write_buf.append(buf, buflen + 1);
       }
       if (need_dynamic)
         delete[] buf;
@@ -357,6 +400,27 @@ void Log::_flush(EntryQueue *t, EntryQueue *requeue, bool crash)
 
     requeue->enqueue(e);
   }
+  _write_buf_flush();
+}
+
+void Log::_write_buf_flush()
+{
+  if (m_write_buf.empty())
+    return;
+  if (m_fd >= 0) {
+    int r = safe_write(m_fd, m_write_buf.data(), m_write_buf.size());
+    if (r != m_fd_last_error) {
+      if (r < 0)
+	cerr << "problem writing to " << m_log_file
+	     << ": " << cpp_strerror(r)
+	     << std::endl;
+      m_fd_last_error = r;
+    }
+  }
+  if (m_write_buf.capacity() > 2 * WRITE_BUF_SIZE)
+    std::string().swap(m_write_buf);  // don't hang on to a huge entry
+  else
+    m_write_buf.clear();
 }
 
 void Log::_log_message(const char *s, bool crash)
@@ -382,14 +446,8 @@ void Log::dump_recent()
   pthread_mutex_lock(&m_flush_mutex);
   m_flush_mutex_holder = pthread_self();
 
-  pthread_mutex_lock(&m_queue_mutex);
-  m_queue_mutex_holder = pthread_self();
-
   EntryQueue t;
-  t.swap(m_new);
-
-  m_queue_mutex_holder = 0;
-  pthread_mutex_unlock(&m_queue_mutex);
+  _take_new(&t);
   _flush(&t, &m_recent, false);
 
   EntryQueue old;
@@ -447,7 +505,7 @@ void *Log::entry()
   pthread_mutex_lock(&m_queue_mutex);
   m_queue_mutex_holder = pthread_self();
   while (!m_stop) {
-    if (!m_new.empty()) {
+    if (m_new_head.load(std::memory_order_relaxed)) {
       m_queue_mutex_holder = 0;
       pthread_mutex_unlock(&m_queue_mutex);
       flush();
@@ -8,6 +8,8 @@
 
 #include <pthread.h>
 
+#include <atomic>
+
 #include "EntryQueue.h"
 
 namespace ceph {
@@ -31,7 +33,10 @@ class Log : private Thread
   pthread_t m_queue_mutex_holder;
   pthread_t m_flush_mutex_holder;
 
-  EntryQueue m_new;    ///< new entries
+  /// new entries, newest first, linked through Entry::m_next.  Loggers
+  /// push with a CAS; the flusher takes the whole list with an exchange.
+  std::atomic<Entry*> m_new_head;
+  std::atomic<int> m_new_len;  ///< entries pushed but not yet taken
   EntryQueue m_recent; ///< recent (less new) entries we've already written at low detail
 
   std::string m_log_file;
@@ -41,6 +46,8 @@ class Log : private Thread
 
   int m_fd_last_error;  ///< last error we say writing to fd (if any)
 
+  std::string m_write_buf;  ///< formatted lines not yet written to m_fd
+
   int m_syslog_log, m_syslog_crash;
   int m_stderr_log, m_stderr_crash;
   int m_graylog_log, m_graylog_crash;
@@ -55,7 +62,11 @@ class Log : private Thread
 
   void *entry();
 
+  /// move the new entries to q, oldest first
+  void _take_new(EntryQueue *q);
+
   void _flush(EntryQueue *q, EntryQueue *requeue, bool crash);
+  void _write_buf_flush();
 
   void _log_message(const char *s, bool crash);
 
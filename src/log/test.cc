@@ -1,5 +1,10 @@
 #include <gtest/gtest.h>
 
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
 #include "log/Log.h"
 #include "common/Clock.h"
 #include "common/PrebufferedStreambuf.h"
@@ -190,6 +195,55 @@ TEST(Log, ManyGather)
   log.stop();
 }
 
+TEST(Log, ManyGatherMultiThread)
+{
+  SubsystemMap subs;
+  subs.add(1, "foo", 20, 1);
+  Log log(&subs);
+  log.start();
+  unlink("/tmp/big_mt");
+  log.set_log_file("/tmp/big_mt");
+  log.reopen_log_file();
+  log.set_stderr_level(-1, -1);
+
+  const int nthreads = 8;
+  utime_t start = ceph_clock_now(NULL);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nthreads; t++) {
+    threads.push_back(std::thread([&log, t]() {
+	  for (int i = 0; i < many; i++) {
+	    Entry *e = new Entry(ceph_clock_now(NULL), pthread_self(), 1, 1);
+	    std::ostringstream ss;
+	    ss << "writer " << t << " seq " << i;
+	    e->set_str(ss.str());
+	    log.submit_entry(e);
+	  }
+	}));
+  }
+  for (auto& th : threads)
+    th.join();
+  utime_t submitted = ceph_clock_now(NULL);
+  log.flush();
+  log.stop();
+  std::cout << nthreads << " threads submitted " << nthreads * many
+	    << " entries in " << (submitted - start) << std::endl;
+
+  // every entry is there, in submission order for each thread
+  std::vector<int> next(nthreads, 0);
+  std::ifstream in("/tmp/big_mt");
+  std::string line;
+  while (std::getline(in, line)) {
+    int t, i;
+    size_t p = line.find("writer ");
+    ASSERT_NE(std::string::npos, p);
+    ASSERT_EQ(2, sscanf(line.c_str() + p, "writer %d seq %d", &t, &i));
+    ASSERT_EQ(next[t], i);
+    next[t]++;
+  }
+  for (int t = 0; t < nthreads; t++)
+    ASSERT_EQ(many, next[t]);
+}
+
 void do_segv()
 {
   SubsystemMap subs;
@@ -30,6 +30,10 @@ class MOSDMap : public Message {
   map<epoch_t, bufferlist> incremental_maps;
   epoch_t oldest_map, newest_map;
 
+  /// features the maps above are encoded for; 0 if they are as stored
+  /// by the monitor.  Not sent over the wire.
+  uint64_t encode_features;
+
   epoch_t get_first() const {
     epoch_t e = 0;
     map<epoch_t, bufferlist>::const_iterator i = maps.begin();
@@ -56,11 +60,51 @@ class MOSDMap : public Message {
   }
 
 
-  MOSDMap() : Message(CEPH_MSG_OSD_MAP, HEAD_VERSION) { }
+  MOSDMap() : Message(CEPH_MSG_OSD_MAP, HEAD_VERSION), encode_features(0) { }
   MOSDMap(const uuid_d &f)
     : Message(CEPH_MSG_OSD_MAP, HEAD_VERSION),
       fsid(f),
-      oldest_map(0), newest_map(0) { }
+      oldest_map(0), newest_map(0),
+      encode_features(0) { }
+
+  /// must maps be re-encoded for a peer with these features?
+  static bool needs_reencode(uint64_t features) {
+    return (features & CEPH_FEATURE_PGID64) == 0 ||
+      (features & CEPH_FEATURE_PGPOOL3) == 0 ||
+      (features & CEPH_FEATURE_OSDENC) == 0 ||
+      (features & CEPH_FEATURE_OSDMAP_ENC) == 0;
+  }
+  /// the bits of features that the encodings we fall back to consult;
+  /// peers that agree on them get the same bytes
+  static uint64_t reencode_features(uint64_t features) {
+    if (features & CEPH_FEATURE_OSDMAP_ENC)
+      return features;  // that encoding records all of them
+    return features & (CEPH_FEATURE_PGID64 |
+		       CEPH_FEATURE_PGPOOL3 |
+		       CEPH_FEATURE_OSDENC |
+		       CEPH_FEATURE_OSD_POOLRESEND);
+  }
+  static void reencode_incremental(bufferlist& bl, uint64_t features) {
+    OSDMap::Incremental inc;
+    bufferlist::iterator q = bl.begin();
+    inc.decode(q);
+    bl.clear();
+    if (inc.fullmap.length()) {
+      // embedded full map?
+      OSDMap m;
+      m.decode(inc.fullmap);
+      inc.fullmap.clear();
+      m.encode(inc.fullmap, features);
+    }
+    inc.encode(bl, features);
+  }
+  static void reencode_full(bufferlist& bl, uint64_t features) {
+    OSDMap m;
+    m.decode(bl);
+    bl.clear();
+    m.encode(bl, features);
+  }
+
 private:
   ~MOSDMap() {}
 
@@ -83,43 +127,28 @@ public:
     header.version = HEAD_VERSION;
     ::encode(fsid, payload);
     if ((features & CEPH_FEATURE_PGID64) == 0 ||
-	(features & CEPH_FEATURE_PGPOOL3) == 0 ||
-	(features & CEPH_FEATURE_OSDENC) == 0 ||
-        (features & CEPH_FEATURE_OSDMAP_ENC) == 0) {
-      if ((features & CEPH_FEATURE_PGID64) == 0 ||
-	  (features & CEPH_FEATURE_PGPOOL3) == 0)
-	header.version = 1;  // old old_client version
-      else if ((features & CEPH_FEATURE_OSDENC) == 0)
-	header.version = 2;  // old pg_pool_t
-
-      // reencode maps using old format
-      //
-      // FIXME: this can probably be done more efficiently higher up
-      // the stack, or maybe replaced with something that only
-      // includes the pools the client cares about.
+	(features & CEPH_FEATURE_PGPOOL3) == 0)
+      header.version = 1;  // old old_client version
+    else if ((features & CEPH_FEATURE_OSDENC) == 0)
+      header.version = 2;  // old pg_pool_t
+
+    // reencode maps using old format, unless the sender (the monitor's
+    // encoded map cache) already did it for exactly these features.
+    //
+    // FIXME: this could be replaced with something that only
+    // includes the pools the client cares about.
+    if (encode_features ?
+	reencode_features(encode_features) != reencode_features(features) :
+	needs_reencode(features)) {
       for (map<epoch_t,bufferlist>::iterator p = incremental_maps.begin();
 	   p != incremental_maps.end();
 	   ++p) {
-	OSDMap::Incremental inc;
-	bufferlist::iterator q = p->second.begin();
-	inc.decode(q);
-	p->second.clear();
-	if (inc.fullmap.length()) {
-	  // embedded full map?
-	  OSDMap m;
-	  m.decode(inc.fullmap);
-	  inc.fullmap.clear();
-	  m.encode(inc.fullmap, features);
-	}
-	inc.encode(p->second, features);
+	reencode_incremental(p->second, features);
       }
       for (map<epoch_t,bufferlist>::iterator p = maps.begin();
 	   p != maps.end();
 	   ++p) {
-	OSDMap m;
-	m.decode(p->second);
-	p->second.clear();
-	m.encode(p->second, features);
+	reencode_full(p->second, features);
       }
     }
     ::encode(incremental_maps, payload);
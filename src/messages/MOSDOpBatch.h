@@ -0,0 +1,110 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MOSDOPBATCH_H
+#define CEPH_MOSDOPBATCH_H
+
+#include "msg/Message.h"
+#include "messages/MOSDOp.h"
+
+/**
+ * several client ops to one OSD, sent as one message
+ *
+ * Only sent to peers with CEPH_FEATURE_OSD_OP_BATCH.  Each op is a
+ * whole MOSDOp, encoded as MForward does, and gets its own reply.
+ */
+class MOSDOpBatch : public Message {
+  static const int HEAD_VERSION = 1;
+  static const int COMPAT_VERSION = 1;
+
+  uint32_t num_ops;
+  bufferlist ops_bl;      ///< outgoing ops
+  list<Message*> ops;     ///< incoming ops, until claimed
+
+public:
+  MOSDOpBatch()
+    : Message(MSG_OSD_OP_BATCH, HEAD_VERSION, COMPAT_VERSION),
+      num_ops(0) {}
+
+  /// add m, encoded for a peer with features; consumes the reference
+  void add_op(MOSDOp *m, uint64_t features) {
+    if (m->get_priority() > get_priority())
+      set_priority(m->get_priority());
+    encode_message(m, features, ops_bl);
+    ++num_ops;
+    m->put();
+  }
+  unsigned get_num_ops() const {
+    return num_ops;
+  }
+
+  /**
+   * take the ops out, as if each had arrived on its own
+   *
+   * They get our connection, source and stamps, and keep their share
+   * of our messenger throttles until they are put.
+   */
+  void claim_ops(list<Message*> *ls) {
+    for (list<Message*>::iterator p = ops.begin(); p != ops.end(); ++p) {
+      Message *m = *p;
+      m->set_connection(get_connection());
+      m->get_header().src = get_header().src;
+      m->set_recv_stamp(get_recv_stamp());
+      m->set_throttle_stamp(get_throttle_stamp());
+      m->set_dispatch_stamp(get_dispatch_stamp());
+      m->set_recv_complete_stamp(get_recv_complete_stamp());
+      if (get_byte_throttler()) {
+	get_byte_throttler()->take(m->get_payload().length() +
+				   m->get_middle().length() +
+				   m->get_data().length());
+	m->set_byte_throttler(get_byte_throttler());
+      }
+      if (get_message_throttler()) {
+	get_message_throttler()->take();
+	m->set_message_throttler(get_message_throttler());
+      }
+    }
+    ls->splice(ls->end(), ops);
+  }
+
+private:
+  ~MOSDOpBatch() {
+    for (list<Message*>::iterator p = ops.begin(); p != ops.end(); ++p)
+      (*p)->put();
+  }
+
+public:
+  void encode_payload(uint64_t features) {
+    ::encode(num_ops, payload);
+    payload.append(ops_bl);
+  }
+  void decode_payload() {
+    bufferlist::iterator p = payload.begin();
+    ::decode(num_ops, p);
+    for (unsigned i = 0; i < num_ops; ++i) {
+      Message *m = decode_message(NULL, 0, p);
+      if (!m || m->get_type() != CEPH_MSG_OSD_OP) {
+	if (m)
+	  m->put();
+	throw buffer::malformed_input("bad op in osd_op_batch");
+      }
+      ops.push_back(m);
+    }
+  }
+
+  const char *get_type_name() const { return "osd_op_batch"; }
+  void print(ostream& out) const {
+    out << "osd_op_batch(" << num_ops << " ops)";
+  }
+};
+
+#endif
@@ -24,7 +24,7 @@
 
 struct MOSDRepScrub : public Message {
 
-  static const int HEAD_VERSION = 6;
+  static const int HEAD_VERSION = 7;
   static const int COMPAT_VERSION = 2;
 
   spg_t pgid;             // PG to scrub
@@ -36,6 +36,7 @@ struct MOSDRepScrub : public Message {
   hobject_t end;         // upper bound of scrub, exclusive
   bool deep;             // true if scrub should be deep
   uint32_t seed;         // seed value for digest calculation
+  deep_scrub_sample_t sample; // which objects a deep scrub reads
 
   MOSDRepScrub()
     : Message(MSG_OSD_REP_SCRUB, HEAD_VERSION, COMPAT_VERSION),
@@ -44,7 +45,8 @@ struct MOSDRepScrub : public Message {
       seed(0) { }
 
   MOSDRepScrub(spg_t pgid, eversion_t scrub_to, epoch_t map_epoch,
-               hobject_t start, hobject_t end, bool deep, uint32_t seed)
+               hobject_t start, hobject_t end, bool deep, uint32_t seed,
+	       const deep_scrub_sample_t& sample)
     : Message(MSG_OSD_REP_SCRUB, HEAD_VERSION, COMPAT_VERSION),
       pgid(pgid),
       scrub_to(scrub_to),
@@ -53,7 +55,8 @@ struct MOSDRepScrub : public Message {
       start(start),
       end(end),
       deep(deep),
-      seed(seed) { }
+      seed(seed),
+      sample(sample) { }
 
 
 private:
@@ -68,6 +71,7 @@ public:
         << ",chunky:" << chunky
         << ",deep:" << deep
 	<< ",seed:" << seed
+	<< ",sample:" << sample
         << ",version:" << header.version;
     out << ")";
   }
@@ -83,6 +87,7 @@ public:
     ::encode(deep, payload);
     ::encode(pgid.shard, payload);
     ::encode(seed, payload);
+    ::encode(sample, payload);
   }
   void decode_payload() {
     bufferlist::iterator p = payload.begin();
@@ -115,6 +120,11 @@ public:
     } else {
       seed = 0;
     }
+    if (header.version >= 7) {
+      ::decode(sample, p);
+    } else {
+      sample = deep_scrub_sample_t();
+    }
   }
 };
 
@@ -0,0 +1,90 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MON_OSDMAPVARIANTCACHE_H
+#define CEPH_MON_OSDMAPVARIANTCACHE_H
+
+#include "common/simple_cache.hpp"
+#include "messages/MOSDMap.h"
+
+/**
+ * osdmaps re-encoded for peers that need an older encoding (see
+ * MOSDMap::needs_reencode).
+ *
+ * Entries are keyed by epoch and MOSDMap::reencode_features(), so all
+ * peers that get the same bytes share one copy, encoded once.  They
+ * are bounded apart from the maps as stored, so a storm of old peers
+ * can't evict those.
+ */
+class OSDMapVariantCache {
+  typedef pair<version_t, uint64_t> key_t;
+  struct key_hash {
+    size_t operator()(const key_t& k) const {
+      return std::hash<version_t>()(k.first) ^
+	(std::hash<uint64_t>()(k.second) * 31);
+    }
+  };
+  typedef SimpleLRU<key_t, bufferlist, std::less<key_t>, key_hash> lru_t;
+
+  lru_t inc_cache;
+  lru_t full_cache;
+  uint64_t num_encoded;
+
+  template <typename F>
+  int get(lru_t& cache, bool full, version_t ver, uint64_t features,
+	  bufferlist& bl, F get_stored) {
+    key_t k(ver, MOSDMap::reencode_features(features));
+    if (cache.lookup(k, &bl))
+      return 0;
+    int r = get_stored(ver, bl);
+    if (r || !bl.length())
+      return r;
+    if (full)
+      MOSDMap::reencode_full(bl, k.second);
+    else
+      MOSDMap::reencode_incremental(bl, k.second);
+    ++num_encoded;
+    cache.add(k, bl);
+    return 0;
+  }
+
+public:
+  explicit OSDMapVariantCache(size_t size)
+    : inc_cache(size), full_cache(size), num_encoded(0) {}
+
+  /**
+   * get incremental ver as encoded for a peer with features
+   *
+   * @param get_stored int(version_t, bufferlist&) that reads the map
+   *                   as stored, called only on a miss
+   * @return 0 or the error from get_stored
+   */
+  template <typename F>
+  int get_incremental(version_t ver, uint64_t features, bufferlist& bl,
+		      F get_stored) {
+    return get(inc_cache, false, ver, features, bl, get_stored);
+  }
+
+  /// get full map ver as encoded for a peer with features
+  template <typename F>
+  int get_full(version_t ver, uint64_t features, bufferlist& bl,
+	       F get_stored) {
+    return get(full_cache, true, ver, features, bl, get_stored);
+  }
+
+  /// how many maps we have re-encoded
+  uint64_t get_num_encoded() const {
+    return num_encoded;
+  }
+};
+
+#endif
@@ -78,6 +78,7 @@ OSDMonitor::OSDMonitor(CephContext *cct, Monitor *mn, Paxos *p, const string& se
  : PaxosService(mn, p, service_name),
    inc_osd_cache(g_conf->mon_osd_cache_size),
    full_osd_cache(g_conf->mon_osd_cache_size),
+   osd_variant_cache(g_conf->mon_osd_cache_variant_size),
    thrash_map(0), thrash_last_up_osd(-1),
    op_tracker(cct, true, 1)
 {}
@@ -284,6 +285,8 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
     mon->store->apply_transaction(t);
   }
 
+  osdmap.update_mapping(g_ceph_context);
+
   for (int o = 0; o < osdmap.get_max_osd(); o++) {
     if (osdmap.is_down(o)) {
       // populate down -> out map
@@ -1295,7 +1298,8 @@ void OSDMonitor::share_map_with_random_osd()
 
   dout(10) << "committed, telling random " << s->inst << " all about it" << dendl;
   // whatev, they'll request more if they need it
-  MOSDMap *m = build_incremental(osdmap.get_epoch() - 1, osdmap.get_epoch());
+  MOSDMap *m = build_incremental(osdmap.get_epoch() - 1, osdmap.get_epoch(),
+				 s->con->get_features());
   s->con->send_message(m);
   // NOTE: do *not* record osd has up to this epoch (as we do
   // elsewhere) as they may still need to request older values.
@@ -1977,6 +1981,19 @@ bool OSDMonitor::preprocess_boot(MonOpRequestRef op)
     }
   }
 
+  if (any_of(osdmap.get_pools().begin(),
+	     osdmap.get_pools().end(),
+	     [](const std::pair<int64_t,pg_pool_t>& pool)
+	     { return pool.second.allows_ecoverwrites(); }) &&
+      !(m->osd_features & CEPH_FEATURE_SERVER_KRAKEN)) {
+    // it would choke on the rollback info of ec overwrites
+    mon->clog->info() << "disallowing boot of OSD "
+		      << m->get_orig_source_inst()
+		      << " because one or more pools allow ec overwrites"
+		      << " and the osd lacks CEPH_FEATURE_SERVER_KRAKEN\n";
+    goto ignore;
+  }
+
   // make sure upgrades stop at hammer
   //  * HAMMER_0_94_4 is the required hammer feature
   //  * MON_METADATA is the first post-hammer feature
@@ -2460,25 +2477,30 @@ void OSDMonitor::send_latest(MonOpRequestRef op, epoch_t start)
 }
 
 
-MOSDMap *OSDMonitor::build_latest_full()
+MOSDMap *OSDMonitor::build_latest_full(uint64_t features)
 {
   MOSDMap *r = new MOSDMap(mon->monmap->fsid);
-  get_version_full(osdmap.get_epoch(), r->maps[osdmap.get_epoch()]);
+  get_version_full(osdmap.get_epoch(), features, r->maps[osdmap.get_epoch()]);
+  if (MOSDMap::needs_reencode(features))
+    r->encode_features = features;
   r->oldest_map = get_first_committed();
   r->newest_map = osdmap.get_epoch();
   return r;
 }
 
-MOSDMap *OSDMonitor::build_incremental(epoch_t from, epoch_t to)
+MOSDMap *OSDMonitor::build_incremental(epoch_t from, epoch_t to,
+				       uint64_t features)
 {
   dout(10) << "build_incremental [" << from << ".." << to << "]" << dendl;
   MOSDMap *m = new MOSDMap(mon->monmap->fsid);
+  if (MOSDMap::needs_reencode(features))
+    m->encode_features = features;
   m->oldest_map = get_first_committed();
   m->newest_map = osdmap.get_epoch();
 
   for (epoch_t e = to; e >= from && e > 0; e--) {
     bufferlist bl;
-    int err = get_version(e, bl);
+    int err = get_version(e, features, bl);
     if (err == 0) {
       assert(bl.length());
       // if (get_version(e, bl) > 0) {
@@ -2488,7 +2510,7 @@ MOSDMap *OSDMonitor::build_incremental(epoch_t from, epoch_t to)
     } else {
       assert(err == -ENOENT);
       assert(!bl.length());
-      get_version_full(e, bl);
+      get_version_full(e, features, bl);
       if (bl.length() > 0) {
       //else if (get_version("full", e, bl) > 0) {
       dout(20) << "build_incremental   full " << e << " "
@@ -2506,7 +2528,8 @@ void OSDMonitor::send_full(MonOpRequestRef op)
 {
   op->mark_osdmon_event(__func__);
   dout(5) << "send_full to " << op->get_req()->get_orig_source_inst() << dendl;
-  mon->send_reply(op, build_latest_full());
+  mon->send_reply(op, build_latest_full(
+		    op->get_session()->con->get_features()));
 }
 
 void OSDMonitor::send_incremental(MonOpRequestRef op, epoch_t first)
@@ -2545,10 +2568,12 @@ void OSDMonitor::send_incremental(epoch_t first,
     first = session->osd_epoch + 1;
   }
 
+  uint64_t features = session->con->get_features();
+
   if (first < get_first_committed()) {
     first = get_first_committed();
     bufferlist bl;
-    int err = get_version_full(first, bl);
+    int err = get_version_full(first, features, bl);
     assert(err == 0);
     assert(bl.length());
 
@@ -2556,6 +2581,8 @@ void OSDMonitor::send_incremental(epoch_t first,
 	     << first << " " << bl.length() << " bytes" << dendl;
 
     MOSDMap *m = new MOSDMap(osdmap.get_fsid());
+    if (MOSDMap::needs_reencode(features))
+      m->encode_features = features;
     m->oldest_map = get_first_committed();
     m->newest_map = osdmap.get_epoch();
     m->maps[first] = bl;
@@ -2574,7 +2601,7 @@ void OSDMonitor::send_incremental(epoch_t first,
   while (first <= osdmap.get_epoch()) {
     epoch_t last = MIN(first + g_conf->osd_map_message_max - 1,
 		       osdmap.get_epoch());
-    MOSDMap *m = build_incremental(first, last);
+    MOSDMap *m = build_incremental(first, last, features);
 
     if (req) {
       // send some maps.  it may not be all of them, but it will get them
@@ -2616,6 +2643,35 @@ int OSDMonitor::get_version_full(version_t ver, bufferlist& bl)
     return ret;
 }
 
+int OSDMonitor::get_version(version_t ver, uint64_t features,
+			    bufferlist& bl)
+{
+  if (!MOSDMap::needs_reencode(features))
+    return get_version(ver, bl);
+  return osd_variant_cache.get_incremental(
+    ver, features, bl,
+    [this, features](version_t v, bufferlist& stored) {
+      dout(20) << "get_version re-encoding inc " << v << " for features "
+	       << MOSDMap::reencode_features(features) << dendl;
+      return get_version(v, stored);
+    });
+}
+
+int OSDMonitor::get_version_full(version_t ver, uint64_t features,
+				 bufferlist& bl)
+{
+  if (!MOSDMap::needs_reencode(features))
+    return get_version_full(ver, bl);
+  return osd_variant_cache.get_full(
+    ver, features, bl,
+    [this, features](version_t v, bufferlist& stored) {
+      dout(20) << "get_version_full re-encoding full " << v
+	       << " for features " << MOSDMap::reencode_features(features)
+	       << dendl;
+      return get_version_full(v, stored);
+    });
+}
+
 epoch_t OSDMonitor::blacklist(const entity_addr_t& a, utime_t until)
 {
   dout(10) << "blacklist " << a << " until " << until << dendl;
@@ -2646,7 +2702,8 @@ void OSDMonitor::check_sub(Subscription *sub)
     if (sub->next >= 1)
       send_incremental(sub->next, sub->session, sub->incremental_onetime);
     else
-      sub->session->con->send_message(build_latest_full());
+      sub->session->con->send_message(build_latest_full(
+	  sub->session->con->get_features()));
     if (sub->onetime)
       mon->session_map.remove_sub(sub);
     else
@@ -5235,6 +5292,26 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
       return -EINVAL;
     }
     p.min_write_recency_for_promote = n;
+  } else if (var == "allow_ec_overwrites") {
+    if (!p.is_erasure()) {
+      ss << "ec overwrites can only be enabled for an erasure coded pool";
+      return -EINVAL;
+    }
+    if (val == "true" || (interr.empty() && n == 1)) {
+      if (!(osdmap.get_up_osd_features() & CEPH_FEATURE_SERVER_KRAKEN)) {
+	ss << "not all up OSDs have CEPH_FEATURE_SERVER_KRAKEN feature";
+	return -EPERM;
+      }
+      p.set_flag(pg_pool_t::FLAG_EC_OVERWRITES);
+    } else if (val == "false" || (interr.empty() && n == 0)) {
+      if (p.has_flag(pg_pool_t::FLAG_EC_OVERWRITES)) {
+	ss << "ec overwrites cannot be disabled once enabled";
+	return -EINVAL;
+      }
+    } else {
+      ss << "expecting value 'true', 'false', '0', or '1'";
+      return -EINVAL;
+    }
   } else if (var == "fast_read") {
     if (p.is_replicated()) {
         ss << "fast read is not supported in replication pool";
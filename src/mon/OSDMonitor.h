@@ -40,6 +40,7 @@ class MOSDMap;
 
 #include "erasure-code/ErasureCodeInterface.h"
 #include "mon/MonOpRequest.h"
+#include "mon/OSDMapVariantCache.h"
 
 #define OSD_METADATA_PREFIX "osd_metadata"
 
@@ -127,6 +128,7 @@ private:
 
   SimpleLRU<version_t, bufferlist> inc_osd_cache;
   SimpleLRU<version_t, bufferlist> full_osd_cache;
+  OSDMapVariantCache osd_variant_cache;
 
   bool check_failures(utime_t now);
   bool check_failure(utime_t now, int target_osd, failure_info_t& fi);
@@ -211,8 +213,8 @@ private:
   bool can_mark_in(int o);
 
   // ...
-  MOSDMap *build_latest_full();
-  MOSDMap *build_incremental(epoch_t first, epoch_t last);
+  MOSDMap *build_latest_full(uint64_t features);
+  MOSDMap *build_incremental(epoch_t first, epoch_t last, uint64_t features);
   void send_full(MonOpRequestRef op);
   void send_incremental(MonOpRequestRef op, epoch_t first);
 public:
@@ -421,6 +423,9 @@ private:
 
   int get_version(version_t ver, bufferlist& bl) override;
   int get_version_full(version_t ver, bufferlist& bl) override;
+  /// the map as a peer with these features should receive it
+  int get_version(version_t ver, uint64_t features, bufferlist& bl);
+  int get_version_full(version_t ver, uint64_t features, bufferlist& bl);
 
   epoch_t blacklist(const entity_addr_t& a, utime_t until);
 
@@ -210,6 +210,7 @@ void PGMap::apply_incremental(CephContext *cct, const Incremental& inc)
       if (min_last_epoch_clean &&
           update_stat.get_effective_last_epoch_clean() < min_last_epoch_clean)
 	min_last_epoch_clean = 0;
+      stat_pg_add(update_pg, update_stat);
     } else {
       // did we (or might we) affect the min?
       epoch_t lec = update_stat.get_effective_last_epoch_clean();
@@ -220,10 +221,8 @@ void PGMap::apply_incremental(CephContext *cct, const Incremental& inc)
           ))
 	min_last_epoch_clean = 0;
 
-      stat_pg_sub(update_pg, t->second);
-      t->second = update_stat;
+      stat_pg_update(update_pg, t->second, update_stat);
     }
-    stat_pg_add(update_pg, update_stat);
   }
   assert(osd_stat.size() == osd_epochs.size());
   for (map<int32_t,osd_stat_t>::const_iterator p =
@@ -270,6 +269,9 @@ void PGMap::apply_incremental(CephContext *cct, const Incremental& inc)
     const pg_t &removed_pg(*p);
     ceph::unordered_map<pg_t,pg_stat_t>::iterator s = pg_stat.find(removed_pg);
     if (s != pg_stat.end()) {
+      if (min_last_epoch_clean &&
+	  s->second.get_effective_last_epoch_clean() == min_last_epoch_clean)
+	min_last_epoch_clean = 0;
       stat_pg_sub(removed_pg, s->second);
       pg_stat.erase(s);
     }
@@ -316,8 +318,54 @@ void PGMap::apply_incremental(CephContext *cct, const Incremental& inc)
     last_osdmap_epoch = inc.osdmap_epoch;
   if (inc.pg_scan)
     last_pg_scan = inc.pg_scan;
+}
+
+void PGMap::apply_dirty(CephContext *cct, version_t v, utime_t stamp,
+			const vector<pair<pg_t,bufferlist> >& pgs,
+			const vector<pair<int32_t,bufferlist> >& osds)
+{
+  pool_stat_t pg_sum_old = pg_sum;
+  ceph::unordered_map<uint64_t, pool_stat_t> pg_pool_sum_old;
+
+  set<int64_t> deleted_pools;
+  for (vector<pair<pg_t,bufferlist> >::const_iterator p = pgs.begin();
+       p != pgs.end();
+       ++p) {
+    if (pg_pool_sum_old.count(p->first.pool()) == 0)
+      pg_pool_sum_old[p->first.pool()] = pg_pool_sum[p->first.pool()];
+    if (p->second.length()) {
+      bufferlist bl = p->second;
+      update_pg(p->first, bl);
+    } else {
+      remove_pg(p->first);
+      if (p->first.ps() == 0)
+	deleted_pools.insert(p->first.pool());
+    }
+  }
+
+  for (vector<pair<int32_t,bufferlist> >::const_iterator p = osds.begin();
+       p != osds.end();
+       ++p) {
+    if (p->second.length()) {
+      bufferlist bl = p->second;
+      update_osd(p->first, bl);
+    } else {
+      remove_osd(p->first);
+    }
+  }
 
-  min_last_epoch_clean = 0;  // invalidate
+  update_global_delta(cct, stamp, pg_sum_old);
+  update_pool_deltas(cct, stamp, pg_pool_sum_old);
+
+  // clean up deleted pools after updating the deltas
+  for (set<int64_t>::iterator p = deleted_pools.begin();
+       p != deleted_pools.end();
+       ++p) {
+    dout(20) << " deleted pool " << *p << dendl;
+    deleted_pool(*p);
+  }
+
+  version = v;
 }
 
 void PGMap::redo_full_sets()
@@ -359,6 +407,9 @@ void PGMap::calc_stats()
   pg_sum = pool_stat_t();
   osd_sum = osd_stat_t();
   pg_by_osd.clear();
+  blocked_by_sum.clear();
+  creating_pgs.clear();
+  creating_pgs_by_osd_epoch.clear();
 
   for (ceph::unordered_map<pg_t,pg_stat_t>::iterator p = pg_stat.begin();
        p != pg_stat.end();
@@ -549,7 +600,16 @@ void PGMap::stat_pg_update(const pg_t pgid, pg_stat_t& s,
 {
   pg_stat_t n;
   ::decode(n, blp);
+  stat_pg_update(pgid, s, n);
+}
 
+/*
+ * most reports only change the counters of a pg; leave the per-osd
+ * indices alone unless its osds or blockers changed
+ */
+void PGMap::stat_pg_update(const pg_t pgid, pg_stat_t& s,
+                           const pg_stat_t& n)
+{
   bool sameosds =
     s.acting == n.acting &&
     s.up == n.up &&
@@ -952,6 +1012,27 @@ void PGMap::get_stuck_stats(int types, const utime_t cutoff,
   }
 }
 
+int PGMap::get_stuck_type(const pg_stat_t& s, utime_t *since)
+{
+  if (!(s.state & PG_STATE_ACTIVE)) {
+    *since = s.last_active;
+    return STUCK_INACTIVE;
+  } else if (!(s.state & PG_STATE_CLEAN)) {
+    *since = s.last_clean;
+    return STUCK_UNCLEAN;
+  } else if (s.state & PG_STATE_DEGRADED) {
+    *since = s.last_undegraded;
+    return STUCK_DEGRADED;
+  } else if (s.state & PG_STATE_UNDERSIZED) {
+    *since = s.last_fullsized;
+    return STUCK_UNDERSIZED;
+  } else if (s.state & PG_STATE_STALE) {
+    *since = s.last_unstale;
+    return STUCK_STALE;
+  }
+  return 0;
+}
+
 bool PGMap::get_stuck_counts(const utime_t cutoff, map<string, int>& note) const
 {
   int inactive = 0;
@@ -963,22 +1044,16 @@ bool PGMap::get_stuck_counts(const utime_t cutoff, map<string, int>& note) const
   for (ceph::unordered_map<pg_t, pg_stat_t>::const_iterator i = pg_stat.begin();
        i != pg_stat.end();
        ++i) {
-
-    if (! (i->second.state & PG_STATE_ACTIVE)) {
-      if (i->second.last_active < cutoff)
-        ++inactive;
-    } else if (! (i->second.state & PG_STATE_CLEAN)) {
-      if (i->second.last_clean < cutoff)
-        ++unclean;
-    } else if (i->second.state & PG_STATE_DEGRADED) {
-      if (i->second.last_undegraded < cutoff)
-        ++degraded;
-    } else if (i->second.state & PG_STATE_UNDERSIZED) {
-      if (i->second.last_fullsized < cutoff)
-        ++undersized;
-    } else if (i->second.state & PG_STATE_STALE) {
-      if (i->second.last_unstale < cutoff)
-        ++stale;
+    utime_t since;
+    int type = get_stuck_type(i->second, &since);
+    if (!type || since >= cutoff)
+      continue;
+    switch (type) {
+    case STUCK_INACTIVE: ++inactive; break;
+    case STUCK_UNCLEAN: ++unclean; break;
+    case STUCK_DEGRADED: ++degraded; break;
+    case STUCK_UNDERSIZED: ++undersized; break;
+    case STUCK_STALE: ++stale; break;
     }
   }
   
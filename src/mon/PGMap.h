@@ -252,6 +252,16 @@ public:
   void remove_osd(int osd);
 
   void apply_incremental(CephContext *cct, const Incremental& inc);
+  /**
+   * move to version v of a pgmap kept as pg and osd keys
+   *
+   * @param pgs the pgs v dirtied, each with its stats as stored, or an
+   *            empty bufferlist if it is gone
+   * @param osds likewise for the osds
+   */
+  void apply_dirty(CephContext *cct, version_t v, utime_t stamp,
+		   const vector<pair<pg_t,bufferlist> >& pgs,
+		   const vector<pair<int32_t,bufferlist> >& osds);
   void redo_full_sets();
   void register_nearfull_status(int osd, const osd_stat_t& s);
   void calc_stats();
@@ -260,6 +270,7 @@ public:
   void stat_pg_sub(const pg_t &pgid, const pg_stat_t &s,
 		   bool sameosds=false);
   void stat_pg_update(const pg_t pgid, pg_stat_t &prev, bufferlist::iterator& blp);
+  void stat_pg_update(const pg_t pgid, pg_stat_t &prev, const pg_stat_t &n);
   void stat_osd_add(const osd_stat_t &s);
   void stat_osd_sub(const osd_stat_t &s);
   
@@ -282,6 +293,8 @@ public:
   void get_stuck_stats(int types, const utime_t cutoff,
 		       ceph::unordered_map<pg_t, pg_stat_t>& stuck_pgs) const;
   bool get_stuck_counts(const utime_t cutoff, map<string, int>& note) const;
+  /// which stuck count s goes in (a STUCK_* bit, or 0), and since when
+  static int get_stuck_type(const pg_stat_t& s, utime_t *since);
   void dump_stuck(Formatter *f, int types, utime_t cutoff) const;
   void dump_stuck_plain(ostream& ss, int types, utime_t cutoff) const;
 
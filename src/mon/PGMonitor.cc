@@ -58,6 +58,26 @@ static ostream& _prefix(std::ostream *_dout, const Monitor *mon, const PGMap& pg
    Tick function to update the map based on performance every N seconds
  */
 
+void PGMonitor::init()
+{
+  if (g_conf->mon_pg_stat_background && !aggregator) {
+    aggregator.reset(new PGStatAggregator(g_ceph_context));
+    aggregator->start();
+    aggregator->reset(pg_map);
+  }
+}
+
+void PGMonitor::on_shutdown()
+{
+  if (aggregator) {
+    // queued reads take our lock to reply
+    mon->lock.Unlock();
+    aggregator->stop();
+    mon->lock.Lock();
+    aggregator.reset();
+  }
+}
+
 void PGMonitor::on_restart()
 {
   // clear leader state
@@ -125,6 +145,8 @@ void PGMonitor::tick()
     if (age > 2 * g_conf->mon_delta_reset_interval) {
       dout(10) << " clearing pg_map delta (" << age << " > " << g_conf->mon_delta_reset_interval << " seconds old)" << dendl;
       pg_map.clear_delta();
+      if (aggregator)
+	aggregator->queue_update([](PGMap& m) { m.clear_delta(); });
     }
   }
 
@@ -144,9 +166,17 @@ void PGMonitor::tick()
 	dout(10) << " clearing pg_map delta for pool " << it->first
 	         << " (" << age << " > " << g_conf->mon_delta_reset_interval
 	         << " seconds old)" << dendl;
-	pg_map.per_pool_sum_deltas.erase(it->first);
-	pg_map.per_pool_sum_deltas_stamps.erase(it->first);
+	uint64_t pool = it->first;
+	pg_map.per_pool_sum_deltas.erase(pool);
+	pg_map.per_pool_sum_deltas_stamps.erase(pool);
 	pg_map.per_pool_sum_delta.erase((it++)->first);
+	if (aggregator)
+	  aggregator->queue_update(
+	    [pool](PGMap& m) {
+	      m.per_pool_sum_deltas.erase(pool);
+	      m.per_pool_sum_deltas_stamps.erase(pool);
+	      m.per_pool_sum_delta.erase(pool);
+	    });
       } else {
 	++it;
       }
@@ -170,8 +200,12 @@ void PGMonitor::update_from_paxos(bool *need_bootstrap)
 
   assert(version >= pg_map.version);
 
+  // whether the aggregator needs a whole new copy
+  bool reloaded = false;
+
   if (format_version == 0) {
     // old format
+    reloaded = true;
 
     /* Obtain latest full pgmap version, if available and whose version is
      * greater than the current pgmap's version.
@@ -234,6 +268,7 @@ void PGMonitor::update_from_paxos(bool *need_bootstrap)
       if (pg_map.version == 0) {
 	dout(10) << __func__ << " v0, read_full" << dendl;
 	read_pgmap_full();
+	reloaded = true;
 	goto out;
       }
 
@@ -244,6 +279,7 @@ void PGMonitor::update_from_paxos(bool *need_bootstrap)
       if (r == -ENOENT) {
 	dout(10) << __func__ << " failed to read_incremental, read_full" << dendl;
 	read_pgmap_full();
+	reloaded = true;
 	goto out;
       }
       assert(r == 0);
@@ -259,6 +295,27 @@ out:
 
   assert(version == pg_map.version);
 
+  if (aggregator) {
+    if (reloaded) {
+      aggregator->reset(pg_map);
+    } else {
+      // what read_pgmap_meta() set
+      epoch_t last_osdmap_epoch = pg_map.get_last_osdmap_epoch();
+      epoch_t last_pg_scan = pg_map.get_last_pg_scan();
+      float full_ratio = pg_map.full_ratio;
+      float nearfull_ratio = pg_map.nearfull_ratio;
+      utime_t stamp = pg_map.get_stamp();
+      aggregator->queue_update(
+	[=](PGMap& m) {
+	  m.set_version(version);
+	  m.set_last_osdmap_epoch(last_osdmap_epoch);
+	  m.set_last_pg_scan(last_pg_scan);
+	  m.set_full_ratios(full_ratio, nearfull_ratio);
+	  m.set_stamp(stamp);
+	});
+    }
+  }
+
   update_logger();
 }
 
@@ -266,6 +323,8 @@ void PGMonitor::on_upgrade()
 {
   dout(1) << __func__ << " discarding in-core PGMap" << dendl;
   pg_map = PGMap();
+  if (aggregator)
+    aggregator->reset(pg_map);
 }
 
 void PGMonitor::upgrade_format()
@@ -407,72 +466,48 @@ void PGMonitor::apply_pgmap_delta(bufferlist& bl)
     ::decode(dirty_osds, p);
   }
 
-  pool_stat_t pg_sum_old = pg_map.pg_sum;
-  ceph::unordered_map<uint64_t, pool_stat_t> pg_pool_sum_old;
-
   // pgs
+  vector<pair<pg_t,bufferlist> > pgs;
   set<int64_t> deleted_pools;
   bufferlist::iterator p = dirty_pgs.begin();
   while (!p.end()) {
     pg_t pgid;
     ::decode(pgid, p);
-
-    int r;
-    bufferlist pgbl;
-    if (deleted_pools.count(pgid.pool())) {
-      r = -ENOENT;
-    } else {
-      r = mon->store->get(pgmap_pg_prefix, stringify(pgid), pgbl);
-      if (pg_pool_sum_old.count(pgid.pool()) == 0)
-	pg_pool_sum_old[pgid.pool()] = pg_map.pg_pool_sum[pgid.pool()];
-    }
-
-    if (r >= 0) {
-      pg_map.update_pg(pgid, pgbl);
-      dout(20) << " refreshing pg " << pgid
-	       << " " << pg_map.pg_stat[pgid].reported_epoch
-	       << ":" << pg_map.pg_stat[pgid].reported_seq
-	       << " " << pg_state_string(pg_map.pg_stat[pgid].state)
-	       << dendl;
-    } else {
+    pgs.push_back(make_pair(pgid, bufferlist()));
+    if (deleted_pools.count(pgid.pool()) ||
+	mon->store->get(pgmap_pg_prefix, stringify(pgid),
+			pgs.back().second) < 0) {
+      pgs.back().second.clear();
       dout(20) << " removing pg " << pgid << dendl;
-      pg_map.remove_pg(pgid);
       if (pgid.ps() == 0)
 	deleted_pools.insert(pgid.pool());
+    } else {
+      dout(20) << " refreshing pg " << pgid << dendl;
     }
   }
 
   // osds
+  vector<pair<int32_t,bufferlist> > osds;
   p = dirty_osds.begin();
   while (!p.end()) {
     int32_t osd;
     ::decode(osd, p);
     dout(20) << " refreshing osd." << osd << dendl;
-    bufferlist bl;
-    int r = mon->store->get(pgmap_osd_prefix, stringify(osd), bl);
-    if (r >= 0) {
-      pg_map.update_osd(osd, bl);
-    } else {
-      pg_map.remove_osd(osd);
-    }
-  }
-
-  pg_map.update_global_delta(g_ceph_context, inc_stamp, pg_sum_old);
-  pg_map.update_pool_deltas(g_ceph_context, inc_stamp, pg_pool_sum_old);
-
-  // clean up deleted pools after updating the deltas
-  for (set<int64_t>::iterator p = deleted_pools.begin();
-       p != deleted_pools.end();
-       ++p) {
-    dout(20) << " deleted pool " << *p << dendl;
-    pg_map.deleted_pool(*p);
+    osds.push_back(make_pair(osd, bufferlist()));
+    if (mon->store->get(pgmap_osd_prefix, stringify(osd),
+			osds.back().second) < 0)
+      osds.back().second.clear();
   }
 
   // ok, we're now on the new version
-  pg_map.version = v;
+  pg_map.apply_dirty(g_ceph_context, v, inc_stamp, pgs, osds);
+  if (aggregator)
+    aggregator->queue_update(
+      [v, inc_stamp, pgs, osds](PGMap& m) {
+	m.apply_dirty(g_ceph_context, v, inc_stamp, pgs, osds);
+      });
 }
 
-
 void PGMonitor::encode_pending(MonitorDBStore::TransactionRef t)
 {
   version_t version = pending_inc.version;
@@ -778,8 +813,10 @@ bool PGMonitor::prepare_pg_stats(MonOpRequestRef op)
     pending_inc.update_stat(from, stats->epoch, osd_stat_t());
   }
 
-  if (pg_map.osd_stat.count(from))
-    dout(10) << " got osd." << from << " " << stats->osd_stat << " (was " << pg_map.osd_stat[from] << ")" << dendl;
+  ceph::unordered_map<int32_t,osd_stat_t>::const_iterator os =
+    pg_map.osd_stat.find(from);
+  if (os != pg_map.osd_stat.end())
+    dout(10) << " got osd." << from << " " << stats->osd_stat << " (was " << os->second << ")" << dendl;
   else
     dout(10) << " got osd." << from << " " << stats->osd_stat << " (first report)" << dendl;
 
@@ -793,20 +830,26 @@ bool PGMonitor::prepare_pg_stats(MonOpRequestRef op)
     pg_t pgid = p->first;
     ack->pg_stat[pgid] = make_pair(p->second.reported_seq, p->second.reported_epoch);
 
-    if (pg_map.pg_stat.count(pgid) &&
-        pg_map.pg_stat[pgid].get_version_pair() > p->second.get_version_pair()) {
-      dout(15) << " had " << pgid << " from " << pg_map.pg_stat[pgid].reported_epoch << ":"
-               << pg_map.pg_stat[pgid].reported_seq << dendl;
+    // look each pg up once; a report can carry hundreds of them
+    ceph::unordered_map<pg_t,pg_stat_t>::const_iterator cur =
+      pg_map.pg_stat.find(pgid);
+    if (cur != pg_map.pg_stat.end() &&
+        cur->second.get_version_pair() > p->second.get_version_pair()) {
+      dout(15) << " had " << pgid << " from " << cur->second.reported_epoch << ":"
+               << cur->second.reported_seq << dendl;
       continue;
     }
-    if (pending_inc.pg_stat_updates.count(pgid) &&
-        pending_inc.pg_stat_updates[pgid].get_version_pair() > p->second.get_version_pair()) {
-      dout(15) << " had " << pgid << " from " << pending_inc.pg_stat_updates[pgid].reported_epoch << ":"
-               << pending_inc.pg_stat_updates[pgid].reported_seq << " (pending)" << dendl;
+    map<pg_t,pg_stat_t>::iterator pending =
+      pending_inc.pg_stat_updates.lower_bound(pgid);
+    if (pending != pending_inc.pg_stat_updates.end() &&
+        pending->first == pgid &&
+        pending->second.get_version_pair() > p->second.get_version_pair()) {
+      dout(15) << " had " << pgid << " from " << pending->second.reported_epoch << ":"
+               << pending->second.reported_seq << " (pending)" << dendl;
       continue;
     }
 
-    if (pg_map.pg_stat.count(pgid) == 0) {
+    if (cur == pg_map.pg_stat.end()) {
       dout(15) << " got " << pgid << " reported at " << p->second.reported_epoch << ":"
                << p->second.reported_seq
                << " state " << pg_state_string(p->second.state)
@@ -817,10 +860,13 @@ bool PGMonitor::prepare_pg_stats(MonOpRequestRef op)
 
     dout(15) << " got " << pgid
              << " reported at " << p->second.reported_epoch << ":" << p->second.reported_seq
-             << " state " << pg_state_string(pg_map.pg_stat[pgid].state)
+             << " state " << pg_state_string(cur->second.state)
              << " -> " << pg_state_string(p->second.state)
              << dendl;
-    pending_inc.pg_stat_updates[pgid] = p->second;
+    if (pending != pending_inc.pg_stat_updates.end() && pending->first == pgid)
+      pending->second = p->second;
+    else
+      pending_inc.pg_stat_updates.insert(pending, make_pair(pgid, p->second));
   }
 
   wait_for_finished_proposal(op, new C_Stats(this, op, ack_op));
@@ -1603,6 +1649,64 @@ void PGMonitor::dump_info(Formatter *f) const
   f->dump_unsigned("pgmap_last_committed", get_last_committed());
 }
 
+static void dump_pg_map(const PGMap& pg_map, const set<string>& what,
+			Formatter *f, ostream& ds)
+{
+  if (f) {
+    if (what.count("all")) {
+      f->open_object_section("pg_map");
+      pg_map.dump(f);
+      f->close_section();
+    } else if (what.count("summary") || what.count("sum")) {
+      f->open_object_section("pg_map");
+      pg_map.dump_basic(f);
+      f->close_section();
+    } else {
+      if (what.count("pools")) {
+	pg_map.dump_pool_stats(f);
+      }
+      if (what.count("osds")) {
+	pg_map.dump_osd_stats(f);
+      }
+      if (what.count("pgs")) {
+	pg_map.dump_pg_stats(f, false);
+      }
+      if (what.count("pgs_brief")) {
+	pg_map.dump_pg_stats(f, true);
+      }
+      if (what.count("delta")) {
+	f->open_object_section("delta");
+	pg_map.dump_delta(f);
+	f->close_section();
+      }
+    }
+    f->flush(ds);
+  } else {
+    if (what.count("all")) {
+      pg_map.dump(ds);
+    } else if (what.count("summary") || what.count("sum")) {
+      pg_map.dump_basic(ds);
+      pg_map.dump_pg_sum_stats(ds, true);
+      pg_map.dump_osd_sum_stats(ds);
+    } else {
+      if (what.count("pgs_brief")) {
+	pg_map.dump_pg_stats(ds, true);
+      }
+      bool header = true;
+      if (what.count("pgs")) {
+	pg_map.dump_pg_stats(ds, false);
+	header = false;
+      }
+      if (what.count("pools")) {
+	pg_map.dump_pool_stats(ds, header);
+      }
+      if (what.count("osds")) {
+	pg_map.dump_osd_stats(ds);
+      }
+    }
+  }
+}
+
 bool PGMonitor::preprocess_command(MonOpRequestRef op)
 {
   op->mark_pgmon_event(__func__);
@@ -1682,7 +1786,6 @@ bool PGMonitor::preprocess_command(MonOpRequestRef op)
     ss << "got pgmap version " << pg_map.version;
     r = 0;
   } else if (prefix == "pg dump") {
-    string val;
     vector<string> dumpcontents;
     set<string> what;
     if (cmd_getval(g_ceph_context, cmdmap, "dumpcontents", dumpcontents)) {
@@ -1691,65 +1794,27 @@ bool PGMonitor::preprocess_command(MonOpRequestRef op)
     }
     if (what.empty())
       what.insert("all");
-    if (f) {
-      vector<string> dumpcontents;
-      if (cmd_getval(g_ceph_context, cmdmap, "dumpcontents", dumpcontents)) {
-	copy(dumpcontents.begin(), dumpcontents.end(),
-	     inserter(what, what.end()));
-      }
-      if (what.count("all")) {
-	f->open_object_section("pg_map");
-	pg_map.dump(f.get());
-	f->close_section();
-      } else if (what.count("summary") || what.count("sum")) {
-	f->open_object_section("pg_map");
-	pg_map.dump_basic(f.get());
-	f->close_section();
-      } else {
-	if (what.count("pools")) {
-	  pg_map.dump_pool_stats(f.get());
-	}
-	if (what.count("osds")) {
-	  pg_map.dump_osd_stats(f.get());
-	}
-	if (what.count("pgs")) {
-	  pg_map.dump_pg_stats(f.get(), false);
-	}
-	if (what.count("pgs_brief")) {
-	  pg_map.dump_pg_stats(f.get(), true);
-	}
-	if (what.count("delta")) {
-	  f->open_object_section("delta");
-	  pg_map.dump_delta(f.get());
-	  f->close_section();
-	}
-      }
-      f->flush(ds);
-    } else {
-      if (what.count("all")) {
-	pg_map.dump(ds);
-      } else if (what.count("summary") || what.count("sum")) {
-	pg_map.dump_basic(ds);
-	pg_map.dump_pg_sum_stats(ds, true);
-	pg_map.dump_osd_sum_stats(ds);
-      } else {
-	if (what.count("pgs_brief")) {
-	  pg_map.dump_pg_stats(ds, true);
-	}
-	bool header = true;
-	if (what.count("pgs")) {
-	  pg_map.dump_pg_stats(ds, false);
-	  header = false;
-	}
-	if (what.count("pools")) {
-	  pg_map.dump_pool_stats(ds, header);
-	}
-	if (what.count("osds")) {
-	  pg_map.dump_osd_stats(ds);
-	}
-      }
-    }
     ss << "dumped " << what << " in format " << format;
+    if (aggregator) {
+      // format it off our lock, from the copy, once that has caught up
+      // with what we have committed
+      string rs;
+      getline(ss, rs);
+      Monitor *m = mon;
+      aggregator->queue_read(
+	[m, op, what, format, rs](const PGMap& pg_map) {
+	  boost::scoped_ptr<Formatter> f(Formatter::create(format));
+	  stringstream ds;
+	  dump_pg_map(pg_map, what, f.get(), ds);
+	  bufferlist rdata;
+	  rdata.append(ds);
+	  Mutex::Locker l(m->lock);
+	  if (!m->is_shutdown())
+	    m->reply_command(op, 0, rs, rdata, pg_map.version);
+	});
+      return true;
+    }
+    dump_pg_map(pg_map, what, f.get(), ds);
     r = 0;
   } else if (prefix == "pg ls") {
     int64_t osd = -1;
@@ -2241,7 +2306,13 @@ void PGMonitor::get_health(list<pair<health_status_t,string> >& summary,
       }
     }
   } else {
-    pg_map.get_stuck_counts(cutoff, note);
+    PGStatAggregator::SnapshotRef snap;
+    if (aggregator)
+      snap = aggregator->get_snapshot();
+    if (snap)
+      snap->get_stuck_counts(cutoff, note);
+    else
+      pg_map.get_stuck_counts(cutoff, note);
     map<string,int>::const_iterator p = note.find("stuck inactive");
     if (p != note.end()) 
       num_inactive_pgs += p->second;
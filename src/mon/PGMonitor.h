@@ -25,6 +25,7 @@
 using namespace std;
 
 #include "PGMap.h"
+#include "PGStatAggregator.h"
 #include "PaxosService.h"
 #include "include/types.h"
 #include "include/utime.h"
@@ -50,6 +51,9 @@ public:
 private:
   PGMap::Incremental pending_inc;
 
+  /// with mon_pg_stat_background: pg_map, again, for reads off our lock
+  std::unique_ptr<PGStatAggregator> aggregator;
+
   const char *pgmap_meta_prefix;
   const char *pgmap_pg_prefix;
   const char *pgmap_osd_prefix;
@@ -177,6 +181,8 @@ public:
     s.insert(pgmap_osd_prefix);
   }
 
+  virtual void init();
+  virtual void on_shutdown();
   virtual void on_restart();
 
   /* Courtesy function provided by PaxosService, called when an election
@@ -0,0 +1,106 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <algorithm>
+
+#include "mon/PGStatAggregator.h"
+
+#define dout_subsys ceph_subsys_mon
+#undef dout_prefix
+#define dout_prefix *_dout << "mon.pgstat_aggregator "
+
+PGStatAggregator::Snapshot::Snapshot(const PGMap& m)
+  : version(m.version)
+{
+  for (ceph::unordered_map<pg_t,pg_stat_t>::const_iterator p =
+	 m.pg_stat.begin();
+       p != m.pg_stat.end();
+       ++p) {
+    utime_t since;
+    int type = PGMap::get_stuck_type(p->second, &since);
+    if (type)
+      stuck_since[type].push_back(since);
+  }
+  for (map<int, vector<utime_t> >::iterator p = stuck_since.begin();
+       p != stuck_since.end();
+       ++p)
+    std::sort(p->second.begin(), p->second.end());
+}
+
+bool PGStatAggregator::Snapshot::get_stuck_counts(
+  utime_t cutoff, map<string,int>& note) const
+{
+  static const pair<int, const char *> names[] = {
+    make_pair(PGMap::STUCK_INACTIVE, "stuck inactive"),
+    make_pair(PGMap::STUCK_UNCLEAN, "stuck unclean"),
+    make_pair(PGMap::STUCK_UNDERSIZED, "stuck undersized"),
+    make_pair(PGMap::STUCK_DEGRADED, "stuck degraded"),
+    make_pair(PGMap::STUCK_STALE, "stuck stale"),
+  };
+  bool any = false;
+  for (unsigned i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+    map<int, vector<utime_t> >::const_iterator p =
+      stuck_since.find(names[i].first);
+    if (p == stuck_since.end())
+      continue;
+    int n = std::lower_bound(p->second.begin(), p->second.end(), cutoff) -
+      p->second.begin();
+    if (n) {
+      note[names[i].second] = n;
+      any = true;
+    }
+  }
+  return any;
+}
+
+PGStatAggregator::PGStatAggregator(CephContext *cct)
+  : cct(cct),
+    finisher(cct, "PGStatAggregator", "mon_pgstat")
+{
+}
+
+void PGStatAggregator::start()
+{
+  finisher.start();
+}
+
+void PGStatAggregator::stop()
+{
+  finisher.wait_for_empty();
+  finisher.stop();
+}
+
+void PGStatAggregator::_apply(std::function<void(PGMap&)>& f)
+{
+  f(pg_map);
+  if (num_queued.dec() == 0) {
+    SnapshotRef s(new Snapshot(pg_map));
+    ldout(cct, 20) << __func__ << " published v" << s->version << dendl;
+    std::atomic_store(&snapshot, s);
+  }
+}
+
+void PGStatAggregator::queue_update(std::function<void(PGMap&)>&& f)
+{
+  num_queued.inc();
+  finisher.queue(new C_Update(this, std::move(f)));
+}
+
+void PGStatAggregator::reset(const PGMap& m)
+{
+  queue_update([m](PGMap& dst) mutable { dst = std::move(m); });
+}
+
+void PGStatAggregator::queue_read(std::function<void(const PGMap&)>&& f)
+{
+  finisher.queue(new C_Read(this, std::move(f)));
+}
@@ -0,0 +1,98 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MON_PGSTATAGGREGATOR_H
+#define CEPH_MON_PGSTATAGGREGATOR_H
+
+#include <functional>
+#include <memory>
+
+#include "common/Finisher.h"
+#include "include/atomic.h"
+#include "mon/PGMap.h"
+
+/**
+ * a copy of the PGMap, kept current off the monitor lock
+ *
+ * PGMonitor queues each change it makes to its PGMap here too.  Our
+ * thread applies them to the copy in order, and runs the reads queued
+ * between them against it, so a pg dump sees exactly the versions
+ * committed before it was asked for without holding up paxos while it
+ * is formatted.  Once the queue of updates drains we also publish a
+ * Snapshot of what ceph -s would otherwise walk every pg for.
+ */
+class PGStatAggregator {
+public:
+  /// what ceph -s needs from one version of the map; never changes
+  struct Snapshot {
+    version_t version;
+    /// PGMap::STUCK_* -> since when each pg has been in it, sorted
+    map<int, vector<utime_t> > stuck_since;
+
+    Snapshot() : version(0) {}
+    explicit Snapshot(const PGMap& m);
+
+    /// as PGMap::get_stuck_counts(), in log time
+    bool get_stuck_counts(utime_t cutoff, map<string,int>& note) const;
+  };
+  typedef std::shared_ptr<const Snapshot> SnapshotRef;
+
+private:
+  CephContext *cct;
+  Finisher finisher;
+  PGMap pg_map;         ///< only touched by finisher
+  atomic_t num_queued;  ///< updates queued and not applied yet
+  SnapshotRef snapshot; ///< atomic_load/atomic_store only
+
+  struct C_Update : public Context {
+    PGStatAggregator *agg;
+    std::function<void(PGMap&)> f;
+    C_Update(PGStatAggregator *a, std::function<void(PGMap&)>&& f)
+      : agg(a), f(std::move(f)) {}
+    void finish(int r) {
+      agg->_apply(f);
+    }
+  };
+  struct C_Read : public Context {
+    PGStatAggregator *agg;
+    std::function<void(const PGMap&)> f;
+    C_Read(PGStatAggregator *a, std::function<void(const PGMap&)>&& f)
+      : agg(a), f(std::move(f)) {}
+    void finish(int r) {
+      f(agg->pg_map);
+    }
+  };
+
+  void _apply(std::function<void(PGMap&)>& f);
+
+public:
+  explicit PGStatAggregator(CephContext *cct);
+
+  void start();
+  /// finish what is queued and stop
+  void stop();
+
+  /// apply f to the copy, after everything queued before it
+  void queue_update(std::function<void(PGMap&)>&& f);
+  /// make the copy m
+  void reset(const PGMap& m);
+  /// run f against the copy, after every update queued before it
+  void queue_read(std::function<void(const PGMap&)>&& f);
+
+  /// the newest snapshot, or NULL before the first; may trail the map
+  /// by the updates still queued
+  SnapshotRef get_snapshot() const {
+    return std::atomic_load(&snapshot);
+  }
+};
+
+#endif
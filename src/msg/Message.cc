@@ -63,6 +63,7 @@ using namespace std;
 #include "messages/MOSDPing.h"
 #include "messages/MOSDOp.h"
 #include "messages/MOSDOpReply.h"
+#include "messages/MOSDOpBatch.h"
 #include "messages/MOSDSubOp.h"
 #include "messages/MOSDSubOpReply.h"
 #include "messages/MOSDRepOp.h"
@@ -429,6 +430,9 @@ Message *decode_message(CephContext *cct, int crcflags,
   case CEPH_MSG_OSD_OPREPLY:
     m = new MOSDOpReply();
     break;
+  case MSG_OSD_OP_BATCH:
+    m = new MOSDOpBatch();
+    break;
   case MSG_OSD_SUBOP:
     m = new MOSDSubOp();
     break;
@@ -118,6 +118,7 @@
 #define MSG_OSD_REPOPREPLY    113
 #define MSG_OSD_PG_UPDATE_LOG_MISSING  114
 #define MSG_OSD_PG_UPDATE_LOG_MISSING_REPLY  115
+#define MSG_OSD_OP_BATCH      116
 
 
 // *** MDS ***
@@ -16,7 +16,11 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
 #include <unistd.h>
+#if defined(__linux__)
+#include <linux/errqueue.h>
+#endif
 
 #include "include/Context.h"
 #include "common/errno.h"
@@ -179,7 +183,8 @@ AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, EventCente
   : Connection(cct, m), delay_state(NULL), async_msgr(m), logger(p), global_seq(0), connect_seq(0), 
     peer_global_seq(0), out_seq(0), ack_left(0), in_seq(0), state(STATE_NONE), state_after_send(0), sd(-1),
     port(-1), write_lock("AsyncConnection::write_lock"), can_write(WriteStatus::NOWRITE),
-    open_write(false), keepalive(false), lock("AsyncConnection::lock"), recv_buf(NULL),
+    open_write(false), keepalive(false), zerocopy(false), zc_next_seq(0),
+    zc_done_seq(0), lock("AsyncConnection::lock"), recv_buf(NULL),
     recv_max_prefetch(MIN(msgr->cct->_conf->ms_tcp_prefetch_max_size, TCP_PREFETCH_MIN_SIZE)),
     recv_start(0), recv_end(0), got_bad_auth(false), authorizer(NULL), replacing(false),
     is_reset_from_peer(false), once_ready(false), state_buffer(NULL), state_offset(0), net(cct), center(c)
@@ -305,17 +310,27 @@ void AsyncConnection::restore_sigpipe()
 
 // return the length of msg needed to be sent,
 // < 0 means error occured
-ssize_t AsyncConnection::do_sendmsg(struct msghdr &msg, unsigned len, bool more)
+// if zerocopy_calls is set, send with MSG_ZEROCOPY and count the
+// sendmsg calls the kernel accepted (each one gets a completion id)
+ssize_t AsyncConnection::do_sendmsg(struct msghdr &msg, unsigned len, bool more,
+                                    unsigned *zerocopy_calls)
 {
   suppress_sigpipe();
 
+  int flags = more ? MSG_MORE : 0;
+#if defined(MSG_ZEROCOPY)
+  if (zerocopy_calls)
+    flags |= MSG_ZEROCOPY;
+#endif
   while (len > 0) {
     ssize_t r;
 #if defined(MSG_NOSIGNAL)
-    r = ::sendmsg(sd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+    r = ::sendmsg(sd, &msg, MSG_NOSIGNAL | flags);
 #else
-    r = ::sendmsg(sd, &msg, (more ? MSG_MORE : 0));
+    r = ::sendmsg(sd, &msg, flags);
 #endif /* defined(MSG_NOSIGNAL) */
+    if (r >= 0 && zerocopy_calls)
+      ++*zerocopy_calls;
 
     if (r == 0) {
       ldout(async_msgr->cct, 10) << __func__ << " sendmsg got r==0!" << dendl;
@@ -364,10 +379,14 @@ ssize_t AsyncConnection::_try_send(bool more)
     }
   }
 
+  if (zc_next_seq != zc_done_seq)
+    _reap_zerocopy();
+
   uint64_t sent_bytes = 0;
   list<bufferptr>::const_iterator pb = outcoming_bl.buffers().begin();
   uint64_t left_pbrs = outcoming_bl.buffers().size();
   while (left_pbrs) {
+    list<bufferptr>::const_iterator batch_start = pb;
     struct msghdr msg;
     uint64_t size = MIN(left_pbrs, ASYNC_IOV_MAX);
     left_pbrs -= size;
@@ -384,7 +403,21 @@ ssize_t AsyncConnection::_try_send(bool more)
       size--;
     }
 
-    ssize_t r = do_sendmsg(msg, msglen, left_pbrs || more);
+    bool use_zerocopy = zerocopy &&
+      msglen >= async_msgr->cct->_conf->ms_async_zerocopy_min_bytes;
+    unsigned zerocopy_calls = 0;
+    ssize_t r = do_sendmsg(msg, msglen, left_pbrs || more,
+                           use_zerocopy ? &zerocopy_calls : NULL);
+    if (zerocopy_calls) {
+      // hold on to the buffers until the kernel is done with them
+      bufferlist pinned;
+      for (list<bufferptr>::const_iterator i = batch_start; i != pb; ++i)
+        pinned.push_back(*i);
+      zc_next_seq += zerocopy_calls;
+      zc_pending.push_back(make_pair(zc_next_seq - 1, pinned));
+      if (r >= 0)
+        logger->inc(l_msgr_send_zerocopy_bytes, msglen - r);
+    }
     if (r < 0)
       return r;
 
@@ -424,6 +457,70 @@ ssize_t AsyncConnection::_try_send(bool more)
   return outcoming_bl.length();
 }
 
+// drain MSG_ZEROCOPY completions from the socket error queue and release
+// the buffers they cover
+void AsyncConnection::_reap_zerocopy()
+{
+  assert(write_lock.is_locked());
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+  while (zc_next_seq != zc_done_seq) {
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    int r = ::recvmsg(sd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      break;  // nothing more for now
+    }
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+         cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+          !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+        continue;
+      struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cm);
+      if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+      // ids [ee_info, ee_data] are done; tcp completes them in order
+      uint32_t hi = serr->ee_data;
+      ldout(async_msgr->cct, 20) << __func__ << " completed " << serr->ee_info
+                                 << ".." << hi << dendl;
+      if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+        // e.g. loopback, or the device can't do scatter/gather; zerocopy
+        // only costs us here
+        logger->inc(l_msgr_send_zerocopy_copied);
+        if (zerocopy &&
+            !async_msgr->cct->_conf->ms_async_zerocopy_debug_keep_copied) {
+          ldout(async_msgr->cct, 10) << __func__ << " kernel copied zerocopy"
+                                     << " data, disabling zerocopy" << dendl;
+          zerocopy = false;
+        }
+      }
+      while (!zc_pending.empty() &&
+             (int32_t)(zc_pending.front().first - hi) <= 0)
+        zc_pending.pop_front();
+      zc_done_seq = hi + 1;
+    }
+  }
+#else
+  zc_done_seq = zc_next_seq;
+#endif
+}
+
+// forget in-flight zerocopy state for the old socket (buffers the
+// kernel still references stay alive in the kernel) and set up the new one
+void AsyncConnection::_reset_zerocopy(bool enable)
+{
+  assert(write_lock.is_locked());
+  zc_pending.clear();
+  zc_next_seq = zc_done_seq = 0;
+  zerocopy = false;
+  if (enable && async_msgr->cct->_conf->ms_async_zerocopy_min_bytes)
+    zerocopy = net.set_zerocopy(sd) == 0;
+}
+
 // Because this func will be called multi times to populate
 // the needed buffer, so the passed in bufferptr must be the same.
 // Normally, only "read_message" will pass existing bufferptr in
@@ -521,6 +618,12 @@ void AsyncConnection::process()
   int prev_state = state;
   bool already_dispatch_writer = false;
   Mutex::Locker l(lock);
+  if (async_msgr->cct->_conf->ms_async_zerocopy_min_bytes) {
+    // EPOLLERR stays raised until completions are drained
+    Mutex::Locker wl(write_lock);
+    if (zc_next_seq != zc_done_seq)
+      _reap_zerocopy();
+  }
   do {
     ldout(async_msgr->cct, 20) << __func__ << " prev state is " << get_state_name(prev_state) << dendl;
     prev_state = state;
@@ -1063,6 +1166,9 @@ ssize_t AsyncConnection::_process_connection()
         if (sd < 0) {
           goto fail;
         }
+        write_lock.Lock();
+        _reset_zerocopy(true);
+        write_lock.Unlock();
 
         center->create_file_event(sd, EVENT_READABLE, read_handler);
         state = STATE_CONNECTING_RE;
@@ -1389,6 +1495,9 @@ ssize_t AsyncConnection::_process_connection()
           goto fail;
 
         net.set_socket_options(sd);
+        write_lock.Lock();
+        _reset_zerocopy(true);
+        write_lock.Unlock();
 
         bl.append(CEPH_BANNER, strlen(CEPH_BANNER));
 
@@ -1864,6 +1973,9 @@ ssize_t AsyncConnection::handle_connect_msg(ceph_msg_connect &connect, bufferlis
     existing->requeue_sent();
 
     swap(existing->sd, sd);
+    // completions for zerocopy sends on the old socket won't show up on
+    // the new one; our own state goes away with _stop() below
+    existing->_reset_zerocopy(true);
     existing->can_write = WriteStatus::NOWRITE;
     existing->open_write = false;
     existing->replacing = true;
@@ -2170,6 +2282,7 @@ void AsyncConnection::fault()
     center->delete_file_event(sd, EVENT_READABLE|EVENT_WRITABLE);
     ::close(sd);
     sd = -1;
+    _reset_zerocopy(false);
   }
   can_write = WriteStatus::NOWRITE;
   open_write = false;
@@ -2280,6 +2393,7 @@ void AsyncConnection::_stop()
     ::close(sd);
   }
   sd = -1;
+  _reset_zerocopy(false);
   for (set<uint64_t>::iterator it = register_time_events.begin();
        it != register_time_events.end(); ++it)
     center->delete_time_event(*it);
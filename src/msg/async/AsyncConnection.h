@@ -51,7 +51,10 @@ class AsyncConnection : public Connection {
   ssize_t read_bulk(int fd, char *buf, unsigned len);
   void suppress_sigpipe();
   void restore_sigpipe();
-  ssize_t do_sendmsg(struct msghdr &msg, unsigned len, bool more);
+  ssize_t do_sendmsg(struct msghdr &msg, unsigned len, bool more,
+                     unsigned *zerocopy_calls = NULL);
+  void _reap_zerocopy();
+  void _reset_zerocopy(bool enable);
   ssize_t try_send(bufferlist &bl, bool more=false) {
     Mutex::Locker l(write_lock);
     outcoming_bl.claim_append(bl);
@@ -300,6 +303,14 @@ class AsyncConnection : public Connection {
   bufferlist outcoming_bl;
   bool keepalive;
 
+  // MSG_ZEROCOPY sends keep their buffers pinned until the kernel reports
+  // (on the socket error queue) that it is done with them.  protected by
+  // write_lock.
+  bool zerocopy;           ///< SO_ZEROCOPY is enabled on sd
+  uint32_t zc_next_seq;    ///< kernel's id for our next zerocopy sendmsg
+  uint32_t zc_done_seq;    ///< all ids before this one have completed
+  deque<pair<uint32_t, bufferlist> > zc_pending;  ///< last id -> buffers
+
   Mutex lock;
   utime_t backoff;         // backoff time
   EventCallbackRef read_handler;
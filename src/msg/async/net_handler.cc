@@ -102,6 +102,21 @@ void NetHandler::set_socket_options(int sd)
 #endif
 }
 
+int NetHandler::set_zerocopy(int sd)
+{
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+  int val = 1;
+  int r = ::setsockopt(sd, SOL_SOCKET, SO_ZEROCOPY, (void*)&val, sizeof(val));
+  if (r < 0) {
+    r = -errno;
+    ldout(cct, 1) << "couldn't set SO_ZEROCOPY: " << cpp_strerror(r) << dendl;
+  }
+  return r;
+#else
+  return -EOPNOTSUPP;
+#endif
+}
+
 int NetHandler::generic_connect(const entity_addr_t& addr, bool nonblock)
 {
   int ret;
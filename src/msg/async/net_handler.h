@@ -29,6 +29,8 @@ namespace ceph {
     explicit NetHandler(CephContext *c): cct(c) {}
     int set_nonblock(int sd);
     void set_socket_options(int sd);
+    /// enable MSG_ZEROCOPY sends on @sd; 0 on success
+    int set_zerocopy(int sd);
     int connect(const entity_addr_t &addr);
     
     /**
@@ -1845,10 +1845,14 @@ void Pipe::writer()
 	blist.append(m->get_middle());
 	blist.append(m->get_data());
 
+	// let a burst of queued messages (e.g. a batch of ops from the
+	// Objecter) go out in as few segments as possible
+	bool more = !out_q.empty();
+
         pipe_lock.Unlock();
 
         ldout(msgr->cct,20) << "writer sending " << m->get_seq() << " " << m << dendl;
-	int rc = write_message(header, footer, blist);
+	int rc = write_message(header, footer, blist, more);
 
 	pipe_lock.Lock();
 	if (rc < 0) {
@@ -2331,7 +2335,8 @@ int Pipe::write_keepalive2(char tag, const utime_t& t)
 }
 
 
-int Pipe::write_message(const ceph_msg_header& header, const ceph_msg_footer& footer, bufferlist& blist)
+int Pipe::write_message(const ceph_msg_header& header, const ceph_msg_footer& footer,
+			bufferlist& blist, bool more)
 {
   int ret;
 
@@ -2444,7 +2449,7 @@ int Pipe::write_message(const ceph_msg_header& header, const ceph_msg_footer& fo
   }
 
   // send
-  if (do_sendmsg(&msg, msglen))
+  if (do_sendmsg(&msg, msglen, more))
     goto fail;
 
   ret = 0;
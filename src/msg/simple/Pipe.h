@@ -234,7 +234,9 @@ static const int SM_IOV_MAX = (IOV_MAX >= 1024 ? IOV_MAX / 4 : IOV_MAX);
 
     int read_message(Message **pm,
 		     AuthSessionHandler *session_security_copy);
-    int write_message(const ceph_msg_header& h, const ceph_msg_footer& f, bufferlist& body);
+    /// write one message; more means another one follows right away
+    int write_message(const ceph_msg_header& h, const ceph_msg_footer& f,
+		      bufferlist& body, bool more);
     /**
      * Write the given data (of length len) to the Pipe's socket. This function
      * will loop until all passed data has been written out.
@@ -69,6 +69,7 @@ struct IOContext {
 
 
 class BlockDevice {
+protected:
   std::mutex ioc_reap_lock;
   vector<IOContext*> ioc_reap_queue;
   std::atomic_int ioc_reap_count = {0};
@@ -14,6 +14,7 @@
 
 #include <unistd.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -614,6 +615,188 @@ int BlueStore::OnodeHashLRU::_trim(int max)
   return trimmed;
 }
 
+// BufferCache
+
+#undef dout_prefix
+#define dout_prefix *_dout << "bluestore.buffercache(" << this << ") "
+
+void BlueStore::BufferCache::_rm(map<uint64_t,Buffer*>& m,
+				 map<uint64_t,Buffer*>::iterator q)
+{
+  Buffer *b = q->second;
+  dout(30) << __func__ << " nid " << b->nid << " " << b->offset << "~"
+	   << b->length() << dendl;
+  size -= b->length();
+  logger->dec(l_bluestore_buffers);
+  logger->dec(l_bluestore_buffer_bytes, b->length());
+  lru.erase(lru.iterator_to(*b));
+  m.erase(q);
+  delete b;
+}
+
+void BlueStore::BufferCache::_add(uint64_t nid, uint64_t offset,
+				  const bufferlist& bl)
+{
+  dout(30) << __func__ << " nid " << nid << " " << offset << "~"
+	   << bl.length() << dendl;
+  Buffer *b = new Buffer(nid, offset, bl);
+  buffer_map[nid][offset] = b;
+  lru.push_front(*b);
+  size += b->length();
+  logger->inc(l_bluestore_buffers);
+  logger->inc(l_bluestore_buffer_bytes, b->length());
+}
+
+void BlueStore::BufferCache::_discard(uint64_t nid, uint64_t offset,
+				      uint64_t length)
+{
+  auto p = buffer_map.find(nid);
+  if (p == buffer_map.end())
+    return;
+  map<uint64_t,Buffer*>& m = p->second;
+  uint64_t end = offset + length;
+  auto q = m.lower_bound(offset);
+  if (q != m.begin()) {
+    --q;
+    if (q->second->end() <= offset)
+      ++q;
+  }
+  while (q != m.end() && q->first < end) {
+    Buffer *b = q->second;
+    dout(30) << __func__ << " nid " << nid << " " << offset << "~" << length
+	     << " overlaps " << b->offset << "~" << b->length() << dendl;
+    bufferlist head, tail;
+    if (b->offset < offset) {
+      head.substr_of(b->data, 0, offset - b->offset);
+    }
+    if (b->end() > end) {
+      tail.substr_of(b->data, end - b->offset, b->end() - end);
+    }
+    uint64_t b_off = b->offset;
+    _rm(m, q++);
+    if (head.length()) {
+      _add(nid, b_off, head);
+    }
+    if (tail.length()) {
+      _add(nid, end, tail);
+      break;
+    }
+  }
+  if (m.empty()) {
+    buffer_map.erase(p);
+  }
+}
+
+void BlueStore::BufferCache::add(uint64_t nid, uint64_t offset,
+				 const bufferlist& bl)
+{
+  std::lock_guard<std::mutex> l(lock);
+  if (max_size == 0 || nid == 0 || bl.length() == 0)
+    return;
+  _discard(nid, offset, bl.length());
+  _add(nid, offset, bl);
+  _trim(max_size);
+}
+
+void BlueStore::BufferCache::write(uint64_t nid, uint64_t offset,
+				   const bufferlist& bl)
+{
+  std::lock_guard<std::mutex> l(lock);
+  _discard(nid, offset, bl.length());
+  if (max_size == 0 || nid == 0 ||
+      bl.length() == 0 || bl.length() > max_size)
+    return;
+  // take a private copy so that we don't pin the (possibly much
+  // larger) buffers the caller's data lives in.
+  bufferlist t = bl;
+  t.rebuild();
+  _add(nid, offset, t);
+  _trim(max_size);
+}
+
+void BlueStore::BufferCache::discard(uint64_t nid, uint64_t offset,
+				     uint64_t length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(20) << __func__ << " nid " << nid << " " << offset << "~" << length
+	   << dendl;
+  _discard(nid, offset, length);
+}
+
+bool BlueStore::BufferCache::read(uint64_t nid, uint64_t offset,
+				  uint64_t length, bufferlist *bl)
+{
+  std::lock_guard<std::mutex> l(lock);
+  auto p = buffer_map.find(nid);
+  if (p == buffer_map.end())
+    return false;
+  auto q = p->second.upper_bound(offset);
+  if (q == p->second.begin())
+    return false;
+  --q;
+  bufferlist t;
+  uint64_t end = offset + length;
+  uint64_t pos = offset;
+  vector<Buffer*> hit;
+  while (pos < end) {
+    if (q == p->second.end() ||
+	q->first > pos ||
+	q->second->end() <= pos) {
+      dout(30) << __func__ << " nid " << nid << " " << offset << "~" << length
+	       << " miss at " << pos << dendl;
+      return false;
+    }
+    Buffer *b = q->second;
+    uint64_t x_off = pos - b->offset;
+    uint64_t x_len = MIN(b->end(), end) - pos;
+    bufferlist u;
+    u.substr_of(b->data, x_off, x_len);
+    t.claim_append(u);
+    hit.push_back(b);
+    pos += x_len;
+    ++q;
+  }
+  for (auto b : hit) {
+    lru.erase(lru.iterator_to(*b));
+    lru.push_front(*b);
+  }
+  dout(30) << __func__ << " nid " << nid << " " << offset << "~" << length
+	   << " hit" << dendl;
+  bl->claim_append(t);
+  return true;
+}
+
+void BlueStore::BufferCache::clear()
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << dendl;
+  _trim(0);
+  assert(buffer_map.empty());
+}
+
+void BlueStore::BufferCache::trim(uint64_t max)
+{
+  std::lock_guard<std::mutex> l(lock);
+  _trim(max);
+}
+
+void BlueStore::BufferCache::_trim(uint64_t max)
+{
+  dout(20) << __func__ << " max " << max << " size " << size << dendl;
+  while (size > max) {
+    assert(!lru.empty());
+    Buffer *b = &lru.back();
+    auto p = buffer_map.find(b->nid);
+    assert(p != buffer_map.end());
+    auto q = p->second.find(b->offset);
+    assert(q != p->second.end());
+    _rm(p->second, q);
+    if (p->second.empty()) {
+      buffer_map.erase(p);
+    }
+  }
+}
+
 // =======================================================
 
 // Collection
@@ -627,7 +810,8 @@ BlueStore::Collection::Collection(BlueStore *ns, coll_t c)
     lock("BlueStore::Collection::lock", true, false),
     exists(true),
     enode_set(g_conf->bluestore_onode_map_size),
-    onode_map(g_conf->bluestore_onode_map_size)
+    onode_map(g_conf->bluestore_onode_map_size),
+    buffer_cache(ns->logger, g_conf->bluestore_buffer_cache_size)
 {
 }
 
@@ -744,6 +928,9 @@ BlueStore::BlueStore(CephContext *cct, const string& path)
     path_fd(-1),
     fsid_fd(-1),
     mounted(false),
+    csum_type(bluestore_extent_t::CSUM_NONE),
+    comp_mode(COMP_NONE),
+    comp_alg(bluestore_extent_t::COMP_ALG_NONE),
     coll_lock("BlueStore::coll_lock"),
     nid_last(0),
     nid_max(0),
@@ -765,16 +952,31 @@ BlueStore::BlueStore(CephContext *cct, const string& path)
 	     cct->_conf->bluestore_wal_thread_timeout,
 	     cct->_conf->bluestore_wal_thread_suicide_timeout,
 	     &wal_tp),
-    finisher(cct),
+    wal_batch_thread(this),
+    wal_batch_stop(false),
+    wal_batch_queue_bytes(0),
+    wal_batch_queued_seq(0),
+    wal_batch_applied_seq(0),
     kv_sync_thread(this),
     kv_stop(false),
+    kv_finalize_thread(this),
+    kv_finalize_stop(false),
+    kv_finalize_in_progress(false),
     logger(NULL)
 {
   _init_logger();
+  int n = MAX(1, cct->_conf->bluestore_finisher_shards);
+  for (int i = 0; i < n; ++i) {
+    finishers.push_back(new Finisher(cct));
+  }
 }
 
 BlueStore::~BlueStore()
 {
+  for (auto f : finishers) {
+    delete f;
+  }
+  finishers.clear();
   _shutdown_logger();
   assert(!mounted);
   assert(db == NULL);
@@ -799,6 +1001,20 @@ void BlueStore::_init_logger()
   b.add_time_avg(l_bluestore_state_wal_done_lat, "state_wal_done_lat", "Average wal_done state latency");
   b.add_time_avg(l_bluestore_state_finishing_lat, "state_finishing_lat", "Average finishing state latency");
   b.add_time_avg(l_bluestore_state_done_lat, "state_done_lat", "Average done state latency");
+  b.add_u64(l_bluestore_buffers, "buffers", "Number of cached buffers");
+  b.add_u64(l_bluestore_buffer_bytes, "buffer_bytes", "Bytes of cached object data");
+  b.add_u64_counter(l_bluestore_buffer_hit_bytes, "buffer_hit_bytes", "Bytes read from the buffer cache");
+  b.add_u64_counter(l_bluestore_buffer_miss_bytes, "buffer_miss_bytes", "Bytes read from the device that missed the buffer cache");
+  b.add_u64_counter(l_bluestore_compress_success_count, "compress_success_count", "Extents stored compressed");
+  b.add_u64_counter(l_bluestore_compress_rejected_count, "compress_rejected_count", "Extents stored uncompressed because they did not compress well enough");
+  b.add_u64_counter(l_bluestore_compressed_bytes, "compressed_bytes", "Bytes allocated for compressed extents");
+  b.add_u64_counter(l_bluestore_compressed_original_bytes, "compressed_original_bytes", "Logical bytes stored in compressed extents");
+  b.add_u64_avg(l_bluestore_kv_commit_batch, "kv_commit_batch", "Average number of txcs committed per kv sync");
+  b.add_time_avg(l_bluestore_kv_sync_lat, "kv_sync_lat", "Average kv sync latency");
+  b.add_time_avg(l_bluestore_kv_finalize_lat, "kv_finalize_lat", "Average time to complete a committed batch");
+  b.add_u64_avg(l_bluestore_wal_batch_txc, "wal_batch_txc", "Average number of wal txcs applied per batch");
+  b.add_u64_counter(l_bluestore_wal_batch_ios, "wal_batch_ios", "Device writes issued for batched wal txcs");
+  b.add_u64_counter(l_bluestore_wal_batch_bytes, "wal_batch_bytes", "Bytes written for batched wal txcs");
   logger = b.create_perf_counters();
   g_ceph_context->get_perfcounters_collection()->add(logger);
 }
@@ -1898,6 +2114,49 @@ int BlueStore::mount()
     }
   }
 
+  {
+    int t = bluestore_extent_t::get_csum_string_type(
+      g_conf->bluestore_csum_type);
+    if (t < 0) {
+      derr << __func__ << " unrecognized bluestore_csum_type '"
+	   << g_conf->bluestore_csum_type << "'" << dendl;
+      return -EINVAL;
+    }
+    csum_type = t;
+  }
+
+  {
+    const string& m = g_conf->bluestore_compression;
+    if (m == "none") {
+      comp_mode = COMP_NONE;
+    } else if (m == "passive") {
+      comp_mode = COMP_PASSIVE;
+    } else if (m == "aggressive") {
+      comp_mode = COMP_AGGRESSIVE;
+    } else if (m == "force") {
+      comp_mode = COMP_FORCE;
+    } else {
+      derr << __func__ << " unrecognized bluestore_compression '" << m << "'"
+	   << dendl;
+      return -EINVAL;
+    }
+    int t = bluestore_extent_t::get_comp_alg_type(
+      g_conf->bluestore_compression_algorithm);
+    if (t < 0) {
+      derr << __func__ << " unrecognized bluestore_compression_algorithm '"
+	   << g_conf->bluestore_compression_algorithm << "'" << dendl;
+      return -EINVAL;
+    }
+    comp_alg = t;
+    if (comp_alg == bluestore_extent_t::COMP_ALG_NONE) {
+      comp_mode = COMP_NONE;
+    } else if (comp_mode != COMP_NONE && !_get_compressor(comp_alg)) {
+      derr << __func__ << " unable to load compressor '"
+	   << g_conf->bluestore_compression_algorithm << "'" << dendl;
+      return -EINVAL;
+    }
+  }
+
   if (g_conf->bluestore_fsck_on_mount) {
     int rc = fsck();
     if (rc < 0)
@@ -1953,9 +2212,13 @@ int BlueStore::mount()
       goto out_coll;
   }
 
-  finisher.start();
+  for (auto f : finishers) {
+    f->start();
+  }
   wal_tp.start();
+  wal_batch_thread.create("bstore_wal_batch");
   kv_sync_thread.create("bstore_kv_sync");
+  kv_finalize_thread.create("bstore_kv_final");
 
   r = _wal_replay();
   if (r < 0)
@@ -1968,8 +2231,10 @@ int BlueStore::mount()
   _kv_stop();
   wal_wq.drain();
   wal_tp.stop();
-  finisher.wait_for_empty();
-  finisher.stop();
+  for (auto f : finishers) {
+    f->wait_for_empty();
+    f->stop();
+  }
  out_coll:
   coll_map.clear();
  out_alloc:
@@ -2002,10 +2267,14 @@ int BlueStore::umount()
   wal_wq.drain();
   dout(20) << __func__ << " stopping wal_tp" << dendl;
   wal_tp.stop();
-  dout(20) << __func__ << " draining finisher" << dendl;
-  finisher.wait_for_empty();
-  dout(20) << __func__ << " stopping finisher" << dendl;
-  finisher.stop();
+  dout(20) << __func__ << " draining finishers" << dendl;
+  for (auto f : finishers) {
+    f->wait_for_empty();
+  }
+  dout(20) << __func__ << " stopping finishers" << dendl;
+  for (auto f : finishers) {
+    f->stop();
+  }
   dout(20) << __func__ << " closing" << dendl;
 
   mounted = false;
@@ -2039,7 +2308,7 @@ int BlueStore::_verify_enode_shared(
   dout(10) << __func__ << " hash " << enode->hash << " v " << v << dendl;
   for (auto& p : v) {
     interval_set<uint64_t> t, i;
-    t.insert(p.offset, p.length);
+    t.insert(p.offset, p.get_disk_length());
     i.intersection_of(t, span);
     t.subtract(i);
     dout(20) << __func__ << "  extent " << p << " t " << t << " i " << i
@@ -2176,14 +2445,15 @@ int BlueStore::fsck()
 	  if (b.second.has_flag(bluestore_extent_t::FLAG_SHARED)) {
 	    hash_shared.push_back(b.second);
 	  } else {
-	    if (used_blocks.intersects(b.second.offset, b.second.length)) {
+	    uint64_t disk_length = b.second.get_disk_length();
+	    if (used_blocks.intersects(b.second.offset, disk_length)) {
 	      derr << " " << oid << " extent " << b.first << ": " << b.second
 		   << " already allocated" << dendl;
 	      ++errors;
 	      continue;
 	    }
-	    used_blocks.insert(b.second.offset, b.second.length);
-	    if (b.second.end() > bdev->get_size()) {
+	    used_blocks.insert(b.second.offset, disk_length);
+	    if (b.second.offset + disk_length > bdev->get_size()) {
 	      derr << " " << oid << " extent " << b.first << ": " << b.second
 		   << " past end of block device" << dendl;
 	      ++errors;
@@ -2478,11 +2748,22 @@ void BlueStore::_sync()
   // flush aios in flight
   bdev->flush();
 
-  std::unique_lock<std::mutex> l(kv_lock);
-  while (!kv_committing.empty() ||
-	 !kv_queue.empty()) {
-    dout(20) << " waiting for kv to commit" << dendl;
-    kv_sync_cond.wait(l);
+  {
+    std::unique_lock<std::mutex> l(kv_lock);
+    while (!kv_committing.empty() ||
+	   !kv_queue.empty()) {
+      dout(20) << " waiting for kv to commit" << dendl;
+      kv_sync_cond.wait(l);
+    }
+  }
+  {
+    std::unique_lock<std::mutex> l(kv_finalize_lock);
+    while (kv_finalize_in_progress ||
+	   !kv_committed_to_finalize.empty() ||
+	   !wal_cleaned_to_finalize.empty()) {
+      dout(20) << " waiting for kv commits to finalize" << dendl;
+      kv_finalize_cond.wait(l);
+    }
   }
 
   dout(10) << __func__ << " done" << dendl;
@@ -2665,7 +2946,7 @@ int BlueStore::read(
   if (offset == length && offset == 0)
     length = o->onode.size;
 
-  r = _do_read(o, offset, length, bl, op_flags);
+  r = _do_read(c, o, offset, length, bl, op_flags);
 
  out:
   dout(10) << __func__ << " " << cid << " " << oid
@@ -2675,6 +2956,7 @@ int BlueStore::read(
 }
 
 int BlueStore::_do_read(
+    Collection *c,
     OnodeRef o,
     uint64_t offset,
     size_t length,
@@ -2700,6 +2982,11 @@ int BlueStore::_do_read(
     buffered = true;
   }
 
+  // populate our own buffer cache unless we are told not to.
+  bool cache = (op_flags & (CEPH_OSD_OP_FLAG_FADVISE_DONTNEED |
+			    CEPH_OSD_OP_FLAG_FADVISE_NOCACHE)) == 0;
+  uint64_t readahead = g_conf->bluestore_buffer_cache_readahead;
+
   dout(20) << __func__ << " " << offset << "~" << length << " size "
 	   << o->onode.size << dendl;
   bl.clear();
@@ -2779,17 +3066,87 @@ int BlueStore::_do_read(
 	       << " use " << x_off << "~" << x_len
 	       << " final offset " << x_off + bp->second.offset
 	       << dendl;
-      uint64_t front_extra = x_off % block_size;
-      uint64_t r_off = x_off - front_extra;
-      uint64_t r_len = ROUND_UP_TO(x_len + front_extra, block_size);
-      dout(30) << __func__ << "  reading " << r_off << "~" << r_len << dendl;
+      bufferlist u;
+      if (c->buffer_cache.read(o->onode.nid, offset, x_len, &u)) {
+	dout(30) << __func__ << "  cached " << offset << "~" << x_len << dendl;
+	logger->inc(l_bluestore_buffer_hit_bytes, x_len);
+	bl.claim_append(u);
+	offset += x_len;
+	length -= x_len;
+	if (x_off + x_len == bp->second.length) {
+	  ++bp;
+	}
+	continue;
+      }
+      logger->inc(l_bluestore_buffer_miss_bytes, x_len);
+      // cache data from the start of the read up to the end of the
+      // extent, eof, or the next overlay, whichever comes first.
+      uint64_t c_end = MIN(bp->first + bp->second.length, o->onode.size);
+      if (op != oend && op->first < c_end) {
+	c_end = op->first;
+      }
+      uint64_t front_extra, r_off, r_len;
       bufferlist t;
-      r = bdev->read(r_off + bp->second.offset, r_len, &t, &ioc, buffered);
-      if (r < 0) {
-	goto out;
+      if (bp->second.has_flag(bluestore_extent_t::FLAG_COMPRESSED)) {
+	// we have to read (and inflate) the whole thing
+	r = _read_compressed_extent(bp->second, &t, &ioc, buffered);
+	if (r < 0) {
+	  derr << __func__ << " " << o->oid << " failed to read compressed "
+	       << "extent " << bp->first << ": " << bp->second << ": "
+	       << cpp_strerror(r) << dendl;
+	  goto out;
+	}
+	front_extra = x_off;
+	r_off = 0;
+	r_len = t.length();
+      } else {
+	front_extra = x_off % block_size;
+	r_off = x_off - front_extra;
+	r_len = ROUND_UP_TO(x_len + front_extra, block_size);
+	if (cache && readahead && r_len < readahead) {
+	  r_len = MIN(ROUND_UP_TO(readahead, block_size),
+		      ROUND_UP_TO(c_end - bp->first, block_size) - r_off);
+	}
+	if (bp->second.has_flag(bluestore_extent_t::FLAG_CSUM)) {
+	  // read whole checksum chunks so that we can verify them
+	  uint64_t chunk_size = MAX(bp->second.get_csum_chunk_size(),
+				    block_size);
+	  uint64_t v_off = r_off - r_off % chunk_size;
+	  uint64_t v_end = MIN(ROUND_UP_TO(r_off + r_len, chunk_size),
+			       MIN(bp->second.length,
+				   ROUND_UP_TO(o->onode.size - bp->first,
+					       block_size)));
+	  front_extra += r_off - v_off;
+	  r_len = MAX(r_off + r_len, v_end) - v_off;
+	  r_off = v_off;
+	}
+	dout(30) << __func__ << "  reading " << r_off << "~" << r_len << dendl;
+	r = bdev->read(r_off + bp->second.offset, r_len, &t, &ioc, buffered);
+	if (r < 0) {
+	  goto out;
+	}
+      }
+      if (bp->second.has_flag(bluestore_extent_t::FLAG_CSUM)) {
+	uint64_t bad;
+	r = o->onode.csum_verify(bp->first + r_off, t, &bad);
+	if (r < 0) {
+	  derr << __func__ << " " << o->oid << " bad "
+	       << bluestore_extent_t::get_csum_type_string(
+		 bp->second.csum_type)
+	       << " checksum at " << bad << "~"
+	       << bp->second.get_csum_chunk_size()
+	       << " (device offset " << bp->second.offset + bad - bp->first
+	       << ")" << dendl;
+	  goto out;
+	}
       }
       r = r_len;
-      bufferlist u;
+      if (cache) {
+	uint64_t c_len = MIN(bp->first + r_off + r_len, c_end) - offset;
+	bufferlist v;
+	v.substr_of(t, front_extra, c_len);
+	c->buffer_cache.add(o->onode.nid, offset, v);
+      }
       u.substr_of(t, front_extra, x_len);
       bl.claim_append(u);
       offset += x_len;
@@ -3732,7 +4089,9 @@ void BlueStore::_txc_state_proc(TransContext *txc)
       txc->log_state_latency(logger, l_bluestore_state_kv_done_lat);
       if (txc->wal_txn) {
 	txc->state = TransContext::STATE_WAL_QUEUED;
-	if (g_conf->bluestore_sync_wal_apply) {
+	if (g_conf->bluestore_wal_batch_bytes) {
+	  _wal_batch_queue(txc);
+	} else if (g_conf->bluestore_sync_wal_apply) {
 	  _wal_apply(txc);
 	} else {
 	  wal_wq.queue(txc);
@@ -3865,16 +4224,17 @@ void BlueStore::_txc_finish_kv(TransContext *txc)
     txc->onreadable_sync->complete(0);
     txc->onreadable_sync = NULL;
   }
+  Finisher *finisher = _get_finisher(txc->osr.get());
   if (txc->onreadable) {
-    finisher.queue(txc->onreadable);
+    finisher->queue(txc->onreadable);
     txc->onreadable = NULL;
   }
   if (txc->oncommit) {
-    finisher.queue(txc->oncommit);
+    finisher->queue(txc->oncommit);
     txc->oncommit = NULL;
   }
   while (!txc->oncommits.empty()) {
-    finisher.queue(txc->oncommits.front());
+    finisher->queue(txc->oncommits.front());
     txc->oncommits.pop_front();
   }
 
@@ -3969,10 +4329,26 @@ void BlueStore::_txc_update_fm(TransContext *txc)
     dout(20) << __func__ << " release " << p.get_start()
       << "~" << p.get_len() << dendl;
     fm->release(p.get_start(), p.get_len(), txc->t);
+    _release_alloc(p.get_start(), p.get_len());
+  }
+}
 
-    if (!g_conf->bluestore_debug_no_reuse_blocks)
-      alloc->release(p.get_start(), p.get_len());
+/*
+ * hand released space back to the allocator.  with wal batching, a
+ * queued batch may still write to it, so it is held until the
+ * kv_finalize_thread has queued the wal ops of the commit that released
+ * it; see _wal_batch_pin().
+ */
+void BlueStore::_release_alloc(uint64_t offset, uint64_t length)
+{
+  if (g_conf->bluestore_debug_no_reuse_blocks)
+    return;
+  if (g_conf->bluestore_wal_batch_bytes) {
+    std::lock_guard<std::mutex> l(wal_batch_lock);
+    wal_batch_released.insert(offset, length);
+    return;
   }
+  alloc->release(offset, length);
 }
 
 
@@ -4001,8 +4377,6 @@ void BlueStore::_kv_sync_thread()
       dout(30) << __func__ << " committing txc " << kv_committing << dendl;
       dout(30) << __func__ << " wal_cleaning txc " << wal_cleaning << dendl;
 
-      alloc->commit_start();
-
       // flush/barrier on block device
       bdev->flush();
 
@@ -4053,8 +4427,7 @@ void BlueStore::_kv_sync_thread()
 	    dout(20) << __func__ << " release " << p.get_start()
 	      << "~" << p.get_len() << dendl;
 	    fm->release(p.get_start(), p.get_len(), t);
-	    if (!g_conf->bluestore_debug_no_reuse_blocks)
-	      alloc->release(p.get_start(), p.get_len());
+	    _release_alloc(p.get_start(), p.get_len());
 	  }
 	}
       }
@@ -4079,6 +4452,23 @@ void BlueStore::_kv_sync_thread()
 	get_wal_key(wt.seq, &key);
 	t->rm_single_key(PREFIX_WAL, key);
       }
+
+      // space released so far becomes allocatable once this sync
+      // commits *and* the kv_finalize_thread has queued the wal ops of
+      // this batch; until then a wal write may still land on it.  the
+      // finalize thread calls commit_finish(), so the previous batch
+      // must be finished before we start a new one.
+      {
+	std::unique_lock<std::mutex> m(kv_finalize_lock);
+	while (kv_finalize_in_progress ||
+	       !kv_committed_to_finalize.empty() ||
+	       !wal_cleaned_to_finalize.empty()) {
+	  kv_finalize_cond.wait(m);
+	}
+      }
+      alloc->commit_start();
+
+      utime_t sync_start = ceph_clock_now(NULL);
       int r = db->submit_transaction_sync(t);
       assert(r == 0);
 
@@ -4087,29 +4477,95 @@ void BlueStore::_kv_sync_thread()
       dout(20) << __func__ << " committed " << kv_committing.size()
 	       << " cleaned " << wal_cleaning.size()
 	       << " in " << dur << dendl;
-      while (!kv_committing.empty()) {
-	TransContext *txc = kv_committing.front();
+      logger->inc(l_bluestore_kv_commit_batch,
+		  kv_committing.size() + wal_cleaning.size());
+      logger->tinc(l_bluestore_kv_sync_lat, finish - sync_start);
+
+      if (bluefs) {
+	if (!bluefs_gift_extents.empty()) {
+	  _commit_bluefs_freespace(bluefs_gift_extents);
+	}
+      }
+
+      // space released for the wal batch thread is durably free now
+      interval_set<uint64_t> released;
+      {
+	std::lock_guard<std::mutex> m(wal_batch_lock);
+	released.swap(wal_batch_released);
+      }
+
+      // hand the committed txcs off so that we can start on the next
+      // batch while they are completed.
+      {
+	std::lock_guard<std::mutex> m(kv_finalize_lock);
+	assert(kv_released_to_finalize.empty());
+	kv_released_to_finalize.swap(released);
+	kv_committed_to_finalize.insert(kv_committed_to_finalize.end(),
+					kv_committing.begin(),
+					kv_committing.end());
+	wal_cleaned_to_finalize.insert(wal_cleaned_to_finalize.end(),
+				       wal_cleaning.begin(),
+				       wal_cleaning.end());
+	kv_finalize_cond.notify_all();
+      }
+
+      l.lock();
+      kv_committing.clear();
+      wal_cleaning.clear();
+    }
+  }
+  dout(10) << __func__ << " finish" << dendl;
+}
+
+void BlueStore::_kv_finalize_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  deque<TransContext*> kv_committed, wal_cleaned;
+  interval_set<uint64_t> released;
+  std::unique_lock<std::mutex> l(kv_finalize_lock);
+  while (true) {
+    assert(kv_committed.empty());
+    assert(wal_cleaned.empty());
+    if (kv_committed_to_finalize.empty() &&
+	wal_cleaned_to_finalize.empty()) {
+      if (kv_finalize_stop)
+	break;
+      dout(20) << __func__ << " sleep" << dendl;
+      kv_finalize_cond.wait(l);
+      dout(20) << __func__ << " wake" << dendl;
+    } else {
+      kv_committed.swap(kv_committed_to_finalize);
+      wal_cleaned.swap(wal_cleaned_to_finalize);
+      released.swap(kv_released_to_finalize);
+      kv_finalize_in_progress = true;
+      l.unlock();
+
+      dout(20) << __func__ << " finalizing " << kv_committed.size()
+	       << " committed, " << wal_cleaned.size() << " cleaned" << dendl;
+      utime_t start = ceph_clock_now(NULL);
+      while (!kv_committed.empty()) {
+	TransContext *txc = kv_committed.front();
 	_txc_state_proc(txc);
-	kv_committing.pop_front();
+	kv_committed.pop_front();
       }
-      while (!wal_cleaning.empty()) {
-	TransContext *txc = wal_cleaning.front();
+      while (!wal_cleaned.empty()) {
+	TransContext *txc = wal_cleaned.front();
 	_txc_state_proc(txc);
-	wal_cleaning.pop_front();
+	wal_cleaned.pop_front();
       }
-
-      alloc->commit_finish();
+      logger->tinc(l_bluestore_kv_finalize_lat, ceph_clock_now(NULL) - start);
 
       // this is as good a place as any ...
       _reap_collections();
 
-      if (bluefs) {
-	if (!bluefs_gift_extents.empty()) {
-	  _commit_bluefs_freespace(bluefs_gift_extents);
-	}
-      }
+      // the wal ops of this batch are queued; only now may space that
+      // was released up to the kv commit be handed out again.
+      _wal_batch_pin(released);
+      alloc->commit_finish();
 
       l.lock();
+      kv_finalize_in_progress = false;
+      kv_finalize_cond.notify_all();
     }
   }
   dout(10) << __func__ << " finish" << dendl;
@@ -4155,6 +4611,243 @@ int BlueStore::_wal_apply(TransContext *txc)
   return 0;
 }
 
+void BlueStore::WALBatch::write(uint64_t off, bufferlist& bl)
+{
+  uint64_t end = off + bl.length();
+  auto p = writes.lower_bound(off);
+  if (p != writes.begin()) {
+    --p;
+    if (p->first + p->second.length() <= off)
+      ++p;
+  }
+  // trim whatever we overwrite
+  while (p != writes.end() && p->first < end) {
+    uint64_t pstart = p->first;
+    uint64_t pend = pstart + p->second.length();
+    bufferlist old;
+    old.claim(p->second);
+    bytes -= old.length();
+    writes.erase(p++);
+    if (pstart < off) {
+      bufferlist head;
+      head.substr_of(old, 0, off - pstart);
+      bytes += head.length();
+      writes[pstart].claim(head);
+    }
+    if (pend > end) {
+      bufferlist tail;
+      tail.substr_of(old, end - pstart, pend - end);
+      bytes += tail.length();
+      writes[end].claim(tail);
+    }
+  }
+  bytes += bl.length();
+  writes[off].claim(bl);
+}
+
+void BlueStore::WALBatch::zero(uint64_t off, uint64_t len)
+{
+  bufferptr z(len);
+  z.zero();
+  bufferlist bl;
+  bl.append(z);
+  write(off, bl);
+}
+
+bool BlueStore::WALBatch::read(uint64_t off, uint64_t len,
+			       bufferlist *bl) const
+{
+  auto p = writes.upper_bound(off);
+  if (p == writes.begin())
+    return false;
+  --p;
+  if (p->first + p->second.length() < off + len)
+    return false;
+  bufferlist t;
+  t.substr_of(p->second, off - p->first, len);
+  t.rebuild();  // callers may modify the result in place
+  bl->claim_append(t);
+  return true;
+}
+
+void BlueStore::WALBatch::overlay(uint64_t off, bufferlist *bl) const
+{
+  uint64_t end = off + bl->length();
+  auto p = writes.lower_bound(off);
+  if (p != writes.begin()) {
+    --p;
+    if (p->first + p->second.length() <= off)
+      ++p;
+  }
+  if (p == writes.end() || p->first >= end)
+    return;
+  bufferlist out;
+  uint64_t pos = off;
+  while (pos < end) {
+    if (p != writes.end() && p->first <= pos) {
+      uint64_t l = MIN(p->first + p->second.length(), end) - pos;
+      bufferlist t;
+      t.substr_of(p->second, pos - p->first, l);
+      out.claim_append(t);
+      pos += l;
+      ++p;
+    } else {
+      uint64_t next = p == writes.end() ? end : MIN(p->first, end);
+      bufferlist t;
+      t.substr_of(*bl, pos - off, next - pos);
+      out.claim_append(t);
+      pos = next;
+    }
+  }
+  out.rebuild();  // callers may modify the result in place
+  bl->swap(out);
+}
+
+void BlueStore::_wal_batch_queue(TransContext *txc)
+{
+  uint64_t bytes = 0;
+  for (auto& wo : txc->wal_txn->ops) {
+    bytes += wo.extent.length;
+  }
+  std::lock_guard<std::mutex> l(wal_batch_lock);
+  dout(20) << __func__ << " txc " << txc << " " << bytes << " bytes, "
+	   << wal_batch_queue.size() << " txcs already queued" << dendl;
+  if (wal_batch_queue.empty()) {
+    wal_batch_queue_start = ceph_clock_now(NULL);
+    wal_batch_cond.notify_one();
+  }
+  wal_batch_queue.push_back(txc);
+  wal_batch_queue_bytes += bytes;
+  ++wal_batch_queued_seq;
+  if (wal_batch_queue_bytes >= g_conf->bluestore_wal_batch_bytes) {
+    wal_batch_cond.notify_one();
+  }
+}
+
+/*
+ * released is durably free, but a wal batch txc queued before now may
+ * still write to it: hold it until those have been applied.  it joins
+ * the allocator's next commit either way.
+ */
+void BlueStore::_wal_batch_pin(interval_set<uint64_t>& released)
+{
+  if (released.empty())
+    return;
+  {
+    std::lock_guard<std::mutex> l(wal_batch_lock);
+    if (wal_batch_applied_seq < wal_batch_queued_seq) {
+      dout(20) << __func__ << " " << released << " until wal batch seq "
+	       << wal_batch_queued_seq << dendl;
+      wal_batch_pinned.push_back(
+	make_pair(wal_batch_queued_seq, interval_set<uint64_t>()));
+      wal_batch_pinned.back().second.swap(released);
+      return;
+    }
+  }
+  for (auto p = released.begin(); p != released.end(); ++p)
+    alloc->release(p.get_start(), p.get_len());
+  released.clear();
+}
+
+void BlueStore::_wal_batch_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  deque<TransContext*> q;
+  std::unique_lock<std::mutex> l(wal_batch_lock);
+  while (true) {
+    if (wal_batch_queue.empty()) {
+      if (wal_batch_stop)
+	break;
+      dout(20) << __func__ << " sleep" << dendl;
+      wal_batch_cond.wait(l);
+      dout(20) << __func__ << " wake" << dendl;
+      continue;
+    }
+    if (!wal_batch_stop &&
+	wal_batch_queue_bytes < g_conf->bluestore_wal_batch_bytes) {
+      // hold a partial batch until it is old enough
+      utime_t deadline = wal_batch_queue_start;
+      deadline += g_conf->bluestore_wal_batch_max_delay;
+      utime_t now = ceph_clock_now(NULL);
+      if (now < deadline) {
+	deadline -= now;
+	wal_batch_cond.wait_for(
+	  l, std::chrono::microseconds(deadline.to_nsec() / 1000));
+	continue;
+      }
+    }
+    q.swap(wal_batch_queue);
+    wal_batch_queue_bytes = 0;
+    l.unlock();
+    _wal_batch_apply(q);
+    l.lock();
+    wal_batch_applied_seq += q.size();
+    q.clear();
+
+    // space no queued write can reach any more
+    interval_set<uint64_t> unpinned;
+    while (!wal_batch_pinned.empty() &&
+	   wal_batch_pinned.front().first <= wal_batch_applied_seq) {
+      unpinned.insert(wal_batch_pinned.front().second);
+      wal_batch_pinned.pop_front();
+    }
+    if (!unpinned.empty()) {
+      l.unlock();
+      dout(20) << __func__ << " unpinned " << unpinned << dendl;
+      for (auto p = unpinned.begin(); p != unpinned.end(); ++p)
+	alloc->release(p.get_start(), p.get_len());
+      l.lock();
+    }
+  }
+  dout(10) << __func__ << " finish" << dendl;
+}
+
+void BlueStore::_wal_batch_apply(deque<TransContext*>& q)
+{
+  dout(20) << __func__ << " " << q.size() << " txcs" << dendl;
+
+  // apply every op in commit order; later writes to the same blocks
+  // replace earlier ones and read-modify-write sees the batched data.
+  WALBatch batch;
+  IOContext ioc(NULL);
+  for (auto txc : q) {
+    txc->log_state_latency(logger, l_bluestore_state_wal_queued_lat);
+    txc->state = TransContext::STATE_WAL_APPLYING;
+    for (auto& wo : txc->wal_txn->ops) {
+      int r = _do_wal_op(wo, &ioc, &batch);
+      assert(r == 0);
+    }
+  }
+
+  // issue the result as few large writes in offset order
+  uint64_t ios = 0;
+  auto p = batch.writes.begin();
+  while (p != batch.writes.end()) {
+    uint64_t offset = p->first;
+    bufferlist bl;
+    bl.claim(p->second);
+    ++p;
+    while (p != batch.writes.end() &&
+	   p->first == offset + bl.length() &&
+	   bl.buffers().size() + p->second.buffers().size() <= IOV_MAX) {
+      bl.claim_append(p->second);
+      ++p;
+    }
+    dout(20) << __func__ << " write " << offset << "~" << bl.length() << dendl;
+    int r = bdev->aio_write(offset, bl, &ioc, true);
+    assert(r == 0);
+    ++ios;
+  }
+  assert(!ioc.has_aios());
+  logger->inc(l_bluestore_wal_batch_txc, q.size());
+  logger->inc(l_bluestore_wal_batch_ios, ios);
+  logger->inc(l_bluestore_wal_batch_bytes, batch.bytes);
+
+  for (auto txc : q) {
+    _txc_state_proc(txc);
+  }
+}
+
 int BlueStore::_wal_finish(TransContext *txc)
 {
   bluestore_wal_transaction_t& wt = *txc->wal_txn;
@@ -4169,7 +4862,31 @@ int BlueStore::_wal_finish(TransContext *txc)
   return 0;
 }
 
-int BlueStore::_do_wal_op(bluestore_wal_op_t& wo, IOContext *ioc)
+int BlueStore::_wal_read(uint64_t off, uint64_t len, bufferlist *bl,
+			 IOContext *ioc, WALBatch *batch)
+{
+  if (batch && batch->read(off, len, bl))
+    return 0;
+  int r = bdev->read(off, len, bl, ioc, true);
+  if (r < 0)
+    return r;
+  if (batch)
+    batch->overlay(off, bl);
+  return 0;
+}
+
+int BlueStore::_wal_write(uint64_t off, bufferlist& bl, IOContext *ioc,
+			  WALBatch *batch)
+{
+  if (batch) {
+    batch->write(off, bl);
+    return 0;
+  }
+  return bdev->aio_write(off, bl, ioc, true);
+}
+
+int BlueStore::_do_wal_op(bluestore_wal_op_t& wo, IOContext *ioc,
+			  WALBatch *batch)
 {
   const uint64_t block_size = bdev->get_block_size();
   const uint64_t block_mask = ~(block_size - 1);
@@ -4200,7 +4917,7 @@ int BlueStore::_do_wal_op(bluestore_wal_op_t& wo, IOContext *ioc)
       offset = offset & block_mask;
       dout(20) << __func__ << "  reading initial partial block "
 	       << src_offset << "~" << block_size << dendl;
-      r = bdev->read(src_offset, block_size, &first, ioc, true);
+      r = _wal_read(src_offset, block_size, &first, ioc, batch);
       assert(r == 0);
       bufferlist t;
       t.substr_of(first, 0, first_len);
@@ -4219,7 +4936,7 @@ int BlueStore::_do_wal_op(bluestore_wal_op_t& wo, IOContext *ioc)
       } else {
 	dout(20) << __func__ << "  reading trailing partial block "
 		 << last_offset << "~" << block_size << dendl;
-	r = bdev->read(last_offset, block_size, &last, ioc, true);
+	r = _wal_read(last_offset, block_size, &last, ioc, batch);
         assert(r == 0);
       }
       bufferlist t;
@@ -4228,7 +4945,7 @@ int BlueStore::_do_wal_op(bluestore_wal_op_t& wo, IOContext *ioc)
       bl.claim_append(t);
     }
     assert((bl.length() & ~block_mask) == 0);
-    r = bdev->aio_write(offset, bl, ioc, true);
+    r = _wal_write(offset, bl, ioc, batch);
     assert(r == 0);
   }
   break;
@@ -4242,11 +4959,11 @@ int BlueStore::_do_wal_op(bluestore_wal_op_t& wo, IOContext *ioc)
     assert(wo.extent.length == wo.src_extent.length);
     assert((wo.src_extent.offset & ~block_mask) == 0);
     bufferlist bl;
-    r = bdev->read(wo.src_extent.offset, wo.src_extent.length, &bl, ioc,
-		       true);
+    r = _wal_read(wo.src_extent.offset, wo.src_extent.length, &bl, ioc,
+		  batch);
     assert(r == 0);
     assert(bl.length() == wo.extent.length);
-    r = bdev->aio_write(wo.extent.offset, bl, ioc, true);
+    r = _wal_write(wo.extent.offset, bl, ioc, batch);
     assert(r == 0);
   }
   break;
@@ -4262,11 +4979,11 @@ int BlueStore::_do_wal_op(bluestore_wal_op_t& wo, IOContext *ioc)
       uint64_t first_offset = offset & block_mask;
       dout(20) << __func__ << "  reading initial partial block "
 	       << first_offset << "~" << block_size << dendl;
-      r = bdev->read(first_offset, block_size, &first, ioc, true);
+      r = _wal_read(first_offset, block_size, &first, ioc, batch);
       assert(r == 0);
       size_t z_len = MIN(block_size - first_len, length);
       memset(first.c_str() + first_len, 0, z_len);
-      r = bdev->aio_write(first_offset, first, ioc, true);
+      r = _wal_write(first_offset, first, ioc, batch);
       assert(r == 0);
       offset += block_size - first_len;
       length -= z_len;
@@ -4275,7 +4992,10 @@ int BlueStore::_do_wal_op(bluestore_wal_op_t& wo, IOContext *ioc)
     if (length >= block_size) {
       uint64_t middle_len = length & block_mask;
       dout(20) << __func__ << "  zero " << offset << "~" << length << dendl;
-      r = bdev->aio_zero(offset, middle_len, ioc);
+      if (batch)
+	batch->zero(offset, middle_len);
+      else
+	r = bdev->aio_zero(offset, middle_len, ioc);
       assert(r == 0);
       offset += middle_len;
       length -= middle_len;
@@ -4286,10 +5006,10 @@ int BlueStore::_do_wal_op(bluestore_wal_op_t& wo, IOContext *ioc)
       bufferlist last;
       dout(20) << __func__ << "  reading trailing partial block "
 	       << offset << "~" << block_size << dendl;
-      r = bdev->read(offset, block_size, &last, ioc, true);
+      r = _wal_read(offset, block_size, &last, ioc, batch);
       assert(r == 0);
       memset(last.c_str(), 0, length);
-      r = bdev->aio_write(offset, last, ioc, true);
+      r = _wal_write(offset, last, ioc, batch);
       assert(r == 0);
     }
   }
@@ -5285,6 +6005,10 @@ int BlueStore::_do_allocate(
 	   bp->first < offset + length &&
 	   bp->first + bp->second.length > offset) {
       dout(30) << "   bp " << bp->first << ": " << bp->second << dendl;
+      // _do_write inflates partially overwritten compressed extents
+      assert(!bp->second.has_flag(bluestore_extent_t::FLAG_COMPRESSED) ||
+	     (bp->first >= offset &&
+	      bp->first + bp->second.length <= offset + length));
       if (bp->first < offset) {
 	uint64_t left = offset - bp->first;
 	if (bp->first + bp->second.length <= offset + length) {
@@ -5294,7 +6018,7 @@ int BlueStore::_do_allocate(
 	    bp->second.offset + left,
 	    bp->second.length - left,
 	    bp->second.has_flag(bluestore_extent_t::FLAG_SHARED));
-	  bp->second.length = left;
+	  bp->second.trim(0, left);
 	  dout(20) << "        now " << bp->first << ": " << bp->second << dendl;
 	  hint = bp->first + bp->second.length;
 	  ++bp;
@@ -5304,12 +6028,10 @@ int BlueStore::_do_allocate(
 	    txc, c, o,
 	    bp->second.offset + left, length,
 	    bp->second.has_flag(bluestore_extent_t::FLAG_SHARED));
-	  o->onode.block_map[offset + length] =
-	    bluestore_extent_t(
-	      bp->second.offset + left + length,
-	      bp->second.length - (left + length),
-	      bp->second.flags);
-	  bp->second.length = left;
+	  bluestore_extent_t& right = o->onode.block_map[offset + length] =
+	    bp->second;
+	  right.trim(left + length, bp->second.length - (left + length));
+	  bp->second.trim(0, left);
 	  dout(20) << "       left " << bp->first << ": " << bp->second << dendl;
 	  ++bp;
 	  dout(20) << "      right " << bp->first << ": " << bp->second << dendl;
@@ -5326,11 +6048,9 @@ int BlueStore::_do_allocate(
 	    txc, c, o,
 	    bp->second.offset, overlap,
 	    bp->second.has_flag(bluestore_extent_t::FLAG_SHARED));
-	  o->onode.block_map[bp->first + overlap] =
-	    bluestore_extent_t(
-	      bp->second.offset + overlap,
-	      bp->second.length - overlap,
-	      bp->second.flags);
+	  bluestore_extent_t& rest = o->onode.block_map[bp->first + overlap] =
+	    bp->second;
+	  rest.trim(overlap, bp->second.length - overlap);
 	  o->onode.block_map.erase(bp++);
 	  dout(20) << "        now " << bp->first << ": " << bp->second << dendl;
 	  assert(bp->first == offset + length);
@@ -5339,7 +6059,7 @@ int BlueStore::_do_allocate(
 	  dout(20) << "    dealloc " << bp->first << ": " << bp->second << dendl;
 	  _txc_release(
 	    txc, c, o,
-	    bp->second.offset, bp->second.length,
+	    bp->second.offset, bp->second.get_disk_length(),
 	    bp->second.has_flag(bluestore_extent_t::FLAG_SHARED));
 	  hint = bp->first + bp->second.length;
 	  o->onode.block_map.erase(bp++);
@@ -5350,11 +6070,20 @@ int BlueStore::_do_allocate(
     *alloc_offset = offset;
     *alloc_length = length;
 
-    // allocate our new extent(s)
+    // allocate our new extent(s).  if we may compress them, keep them
+    // small enough that a later partial overwrite or read does not
+    // have to inflate too much.
+    uint64_t max_extent = length;
+    if (_want_compress(o)) {
+      max_extent = MAX(g_conf->bluestore_compression_max_blob_size -
+		       g_conf->bluestore_compression_max_blob_size %
+		       min_alloc_size,
+		       min_alloc_size);
+    }
     uint64_t alloc_start = offset;
     while (length > 0) {
       bluestore_extent_t e;
-      int r = alloc->allocate(length, min_alloc_size, hint,
+      int r = alloc->allocate(MIN(length, max_extent), min_alloc_size, hint,
 			      &e.offset, &e.length);
       assert(r == 0);
       assert(e.length <= length);  // bc length is a multiple of min_alloc_size
@@ -5396,6 +6125,194 @@ bool BlueStore::_can_overlay_write(OnodeRef o, uint64_t length)
     (int)length <= g_conf->bluestore_overlay_max_length;
 }
 
+CompressorRef BlueStore::_get_compressor(int alg)
+{
+  std::lock_guard<std::mutex> l(compressor_lock);
+  map<int,CompressorRef>::iterator p = compressors.find(alg);
+  if (p != compressors.end())
+    return p->second;
+  CompressorRef cp = Compressor::create(
+    cct, bluestore_extent_t::get_comp_alg_name(alg));
+  if (cp)
+    compressors[alg] = cp;
+  return cp;
+}
+
+bool BlueStore::_want_compress(OnodeRef o)
+{
+  switch (comp_mode) {
+  case COMP_FORCE:
+    return true;
+  case COMP_AGGRESSIVE:
+    return (o->onode.alloc_hint_flags &
+	    CEPH_OSD_ALLOC_HINT_FLAG_INCOMPRESSIBLE) == 0;
+  case COMP_PASSIVE:
+    return (o->onode.alloc_hint_flags &
+	    CEPH_OSD_ALLOC_HINT_FLAG_COMPRESSIBLE) != 0;
+  default:
+    return false;
+  }
+}
+
+bool BlueStore::_do_write_compressed(
+  TransContext *txc,
+  OnodeRef o,
+  bluestore_extent_t& e,
+  bufferlist& bl,
+  bool buffered)
+{
+  uint64_t min_alloc_size = g_conf->bluestore_min_alloc_size;
+  uint64_t block_size = bdev->get_block_size();
+  assert(bl.length() == e.length);
+
+  CompressorRef cp = _get_compressor(comp_alg);
+  if (!cp)
+    return false;
+  bufferlist out;
+  int r = cp->compress(bl, out);
+  if (r < 0) {
+    dout(10) << __func__ << " compress failed, " << cpp_strerror(r) << dendl;
+    logger->inc(l_bluestore_compress_rejected_count);
+    return false;
+  }
+  uint64_t disk_length = ROUND_UP_TO(out.length(), min_alloc_size);
+  if (disk_length >
+      e.length * g_conf->bluestore_compression_required_ratio) {
+    dout(20) << __func__ << " " << e.length << " -> " << out.length()
+	     << " (" << disk_length << " allocated) is not enough, rejecting"
+	     << dendl;
+    logger->inc(l_bluestore_compress_rejected_count);
+    return false;
+  }
+
+  // give back the space we no longer need.  it was never committed,
+  // so it can go straight back to the allocator.
+  uint64_t unused = e.length - disk_length;
+  if (unused) {
+    txc->allocated.erase(e.offset + disk_length, unused);
+    alloc->release(e.offset + disk_length, unused);
+  }
+  e.set_flag(bluestore_extent_t::FLAG_COMPRESSED);
+  e.compressed_length = out.length();
+  e.disk_length = disk_length;
+  e.comp_alg = comp_alg;
+  dout(20) << __func__ << " " << e.length << " -> " << out.length()
+	   << ", now " << e << dendl;
+  logger->inc(l_bluestore_compress_success_count);
+  logger->inc(l_bluestore_compressed_bytes, disk_length);
+  logger->inc(l_bluestore_compressed_original_bytes, e.length);
+
+  txc->compressed_extents[e.offset] = bl;
+  uint64_t pad = ROUND_UP_TO(out.length(), block_size) - out.length();
+  if (pad)
+    out.append_zero(pad);
+  bdev->aio_write(e.offset, out, &txc->ioc, buffered);
+  return true;
+}
+
+int BlueStore::_read_compressed_extent(
+  const bluestore_extent_t& e,
+  bufferlist *out,
+  IOContext *ioc,
+  bool buffered)
+{
+  assert(e.has_flag(bluestore_extent_t::FLAG_COMPRESSED));
+  uint64_t block_size = bdev->get_block_size();
+  CompressorRef cp = _get_compressor(e.comp_alg);
+  if (!cp) {
+    derr << __func__ << " no compressor for "
+	 << bluestore_extent_t::get_comp_alg_name(e.comp_alg) << dendl;
+    return -EIO;
+  }
+  bufferlist raw;
+  int r = bdev->read(e.offset, ROUND_UP_TO(e.compressed_length, block_size),
+		     &raw, ioc, buffered);
+  if (r < 0)
+    return r;
+  bufferlist in;
+  in.substr_of(raw, 0, e.compressed_length);
+  out->clear();
+  r = cp->decompress(in, *out);
+  if (r < 0)
+    return r;
+  if (out->length() != e.length) {
+    derr << __func__ << " " << e << " inflated to " << out->length()
+	 << " bytes" << dendl;
+    return -EIO;
+  }
+  return 0;
+}
+
+int BlueStore::_do_inflate(
+  TransContext *txc,
+  CollectionRef& c,
+  OnodeRef o,
+  uint64_t offset,
+  uint64_t length)
+{
+  uint64_t end = offset + length;
+  uint64_t size = o->onode.size;
+  bool flushed = false;
+  map<uint64_t,bluestore_extent_t>::iterator bp = o->onode.seek_extent(offset);
+  while (bp != o->onode.block_map.end() && bp->first < end) {
+    if (!bp->second.has_flag(bluestore_extent_t::FLAG_COMPRESSED) ||
+	(bp->first >= offset && bp->first + bp->second.length <= end &&
+	 bp->first + bp->second.length <= size)) {
+      // leave fully covered extents for the caller to deallocate
+      ++bp;
+      continue;
+    }
+    uint64_t e_off = bp->first;
+    bluestore_extent_t e = bp->second;
+    dout(20) << __func__ << " " << offset << "~" << length << " inflating "
+	     << e_off << ": " << e << dendl;
+
+    bufferlist bl;
+    map<uint64_t,bufferlist>::iterator q = txc->compressed_extents.find(
+      e.offset);
+    if (q != txc->compressed_extents.end()) {
+      bl = q->second;
+    } else {
+      if (!flushed) {
+	o->flush();
+	flushed = true;
+      }
+      IOContext ioc(NULL);
+      int r = _read_compressed_extent(e, &bl, &ioc, false);
+      if (r < 0) {
+	derr << __func__ << " failed to read " << e_off << ": " << e << ": "
+	     << cpp_strerror(r) << dendl;
+	return r;
+      }
+    }
+
+    _txc_release(txc, c, o, e.offset, e.disk_length,
+		 e.has_flag(bluestore_extent_t::FLAG_SHARED));
+    o->onode.block_map.erase(bp);
+
+    // rewrite whatever the caller is not about to replace.  anything
+    // past eof is dropped; unallocated space reads back as zeros.
+    uint64_t head_end = MIN(offset, size);
+    if (e_off < head_end) {
+      bufferlist head;
+      head.substr_of(bl, 0, head_end - e_off);
+      int r = _do_write(txc, c, o, e_off, head.length(), head, 0);
+      if (r < 0)
+	return r;
+    }
+    uint64_t tail_end = MIN(e_off + e.length, size);
+    if (end < tail_end) {
+      bufferlist tail;
+      tail.substr_of(bl, end - e_off, tail_end - end);
+      int r = _do_write(txc, c, o, end, tail.length(), tail, 0);
+      if (r < 0)
+	return r;
+    }
+    bp = o->onode.seek_extent(e_off + e.length);
+  }
+  return 0;
+}
+
 int BlueStore::_do_write(
   TransContext *txc,
   CollectionRef& c,
@@ -5435,9 +6352,31 @@ int BlueStore::_do_write(
   uint64_t cow_rmw_head = 0;
   uint64_t cow_rmw_tail = 0;
 
+  // compressed extents can only be replaced as a whole
+  {
+    uint64_t start = MIN(orig_offset, o->onode.size);
+    r = _do_inflate(txc, c, o, start, orig_offset + orig_length - start);
+    if (r < 0)
+      goto out;
+  }
+
   if (orig_offset > o->onode.size) {
     // zero tail of previous existing extent?
     _do_zero_tail_extent(txc, c, o, orig_offset);
+    c->buffer_cache.discard(o->onode.nid, o->onode.size,
+			    orig_offset - o->onode.size);
+  }
+
+  {
+    bufferlist t;
+    t.substr_of(orig_bl, 0, orig_length);
+    if (g_conf->bluestore_buffer_cache_writes &&
+	(fadvise_flags & (CEPH_OSD_OP_FLAG_FADVISE_DONTNEED |
+			  CEPH_OSD_OP_FLAG_FADVISE_NOCACHE)) == 0) {
+      c->buffer_cache.write(o->onode.nid, orig_offset, t);
+    } else {
+      c->buffer_cache.discard(o->onode.nid, orig_offset, orig_length);
+    }
   }
 
   r = _do_allocate(txc, c, o, orig_offset, orig_length, fadvise_flags, true,
@@ -5449,6 +6388,16 @@ int BlueStore::_do_write(
     goto out;
   }
 
+  // checksums live on the extents we are about to write into.  extents
+  // keep the checksum parameters they were written with until all of
+  // their checksums are gone.
+  {
+    bufferlist t;
+    t.substr_of(orig_bl, 0, orig_length);
+    o->onode.csum_update(orig_offset, t, csum_type,
+			 g_conf->bluestore_csum_chunk_order);
+  }
+
   bp = o->onode.seek_extent(orig_offset);
 
   for (uint64_t offset = orig_offset;
@@ -5589,6 +6538,16 @@ int BlueStore::_do_write(
 
     if (bp->first >= alloc_offset &&
 	bp->first + bp->second.length <= alloc_offset + alloc_length) {
+      if (offset == bp->first &&
+	  length == bp->second.length &&
+	  cow_head_extent != bp->second.offset &&
+	  cow_tail_extent != bp->second.offset &&
+	  _want_compress(o) &&
+	  _do_write_compressed(txc, o, bp->second, bl, buffered)) {
+	_do_overlay_trim(txc, o, offset, length);
+	++bp;
+	continue;
+      }
       // NOTE: we may need to zero before or after our write if the
       // prior extent wasn't allocated but we are still doing some COW.
       uint64_t z_end = offset & block_mask;
@@ -5715,7 +6674,10 @@ int BlueStore::_do_write_zero(
   int r = _do_write(txc, c, o, offset, length, zl, 0);
   // we do not modify onode size
   o->onode.size = old_size;
-  return r;
+  if (r < 0)
+    return r;
+  // compressed extents must not extend past eof
+  return _do_inflate(txc, c, o, old_size, (uint64_t)-1 - old_size);
 }
 
 int BlueStore::_zero(TransContext *txc,
@@ -5813,9 +6775,16 @@ int BlueStore::_do_zero(TransContext *txc,
     return _do_truncate(txc, c, o, offset + length);
   }
 
+  r = _do_inflate(txc, c, o, offset, length);
+  if (r < 0)
+    return r;
+
   // overlay
   _do_overlay_trim(txc, o, offset, length);
 
+  c->buffer_cache.discard(o->onode.nid, offset, length);
+  o->onode.csum_discard(offset, length);
+
   uint64_t block_size = bdev->get_block_size();
 
   map<uint64_t,bluestore_extent_t>::iterator bp = o->onode.seek_extent(offset);
@@ -5831,7 +6800,7 @@ int BlueStore::_do_zero(TransContext *txc,
 	       << bp->second << dendl;
       _txc_release(
 	txc, c, o,
-	bp->second.offset, bp->second.length,
+	bp->second.offset, bp->second.get_disk_length(),
 	bp->second.has_flag(bluestore_extent_t::FLAG_SHARED));
       o->onode.block_map.erase(bp++);
       continue;
@@ -5904,6 +6873,13 @@ int BlueStore::_do_truncate(
   // they may touch.
   o->flush();
 
+  {
+    uint64_t start = MIN(offset, o->onode.size);
+    int r = _do_inflate(txc, c, o, start, (uint64_t)-1 - start);
+    if (r < 0)
+      return r;
+  }
+
   // trim down cached tail
   if (o->tail_bl.length()) {
     // we could adjust this if we truncate down within the same
@@ -5911,6 +6887,8 @@ int BlueStore::_do_truncate(
     dout(20) << __func__ << " clear cached tail" << dendl;
     o->clear_tail();
   }
+  c->buffer_cache.discard(o->onode.nid, offset, (uint64_t)-1 - offset);
+  o->onode.csum_discard(offset, (uint64_t)-1 - offset);
 
   // trim down fragments
   map<uint64_t,bluestore_extent_t>::iterator bp = o->onode.block_map.end();
@@ -5925,7 +6903,7 @@ int BlueStore::_do_truncate(
 	       << bp->second << dendl;
       _txc_release(
 	txc, c, o,
-	bp->second.offset, bp->second.length,
+	bp->second.offset, bp->second.get_disk_length(),
 	bp->second.has_flag(bluestore_extent_t::FLAG_SHARED));
       if (bp != o->onode.block_map.begin()) {
 	o->onode.block_map.erase(bp--);
@@ -5945,7 +6923,7 @@ int BlueStore::_do_truncate(
 	txc, c, o,
 	bp->second.offset + newlen, bp->second.length - newlen,
 	bp->second.has_flag(bluestore_extent_t::FLAG_SHARED));
-      bp->second.length = newlen;
+      bp->second.trim(0, newlen);
       break;
     }
   }
@@ -6351,10 +7329,10 @@ int BlueStore::_clone(TransContext *txc,
       bool marked = false;
       for (auto& p : oldo->onode.block_map) {
 	if (p.second.has_flag(bluestore_extent_t::FLAG_SHARED)) {
-	  e->ref_map.get(p.second.offset, p.second.length);
+	  e->ref_map.get(p.second.offset, p.second.get_disk_length());
 	} else {
 	  p.second.set_flag(bluestore_extent_t::FLAG_SHARED);
-	  e->ref_map.add(p.second.offset, p.second.length, 2);
+	  e->ref_map.add(p.second.offset, p.second.get_disk_length(), 2);
 	  marked = true;
 	}
       }
@@ -6390,7 +7368,7 @@ int BlueStore::_clone(TransContext *txc,
     newo->onode.size = oldo->onode.size;
   } else {
     // read + write
-    r = _do_read(oldo, 0, oldo->onode.size, bl, 0);
+    r = _do_read(c.get(), oldo, 0, oldo->onode.size, bl, 0);
     if (r < 0)
       goto out;
 
@@ -6457,7 +7435,7 @@ int BlueStore::_clone_range(TransContext *txc,
   newo->exists = true;
   _assign_nid(txc, newo);
 
-  r = _do_read(oldo, srcoff, length, bl, 0);
+  r = _do_read(c.get(), oldo, srcoff, length, bl, 0);
   if (r < 0)
     goto out;
 
@@ -6589,6 +7567,8 @@ int BlueStore::_split_collection(TransContext *txc,
   RWLock::WLocker l2(d->lock);
   c->onode_map.clear();
   d->onode_map.clear();
+  c->buffer_cache.clear();
+  d->buffer_cache.clear();
   c->cnode.bits = bits;
   assert(d->cnode.bits == bits);
   r = 0;
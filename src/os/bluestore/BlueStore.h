@@ -31,6 +31,7 @@
 #include "include/unordered_map.h"
 #include "include/memory.h"
 #include "common/Finisher.h"
+#include "compressor/Compressor.h"
 #include "os/ObjectStore.h"
 
 #include "bluestore_types.h"
@@ -54,6 +55,20 @@ enum {
   l_bluestore_state_wal_done_lat,
   l_bluestore_state_finishing_lat,
   l_bluestore_state_done_lat,
+  l_bluestore_buffers,
+  l_bluestore_buffer_bytes,
+  l_bluestore_buffer_hit_bytes,
+  l_bluestore_buffer_miss_bytes,
+  l_bluestore_compress_success_count,
+  l_bluestore_compress_rejected_count,
+  l_bluestore_compressed_bytes,
+  l_bluestore_compressed_original_bytes,
+  l_bluestore_kv_commit_batch,
+  l_bluestore_kv_sync_lat,
+  l_bluestore_kv_finalize_lat,
+  l_bluestore_wal_batch_txc,
+  l_bluestore_wal_batch_ios,
+  l_bluestore_wal_batch_bytes,
   l_bluestore_last
 };
 
@@ -188,6 +203,63 @@ public:
     int _trim(int max);
   };
 
+  /// a cached extent of object data
+  struct Buffer {
+    uint64_t nid;      ///< owning object
+    uint64_t offset;   ///< logical offset in the object
+    bufferlist data;
+    boost::intrusive::list_member_hook<> lru_item;
+
+    Buffer(uint64_t n, uint64_t o, const bufferlist& b)
+      : nid(n), offset(o), data(b) {}
+
+    uint64_t length() const {
+      return data.length();
+    }
+    uint64_t end() const {
+      return offset + data.length();
+    }
+  };
+
+  /// clean and recently written object data, trimmed to a byte budget
+  struct BufferCache {
+    typedef boost::intrusive::list<
+      Buffer,
+      boost::intrusive::member_hook<
+        Buffer,
+	boost::intrusive::list_member_hook<>,
+	&Buffer::lru_item> > lru_list_t;
+
+    std::mutex lock;
+    map<uint64_t,map<uint64_t,Buffer*>> buffer_map; ///< nid -> offset -> buffer
+    lru_list_t lru;
+    uint64_t size = 0;    ///< total bytes cached
+    uint64_t max_size;
+    PerfCounters *logger;
+
+    BufferCache(PerfCounters *l, uint64_t s) : max_size(s), logger(l) {}
+    ~BufferCache() {
+      clear();
+    }
+
+    /// populate with clean data (e.g., just read from disk)
+    void add(uint64_t nid, uint64_t offset, const bufferlist& bl);
+    /// replace any cached data in the range with newly written data
+    void write(uint64_t nid, uint64_t offset, const bufferlist& bl);
+    /// drop any cached data in the range
+    void discard(uint64_t nid, uint64_t offset, uint64_t length);
+    /// return true (and fill in *bl) if the entire range is cached
+    bool read(uint64_t nid, uint64_t offset, uint64_t length, bufferlist *bl);
+    void clear();
+    void trim(uint64_t max);
+
+  private:
+    void _add(uint64_t nid, uint64_t offset, const bufferlist& bl);
+    void _discard(uint64_t nid, uint64_t offset, uint64_t length);
+    void _rm(map<uint64_t,Buffer*>& m, map<uint64_t,Buffer*>::iterator q);
+    void _trim(uint64_t max);
+  };
+
   struct Collection : public CollectionImpl {
     BlueStore *store;
     coll_t cid;
@@ -202,6 +274,9 @@ public:
     // contention.
     OnodeHashLRU onode_map;
 
+    // cache object data on a per-collection basis as well.
+    BufferCache buffer_cache;
+
     OnodeRef get_onode(const ghobject_t& oid, bool create);
     EnodeRef get_enode(uint32_t hash);
 
@@ -311,6 +386,10 @@ public:
 
     interval_set<uint64_t> allocated, released;
 
+    /// device offset -> logical data of extents we compressed (the aio
+    /// has not been submitted yet, so we cannot read them back)
+    map<uint64_t,bufferlist> compressed_extents;
+
     IOContext ioc;
 
     CollectionRef first_collection;  ///< first referenced collection
@@ -501,6 +580,29 @@ public:
     }
   };
 
+  /// block-aligned device writes gathered from many wal transactions
+  struct WALBatch {
+    map<uint64_t,bufferlist> writes;  ///< offset -> data; never overlapping
+    uint64_t bytes = 0;
+
+    /// queue a block-aligned write, replacing any older data in its range
+    void write(uint64_t off, bufferlist& bl);
+    void zero(uint64_t off, uint64_t len);
+    /// fill @bl if the whole range is batched
+    bool read(uint64_t off, uint64_t len, bufferlist *bl) const;
+    /// apply batched data onto @bl, which was read from the device at @off
+    void overlay(uint64_t off, bufferlist *bl) const;
+  };
+
+  struct WALBatchThread : public Thread {
+    BlueStore *store;
+    explicit WALBatchThread(BlueStore *s) : store(s) {}
+    void *entry() {
+      store->_wal_batch_thread();
+      return NULL;
+    }
+  };
+
   struct KVSyncThread : public Thread {
     BlueStore *store;
     explicit KVSyncThread(BlueStore *s) : store(s) {}
@@ -509,6 +611,14 @@ public:
       return NULL;
     }
   };
+  struct KVFinalizeThread : public Thread {
+    BlueStore *store;
+    explicit KVFinalizeThread(BlueStore *s) : store(s) {}
+    void *entry() {
+      store->_kv_finalize_thread();
+      return NULL;
+    }
+  };
 
   // --------------------------------------------------------
   // members
@@ -525,6 +635,19 @@ private:
   int path_fd;  ///< open handle to $path
   int fsid_fd;  ///< open handle (locked) to $path/fsid
   bool mounted;
+  int csum_type;  ///< bluestore_extent_t::CSUM_* for newly written data
+
+  enum {
+    COMP_NONE = 0,        ///< never compress
+    COMP_PASSIVE = 1,     ///< compress only if hinted COMPRESSIBLE
+    COMP_AGGRESSIVE = 2,  ///< compress unless hinted INCOMPRESSIBLE
+    COMP_FORCE = 3,       ///< always compress
+  };
+  int comp_mode;  ///< COMP_* for newly written data
+  int comp_alg;   ///< bluestore_extent_t::COMP_ALG_* for newly written data
+
+  std::mutex compressor_lock;
+  map<int,CompressorRef> compressors;  ///< alg -> instance
 
   RWLock coll_lock;    ///< rwlock to protect coll_map
   ceph::unordered_map<coll_t, CollectionRef> coll_map;
@@ -543,7 +666,22 @@ private:
   ThreadPool wal_tp;
   WALWQ wal_wq;
 
-  Finisher finisher;
+  /// wal txcs waiting to be applied as one sorted, coalesced batch
+  WALBatchThread wal_batch_thread;
+  std::mutex wal_batch_lock;
+  std::condition_variable wal_batch_cond;
+  bool wal_batch_stop;
+  deque<TransContext*> wal_batch_queue;
+  uint64_t wal_batch_queue_bytes;
+  utime_t wal_batch_queue_start;  ///< when the oldest queued txc arrived
+  uint64_t wal_batch_queued_seq;   ///< txcs ever queued
+  uint64_t wal_batch_applied_seq;  ///< txcs ever applied
+  /// released space not yet handed to the kv_finalize_thread
+  interval_set<uint64_t> wal_batch_released;
+  /// released space held until txcs up to seq have been applied
+  deque<pair<uint64_t, interval_set<uint64_t> > > wal_batch_pinned;
+
+  vector<Finisher*> finishers;  ///< completions, sharded by OpSequencer
 
   KVSyncThread kv_sync_thread;
   std::mutex kv_lock;
@@ -552,6 +690,16 @@ private:
   deque<TransContext*> kv_queue, kv_committing;
   deque<TransContext*> wal_cleanup_queue, wal_cleaning;
 
+  /// txcs the kv_sync_thread has made durable; completed in order by
+  /// the kv_finalize_thread so that the next commit can start right away
+  KVFinalizeThread kv_finalize_thread;
+  std::mutex kv_finalize_lock;
+  std::condition_variable kv_finalize_cond;
+  bool kv_finalize_stop;
+  bool kv_finalize_in_progress;
+  deque<TransContext*> kv_committed_to_finalize, wal_cleaned_to_finalize;
+  interval_set<uint64_t> kv_released_to_finalize;
+
   PerfCounters *logger;
 
   std::mutex reap_lock;
@@ -614,6 +762,7 @@ private:
   void _txc_state_proc(TransContext *txc);
   void _txc_aio_submit(TransContext *txc);
   void _txc_update_fm(TransContext *txc);
+  void _release_alloc(uint64_t offset, uint64_t length);
 public:
   void _txc_aio_finish(void *p) {
     _txc_state_proc(static_cast<TransContext*>(p));
@@ -626,7 +775,15 @@ private:
   void _osr_reap_done(OpSequencer *osr);
 
   void _kv_sync_thread();
+  void _kv_finalize_thread();
   void _kv_stop() {
+    {
+      std::lock_guard<std::mutex> l(wal_batch_lock);
+      wal_batch_stop = true;
+      wal_batch_cond.notify_all();
+    }
+    wal_batch_thread.join();
+    wal_batch_stop = false;
     {
       std::lock_guard<std::mutex> l(kv_lock);
       kv_stop = true;
@@ -634,12 +791,32 @@ private:
     }
     kv_sync_thread.join();
     kv_stop = false;
+    {
+      std::lock_guard<std::mutex> l(kv_finalize_lock);
+      kv_finalize_stop = true;
+      kv_finalize_cond.notify_all();
+    }
+    kv_finalize_thread.join();
+    kv_finalize_stop = false;
+  }
+  Finisher *_get_finisher(OpSequencer *osr) {
+    return finishers[(reinterpret_cast<uintptr_t>(osr) / sizeof(*osr)) %
+		     finishers.size()];
   }
 
   bluestore_wal_op_t *_get_wal_op(TransContext *txc, OnodeRef o);
   int _wal_apply(TransContext *txc);
   int _wal_finish(TransContext *txc);
-  int _do_wal_op(bluestore_wal_op_t& wo, IOContext *ioc);
+  void _wal_batch_queue(TransContext *txc);
+  void _wal_batch_pin(interval_set<uint64_t>& released);
+  void _wal_batch_thread();
+  void _wal_batch_apply(deque<TransContext*>& q);
+  int _do_wal_op(bluestore_wal_op_t& wo, IOContext *ioc,
+		 WALBatch *batch = NULL);
+  int _wal_read(uint64_t off, uint64_t len, bufferlist *bl, IOContext *ioc,
+		WALBatch *batch);
+  int _wal_write(uint64_t off, bufferlist& bl, IOContext *ioc,
+		 WALBatch *batch);
   int _wal_replay();
 
   // for fsck
@@ -712,6 +889,7 @@ public:
     uint32_t op_flags = 0,
     bool allow_eio = false) override;
   int _do_read(
+    Collection *c,
     OnodeRef o,
     uint64_t offset,
     size_t len,
@@ -900,6 +1078,22 @@ private:
 		uint64_t offset, uint64_t length,
 		bufferlist& bl,
 		uint32_t fadvise_flags);
+
+  CompressorRef _get_compressor(int alg);
+  bool _want_compress(OnodeRef o);
+  bool _do_write_compressed(TransContext *txc,
+			    OnodeRef o,
+			    bluestore_extent_t& e,
+			    bufferlist& bl,
+			    bool buffered);
+  int _read_compressed_extent(const bluestore_extent_t& e,
+			      bufferlist *out,
+			      IOContext *ioc,
+			      bool buffered);
+  int _do_inflate(TransContext *txc,
+		  CollectionRef& c,
+		  OnodeRef o,
+		  uint64_t offset, uint64_t length);
   int _touch(TransContext *txc,
 	     CollectionRef& c,
 	     OnodeRef& o);
@@ -18,6 +18,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <thread>
 
 #include "KernelDevice.h"
 #include "include/types.h"
@@ -41,7 +42,6 @@ KernelDevice::KernelDevice(aio_callback_t cb, void *cbpriv)
     aio_callback(cb),
     aio_callback_priv(cbpriv),
     aio_stop(false),
-    aio_thread(this),
     injecting_crash(0)
 {
   zeros = buffer::create_page_aligned(1048576);
@@ -214,7 +214,12 @@ int KernelDevice::_aio_start()
       derr << __func__ << " failed: " << cpp_strerror(r) << dendl;
       return r;
     }
-    aio_thread.create("bstore_aio");
+    int n = MAX(1, g_conf->bdev_aio_reap_threads);
+    for (int i = 0; i < n; ++i) {
+      AioCompletionThread *t = new AioCompletionThread(this, i);
+      t->create("bstore_aio");
+      aio_threads.push_back(t);
+    }
   }
   return 0;
 }
@@ -224,15 +229,44 @@ void KernelDevice::_aio_stop()
   if (aio) {
     dout(10) << __func__ << dendl;
     aio_stop = true;
-    aio_thread.join();
+    for (auto t : aio_threads) {
+      t->join();
+      delete t;
+    }
+    aio_threads.clear();
     aio_stop = false;
     aio_queue.shutdown();
   }
 }
 
-void KernelDevice::_aio_thread()
+void KernelDevice::_aio_reap_iocs()
 {
-  dout(10) << __func__ << " start" << dendl;
+  if (!ioc_reap_count.load())
+    return;
+  vector<IOContext*> q;
+  {
+    std::lock_guard<std::mutex> l(ioc_reap_lock);
+    q.swap(ioc_reap_queue);
+    --ioc_reap_count;
+  }
+  // another reaper may still be inside aio_wake() for the final aio
+  // of one of these.  wait for everyone who was busy to move on.
+  for (auto t : aio_threads) {
+    uint64_t s = t->seq.load();
+    if (s & 1) {
+      while (t->seq.load() == s)
+	std::this_thread::yield();
+    }
+  }
+  for (auto p : q) {
+    dout(20) << __func__ << " reap ioc " << p << dendl;
+    delete p;
+  }
+}
+
+void KernelDevice::_aio_thread(AioCompletionThread *t)
+{
+  dout(10) << __func__ << " " << t->id << " start" << dendl;
   int inject_crash_count = 0;
   while (!aio_stop) {
     dout(40) << __func__ << " polling" << dendl;
@@ -244,6 +278,7 @@ void KernelDevice::_aio_thread()
       derr << __func__ << " got " << cpp_strerror(r) << dendl;
     }
     if (r > 0) {
+      ++t->seq;
       dout(30) << __func__ << " got " << r << " completed aios" << dendl;
       for (int i = 0; i < r; ++i) {
 	IOContext *ioc = static_cast<IOContext*>(aio[i]->priv);
@@ -263,8 +298,10 @@ void KernelDevice::_aio_thread()
 	  }
 	}
       }
+      ++t->seq;
     }
-    reap_ioc();
+    if (t->id == 0)
+      _aio_reap_iocs();
     if (g_conf->bdev_inject_crash) {
       ++inject_crash_count;
       if (inject_crash_count * g_conf->bdev_aio_poll_ms / 1000 >
@@ -276,7 +313,7 @@ void KernelDevice::_aio_thread()
       }
     }
   }
-  dout(10) << __func__ << " end" << dendl;
+  dout(10) << __func__ << " " << t->id << " end" << dendl;
 }
 
 void KernelDevice::_aio_log_start(
@@ -327,6 +364,23 @@ void KernelDevice::aio_submit(IOContext *ioc)
   ioc->num_pending -= pending;
   assert(ioc->num_pending.load() == 0);  // we should be only thread doing this
 
+  if (g_conf->bdev_aio_submit_batch) {
+    // queue the iocbs and let whoever holds submit_lock push them (and
+    // anything queued by other callers meanwhile) to the kernel at once.
+    {
+      std::lock_guard<std::mutex> l(submit_queue_lock);
+      for (; p != e; ++p) {
+	p->priv = static_cast<void*>(ioc);
+	dout(20) << __func__ << "  aio " << &*p << " fd " << p->fd
+		 << " " << p->offset << "~" << p->length << dendl;
+	submit_queue.push_back(&p->iocb);
+      }
+    }
+    // do not dereference ioc from here on; it may already be complete.
+    _aio_submit_queued();
+    return;
+  }
+
   bool done = false;
   while (!done) {
     FS::aio_t& aio = *p;
@@ -357,6 +411,48 @@ void KernelDevice::aio_submit(IOContext *ioc)
   }
 }
 
+void KernelDevice::_aio_submit_queued()
+{
+  vector<iocb*> batch;
+  while (true) {
+    if (!submit_lock.try_lock()) {
+      // the holder will check submit_queue again after it unlocks
+      return;
+    }
+    while (true) {
+      {
+	std::lock_guard<std::mutex> l(submit_queue_lock);
+	batch.swap(submit_queue);
+      }
+      if (batch.empty())
+	break;
+      dout(20) << __func__ << " submitting " << batch.size() << " aios"
+	       << dendl;
+      unsigned pos = 0;
+      while (pos < batch.size()) {
+	int n = MIN(batch.size() - pos, (size_t)aio_queue.max_iodepth);
+	int retries = 0;
+	int r = aio_queue.submit_batch(&batch[pos], n, &retries);
+	if (retries)
+	  derr << __func__ << " retries " << retries << dendl;
+	if (r) {
+	  derr << " aio submit got " << cpp_strerror(r) << dendl;
+	  assert(r == 0);
+	}
+	pos += n;
+      }
+      batch.clear();
+    }
+    submit_lock.unlock();
+
+    // close the race with a caller who queued after our last check
+    // but failed to take submit_lock before we dropped it.
+    std::lock_guard<std::mutex> l(submit_queue_lock);
+    if (submit_queue.empty())
+      return;
+  }
+}
+
 int KernelDevice::aio_write(
   uint64_t off,
   bufferlist &bl,
@@ -16,6 +16,7 @@
 #define CEPH_OS_BLUESTORE_KERNELDEVICE_H
 
 #include <atomic>
+#include <mutex>
 
 #include "os/fs/FS.h"
 #include "include/interval_set.h"
@@ -44,18 +45,30 @@ class KernelDevice : public BlockDevice {
 
   struct AioCompletionThread : public Thread {
     KernelDevice *bdev;
-    explicit AioCompletionThread(KernelDevice *b) : bdev(b) {}
+    unsigned id;
+    /// odd while completions are being processed
+    std::atomic<uint64_t> seq = {0};
+    AioCompletionThread(KernelDevice *b, unsigned i) : bdev(b), id(i) {}
     void *entry() {
-      bdev->_aio_thread();
+      bdev->_aio_thread(this);
       return NULL;
     }
-  } aio_thread;
+  };
+  vector<AioCompletionThread*> aio_threads;
+
+  /// iocbs queued by aio_submit callers, submitted by whoever holds
+  /// submit_lock
+  std::mutex submit_queue_lock;
+  vector<iocb*> submit_queue;
+  std::mutex submit_lock;
 
   std::atomic_int injecting_crash;
 
-  void _aio_thread();
+  void _aio_thread(AioCompletionThread *t);
   int _aio_start();
   void _aio_stop();
+  void _aio_reap_iocs();
+  void _aio_submit_queued();
 
   void _aio_log_start(IOContext *ioc, uint64_t offset, uint64_t length);
   void _aio_log_finish(IOContext *ioc, uint64_t offset, uint64_t length);
@@ -0,0 +1,189 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "ShardedAllocator.h"
+#include "StupidAllocator.h"
+#include "common/debug.h"
+
+#define dout_subsys ceph_subsys_bluestore
+#undef dout_prefix
+#define dout_prefix *_dout << "shardedalloc "
+
+ShardedAllocator::ShardedAllocator(int64_t size, unsigned shards)
+  : num_free(0),
+    num_reserved(0),
+    num_uncommitted(0),
+    num_committing(0)
+{
+  uint64_t min_alloc_size = g_conf->bluestore_min_alloc_size;
+  if (shards < 1)
+    shards = 1;
+  // zones are aligned to min_alloc_size so that no allocation ever
+  // needs to span two of them.
+  zone_size = ROUND_UP_TO(MAX(size, 1) / shards, min_alloc_size);
+  if (zone_size == 0)
+    zone_size = min_alloc_size;
+  unsigned n = (size + zone_size - 1) / zone_size;
+  if (n < 1)
+    n = 1;
+  for (unsigned i = 0; i < n; ++i)
+    zones.push_back(new StupidAllocator);
+  dout(10) << __func__ << " size " << size << " in " << n << " zones of "
+	   << zone_size << dendl;
+}
+
+ShardedAllocator::~ShardedAllocator()
+{
+  for (auto z : zones)
+    delete z;
+}
+
+unsigned ShardedAllocator::_choose_zone()
+{
+  // spread threads round-robin over the zones; each thread sticks to
+  // the zone it was first given.
+  static std::atomic<unsigned> next_thread = {0};
+  static thread_local unsigned thread_zone = next_thread++;
+  return thread_zone % zones.size();
+}
+
+int ShardedAllocator::reserve(uint64_t need)
+{
+  int64_t reserved = num_reserved.load();
+  do {
+    if ((int64_t)need > num_free.load() - reserved) {
+      dout(10) << __func__ << " need " << need << " num_free "
+	       << num_free.load() << " num_reserved " << reserved
+	       << ": ENOSPC" << dendl;
+      return -ENOSPC;
+    }
+  } while (!num_reserved.compare_exchange_weak(reserved, reserved + need));
+  dout(10) << __func__ << " need " << need << " num_reserved now "
+	   << reserved + need << dendl;
+  return 0;
+}
+
+void ShardedAllocator::unreserve(uint64_t unused)
+{
+  int64_t r = num_reserved.fetch_sub(unused);
+  dout(10) << __func__ << " unused " << unused << " num_reserved now "
+	   << r - (int64_t)unused << dendl;
+  assert(r >= (int64_t)unused);
+}
+
+int ShardedAllocator::allocate(
+  uint64_t want_size, uint64_t alloc_unit, int64_t hint,
+  uint64_t *offset, uint32_t *length)
+{
+  unsigned n = zones.size();
+  unsigned first = _choose_zone();
+  uint64_t want = MAX(alloc_unit, want_size);
+  dout(10) << __func__ << " want_size " << want_size
+	   << " alloc_unit " << alloc_unit
+	   << " hint " << hint
+	   << " zone " << first
+	   << dendl;
+
+  // first look for a zone that has room for all of it, then settle for
+  // anything.  only the zone locks are taken here; the caller's
+  // reservation guarantees that the search succeeds.
+  for (int pass = 0; pass < 2; ++pass) {
+    uint64_t need = pass == 0 ? want : alloc_unit;
+    for (unsigned i = 0; i < n; ++i) {
+      unsigned z = (first + i) % n;
+      if (zones[z]->reserve(need) < 0)
+	continue;
+      int64_t h = hint && _zone_of(hint) == z ? hint : 0;
+      int r = zones[z]->allocate(need, alloc_unit, h, offset, length);
+      assert(r == 0);
+      if (*length < need)
+	zones[z]->unreserve(need - *length);
+      if (z != first) {
+	dout(20) << __func__ << " stole " << *offset << "~" << *length
+		 << " from zone " << z << dendl;
+      }
+      num_free -= *length;
+      num_reserved -= *length;
+      assert(num_free.load() >= 0);
+      assert(num_reserved.load() >= 0);
+      dout(10) << __func__ << " got " << *offset << "~" << *length << dendl;
+      return 0;
+    }
+  }
+
+  assert(0 == "caller didn't reserve?");
+  return -ENOSPC;
+}
+
+int ShardedAllocator::release(
+  uint64_t offset, uint64_t length)
+{
+  dout(10) << __func__ << " " << offset << "~" << length << dendl;
+  _for_each_zone(offset, length,
+		 [](StupidAllocator *a, uint64_t o, uint64_t l) {
+		   a->release(o, l);
+		 });
+  num_uncommitted += length;
+  return 0;
+}
+
+void ShardedAllocator::commit_start()
+{
+  int64_t c = num_uncommitted.exchange(0);
+  dout(10) << __func__ << " releasing " << c << dendl;
+  for (auto z : zones)
+    z->commit_start();
+  assert(num_committing.load() == 0);
+  num_committing = c;
+}
+
+void ShardedAllocator::commit_finish()
+{
+  for (auto z : zones)
+    z->commit_finish();
+  int64_t c = num_committing.exchange(0);
+  dout(10) << __func__ << " released " << c << dendl;
+  num_free += c;
+}
+
+uint64_t ShardedAllocator::get_free()
+{
+  return num_free.load();
+}
+
+void ShardedAllocator::dump(std::ostream& out)
+{
+  for (unsigned i = 0; i < zones.size(); ++i) {
+    dout(30) << __func__ << " zone " << i << " free "
+	     << zones[i]->get_free() << dendl;
+    zones[i]->dump(out);
+  }
+}
+
+void ShardedAllocator::init_add_free(uint64_t offset, uint64_t length)
+{
+  dout(10) << __func__ << " " << offset << "~" << length << dendl;
+  _for_each_zone(offset, length,
+		 [](StupidAllocator *a, uint64_t o, uint64_t l) {
+		   a->init_add_free(o, l);
+		 });
+  num_free += length;
+}
+
+void ShardedAllocator::init_rm_free(uint64_t offset, uint64_t length)
+{
+  dout(10) << __func__ << " " << offset << "~" << length << dendl;
+  _for_each_zone(offset, length,
+		 [](StupidAllocator *a, uint64_t o, uint64_t l) {
+		   a->init_rm_free(o, l);
+		 });
+  num_free -= length;
+  assert(num_free.load() >= 0);
+}
+
+void ShardedAllocator::shutdown()
+{
+  dout(1) << __func__ << dendl;
+  for (auto z : zones)
+    z->shutdown();
+}
@@ -0,0 +1,76 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_OS_BLUESTORE_SHARDEDALLOCATOR_H
+#define CEPH_OS_BLUESTORE_SHARDEDALLOCATOR_H
+
+#include <atomic>
+#include <vector>
+
+#include "Allocator.h"
+
+class StupidAllocator;
+
+/**
+ * ShardedAllocator
+ *
+ * Split the device into a fixed number of equally sized zones, each
+ * managed by its own StupidAllocator (and lock).  Threads allocate from
+ * "their" zone and only move on to the others when it runs dry.  The
+ * global free/reserved accounting is kept in atomics so that reserve()
+ * and unreserve() never take a lock.
+ */
+class ShardedAllocator : public Allocator {
+  uint64_t zone_size;
+  std::vector<StupidAllocator*> zones;
+
+  std::atomic<int64_t> num_free;         ///< total bytes in freelists
+  std::atomic<int64_t> num_reserved;     ///< reserved bytes
+  std::atomic<int64_t> num_uncommitted;  ///< released, not yet committing
+  std::atomic<int64_t> num_committing;   ///< released, committing
+
+  unsigned _zone_of(uint64_t offset) const {
+    return offset / zone_size;
+  }
+  unsigned _choose_zone();
+
+  /// apply f to each zone-contained piece of offset~length
+  template <typename F>
+  void _for_each_zone(uint64_t offset, uint64_t length, F f) {
+    while (length > 0) {
+      unsigned z = _zone_of(offset);
+      uint64_t l = MIN(length, (z + 1) * zone_size - offset);
+      f(zones[z], offset, l);
+      offset += l;
+      length -= l;
+    }
+  }
+
+public:
+  ShardedAllocator(int64_t size, unsigned shards);
+  ~ShardedAllocator();
+
+  int reserve(uint64_t need);
+  void unreserve(uint64_t unused);
+
+  int allocate(
+    uint64_t want_size, uint64_t alloc_unit, int64_t hint,
+    uint64_t *offset, uint32_t *length);
+
+  int release(
+    uint64_t offset, uint64_t length);
+
+  void commit_start();
+  void commit_finish();
+
+  uint64_t get_free();
+
+  void dump(std::ostream& out);
+
+  void init_add_free(uint64_t offset, uint64_t length);
+  void init_rm_free(uint64_t offset, uint64_t length);
+
+  void shutdown();
+};
+
+#endif
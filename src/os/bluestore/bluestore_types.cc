@@ -15,6 +15,7 @@
 #include "bluestore_types.h"
 #include "common/Formatter.h"
 #include "include/stringify.h"
+#include "xxHash/xxhash.h"
 
 // bluestore_bdev_label_t
 
@@ -107,14 +108,269 @@ string bluestore_extent_t::get_flags_string(unsigned flags)
       s += '+';
     s += "shared";
   }
+  if (flags & FLAG_COMPRESSED) {
+    if (s.length())
+      s += '+';
+    s += "compressed";
+  }
+  if (flags & FLAG_CSUM) {
+    if (s.length())
+      s += '+';
+    s += "csum";
+  }
   return s;
 }
 
+const char *bluestore_extent_t::get_csum_type_string(unsigned t)
+{
+  switch (t) {
+  case CSUM_NONE: return "none";
+  case CSUM_CRC32C: return "crc32c";
+  case CSUM_XXHASH32: return "xxhash32";
+  case CSUM_XXHASH64: return "xxhash64";
+  default: return "???";
+  }
+}
+
+int bluestore_extent_t::get_csum_string_type(const string& s)
+{
+  if (s == "none")
+    return CSUM_NONE;
+  if (s == "crc32c")
+    return CSUM_CRC32C;
+  if (s == "xxhash32")
+    return CSUM_XXHASH32;
+  if (s == "xxhash64")
+    return CSUM_XXHASH64;
+  return -EINVAL;
+}
+
+unsigned bluestore_extent_t::get_csum_value_size(unsigned t)
+{
+  switch (t) {
+  case CSUM_CRC32C:
+  case CSUM_XXHASH32:
+    return 4;
+  case CSUM_XXHASH64:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+uint64_t bluestore_extent_t::calc_csum(unsigned t, const bufferlist& bl)
+{
+  switch (t) {
+  case CSUM_CRC32C:
+    return bl.crc32c(-1);
+  case CSUM_XXHASH32:
+  case CSUM_XXHASH64:
+    {
+      bufferlist c = bl;  // xxhash wants contiguous input
+      if (t == CSUM_XXHASH32)
+	return XXH32(c.c_str(), c.length(), -1);
+      return XXH64(c.c_str(), c.length(), -1);
+    }
+  default:
+    assert(0 == "unrecognized csum type");
+  }
+  return 0;
+}
+
+uint64_t bluestore_extent_t::get_csum(unsigned i) const
+{
+  unsigned vs = get_csum_value_size(csum_type);
+  const uint8_t *p = &csum_data[i * vs];
+  uint64_t v = 0;
+  for (unsigned b = 0; b < vs; ++b)
+    v |= (uint64_t)p[b] << (b * 8);
+  return v;
+}
+
+void bluestore_extent_t::set_csum(unsigned i, uint64_t v)
+{
+  unsigned vs = get_csum_value_size(csum_type);
+  if (i >= get_csum_count()) {
+    csum_data.resize((i + 1) * vs);
+    csum_valid.resize((i + 8) / 8);
+  }
+  uint8_t *p = &csum_data[i * vs];
+  for (unsigned b = 0; b < vs; ++b)
+    p[b] = v >> (b * 8);
+  csum_valid[i >> 3] |= 1 << (i & 7);
+  set_flag(FLAG_CSUM);
+}
+
+void bluestore_extent_t::clear_csums()
+{
+  csum_type = CSUM_NONE;
+  csum_chunk_order = 0;
+  csum_data.clear();
+  csum_valid.clear();
+  clear_flag(FLAG_CSUM);
+}
+
+void bluestore_extent_t::csum_discard(uint32_t x_off, uint32_t len)
+{
+  if (!has_flag(FLAG_CSUM) || len == 0)
+    return;
+  unsigned n = get_csum_count();
+  unsigned first = x_off >> csum_chunk_order;
+  unsigned last = ((uint64_t)x_off + len - 1) >> csum_chunk_order;
+  for (unsigned i = first; i <= last && i < n; ++i)
+    csum_valid[i >> 3] &= ~(1 << (i & 7));
+  for (auto b : csum_valid)
+    if (b)
+      return;
+  clear_csums();
+}
+
+void bluestore_extent_t::csum_update(uint32_t x_off, const bufferlist& bl,
+				     unsigned type, unsigned chunk_order)
+{
+  csum_discard(x_off, bl.length());
+  if (!has_flag(FLAG_CSUM)) {
+    if (type == CSUM_NONE)
+      return;
+    csum_type = type;
+    csum_chunk_order = chunk_order;
+  }
+  uint64_t chunk_size = get_csum_chunk_size();
+  uint64_t end = (uint64_t)x_off + bl.length();
+  uint64_t pos = ROUND_UP_TO(x_off, chunk_size);
+  while (pos + chunk_size <= end) {
+    bufferlist t;
+    t.substr_of(bl, pos - x_off, chunk_size);
+    set_csum(pos >> csum_chunk_order, calc_csum(csum_type, t));
+    pos += chunk_size;
+  }
+}
+
+void bluestore_extent_t::trim(uint32_t x_off, uint32_t len)
+{
+  assert(!has_flag(FLAG_COMPRESSED));
+  assert((uint64_t)x_off + len <= length);
+  offset += x_off;
+  length = len;
+  if (!has_flag(FLAG_CSUM))
+    return;
+  if (x_off & (get_csum_chunk_size() - 1)) {
+    clear_csums();
+    return;
+  }
+  unsigned skip = x_off >> csum_chunk_order;
+  unsigned keep = len >> csum_chunk_order;
+  unsigned n = get_csum_count();
+  unsigned vs = get_csum_value_size(csum_type);
+  vector<uint8_t> valid((keep + 7) / 8);
+  bool any = false;
+  for (unsigned i = 0; i < keep && skip + i < n; ++i) {
+    if (has_csum(skip + i)) {
+      valid[i >> 3] |= 1 << (i & 7);
+      any = true;
+    }
+  }
+  if (!any) {
+    clear_csums();
+    return;
+  }
+  keep = MIN(keep, n - skip);
+  csum_data.erase(csum_data.begin(), csum_data.begin() + skip * vs);
+  csum_data.resize(keep * vs);
+  valid.resize((keep + 7) / 8);
+  csum_valid.swap(valid);
+}
+
+void bluestore_extent_t::encode(bufferlist& bl) const
+{
+  ::encode(offset, bl);
+  ::encode(length, bl);
+  ::encode(flags, bl);
+  if (has_flag(FLAG_COMPRESSED)) {
+    ::encode(compressed_length, bl);
+    ::encode(disk_length, bl);
+    ::encode(comp_alg, bl);
+  }
+  if (has_flag(FLAG_CSUM)) {
+    ::encode(csum_type, bl);
+    ::encode(csum_chunk_order, bl);
+    // packed; avoid the per-element vector<> encoding
+    ::encode((uint32_t)csum_data.size(), bl);
+    bl.append((const char *)csum_data.data(), csum_data.size());
+    ::encode((uint32_t)csum_valid.size(), bl);
+    bl.append((const char *)csum_valid.data(), csum_valid.size());
+  }
+}
+
+void bluestore_extent_t::decode(bufferlist::iterator& p)
+{
+  ::decode(offset, p);
+  ::decode(length, p);
+  ::decode(flags, p);
+  if (has_flag(FLAG_COMPRESSED)) {
+    ::decode(compressed_length, p);
+    ::decode(disk_length, p);
+    ::decode(comp_alg, p);
+  }
+  if (has_flag(FLAG_CSUM)) {
+    ::decode(csum_type, p);
+    ::decode(csum_chunk_order, p);
+    uint32_t n;
+    ::decode(n, p);
+    csum_data.resize(n);
+    if (n)
+      p.copy(n, (char *)&csum_data[0]);
+    ::decode(n, p);
+    csum_valid.resize(n);
+    if (n)
+      p.copy(n, (char *)&csum_valid[0]);
+  }
+}
+
+const char *bluestore_extent_t::get_comp_alg_name(unsigned a)
+{
+  switch (a) {
+  case COMP_ALG_NONE: return "none";
+  case COMP_ALG_SNAPPY: return "snappy";
+  case COMP_ALG_ZLIB: return "zlib";
+  default: return "???";
+  }
+}
+
+int bluestore_extent_t::get_comp_alg_type(const string& s)
+{
+  if (s == "snappy")
+    return COMP_ALG_SNAPPY;
+  if (s == "zlib")
+    return COMP_ALG_ZLIB;
+  if (s == "none")
+    return COMP_ALG_NONE;
+  return -EINVAL;
+}
+
 void bluestore_extent_t::dump(Formatter *f) const
 {
   f->dump_unsigned("offset", offset);
   f->dump_unsigned("length", length);
   f->dump_unsigned("flags", flags);
+  if (has_flag(FLAG_COMPRESSED)) {
+    f->dump_unsigned("compressed_length", compressed_length);
+    f->dump_unsigned("disk_length", disk_length);
+    f->dump_string("comp_alg", get_comp_alg_name(comp_alg));
+  }
+  if (has_flag(FLAG_CSUM)) {
+    f->dump_string("csum_type", get_csum_type_string(csum_type));
+    f->dump_unsigned("csum_chunk_order", csum_chunk_order);
+    f->open_array_section("csums");
+    unsigned n = get_csum_count();
+    for (unsigned i = 0; i < n; ++i) {
+      if (has_csum(i))
+	f->dump_unsigned("csum", get_csum(i));
+      else
+	f->dump_string("csum", "-");
+    }
+    f->close_section();
+  }
 }
 
 void bluestore_extent_t::generate_test_instances(list<bluestore_extent_t*>& o)
@@ -122,6 +378,15 @@ void bluestore_extent_t::generate_test_instances(list<bluestore_extent_t*>& o)
   o.push_back(new bluestore_extent_t());
   o.push_back(new bluestore_extent_t(123, 456));
   o.push_back(new bluestore_extent_t(789, 1024, 322));
+  o.push_back(new bluestore_extent_t(65536, 65536, FLAG_COMPRESSED));
+  o.back()->compressed_length = 1234;
+  o.back()->disk_length = 4096;
+  o.back()->comp_alg = COMP_ALG_SNAPPY;
+  o.push_back(new bluestore_extent_t(131072, 16384));
+  o.back()->csum_type = CSUM_CRC32C;
+  o.back()->csum_chunk_order = 12;
+  o.back()->set_csum(0, 0x12345678);
+  o.back()->set_csum(3, 0x9abcdef0);
 }
 
 ostream& operator<<(ostream& out, const bluestore_extent_t& e)
@@ -129,6 +394,12 @@ ostream& operator<<(ostream& out, const bluestore_extent_t& e)
   out << e.offset << "~" << e.length;
   if (e.flags)
     out << ":" << bluestore_extent_t::get_flags_string(e.flags);
+  if (e.has_flag(bluestore_extent_t::FLAG_COMPRESSED))
+    out << "(" << bluestore_extent_t::get_comp_alg_name(e.comp_alg)
+	<< " " << e.compressed_length << "/" << e.disk_length << ")";
+  if (e.has_flag(bluestore_extent_t::FLAG_CSUM))
+    out << "(" << bluestore_extent_t::get_csum_type_string(e.csum_type)
+	<< "/" << e.get_csum_chunk_size() << ")";
   return out;
 }
 
@@ -468,6 +739,77 @@ void bluestore_onode_t::generate_test_instances(list<bluestore_onode_t*>& o)
   // FIXME
 }
 
+void bluestore_onode_t::csum_discard(uint64_t offset, uint64_t length)
+{
+  if (length == 0)
+    return;
+  map<uint64_t,bluestore_extent_t>::iterator bp = seek_extent(offset);
+  while (bp != block_map.end() && bp->first < offset + length) {
+    uint64_t start = MAX(offset, bp->first);
+    uint64_t end = MIN(offset + length, bp->first + bp->second.length);
+    bp->second.csum_discard(start - bp->first, end - start);
+    ++bp;
+  }
+}
+
+void bluestore_onode_t::csum_update(uint64_t offset, const bufferlist& bl,
+				    unsigned type, unsigned chunk_order)
+{
+  uint64_t end = offset + bl.length();
+  map<uint64_t,bluestore_extent_t>::iterator bp = seek_extent(offset);
+  while (bp != block_map.end() && bp->first < end) {
+    uint64_t start = MAX(offset, bp->first);
+    uint64_t stop = MIN(end, bp->first + bp->second.length);
+    bufferlist t;
+    t.substr_of(bl, start - offset, stop - start);
+    bp->second.csum_update(start - bp->first, t, type, chunk_order);
+    ++bp;
+  }
+}
+
+int bluestore_onode_t::csum_verify(uint64_t offset, const bufferlist& bl,
+				   uint64_t *bad_offset) const
+{
+  map<uint64_t,bluestore_extent_t>::const_iterator bp =
+    block_map.upper_bound(offset);
+  if (bp == block_map.begin())
+    return 0;
+  --bp;
+  const bluestore_extent_t& e = bp->second;
+  if (!e.has_flag(bluestore_extent_t::FLAG_CSUM))
+    return 0;
+  uint64_t chunk_size = e.get_csum_chunk_size();
+  uint64_t x_off = offset - bp->first;
+  uint64_t x_end = MIN(x_off + bl.length(), (uint64_t)e.length);
+  for (uint64_t pos = ROUND_UP_TO(x_off, chunk_size);
+       pos + chunk_size <= x_end;
+       pos += chunk_size) {
+    unsigned i = pos >> e.csum_chunk_order;
+    if (!e.has_csum(i))
+      continue;
+
+    // overlay data takes precedence over what is on disk
+    uint64_t lpos = bp->first + pos;
+    map<uint64_t,bluestore_overlay_t>::const_iterator q =
+      overlay_map.lower_bound(lpos);
+    if (q != overlay_map.begin()) {
+      --q;
+      if (q->first + q->second.length <= lpos)
+	++q;
+    }
+    if (q != overlay_map.end() && q->first < lpos + chunk_size)
+      continue;
+
+    bufferlist t;
+    t.substr_of(bl, pos - x_off, chunk_size);
+    if (bluestore_extent_t::calc_csum(e.csum_type, t) != e.get_csum(i)) {
+      *bad_offset = lpos;
+      return -EIO;
+    }
+  }
+  return 0;
+}
+
 // bluestore_wal_op_t
 
 void bluestore_wal_op_t::encode(bufferlist& bl) const
@@ -58,13 +58,48 @@ WRITE_CLASS_ENCODER(bluestore_cnode_t)
 struct bluestore_extent_t {
   enum {
     FLAG_SHARED = 2,      ///< extent is shared by another object, and refcounted
+    FLAG_COMPRESSED = 4,  ///< extent holds compressed data
+    FLAG_CSUM = 8,        ///< extent carries per-chunk data checksums
   };
   static string get_flags_string(unsigned flags);
 
+  enum {
+    CSUM_NONE = 0,
+    CSUM_CRC32C = 1,
+    CSUM_XXHASH32 = 2,
+    CSUM_XXHASH64 = 3,
+  };
+  static const char *get_csum_type_string(unsigned t);
+  static int get_csum_string_type(const string& s);
+  static unsigned get_csum_value_size(unsigned t);
+  static uint64_t calc_csum(unsigned t, const bufferlist& bl);
+
+  enum {
+    COMP_ALG_NONE = 0,
+    COMP_ALG_SNAPPY = 1,
+    COMP_ALG_ZLIB = 2,
+  };
+  static const char *get_comp_alg_name(unsigned a);
+  static int get_comp_alg_type(const string& s);
+
   uint64_t offset;
-  uint32_t length;
+  uint32_t length;  ///< logical length (and device length if uncompressed)
   uint32_t flags;  /// or reserved
 
+  // only meaningful (and encoded) if FLAG_COMPRESSED
+  uint32_t compressed_length = 0;  ///< bytes of compressed payload
+  uint32_t disk_length = 0;        ///< bytes allocated on the device
+  uint8_t comp_alg = COMP_ALG_NONE;
+
+  // only meaningful (and encoded) if FLAG_CSUM.  csum_data packs one
+  // little-endian value per chunk, starting at the (logical) beginning
+  // of the extent; csum_valid has a bit set for each chunk whose value
+  // is current.
+  uint8_t csum_type = CSUM_NONE;
+  uint8_t csum_chunk_order = 0;
+  vector<uint8_t> csum_data;
+  vector<uint8_t> csum_valid;
+
   bluestore_extent_t(uint64_t o=0, uint32_t l=0, uint32_t f=0)
     : offset(o), length(l), flags(f) {}
 
@@ -72,6 +107,11 @@ struct bluestore_extent_t {
     return offset + length;
   }
 
+  /// bytes of the block device this extent references
+  uint32_t get_disk_length() const {
+    return has_flag(FLAG_COMPRESSED) ? disk_length : length;
+  }
+
   bool has_flag(unsigned f) const {
     return flags & f;
   }
@@ -82,16 +122,45 @@ struct bluestore_extent_t {
     flags &= ~f;
   }
 
-  void encode(bufferlist& bl) const {
-    ::encode(offset, bl);
-    ::encode(length, bl);
-    ::encode(flags, bl);
+  uint64_t get_csum_chunk_size() const {
+    return 1ull << csum_chunk_order;
+  }
+  /// number of chunks csum_data has room for
+  unsigned get_csum_count() const {
+    unsigned vs = get_csum_value_size(csum_type);
+    return vs ? csum_data.size() / vs : 0;
   }
-  void decode(bufferlist::iterator& p) {
-    ::decode(offset, p);
-    ::decode(length, p);
-    ::decode(flags, p);
+  bool has_csum(unsigned i) const {
+    return i < get_csum_count() && (csum_valid[i >> 3] & (1 << (i & 7)));
   }
+  uint64_t get_csum(unsigned i) const;
+  void set_csum(unsigned i, uint64_t v);
+  void clear_csums();
+
+  /// drop checksums for any chunk overlapping the (extent-relative) range
+  void csum_discard(uint32_t x_off, uint32_t len);
+
+  /**
+   * recalculate checksums for the chunks entirely covered by new data
+   *
+   * If the extent has no current checksums it adopts the given type
+   * and chunk order; otherwise it keeps its own.
+   *
+   * @param x_off extent-relative logical offset of bl
+   */
+  void csum_update(uint32_t x_off, const bufferlist& bl,
+		   unsigned type, unsigned chunk_order);
+
+  /**
+   * narrow an uncompressed extent to [x_off, x_off+len)
+   *
+   * Checksums move with the data when x_off is chunk aligned; a
+   * trailing partial chunk loses its checksum.
+   */
+  void trim(uint32_t x_off, uint32_t len);
+
+  void encode(bufferlist& bl) const;
+  void decode(bufferlist::iterator& p);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<bluestore_extent_t*>& o);
 };
@@ -242,6 +311,32 @@ struct bluestore_onode_t {
       ++q->second;
   }
 
+  /// drop checksums for any chunk overlapping the range
+  void csum_discard(uint64_t offset, uint64_t length);
+
+  /**
+   * recalculate checksums for the chunks entirely covered by new data
+   *
+   * Checksums live on the extents in block_map; data that is not
+   * backed by an extent (e.g., overlay-only) is not checksummed.
+   */
+  void csum_update(uint64_t offset, const bufferlist& bl,
+		   unsigned type, unsigned chunk_order);
+
+  /**
+   * verify data read from an extent against its checksums
+   *
+   * Only chunks that are fully contained in bl, have a checksum, and
+   * are not (partially) shadowed by an overlay are checked.
+   *
+   * @param offset logical offset of bl, which must lie in one extent
+   * @param bl data
+   * @param bad_offset [out] logical offset of the first bad chunk
+   * @returns 0 on success, -EIO on mismatch
+   */
+  int csum_verify(uint64_t offset, const bufferlist& bl,
+		  uint64_t *bad_offset) const;
+
   void encode(bufferlist& bl) const;
   void decode(bufferlist::iterator& p);
   void dump(Formatter *f) const;
@@ -131,6 +131,27 @@ public:
       return 0;
     }
 
+    /// submit n iocbs with as few io_submit calls as possible
+    int submit_batch(iocb **piocb, int n, int *retries) {
+      int attempts = 16;
+      int delay = 125;
+      int done = 0;
+      while (done < n) {
+	int r = io_submit(ctx, n - done, piocb + done);
+	if (r <= 0) {
+	  if ((r == -EAGAIN || r == 0) && attempts-- > 0) {
+	    usleep(delay);
+	    delay *= 2;
+	    (*retries)++;
+	    continue;
+	  }
+	  return r < 0 ? r : -EAGAIN;
+	}
+	done += r;
+      }
+      return 0;
+    }
+
     int get_next_completed(int timeout_ms, aio_t **paio, int max) {
       io_event event[max];
       struct timespec t = {
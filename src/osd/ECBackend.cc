@@ -77,6 +77,7 @@ ostream &operator<<(ostream &lhs, const ECBackend::read_request_t &rhs)
   return lhs << "read_request_t(to_read=[" << rhs.to_read << "]"
 	     << ", need=" << rhs.need
 	     << ", want_attrs=" << rhs.want_attrs
+	     << ", subchunks=" << rhs.subchunks
 	     << ")";
 }
 
@@ -178,9 +179,11 @@ ECBackend::ECBackend(
   ErasureCodeInterfaceRef ec_impl,
   uint64_t stripe_width)
   : PGBackend(pg, store, coll, ch),
+    untracked_writes(0),
     cct(cct),
     ec_impl(ec_impl),
-    sinfo(ec_impl->get_data_chunk_count(), stripe_width) {
+    sinfo(ec_impl->get_data_chunk_count(), stripe_width),
+    stripe_cache(stripe_width, cct->_conf->osd_ec_stripe_cache_bytes) {
   assert((ec_impl->get_data_chunk_count() *
 	  ec_impl->get_chunk_size(stripe_width)) == stripe_width);
 }
@@ -218,6 +221,7 @@ struct RecoveryMessages {
     ECBackend *ec,
     const hobject_t &hoid, uint64_t off, uint64_t len,
     const set<pg_shard_t> &need,
+    const map<pg_shard_t, vector<pair<int, int> > > &subchunks,
     bool attrs) {
     list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
     to_read.push_back(boost::make_tuple(off, len, 0));
@@ -232,7 +236,8 @@ struct RecoveryMessages {
 	  attrs,
 	  new OnRecoveryReadComplete(
 	    ec,
-	    hoid))));
+	    hoid),
+	  subchunks)));
   }
 
   map<pg_shard_t, vector<PushOp> > pushes;
@@ -364,8 +369,15 @@ void ECBackend::handle_recovery_read_complete(
       ++i) {
     from[i->first.shard].claim(i->second);
   }
-  dout(10) << __func__ << ": " << from << dendl;
-  int r = ECUtil::decode(sinfo, ec_impl, from, target);
+  map<int, vector<pair<int, int> > > subchunks;
+  for (map<pg_shard_t, vector<pair<int, int> > >::iterator i =
+	 op.subchunks_requested.begin();
+       i != op.subchunks_requested.end();
+       ++i) {
+    subchunks[i->first.shard] = i->second;
+  }
+  dout(10) << __func__ << ": " << from << " subchunks " << subchunks << dendl;
+  int r = ECUtil::decode(sinfo, ec_impl, from, target, subchunks);
   assert(r == 0);
   if (attrs) {
     op.xattrs.swap(*attrs);
@@ -495,8 +507,9 @@ void ECBackend::continue_recovery_op(
       set<int> want(op.missing_on_shards.begin(), op.missing_on_shards.end());
       set<pg_shard_t> to_read;
       uint64_t recovery_max_chunk = get_recovery_chunk_size();
+      op.subchunks_requested.clear();
       int r = get_min_avail_to_read_shards(
-	op.hoid, want, true, false, &to_read);
+	op.hoid, want, true, false, &to_read, &op.subchunks_requested);
       if (r != 0) {
 	// we must have lost a recovery source
 	assert(!op.recovery_progress.first);
@@ -512,6 +525,7 @@ void ECBackend::continue_recovery_op(
 	op.recovery_progress.data_recovered_to,
 	recovery_max_chunk,
 	to_read,
+	op.subchunks_requested,
 	op.recovery_progress.first);
       op.extent_requested = make_pair(op.recovery_progress.data_recovered_to,
 				      recovery_max_chunk);
@@ -937,7 +951,7 @@ void ECBackend::handle_sub_read(
       // Do NOT check osd_read_eio_on_bad_digest here.  We need to report
       // the state of our chunk in case other chunks could substitute.
       if ((bl.length() == hinfo->get_total_chunk_size()) &&
-	  (j->get<0>() == 0)) {
+	  (j->get<0>() == 0) && hinfo->has_chunk_hash()) {
 	dout(20) << __func__ << ": Checking hash of " << i->first << dendl;
 	bufferhash h(-1);
 	h << bl;
@@ -1036,8 +1050,21 @@ void ECBackend::handle_sub_read_reply(
       pair<uint64_t, uint64_t> adjusted =
 	sinfo.aligned_offset_len_to_chunk(
 	  make_pair(req_iter->get<0>(), req_iter->get<1>()));
-      assert(adjusted.first == j->first);
-      riter->get<2>()[from].claim(j->second);
+      // a partial chunk read comes back as one buffer per sub-chunk
+      // range, each at its own offset within the chunk
+      list<boost::tuple<uint64_t, uint64_t, uint32_t> > pieces;
+      add_shard_reads(rop.to_read.find(i->first)->second, from, adjusted, 0,
+		      &pieces);
+      for (list<boost::tuple<uint64_t, uint64_t, uint32_t> >::iterator p =
+	     pieces.begin();
+	   p != pieces.end();
+	   ++p) {
+	if (p != pieces.begin())
+	  ++j;
+	assert(j != i->second.end());
+	assert(p->get<0>() == j->first);
+	riter->get<2>()[from].claim_append(j->second);
+      }
     }
   }
   for (map<hobject_t, map<string, bufferlist>, hobject_t::BitwiseComparator>::iterator i = op.attrs_read.begin();
@@ -1258,8 +1285,11 @@ void ECBackend::check_recovery_sources(const OSDMapRef osdmap)
 void ECBackend::on_change()
 {
   dout(10) << __func__ << dendl;
+  waiting_rmw.clear();
   writing.clear();
+  untracked_writes = 0;
   tid_to_op_map.clear();
+  stripe_cache.clear();
   for (map<ceph_tid_t, ReadOp>::iterator i = tid_to_read_map.begin();
        i != tid_to_read_map.end();
        ++i) {
@@ -1338,6 +1368,13 @@ struct MustPrependHashInfo : public ObjectModDesc::Visitor {
       state = FOUND_CREATE_STASH;
     }
   }
+  void rollback_extents(
+    version_t gen,
+    const vector<pair<uint64_t, uint64_t> > &extents) {
+    if (state == EMPTY) {
+      state = FOUND_APPEND;
+    }
+  }
   bool must_prepend_hash_info() const { return state == FOUND_APPEND; }
 };
 
@@ -1415,17 +1452,404 @@ void ECBackend::submit_transaction(
   }
 
   dout(10) << __func__ << ": op " << *op << " starting" << dendl;
-  start_write(op);
-  writing.push_back(op);
+  if (waiting_rmw.empty() &&
+      !get_parent()->get_pool().allows_ecoverwrites()) {
+    op->untracked = true;
+    ++untracked_writes;
+    start_write(op);
+    writing.push_back(op);
+  } else {
+    waiting_rmw.push_back(op);
+    try_rmw();
+  }
   dout(10) << "onreadable_sync: " << op->on_local_applied_sync << dendl;
 }
 
+/// reserves the stripes an op writes and works out which to read
+struct RMWPlanner : public boost::static_visitor<void> {
+  ECBackend *ec;
+  ECBackend::Op *op;
+  map<hobject_t, set<uint64_t>, hobject_t::BitwiseComparator> to_read;
+  RMWPlanner(ECBackend *ec, ECBackend::Op *op) : ec(ec), op(op) {}
+
+  uint64_t disk_size(const hobject_t &oid) {
+    assert(op->unstable_hash_infos.count(oid));
+    return ec->sinfo.aligned_chunk_offset_to_logical_offset(
+      op->unstable_hash_infos[oid]->get_total_chunk_size());
+  }
+  void reserve(const hobject_t &oid, uint64_t off, uint64_t len) {
+    uint64_t size = disk_size(oid);
+    for (uint64_t s = off; s < off + len; s += ec->sinfo.get_stripe_width())
+      ec->stripe_cache.reserve(op->tid, oid, s, size);
+  }
+  void need(const hobject_t &oid, uint64_t stripe) {
+    if (ec->stripe_cache.have(oid, stripe) ||
+	stripe >= ec->stripe_cache.get_projected_size(oid, disk_size(oid)))
+      return;
+    to_read[oid].insert(stripe);
+  }
+
+  void operator()(const ECTransaction::OverwriteOp &wop) {
+    uint64_t sw = ec->sinfo.get_stripe_width();
+    uint64_t end = wop.off + wop.bl.length();
+    pair<uint64_t, uint64_t> bounds = ec->sinfo.offset_len_to_stripe_bounds(
+      make_pair(wop.off, (uint64_t)wop.bl.length()));
+    if (op->unstable_hash_infos[wop.oid]->has_chunk_hash()) {
+      // the chunk hashes are moved by what the write replaces
+      for (uint64_t s = bounds.first;
+	   s < bounds.first + bounds.second;
+	   s += sw)
+	need(wop.oid, s);
+    } else {
+      if (wop.off % sw)
+	need(wop.oid, bounds.first);
+      if (end % sw)
+	need(wop.oid, bounds.first + bounds.second - sw);
+    }
+    reserve(wop.oid, bounds.first, bounds.second);
+  }
+  void operator()(const ECTransaction::AppendOp &aop) {
+    reserve(aop.oid, aop.off,
+	    ec->sinfo.logical_to_next_stripe_offset(aop.bl.length()));
+  }
+  void operator()(const ECTransaction::CloneOp &cop) {
+    ec->stripe_cache.add_barrier(op->tid, cop.target);
+  }
+  void operator()(const ECTransaction::RenameOp &rop) {
+    ec->stripe_cache.add_barrier(op->tid, rop.source);
+    ec->stripe_cache.add_barrier(op->tid, rop.destination);
+  }
+  void operator()(const ECTransaction::StashOp &sop) {
+    ec->stripe_cache.add_barrier(op->tid, sop.oid);
+  }
+  void operator()(const ECTransaction::RemoveOp &rop) {
+    ec->stripe_cache.add_barrier(op->tid, rop.oid);
+  }
+  void operator()(const ECTransaction::TouchOp &) {}
+  void operator()(const ECTransaction::SetAttrsOp &) {}
+  void operator()(const ECTransaction::RmAttrOp &) {}
+  void operator()(const ECTransaction::AllocHintOp &) {}
+  void operator()(const ECTransaction::NoOp &) {}
+};
+
+/// objects an op writes data to or replaces
+struct RMWObjects : public boost::static_visitor<void> {
+  set<hobject_t, hobject_t::BitwiseComparator> oids;
+  void operator()(const ECTransaction::OverwriteOp &op) {
+    oids.insert(op.oid);
+  }
+  void operator()(const ECTransaction::AppendOp &op) {
+    oids.insert(op.oid);
+  }
+  void operator()(const ECTransaction::CloneOp &op) {
+    oids.insert(op.target);
+  }
+  void operator()(const ECTransaction::RenameOp &op) {
+    oids.insert(op.source);
+    oids.insert(op.destination);
+  }
+  void operator()(const ECTransaction::StashOp &op) {
+    oids.insert(op.oid);
+  }
+  void operator()(const ECTransaction::RemoveOp &op) {
+    oids.insert(op.oid);
+  }
+  void operator()(const ECTransaction::TouchOp &) {}
+  void operator()(const ECTransaction::SetAttrsOp &) {}
+  void operator()(const ECTransaction::RmAttrOp &) {}
+  void operator()(const ECTransaction::AllocHintOp &) {}
+  void operator()(const ECTransaction::NoOp &) {}
+};
+
+struct RMWReadCB :
+  public GenContext<pair<RecoveryMessages*, ECBackend::read_result_t& > &> {
+  ECBackend *ec;
+  ceph_tid_t tid;
+  hobject_t hoid;
+  RMWReadCB(ECBackend *ec, ceph_tid_t tid, const hobject_t &hoid)
+    : ec(ec), tid(tid), hoid(hoid) {}
+  void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) {
+    ec->handle_rmw_read(tid, hoid, in.second);
+  }
+};
+
+void ECBackend::handle_rmw_read(
+  ceph_tid_t tid, const hobject_t &hoid, read_result_t &res)
+{
+  map<ceph_tid_t, Op>::iterator i = tid_to_op_map.find(tid);
+  assert(i != tid_to_op_map.end());
+  Op &op = i->second;
+  assert(op.rmw_reads > 0);
+  if (res.r != 0) {
+    derr << __func__ << ": " << op << " failed to read old stripes of "
+	 << hoid << ": " << cpp_strerror(res.r) << dendl;
+    // ops queued behind this one were planned on top of what it would
+    // have written to hoid; fail those as well
+    bool after = false;
+    for (list<Op*>::iterator j = waiting_rmw.begin();
+	 j != waiting_rmw.end();
+	 ++j) {
+      if (*j == &op) {
+	after = true;
+      } else if (!after) {
+	continue;
+      }
+      RMWObjects objs;
+      (*j)->t->visit(objs);
+      if (*j == &op || objs.oids.count(hoid))
+	(*j)->rmw_error = res.r;
+    }
+    --op.rmw_reads;
+    try_rmw();
+    return;
+  }
+  map<uint64_t, bufferlist> &stripes = op.rmw_read[hoid];
+  for (list<boost::tuple<uint64_t, uint64_t, map<pg_shard_t, bufferlist> > >::iterator j =
+	 res.returned.begin();
+       j != res.returned.end();
+       ++j) {
+    map<int, bufferlist> to_decode;
+    for (map<pg_shard_t, bufferlist>::iterator k = j->get<2>().begin();
+	 k != j->get<2>().end();
+	 ++k) {
+      to_decode[k->first.shard].claim(k->second);
+    }
+    bufferlist bl;
+    int r = ECUtil::decode(sinfo, ec_impl, to_decode, &bl);
+    assert(r == 0);
+    // a short read means the stripe is past the end on the shards
+    if (bl.length() < j->get<1>())
+      bl.append_zero(j->get<1>() - bl.length());
+    stripes[j->get<0>()].claim(bl);
+  }
+  --op.rmw_reads;
+  try_rmw();
+}
+
+bool ECBackend::plan_rmw(Op *op)
+{
+  RMWObjects objs;
+  op->t->visit(objs);
+  for (set<hobject_t, hobject_t::BitwiseComparator>::iterator i =
+	 objs.oids.begin();
+       i != objs.oids.end();
+       ++i) {
+    if (stripe_cache.blocked(*i)) {
+      dout(20) << __func__ << " " << *op << " waiting for " << *i << dendl;
+      return false;
+    }
+  }
+  if (untracked_writes) {
+    // written before overwrites were enabled; shards may not have them
+    dout(20) << __func__ << " " << *op << " waiting for "
+	     << untracked_writes << " untracked writes" << dendl;
+    return false;
+  }
+
+  RMWPlanner planner(this, op);
+  op->t->visit(planner);
+  op->rmw_planned = true;
+  op->using_cache = true;
+  if (planner.to_read.empty())
+    return true;
+
+  set<int> want_to_read;
+  get_want_to_read_shards(&want_to_read);
+  map<hobject_t, read_request_t, hobject_t::BitwiseComparator> for_read_op;
+  for (map<hobject_t, set<uint64_t>, hobject_t::BitwiseComparator>::iterator i =
+	 planner.to_read.begin();
+       i != planner.to_read.end();
+       ++i) {
+    set<pg_shard_t> shards;
+    int r = get_min_avail_to_read_shards(
+      i->first, want_to_read, false, false, &shards);
+    assert(r == 0);
+    list<boost::tuple<uint64_t, uint64_t, uint32_t> > offsets;
+    for (set<uint64_t>::iterator j = i->second.begin();
+	 j != i->second.end();
+	 ++j) {
+      offsets.push_back(boost::make_tuple(*j, sinfo.get_stripe_width(), 0));
+    }
+    dout(10) << __func__ << " " << *op << " reading " << i->second
+	     << " of " << i->first << " from " << shards << dendl;
+    for_read_op.insert(
+      make_pair(
+	i->first,
+	read_request_t(
+	  i->first,
+	  offsets,
+	  shards,
+	  false,
+	  new RMWReadCB(this, op->tid, i->first))));
+    ++op->rmw_reads;
+  }
+  start_read_op(
+    CEPH_MSG_PRIO_DEFAULT,
+    for_read_op,
+    op->client_op,
+    false, false);
+  return true;
+}
+
+/// widens overwrites to whole stripes and fills the stripe cache
+struct RMWFiller : public boost::static_visitor<void> {
+  ECBackend *ec;
+  ECBackend::Op *op;
+  typedef map<hobject_t, map<uint64_t, bufferlist>, hobject_t::BitwiseComparator> StripeMap;
+  StripeMap written;  ///< by earlier ops in this transaction
+  RMWFiller(ECBackend *ec, ECBackend::Op *op) : ec(ec), op(op) {}
+
+  bufferlist get_stripe(const hobject_t &oid, uint64_t off) {
+    bufferlist bl;
+    StripeMap::iterator o = written.find(oid);
+    if (o != written.end() && o->second.count(off))
+      return o->second[off];
+    o = op->rmw_read.find(oid);
+    if (o != op->rmw_read.end() && o->second.count(off))
+      return o->second[off];
+    if (ec->stripe_cache.get(oid, off, &bl))
+      return bl;
+    bl.append_zero(ec->sinfo.get_stripe_width());  // past the end
+    return bl;
+  }
+  void put_stripes(const hobject_t &oid, uint64_t off, bufferlist &bl) {
+    uint64_t sw = ec->sinfo.get_stripe_width();
+    for (uint64_t pos = 0; pos < bl.length(); pos += sw) {
+      bufferlist s;
+      s.substr_of(bl, pos, sw);
+      written[oid][off + pos] = s;
+      ec->stripe_cache.fill(op->tid, oid, off + pos, s);
+    }
+  }
+
+  void operator()(ECTransaction::OverwriteOp &wop) {
+    uint64_t sw = ec->sinfo.get_stripe_width();
+    uint64_t end = wop.off + wop.bl.length();
+    pair<uint64_t, uint64_t> bounds = ec->sinfo.offset_len_to_stripe_bounds(
+      make_pair(wop.off, (uint64_t)wop.bl.length()));
+    bufferlist bl;
+    if (wop.off % sw) {
+      bufferlist head;
+      head.substr_of(get_stripe(wop.oid, bounds.first), 0,
+		     wop.off - bounds.first);
+      bl.claim_append(head);
+    }
+    bl.append(wop.bl);
+    if (end % sw) {
+      uint64_t tail_off = bounds.first + bounds.second - sw;
+      bufferlist tail;
+      tail.substr_of(get_stripe(wop.oid, tail_off), end - tail_off,
+		     sw - (end - tail_off));
+      bl.claim_append(tail);
+    }
+    assert(bl.length() == bounds.second);
+    if (op->unstable_hash_infos[wop.oid]->has_chunk_hash()) {
+      for (uint64_t s = bounds.first;
+	   s < bounds.first + bounds.second;
+	   s += sw)
+	wop.old_bl.append(get_stripe(wop.oid, s));
+    }
+    wop.off = bounds.first;
+    wop.bl.claim(bl);
+    put_stripes(wop.oid, wop.off, wop.bl);
+  }
+  void operator()(ECTransaction::AppendOp &aop) {
+    bufferlist bl(aop.bl);
+    uint64_t padded = ec->sinfo.logical_to_next_stripe_offset(bl.length());
+    bl.append_zero(padded - bl.length());
+    put_stripes(aop.oid, aop.off, bl);
+  }
+  void operator()(ECTransaction::CloneOp &cop) {
+    written[cop.target] = written[cop.source];
+  }
+  void operator()(ECTransaction::RenameOp &rop) {
+    written[rop.destination].swap(written[rop.source]);
+    written.erase(rop.source);
+  }
+  void operator()(ECTransaction::StashOp &sop) {
+    written.erase(sop.oid);
+  }
+  void operator()(ECTransaction::RemoveOp &rop) {
+    written.erase(rop.oid);
+  }
+  void operator()(ECTransaction::TouchOp &) {}
+  void operator()(ECTransaction::SetAttrsOp &) {}
+  void operator()(ECTransaction::RmAttrOp &) {}
+  void operator()(ECTransaction::AllocHintOp &) {}
+  void operator()(ECTransaction::NoOp &) {}
+};
+
+void ECBackend::fill_rmw(Op *op)
+{
+  RMWFiller filler(this, op);
+  for (list<ECTransaction::Op>::iterator i = op->t->ops.begin();
+       i != op->t->ops.end();
+       ++i) {
+    boost::apply_visitor(filler, *i);
+  }
+  op->rmw_read.clear();
+}
+
+void ECBackend::fail_rmw(Op *op)
+{
+  dout(10) << __func__ << ": " << *op << " " << cpp_strerror(op->rmw_error)
+	   << dendl;
+  stripe_cache.release(op->tid);
+  op->using_cache = false;
+  if (op->on_local_applied_sync) {
+    // drops the ondisk write locks
+    op->on_local_applied_sync->complete(0);
+    op->on_local_applied_sync = 0;
+  }
+  delete op->on_all_applied;
+  op->on_all_applied = 0;
+  delete op->on_all_commit;
+  op->on_all_commit = 0;
+  ceph_tid_t tid = op->tid;
+  int r = op->rmw_error;
+  tid_to_op_map.erase(tid);
+  get_parent()->failed_write(tid, r);
+}
+
+void ECBackend::try_rmw()
+{
+  // ops are planned in order so that each sees the reservations of
+  // the ones queued before it
+  for (list<Op*>::iterator i = waiting_rmw.begin();
+       i != waiting_rmw.end();
+       ++i) {
+    if ((*i)->rmw_planned)
+      continue;
+    if (!plan_rmw(*i))
+      break;
+  }
+  while (!waiting_rmw.empty()) {
+    Op *op = waiting_rmw.front();
+    if (!op->rmw_planned || op->rmw_reads)
+      break;
+    if (op->rmw_error) {
+      // the parent completes writes in order, so wait for those ahead
+      if (!writing.empty())
+	break;
+      waiting_rmw.pop_front();
+      fail_rmw(op);
+      continue;
+    }
+    waiting_rmw.pop_front();
+    fill_rmw(op);
+    dout(10) << __func__ << ": starting " << *op << dendl;
+    start_write(op);
+    writing.push_back(op);
+  }
+}
+
 int ECBackend::get_min_avail_to_read_shards(
   const hobject_t &hoid,
   const set<int> &want,
   bool for_recovery,
   bool do_redundant_reads,
-  set<pg_shard_t> *to_read)
+  set<pg_shard_t> *to_read,
+  map<pg_shard_t, vector<pair<int, int> > > *subchunks)
 {
   // Make sure we don't do redundant reads for recovery
   assert(!for_recovery || !do_redundant_reads);
@@ -1487,7 +1911,21 @@ int ECBackend::get_min_avail_to_read_shards(
   }
 
   set<int> need;
-  int r = ec_impl->minimum_to_decode(want, have, &need);
+  map<int, vector<pair<int, int> > > need_subchunks;
+  int r;
+  if (subchunks) {
+    map<int, int> available;
+    for (set<int>::iterator i = have.begin(); i != have.end(); ++i)
+      available[*i] = 0;
+    r = ec_impl->minimum_to_decode_with_cost(want, available, &need_subchunks);
+    for (map<int, vector<pair<int, int> > >::iterator i =
+	   need_subchunks.begin();
+	 i != need_subchunks.end();
+	 ++i)
+      need.insert(i->first);
+  } else {
+    r = ec_impl->minimum_to_decode(want, have, &need);
+  }
   if (r < 0)
     return r;
 
@@ -1503,10 +1941,46 @@ int ECBackend::get_min_avail_to_read_shards(
        ++i) {
     assert(shards.count(shard_id_t(*i)));
     to_read->insert(shards[shard_id_t(*i)]);
+    if (!subchunks || !need_subchunks.count(*i))
+      continue;
+    const vector<pair<int, int> > &ranges = need_subchunks[*i];
+    if (ranges.size() == 1 && ranges[0].first == 0 &&
+	ranges[0].second == ec_impl->get_sub_chunk_count())
+      continue;
+    (*subchunks)[shards[shard_id_t(*i)]] = ranges;
   }
   return 0;
 }
 
+void ECBackend::add_shard_reads(
+  const read_request_t &req,
+  pg_shard_t shard,
+  pair<uint64_t, uint64_t> chunk_off_len,
+  uint32_t flags,
+  list<boost::tuple<uint64_t, uint64_t, uint32_t> > *reads) const
+{
+  map<pg_shard_t, vector<pair<int, int> > >::const_iterator sub =
+    req.subchunks.find(shard);
+  if (sub == req.subchunks.end()) {
+    reads->push_back(boost::make_tuple(chunk_off_len.first,
+				       chunk_off_len.second,
+				       flags));
+    return;
+  }
+  uint64_t sub_size = sinfo.get_chunk_size() / ec_impl->get_sub_chunk_count();
+  for (uint64_t off = chunk_off_len.first;
+       off < chunk_off_len.first + chunk_off_len.second;
+       off += sinfo.get_chunk_size()) {
+    for (vector<pair<int, int> >::const_iterator i = sub->second.begin();
+	 i != sub->second.end();
+	 ++i) {
+      reads->push_back(boost::make_tuple(off + i->first * sub_size,
+					 i->second * sub_size,
+					 flags));
+    }
+  }
+}
+
 int ECBackend::get_remaining_shards(
   const hobject_t &hoid,
   const set<int> &avail,
@@ -1595,9 +2069,8 @@ void ECBackend::start_read_op(
       for (set<pg_shard_t>::const_iterator k = i->second.need.begin();
 	   k != i->second.need.end();
 	   ++k) {
-	messages[*k].to_read[i->first].push_back(boost::make_tuple(chunk_off_len.first,
-								    chunk_off_len.second,
-								    j->get<2>()));
+	add_shard_reads(i->second, *k, chunk_off_len, j->get<2>(),
+			&messages[*k].to_read[i->first]);
       }
       assert(!need_attrs);
     }
@@ -1662,9 +2135,8 @@ void ECBackend::start_remaining_read_op(
       for (set<pg_shard_t>::const_iterator k = i->second.need.begin();
 	   k != i->second.need.end();
 	   ++k) {
-	messages[*k].to_read[i->first].push_back(boost::make_tuple(chunk_off_len.first,
-								    chunk_off_len.second,
-								    j->get<2>()));
+	add_shard_reads(i->second, *k, chunk_off_len, j->get<2>(),
+			&messages[*k].to_read[i->first]);
       }
       assert(!need_attrs);
     }
@@ -1747,6 +2219,19 @@ ECUtil::HashInfoRef ECBackend::get_hash_info(
 
 void ECBackend::check_op(Op *op)
 {
+  bool kick_rmw = false;
+  if (op->pending_apply.empty() && op->using_cache) {
+    // every shard can now serve what this op wrote
+    stripe_cache.release(op->tid);
+    op->using_cache = false;
+    kick_rmw = true;
+  }
+  if (op->pending_apply.empty() && op->untracked) {
+    assert(untracked_writes > 0);
+    --untracked_writes;
+    op->untracked = false;
+    kick_rmw = true;
+  }
   if (op->pending_apply.empty() && op->on_all_applied) {
     dout(10) << __func__ << " Calling on_all_applied on " << *op << dendl;
     op->on_all_applied->complete(0);
@@ -1763,12 +2248,15 @@ void ECBackend::check_op(Op *op)
     dout(10) << __func__ << " Completing " << *op << dendl;
     writing.pop_front();
     tid_to_op_map.erase(op->tid);
+    kick_rmw = true;
   }
   for (map<ceph_tid_t, Op>::iterator i = tid_to_op_map.begin();
        i != tid_to_op_map.end();
        ++i) {
     dout(20) << __func__ << " tid " << i->first <<": " << i->second << dendl;
   }
+  if (kick_rmw && !waiting_rmw.empty())
+    try_rmw();
 }
 
 void ECBackend::start_write(Op *op) {
@@ -1785,6 +2273,7 @@ void ECBackend::start_write(Op *op) {
     op->unstable_hash_infos,
     ec_impl,
     get_parent()->get_info().pgid.pgid,
+    ObjectModDesc::extent_stash_gen(op->version.version),
     sinfo,
     &trans,
     &(op->temp_added),
@@ -2050,6 +2539,21 @@ void ECBackend::rollback_append(
       old_size));
 }
 
+void ECBackend::rollback_extents(
+  version_t gen,
+  const vector<pair<uint64_t, uint64_t> > &extents,
+  const hobject_t &hoid,
+  ObjectStore::Transaction *t)
+{
+  vector<pair<uint64_t, uint64_t> > chunk_extents;
+  for (vector<pair<uint64_t, uint64_t> >::const_iterator i = extents.begin();
+       i != extents.end();
+       ++i) {
+    chunk_extents.push_back(sinfo.aligned_offset_len_to_chunk(*i));
+  }
+  PGBackend::rollback_extents(gen, chunk_extents, hoid, t);
+}
+
 void ECBackend::be_deep_scrub(
   const hobject_t &poid,
   uint32_t seed,
@@ -2099,6 +2603,15 @@ void ECBackend::be_deep_scrub(
     o.read_error = true;
     o.digest_present = false;
     return;
+  } else if (!hinfo->has_chunk_hash()) {
+    // overwritten in place before the hashes were kept up to date,
+    // there is no hash to check against
+    if (hinfo->get_total_chunk_size() != pos) {
+      dout(0) << "_scan_list  " << poid << " got incorrect size on read" << dendl;
+      o.read_error = true;
+      return;
+    }
+    o.digest_present = false;
   } else {
     if (hinfo->get_chunk_hash(get_parent()->whoami_shard().shard) != h.digest()) {
       dout(0) << "_scan_list  " << poid << " got incorrect hash on read" << dendl;
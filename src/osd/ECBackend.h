@@ -234,6 +234,7 @@ private:
 
     // valid in state READING
     pair<uint64_t, uint64_t> extent_requested;
+    map<pg_shard_t, vector<pair<int, int> > > subchunks_requested;
 
     void dump(Formatter *f) const;
 
@@ -277,15 +278,19 @@ public:
     const list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
     const set<pg_shard_t> need;
     const bool want_attrs;
+    /// sub-chunk ranges to read from each chunk, whole chunks if absent
+    const map<pg_shard_t, vector<pair<int, int> > > subchunks;
     GenContext<pair<RecoveryMessages *, read_result_t& > &> *cb;
     read_request_t(
       const hobject_t &hoid,
       const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
       const set<pg_shard_t> &need,
       bool want_attrs,
-      GenContext<pair<RecoveryMessages *, read_result_t& > &> *cb)
+      GenContext<pair<RecoveryMessages *, read_result_t& > &> *cb,
+      const map<pg_shard_t, vector<pair<int, int> > > &subchunks =
+        map<pg_shard_t, vector<pair<int, int> > >())
       : to_read(to_read), need(need), want_attrs(want_attrs),
-	cb(cb) {}
+	subchunks(subchunks), cb(cb) {}
   };
   friend ostream &operator<<(ostream &lhs, const read_request_t &rhs);
 
@@ -344,6 +349,15 @@ public:
    * As with client reads, there is a possibility of out-of-order
    * completions. Thus, callbacks and completion are called in order
    * on the writing list.
+   *
+   * On pools that allow overwrites, writes that don't cover whole
+   * stripes need the old contents of the partial stripes at either end.
+   * Such ops wait on waiting_rmw, in order, until those stripes have
+   * been read from the shards or found in stripe_cache; then the write
+   * is widened to whole stripes and started.  Every queued write
+   * reserves the stripes it will write in stripe_cache, so that later
+   * ops take them from there rather than from shards that may not have
+   * applied them yet.
    */
   struct Op {
     hobject_t hoid;
@@ -368,6 +382,14 @@ public:
     set<pg_shard_t> pending_apply;
 
     map<hobject_t, ECUtil::HashInfoRef, hobject_t::BitwiseComparator> unstable_hash_infos;
+
+    bool rmw_planned = false;     ///< stripes reserved, reads sent
+    unsigned rmw_reads = 0;       ///< objects with reads outstanding
+    int rmw_error = 0;            ///< old stripes could not be read
+    map<hobject_t, map<uint64_t, bufferlist>, hobject_t::BitwiseComparator>
+      rmw_read;                   ///< old stripes read from the shards
+    bool using_cache = false;     ///< holds stripe_cache pins until applied
+    bool untracked = false;       ///< written without using stripe_cache
     ~Op() {
       delete on_local_applied_sync;
       delete on_all_applied;
@@ -396,7 +418,19 @@ public:
     RecoveryMessages *m);
 
   map<ceph_tid_t, Op> tid_to_op_map; /// lists below point into here
+  list<Op*> waiting_rmw;
   list<Op*> writing;
+  unsigned untracked_writes;  ///< ops in writing not using stripe_cache
+
+  friend struct RMWPlanner;
+  friend struct RMWFiller;
+  friend struct RMWReadCB;
+  bool plan_rmw(Op *op);
+  void handle_rmw_read(ceph_tid_t tid, const hobject_t &hoid,
+		       read_result_t &res);
+  void fill_rmw(Op *op);
+  void fail_rmw(Op *op);
+  void try_rmw();
 
   CephContext *cct;
   ErasureCodeInterfaceRef ec_impl;
@@ -453,6 +487,7 @@ public:
 
 
   const ECUtil::stripe_info_t sinfo;
+  ECUtil::StripeCache stripe_cache;
   /// If modified, ensure that the ref is held until the update is applied
   SharedPtrRegistry<hobject_t, ECUtil::HashInfo, hobject_t::BitwiseComparator> unstable_hashinfo_registry;
   ECUtil::HashInfoRef get_hash_info(const hobject_t &hoid, bool checks = true,
@@ -477,9 +512,19 @@ public:
     const set<int> &want,      ///< [in] desired shards
     bool for_recovery,         ///< [in] true if we may use non-acting replicas
     bool do_redundant_reads,   ///< [in] true if we want to issue redundant reads to reduce latency
-    set<pg_shard_t> *to_read   ///< [out] shards to read
+    set<pg_shard_t> *to_read,  ///< [out] shards to read
+    map<pg_shard_t, vector<pair<int, int> > > *subchunks = 0 ///< [out] partial chunk reads, if the code allows them
     ); ///< @return error code, 0 on success
 
+  /// queue the reads of one extent of req on shard, sub-chunk by
+  /// sub-chunk if req only needs part of its chunks
+  void add_shard_reads(
+    const read_request_t &req,
+    pg_shard_t shard,
+    pair<uint64_t, uint64_t> chunk_off_len,
+    uint32_t flags,
+    list<boost::tuple<uint64_t, uint64_t, uint32_t> > *reads) const;
+
   int get_remaining_shards(
     const hobject_t &hoid,
     const set<int> &avail,
@@ -494,6 +539,12 @@ public:
     uint64_t old_size,
     ObjectStore::Transaction *t);
 
+  void rollback_extents(
+    version_t gen,
+    const vector<pair<uint64_t, uint64_t> > &extents,
+    const hobject_t &hoid,
+    ObjectStore::Transaction *t);
+
   bool scrub_supported() { return true; }
   bool auto_repair_supported() const { return true; }
 
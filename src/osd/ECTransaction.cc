@@ -19,6 +19,7 @@
 #include "ECTransaction.h"
 #include "ECUtil.h"
 #include "os/ObjectStore.h"
+#include "include/interval_set.h"
 
 struct AppendObjectsGenerator: public boost::static_visitor<void> {
   set<hobject_t, hobject_t::BitwiseComparator> *out;
@@ -26,6 +27,9 @@ struct AppendObjectsGenerator: public boost::static_visitor<void> {
   void operator()(const ECTransaction::AppendOp &op) {
     out->insert(op.oid);
   }
+  void operator()(const ECTransaction::OverwriteOp &op) {
+    out->insert(op.oid);
+  }
   void operator()(const ECTransaction::TouchOp &op) {
     out->insert(op.oid);
   }
@@ -60,16 +64,22 @@ struct TransGenerator : public boost::static_visitor<void> {
 
   ErasureCodeInterfaceRef &ecimpl;
   const pg_t pgid;
+  const version_t rollback_gen;
   const ECUtil::stripe_info_t sinfo;
   map<shard_id_t, ObjectStore::Transaction> *trans;
   set<int> want;
   set<hobject_t, hobject_t::BitwiseComparator> *temp_added;
   set<hobject_t, hobject_t::BitwiseComparator> *temp_removed;
   stringstream *out;
+  /// chunk extents already stashed at rollback_gen
+  map<hobject_t, interval_set<uint64_t>, hobject_t::BitwiseComparator> stashed;
+  /// only data that predates the transaction needs stashing
+  map<hobject_t, uint64_t, hobject_t::BitwiseComparator> stash_limit;
   TransGenerator(
     map<hobject_t, ECUtil::HashInfoRef, hobject_t::BitwiseComparator> &hash_infos,
     ErasureCodeInterfaceRef &ecimpl,
     pg_t pgid,
+    version_t rollback_gen,
     const ECUtil::stripe_info_t &sinfo,
     map<shard_id_t, ObjectStore::Transaction> *trans,
     set<hobject_t, hobject_t::BitwiseComparator> *temp_added,
@@ -77,6 +87,7 @@ struct TransGenerator : public boost::static_visitor<void> {
     stringstream *out)
     : hash_infos(hash_infos),
       ecimpl(ecimpl), pgid(pgid),
+      rollback_gen(rollback_gen),
       sinfo(sinfo),
       trans(trans),
       temp_added(temp_added), temp_removed(temp_removed),
@@ -103,8 +114,17 @@ struct TransGenerator : public boost::static_visitor<void> {
   coll_t get_coll(shard_id_t shard) {
     return coll_t(spg_t(pgid, shard));
   }
+  void touched(const hobject_t &hoid, bool replaced = false) {
+    if (!stash_limit.count(hoid)) {
+      assert(hash_infos.count(hoid));
+      stash_limit[hoid] = hash_infos[hoid]->get_total_chunk_size();
+    }
+    if (replaced)
+      stash_limit[hoid] = 0;
+  }
 
   void operator()(const ECTransaction::TouchOp &op) {
+    touched(op.oid);
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
 	 ++i) {
@@ -136,6 +156,7 @@ struct TransGenerator : public boost::static_visitor<void> {
 
     assert(hash_infos.count(op.oid));
     ECUtil::HashInfoRef hinfo = hash_infos[op.oid];
+    touched(op.oid);
 
     // align
     if (bl.length() % sinfo.get_stripe_width())
@@ -181,9 +202,89 @@ struct TransGenerator : public boost::static_visitor<void> {
 	hbuf);
     }
   }
+  void operator()(const ECTransaction::OverwriteOp &op) {
+    assert(op.bl.length());
+    assert(op.off % sinfo.get_stripe_width() == 0);
+    assert(op.bl.length() % sinfo.get_stripe_width() == 0);
+    map<int, bufferlist> buffers;
+    bufferlist bl(op.bl);
+    int r = ECUtil::encode(
+      sinfo, ecimpl, bl, want, &buffers);
+    assert(r == 0);
+
+    assert(hash_infos.count(op.oid));
+    ECUtil::HashInfoRef hinfo = hash_infos[op.oid];
+    touched(op.oid);
+    uint64_t old_size = hinfo->get_total_chunk_size();
+    uint64_t limit = MIN(old_size, stash_limit[op.oid]);
+    pair<uint64_t, uint64_t> chunk = sinfo.aligned_offset_len_to_chunk(
+      make_pair(op.off, op.bl.length()));
+
+    // keep the old contents of the chunks we overwrite so that the log
+    // entry can be rolled back; ReplicatedPG logs the same extents
+    interval_set<uint64_t> to_stash;
+    if (chunk.first < limit)
+      to_stash.insert(chunk.first,
+		      MIN(chunk.first + chunk.second, limit) - chunk.first);
+    interval_set<uint64_t> &already = stashed[op.oid];
+    interval_set<uint64_t> overlap;
+    overlap.intersection_of(to_stash, already);
+    to_stash.subtract(overlap);
+    already.union_of(to_stash);
+
+    map<int, bufferlist> old_buffers;
+    if (hinfo->has_chunk_hash() && chunk.first < old_size) {
+      bufferlist old_bl;
+      old_bl.substr_of(
+	op.old_bl, 0,
+	sinfo.aligned_chunk_offset_to_logical_offset(
+	  MIN(chunk.second, old_size - chunk.first)));
+      r = ECUtil::encode(
+	sinfo, ecimpl, old_bl, want, &old_buffers);
+      assert(r == 0);
+    }
+    hinfo->overwrite(chunk.first, old_buffers, buffers);
+    bufferlist hbuf;
+    ::encode(
+      *hinfo,
+      hbuf);
+
+    for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
+	 i != trans->end();
+	 ++i) {
+      assert(buffers.count(i->first));
+      bufferlist &enc_bl = buffers[i->first];
+      coll_t cid(get_coll_ct(i->first, op.oid));
+      ghobject_t goid(op.oid, ghobject_t::NO_GEN, i->first);
+      if (!to_stash.empty()) {
+	ghobject_t stash_oid(op.oid, rollback_gen, i->first);
+	i->second.touch(cid, stash_oid);
+	for (interval_set<uint64_t>::iterator j = to_stash.begin();
+	     j != to_stash.end();
+	     ++j) {
+	  i->second.clone_range(
+	    cid, goid, stash_oid, j.get_start(), j.get_len(), j.get_start());
+	}
+      }
+      i->second.write(
+	cid,
+	goid,
+	chunk.first,
+	enc_bl.length(),
+	enc_bl,
+	op.fadvise_flags);
+      i->second.setattr(
+	cid,
+	goid,
+	ECUtil::get_hinfo_key(),
+	hbuf);
+    }
+  }
   void operator()(const ECTransaction::CloneOp &op) {
     assert(hash_infos.count(op.source));
     assert(hash_infos.count(op.target));
+    touched(op.source);
+    touched(op.target, true);
     *(hash_infos[op.target]) = *(hash_infos[op.source]);
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
@@ -197,6 +298,8 @@ struct TransGenerator : public boost::static_visitor<void> {
   void operator()(const ECTransaction::RenameOp &op) {
     assert(hash_infos.count(op.source));
     assert(hash_infos.count(op.destination));
+    touched(op.source, true);
+    touched(op.destination, true);
     *(hash_infos[op.destination]) = *(hash_infos[op.source]);
     hash_infos[op.source]->clear();
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
@@ -211,6 +314,7 @@ struct TransGenerator : public boost::static_visitor<void> {
   }
   void operator()(const ECTransaction::StashOp &op) {
     assert(hash_infos.count(op.oid));
+    touched(op.oid, true);
     hash_infos[op.oid]->clear();
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
@@ -225,6 +329,7 @@ struct TransGenerator : public boost::static_visitor<void> {
   }
   void operator()(const ECTransaction::RemoveOp &op) {
     assert(hash_infos.count(op.oid));
+    touched(op.oid, true);
     hash_infos[op.oid]->clear();
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
@@ -280,6 +385,7 @@ void ECTransaction::generate_transactions(
   map<hobject_t, ECUtil::HashInfoRef, hobject_t::BitwiseComparator> &hash_infos,
   ErasureCodeInterfaceRef &ecimpl,
   pg_t pgid,
+  version_t rollback_gen,
   const ECUtil::stripe_info_t &sinfo,
   map<shard_id_t, ObjectStore::Transaction> *transactions,
   set<hobject_t, hobject_t::BitwiseComparator> *temp_added,
@@ -290,6 +396,7 @@ void ECTransaction::generate_transactions(
     hash_infos,
     ecimpl,
     pgid,
+    rollback_gen,
     sinfo,
     transactions,
     temp_added,
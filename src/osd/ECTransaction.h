@@ -30,6 +30,17 @@ public:
     AppendOp(const hobject_t &oid, uint64_t off, bufferlist &bl, uint32_t flags)
       : oid(oid), off(off), bl(bl), fadvise_flags(flags) {}
   };
+  /// write into existing data, stripe aligned by ECBackend before encoding
+  struct OverwriteOp {
+    hobject_t oid;
+    uint64_t off;
+    bufferlist bl;
+    bufferlist old_bl;  ///< what bl replaces, filled in with bl by ECBackend
+    uint32_t fadvise_flags;
+    OverwriteOp(const hobject_t &oid, uint64_t off, bufferlist &bl,
+		uint32_t flags)
+      : oid(oid), off(off), bl(bl), fadvise_flags(flags) {}
+  };
   struct CloneOp {
     hobject_t source;
     hobject_t target;
@@ -90,6 +101,7 @@ public:
   struct NoOp {};
   typedef boost::variant<
     AppendOp,
+    OverwriteOp,
     CloneOp,
     RenameOp,
     StashOp,
@@ -122,6 +134,20 @@ public:
     assert(len == bl.length());
     ops.push_back(AppendOp(hoid, off, bl, fadvise_flags));
   }
+  void write(
+    const hobject_t &hoid,
+    uint64_t off,
+    uint64_t len,
+    bufferlist &bl,
+    uint32_t fadvise_flags) {
+    if (len == 0) {
+      touch(hoid);
+      return;
+    }
+    written += len;
+    assert(len == bl.length());
+    ops.push_back(OverwriteOp(hoid, off, bl, fadvise_flags));
+  }
   void stash(
     const hobject_t &hoid,
     version_t former_version) {
@@ -202,6 +228,7 @@ public:
     map<hobject_t, ECUtil::HashInfoRef, hobject_t::BitwiseComparator> &hash_infos,
     ErasureCodeInterfaceRef &ecimpl,
     pg_t pgid,
+    version_t rollback_gen,  ///< stash for overwritten extents
     const ECUtil::stripe_info_t &sinfo,
     map<shard_id_t, ObjectStore::Transaction> *transactions,
     set<hobject_t, hobject_t::BitwiseComparator> *temp_added,
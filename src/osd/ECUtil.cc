@@ -47,16 +47,42 @@ int ECUtil::decode(
   ErasureCodeInterfaceRef &ec_impl,
   map<int, bufferlist> &to_decode,
   map<int, bufferlist*> &out) {
-  assert(to_decode.size());
+  return decode(sinfo, ec_impl, to_decode, out,
+		map<int, vector<pair<int, int> > >());
+}
 
-  uint64_t total_data_size = to_decode.begin()->second.length();
-  assert(total_data_size % sinfo.get_chunk_size() == 0);
+int ECUtil::decode(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  map<int, bufferlist> &to_decode,
+  map<int, bufferlist*> &out,
+  const map<int, vector<pair<int, int> > > &subchunks) {
+  assert(to_decode.size());
 
+  // bytes of each stripe read from every shard
+  uint64_t sub_size = sinfo.get_chunk_size() / ec_impl->get_sub_chunk_count();
+  map<int, uint64_t> read_size;
+  uint64_t num_stripes = 0;
   for (map<int, bufferlist>::iterator i = to_decode.begin();
        i != to_decode.end();
        ++i) {
-    assert(i->second.length() == total_data_size);
+    uint64_t size = sinfo.get_chunk_size();
+    map<int, vector<pair<int, int> > >::const_iterator sub =
+      subchunks.find(i->first);
+    if (sub != subchunks.end()) {
+      size = 0;
+      for (vector<pair<int, int> >::const_iterator j = sub->second.begin();
+	   j != sub->second.end();
+	   ++j)
+	size += j->second * sub_size;
+    }
+    assert(i->second.length() % size == 0);
+    if (i == to_decode.begin())
+      num_stripes = i->second.length() / size;
+    assert(i->second.length() == num_stripes * size);
+    read_size[i->first] = size;
   }
+  uint64_t total_data_size = num_stripes * sinfo.get_chunk_size();
 
   if (total_data_size == 0)
     return 0;
@@ -70,15 +96,16 @@ int ECUtil::decode(
     need.insert(i->first);
   }
 
-  for (uint64_t i = 0; i < total_data_size; i += sinfo.get_chunk_size()) {
+  for (uint64_t i = 0; i < num_stripes; ++i) {
     map<int, bufferlist> chunks;
     for (map<int, bufferlist>::iterator j = to_decode.begin();
 	 j != to_decode.end();
 	 ++j) {
-      chunks[j->first].substr_of(j->second, i, sinfo.get_chunk_size());
+      chunks[j->first].substr_of(j->second, i * read_size[j->first],
+				 read_size[j->first]);
     }
     map<int, bufferlist> out_bls;
-    int r = ec_impl->decode(need, chunks, &out_bls);
+    int r = ec_impl->decode(need, chunks, &out_bls, sinfo.get_chunk_size());
     assert(r == 0);
     for (map<int, bufferlist*>::iterator j = out.begin();
 	 j != out.end();
@@ -112,19 +139,9 @@ int ECUtil::encode(
   if (logical_size == 0)
     return 0;
 
-  for (uint64_t i = 0; i < logical_size; i += sinfo.get_stripe_width()) {
-    map<int, bufferlist> encoded;
-    bufferlist buf;
-    buf.substr_of(in, i, sinfo.get_stripe_width());
-    int r = ec_impl->encode(want, buf, &encoded);
-    assert(r == 0);
-    for (map<int, bufferlist>::iterator i = encoded.begin();
-	 i != encoded.end();
-	 ++i) {
-      assert(i->second.length() == sinfo.get_chunk_size());
-      (*out)[i->first].claim_append(i->second);
-    }
-  }
+  int r = ec_impl->encode_stripes(
+    want, in, logical_size / sinfo.get_stripe_width(), out);
+  assert(r == 0);
 
   for (map<int, bufferlist>::iterator i = out->begin();
        i != out->end();
@@ -139,9 +156,13 @@ int ECUtil::encode(
 
 void ECUtil::HashInfo::append(uint64_t old_size,
 			      map<int, bufferlist> &to_append) {
-  assert(to_append.size() == cumulative_shard_hashes.size());
   assert(old_size == total_chunk_size);
   uint64_t size_to_append = to_append.begin()->second.length();
+  if (!has_chunk_hash()) {
+    total_chunk_size += size_to_append;
+    return;
+  }
+  assert(to_append.size() == cumulative_shard_hashes.size());
   for (map<int, bufferlist>::iterator i = to_append.begin();
        i != to_append.end();
        ++i) {
@@ -153,6 +174,48 @@ void ECUtil::HashInfo::append(uint64_t old_size,
   total_chunk_size += size_to_append;
 }
 
+void ECUtil::HashInfo::overwrite(uint64_t offset,
+				 map<int, bufferlist> &old_chunks,
+				 map<int, bufferlist> &new_chunks) {
+  uint64_t len = new_chunks.begin()->second.length();
+  uint64_t end = offset + len;
+  if (!has_chunk_hash()) {
+    total_chunk_size = MAX(total_chunk_size, end);
+    return;
+  }
+  assert(new_chunks.size() == cumulative_shard_hashes.size());
+  uint64_t overlap = 0;
+  if (offset < total_chunk_size)
+    overlap = MIN(len, total_chunk_size - offset);
+  for (map<int, bufferlist>::iterator i = new_chunks.begin();
+       i != new_chunks.end();
+       ++i) {
+    assert(len == i->second.length());
+    assert((unsigned)i->first < cumulative_shard_hashes.size());
+    uint32_t hash = cumulative_shard_hashes[i->first];
+    if (overlap) {
+      // crc32c is linear: swapping old for new changes the hash by the
+      // crc of their xor, carried through the rest of the chunk
+      assert(old_chunks.count(i->first));
+      assert(old_chunks[i->first].length() == overlap);
+      bufferlist replaced;
+      replaced.substr_of(i->second, 0, overlap);
+      uint32_t delta = old_chunks[i->first].crc32c(0) ^ replaced.crc32c(0);
+      hash ^= ceph_crc32c(delta, NULL, total_chunk_size - offset - overlap);
+    }
+    if (end > total_chunk_size) {
+      // a hole before the new data reads back as zeros
+      if (offset > total_chunk_size)
+	hash = ceph_crc32c(hash, NULL, offset - total_chunk_size);
+      bufferlist appended;
+      appended.substr_of(i->second, overlap, len - overlap);
+      hash = appended.crc32c(hash);
+    }
+    cumulative_shard_hashes[i->first] = hash;
+  }
+  total_chunk_size = MAX(total_chunk_size, end);
+}
+
 void ECUtil::HashInfo::encode(bufferlist &bl) const
 {
   ENCODE_START(1, 1, bl);
@@ -209,3 +272,192 @@ const string &ECUtil::get_hinfo_key()
 {
   return HINFO_KEY;
 }
+
+void ECUtil::StripeCache::lru_remove(Stripe &s)
+{
+  if (s.in_lru) {
+    lru.erase(s.lru_pos);
+    s.in_lru = false;
+  }
+}
+
+void ECUtil::StripeCache::erase_stripe(
+  Object &o, map<uint64_t, Stripe>::iterator p)
+{
+  lru_remove(p->second);
+  if (p->second.valid)
+    bytes -= stripe_width;
+  o.stripes.erase(p);
+}
+
+void ECUtil::StripeCache::trim()
+{
+  while (bytes > max_bytes && !lru.empty()) {
+    ObjectMap::iterator o = objects.find(lru.back().first);
+    assert(o != objects.end());
+    map<uint64_t, Stripe>::iterator p = o->second.stripes.find(
+      lru.back().second);
+    assert(p != o->second.stripes.end());
+    erase_stripe(o->second, p);
+    if (o->second.stripes.empty() && o->second.barriers.empty())
+      objects.erase(o);
+  }
+}
+
+bool ECUtil::StripeCache::blocked(const hobject_t &oid) const
+{
+  ObjectMap::const_iterator o = objects.find(oid);
+  return o != objects.end() && !o->second.barriers.empty();
+}
+
+uint64_t ECUtil::StripeCache::get_projected_size(
+  const hobject_t &oid, uint64_t disk_size)
+{
+  ObjectMap::iterator o = objects.find(oid);
+  if (o == objects.end())
+    return disk_size;
+  return o->second.projected_size;
+}
+
+bool ECUtil::StripeCache::have(const hobject_t &oid, uint64_t off) const
+{
+  ObjectMap::const_iterator o = objects.find(oid);
+  if (o == objects.end())
+    return false;
+  map<uint64_t, Stripe>::const_iterator p = o->second.stripes.find(off);
+  return p != o->second.stripes.end() &&
+    (p->second.valid || p->second.pending);
+}
+
+bool ECUtil::StripeCache::get(
+  const hobject_t &oid, uint64_t off, bufferlist *bl)
+{
+  ObjectMap::iterator o = objects.find(oid);
+  if (o == objects.end())
+    return false;
+  map<uint64_t, Stripe>::iterator p = o->second.stripes.find(off);
+  if (p == o->second.stripes.end() || !p->second.valid)
+    return false;
+  *bl = p->second.bl;
+  if (p->second.in_lru) {
+    lru.splice(lru.begin(), lru, p->second.lru_pos);
+  }
+  return true;
+}
+
+void ECUtil::StripeCache::reserve(
+  ceph_tid_t tid, const hobject_t &oid, uint64_t off, uint64_t disk_size)
+{
+  assert(off % stripe_width == 0);
+  ObjectMap::iterator o = objects.find(oid);
+  if (o == objects.end())
+    o = objects.insert(make_pair(oid, Object(disk_size))).first;
+  Stripe &s = o->second.stripes[off];
+  lru_remove(s);
+  s.pending = tid;
+  if (s.writers.insert(tid).second)
+    pinned[tid].push_back(make_pair(oid, off));
+  if (off + stripe_width > o->second.projected_size)
+    o->second.projected_size = off + stripe_width;
+}
+
+void ECUtil::StripeCache::fill(
+  ceph_tid_t tid, const hobject_t &oid, uint64_t off, const bufferlist &bl)
+{
+  assert(bl.length() == stripe_width);
+  ObjectMap::iterator o = objects.find(oid);
+  if (o == objects.end())
+    return;
+  map<uint64_t, Stripe>::iterator p = o->second.stripes.find(off);
+  if (p == o->second.stripes.end() || !p->second.writers.count(tid))
+    return;  // dropped by a barrier
+  if (!p->second.valid)
+    bytes += stripe_width;
+  p->second.bl = bl;
+  p->second.valid = true;
+  if (p->second.pending == tid)
+    p->second.pending = 0;
+}
+
+void ECUtil::StripeCache::add_barrier(ceph_tid_t tid, const hobject_t &oid)
+{
+  ObjectMap::iterator o = objects.find(oid);
+  if (o == objects.end())
+    o = objects.insert(make_pair(oid, Object(0))).first;
+  while (!o->second.stripes.empty())
+    erase_stripe(o->second, o->second.stripes.begin());
+  o->second.projected_size = 0;
+  o->second.barriers.insert(tid);
+  barriers[tid].insert(oid);
+}
+
+void ECUtil::StripeCache::release(ceph_tid_t tid)
+{
+  map<ceph_tid_t, list<pair<hobject_t, uint64_t> > >::iterator pins =
+    pinned.find(tid);
+  if (pins != pinned.end()) {
+    for (list<pair<hobject_t, uint64_t> >::iterator i = pins->second.begin();
+	 i != pins->second.end();
+	 ++i) {
+      ObjectMap::iterator o = objects.find(i->first);
+      if (o == objects.end())
+	continue;
+      map<uint64_t, Stripe>::iterator p = o->second.stripes.find(i->second);
+      if (p == o->second.stripes.end() || !p->second.writers.erase(tid))
+	continue;
+      if (p->second.pending == tid)
+	p->second.pending = 0;  // never filled
+      if (!p->second.writers.empty())
+	continue;
+      if (p->second.valid) {
+	lru.push_front(make_pair(i->first, i->second));
+	p->second.lru_pos = lru.begin();
+	p->second.in_lru = true;
+      } else {
+	erase_stripe(o->second, p);
+	if (o->second.stripes.empty() && o->second.barriers.empty())
+	  objects.erase(o);
+      }
+    }
+    pinned.erase(pins);
+  }
+
+  map<ceph_tid_t, set<hobject_t, hobject_t::BitwiseComparator> >::iterator b =
+    barriers.find(tid);
+  if (b != barriers.end()) {
+    // the object is whatever the op left on disk; forget what we know
+    for (set<hobject_t, hobject_t::BitwiseComparator>::iterator i =
+	   b->second.begin();
+	 i != b->second.end();
+	 ++i) {
+      ObjectMap::iterator o = objects.find(*i);
+      if (o == objects.end())
+	continue;
+      o->second.barriers.erase(tid);
+      if (!o->second.barriers.empty())
+	continue;
+      bool pinned_stripes = false;
+      for (map<uint64_t, Stripe>::iterator p = o->second.stripes.begin();
+	   p != o->second.stripes.end();
+	   ++p) {
+	pinned_stripes |= !p->second.writers.empty();
+      }
+      if (!pinned_stripes) {
+	while (!o->second.stripes.empty())
+	  erase_stripe(o->second, o->second.stripes.begin());
+	objects.erase(o);
+      }
+    }
+    barriers.erase(b);
+  }
+  trim();
+}
+
+void ECUtil::StripeCache::clear()
+{
+  objects.clear();
+  lru.clear();
+  pinned.clear();
+  barriers.clear();
+  bytes = 0;
+}
@@ -15,6 +15,7 @@
 #ifndef ECUTIL_H
 #define ECUTIL_H
 
+#include <list>
 #include <map>
 #include <set>
 
@@ -24,6 +25,7 @@
 #include "include/assert.h"
 #include "include/encoding.h"
 #include "common/Formatter.h"
+#include "common/hobject.h"
 
 namespace ECUtil {
 
@@ -96,6 +98,15 @@ int decode(
   map<int, bufferlist> &to_decode,
   map<int, bufferlist*> &out);
 
+/// to_decode holds, for the shards in subchunks, only the listed
+/// (first, count) sub-chunk ranges of each chunk
+int decode(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  map<int, bufferlist> &to_decode,
+  map<int, bufferlist*> &out,
+  const map<int, vector<pair<int, int> > > &subchunks);
+
 int encode(
   const stripe_info_t &sinfo,
   ErasureCodeInterfaceRef &ec_impl,
@@ -112,6 +123,16 @@ public:
   : total_chunk_size(0),
     cumulative_shard_hashes(num_chunks, -1) {}
   void append(uint64_t old_size, map<int, bufferlist> &to_append);
+  /**
+   * replace the chunks at offset, growing the object if they run past
+   * its end
+   *
+   * @param old_chunks what the chunks held below the old size
+   * @param new_chunks what they hold now
+   */
+  void overwrite(uint64_t offset,
+		 map<int, bufferlist> &old_chunks,
+		 map<int, bufferlist> &new_chunks);
   void clear() {
     total_chunk_size = 0;
     cumulative_shard_hashes = vector<uint32_t>(
@@ -129,9 +150,95 @@ public:
   uint64_t get_total_chunk_size() const {
     return total_chunk_size;
   }
+  /// false for objects overwritten in place before overwrite() kept them
+  bool has_chunk_hash() const {
+    return !cumulative_shard_hashes.empty();
+  }
 };
 typedef ceph::shared_ptr<HashInfo> HashInfoRef;
 
+/**
+ * StripeCache
+ *
+ * Logical contents of stripes written by recent partial-stripe
+ * overwrites and appends, so that the next small write to the same
+ * stripe doesn't need to read the old data back from the shards.
+ *
+ * An op reserve()s every stripe it is going to write when it is queued
+ * and fill()s it with the new contents once it has built them.  Until
+ * the op is release()d (its write is applied on every shard) the stripe
+ * is pinned: a read from the shards could return stale data.  Unpinned
+ * stripes are kept up to max_bytes, least recently used first out.
+ *
+ * Ops that replace an object as a whole (stash, remove, rename, clone)
+ * add a barrier instead: the object's stripes are dropped and it is
+ * blocked() until the op is released.
+ */
+class StripeCache {
+  struct Stripe {
+    bufferlist bl;          ///< contents, valid once filled
+    bool valid;
+    ceph_tid_t pending;     ///< last reserving op, 0 once it filled
+    set<ceph_tid_t> writers;
+    bool in_lru;
+    list<pair<hobject_t, uint64_t> >::iterator lru_pos;
+    Stripe() : valid(false), pending(0), in_lru(false) {}
+  };
+  struct Object {
+    map<uint64_t, Stripe> stripes;
+    uint64_t projected_size; ///< stripe aligned, including queued writes
+    set<ceph_tid_t> barriers;
+    explicit Object(uint64_t size) : projected_size(size) {}
+  };
+  typedef map<hobject_t, Object, hobject_t::BitwiseComparator> ObjectMap;
+
+  const uint64_t stripe_width;
+  uint64_t max_bytes;
+  uint64_t bytes;
+  ObjectMap objects;
+  list<pair<hobject_t, uint64_t> > lru;  ///< unpinned valid stripes
+  map<ceph_tid_t, list<pair<hobject_t, uint64_t> > > pinned;
+  map<ceph_tid_t, set<hobject_t, hobject_t::BitwiseComparator> > barriers;
+
+  void lru_remove(Stripe &s);
+  void erase_stripe(Object &o, map<uint64_t, Stripe>::iterator p);
+  void trim();
+
+public:
+  StripeCache(uint64_t stripe_width, uint64_t max_bytes)
+    : stripe_width(stripe_width), max_bytes(max_bytes), bytes(0) {}
+
+  void set_max_bytes(uint64_t b) {
+    max_bytes = b;
+    trim();
+  }
+  uint64_t get_bytes() const {
+    return bytes;
+  }
+
+  /// true if an in-flight op is replacing oid
+  bool blocked(const hobject_t &oid) const;
+  /// logical size of oid once queued writes land; disk_size if untracked
+  uint64_t get_projected_size(const hobject_t &oid, uint64_t disk_size);
+  /// true if the stripe at off is cached or will be filled by a queued op
+  bool have(const hobject_t &oid, uint64_t off) const;
+  /// contents of the stripe at off, false if not (yet) known
+  bool get(const hobject_t &oid, uint64_t off, bufferlist *bl);
+
+  /// tid will write the stripe at off of oid, which has disk_size now
+  void reserve(ceph_tid_t tid, const hobject_t &oid, uint64_t off,
+	       uint64_t disk_size);
+  /// tid wrote bl (one stripe) at off
+  void fill(ceph_tid_t tid, const hobject_t &oid, uint64_t off,
+	    const bufferlist &bl);
+  /// tid replaces oid
+  void add_barrier(ceph_tid_t tid, const hobject_t &oid);
+  /// tid is applied everywhere, drop its pins and barriers
+  void release(ceph_tid_t tid);
+
+  void clear();
+};
+
 bool is_hinfo_key_string(const string &key);
 const string &get_hinfo_key();
 
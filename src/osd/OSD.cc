@@ -64,6 +64,7 @@
 #include "messages/MOSDFailure.h"
 #include "messages/MOSDMarkMeDown.h"
 #include "messages/MOSDOp.h"
+#include "messages/MOSDOpBatch.h"
 #include "messages/MOSDOpReply.h"
 #include "messages/MOSDRepOp.h"
 #include "messages/MOSDRepOpReply.h"
@@ -250,6 +251,8 @@ OSDService::OSDService(OSD *osd) :
   next_notif_id(0),
   backfill_request_lock("OSDService::backfill_request_lock"),
   backfill_request_timer(cct, backfill_request_lock, false),
+  scrub_sleep_lock("OSDService::scrub_sleep_lock"),
+  scrub_sleep_timer(cct, scrub_sleep_lock, false),
   last_tid(0),
   reserver_finisher(cct),
   local_reserver(&reserver_finisher, cct->_conf->osd_max_backfills,
@@ -260,6 +263,7 @@ OSDService::OSDService(OSD *osd) :
   recovery_lock("OSDService::recovery_lock"),
   recovery_ops_active(0),
   recovery_ops_reserved(0),
+  recovery_max_active_adapted(0),
   recovery_paused(false),
   map_cache_lock("OSDService::map_cache_lock"),
   map_cache(cct, cct->_conf->osd_map_cache_size),
@@ -489,6 +493,10 @@ void OSDService::shutdown()
     Mutex::Locker l(backfill_request_lock);
     backfill_request_timer.shutdown();
   }
+  {
+    Mutex::Locker l(scrub_sleep_lock);
+    scrub_sleep_timer.shutdown();
+  }
   osdmap = OSDMapRef();
   next_osdmap = OSDMapRef();
 }
@@ -1661,6 +1669,7 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
     cct->_conf->osd_op_num_threads_per_shard * cct->_conf->osd_op_num_shards),
   disk_tp(cct, "OSD::disk_tp", "tp_osd_disk", cct->_conf->osd_disk_threads, "osd_disk_threads"),
   command_tp(cct, "OSD::command_tp", "tp_osd_cmd",  1),
+  mapping_tp(cct, "OSD::mapping_tp", "tp_osd_map", 1),
   session_waiting_lock("OSD::session_waiting_lock"),
   heartbeat_lock("OSD::heartbeat_lock"),
   heartbeat_stop(false), heartbeat_update_lock("OSD::heartbeat_update_lock"),
@@ -1709,6 +1718,11 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
     cct->_conf->osd_remove_thread_timeout,
     cct->_conf->osd_remove_thread_suicide_timeout,
     &disk_tp),
+  mapping_wq(
+    cct,
+    cct->_conf->osd_op_thread_timeout,
+    cct->_conf->osd_op_thread_suicide_timeout,
+    &mapping_tp),
   service(this)
 {
   monc->set_messenger(client_messenger);
@@ -2017,6 +2031,7 @@ int OSD::init()
   tick_timer.init();
   tick_timer_without_osd_lock.init();
   service.backfill_request_timer.init();
+  service.scrub_sleep_timer.init();
 
   // mount.
   dout(2) << "mounting " << dev_path << " "
@@ -2188,6 +2203,7 @@ int OSD::init()
   osd_op_tp.start();
   disk_tp.start();
   command_tp.start();
+  mapping_tp.start();
 
   set_disk_tp_priority();
 
@@ -2426,54 +2442,67 @@ void OSD::create_logger()
 
   osd_plb.add_u64(l_osd_op_wip, "op_wip",
       "Replication operations currently being processed (primary)");   // rep ops currently being processed (primary)
-  osd_plb.add_u64_counter(l_osd_op,       "op",
+  // latency in usec from 100us, op size in bytes from 512 bytes
+  PerfHistogram::axis_config_d op_hist_lat_axis = {
+    "Latency (usec)", PerfHistogram::SCALE_LOG2, 0, 100, 16
+  };
+  PerfHistogram::axis_config_d op_hist_size_axis = {
+    "Request size (bytes)", PerfHistogram::SCALE_LOG2, 0, 512, 16
+  };
+  osd_plb.add_u64_counter_sharded(l_osd_op,       "op",
       "Client operations", "ops");           // client ops
-  osd_plb.add_u64_counter(l_osd_op_inb,   "op_in_bytes",
+  osd_plb.add_u64_counter_sharded(l_osd_op_inb,   "op_in_bytes",
       "Client operations total write size", "wr");       // client op in bytes (writes)
-  osd_plb.add_u64_counter(l_osd_op_outb,  "op_out_bytes",
+  osd_plb.add_u64_counter_sharded(l_osd_op_outb,  "op_out_bytes",
       "Client operations total read size", "rd");      // client op out bytes (reads)
-  osd_plb.add_time_avg(l_osd_op_lat,   "op_latency",
+  osd_plb.add_time_avg_sharded(l_osd_op_lat,   "op_latency",
       "Latency of client operations (including queue time)", "lat");       // client op latency
-  osd_plb.add_time_avg(l_osd_op_process_lat, "op_process_latency",
+  osd_plb.add_time_avg_sharded(l_osd_op_process_lat, "op_process_latency",
       "Latency of client operations (excluding queue time)");   // client op process latency
-  osd_plb.add_time_avg(l_osd_op_prepare_lat, "op_prepare_latency",
+  osd_plb.add_time_avg_sharded(l_osd_op_prepare_lat, "op_prepare_latency",
       "Latency of client operations (excluding queue time and wait for finished)"); // client op prepare latency
 
-  osd_plb.add_u64_counter(l_osd_op_r,      "op_r",
+  osd_plb.add_u64_counter_sharded(l_osd_op_r,      "op_r",
       "Client read operations");        // client reads
-  osd_plb.add_u64_counter(l_osd_op_r_outb, "op_r_out_bytes",
+  osd_plb.add_u64_counter_sharded(l_osd_op_r_outb, "op_r_out_bytes",
       "Client data read");   // client read out bytes
-  osd_plb.add_time_avg(l_osd_op_r_lat,  "op_r_latency",
+  osd_plb.add_time_avg_sharded(l_osd_op_r_lat,  "op_r_latency",
       "Latency of read operation (including queue time)");    // client read latency
-  osd_plb.add_time_avg(l_osd_op_r_process_lat, "op_r_process_latency",
+  osd_plb.add_time_avg_sharded(l_osd_op_r_process_lat, "op_r_process_latency",
       "Latency of read operation (excluding queue time)");   // client read process latency
-  osd_plb.add_time_avg(l_osd_op_r_prepare_lat, "op_r_prepare_latency",
+  osd_plb.add_time_avg_sharded(l_osd_op_r_prepare_lat, "op_r_prepare_latency",
       "Latency of read operations (excluding queue time and wait for finished)"); // client read prepare latency
-  osd_plb.add_u64_counter(l_osd_op_w,      "op_w",
+  osd_plb.add_histogram(l_osd_op_r_lat_outb_hist, "op_r_latency_out_bytes_histogram",
+      op_hist_lat_axis, op_hist_size_axis,
+      "Histogram of operation latency (including queue time) + data read");
+  osd_plb.add_u64_counter_sharded(l_osd_op_w,      "op_w",
       "Client write operations");        // client writes
-  osd_plb.add_u64_counter(l_osd_op_w_inb,  "op_w_in_bytes",
+  osd_plb.add_u64_counter_sharded(l_osd_op_w_inb,  "op_w_in_bytes",
       "Client data written");    // client write in bytes
-  osd_plb.add_time_avg(l_osd_op_w_rlat, "op_w_rlat",
+  osd_plb.add_time_avg_sharded(l_osd_op_w_rlat, "op_w_rlat",
       "Client write operation readable/applied latency");   // client write readable/applied latency
-  osd_plb.add_time_avg(l_osd_op_w_lat,  "op_w_latency",
+  osd_plb.add_time_avg_sharded(l_osd_op_w_lat,  "op_w_latency",
       "Latency of write operation (including queue time)");    // client write latency
-  osd_plb.add_time_avg(l_osd_op_w_process_lat, "op_w_process_latency",
+  osd_plb.add_time_avg_sharded(l_osd_op_w_process_lat, "op_w_process_latency",
       "Latency of write operation (excluding queue time)");   // client write process latency
-  osd_plb.add_time_avg(l_osd_op_w_prepare_lat, "op_w_prepare_latency",
+  osd_plb.add_time_avg_sharded(l_osd_op_w_prepare_lat, "op_w_prepare_latency",
       "Latency of write operations (excluding queue time and wait for finished)"); // client write prepare latency
-  osd_plb.add_u64_counter(l_osd_op_rw,     "op_rw",
+  osd_plb.add_histogram(l_osd_op_w_lat_inb_hist, "op_w_latency_in_bytes_histogram",
+      op_hist_lat_axis, op_hist_size_axis,
+      "Histogram of operation latency (including queue time) + data written");
+  osd_plb.add_u64_counter_sharded(l_osd_op_rw,     "op_rw",
       "Client read-modify-write operations");       // client rmw
-  osd_plb.add_u64_counter(l_osd_op_rw_inb, "op_rw_in_bytes",
+  osd_plb.add_u64_counter_sharded(l_osd_op_rw_inb, "op_rw_in_bytes",
       "Client read-modify-write operations write in");   // client rmw in bytes
-  osd_plb.add_u64_counter(l_osd_op_rw_outb,"op_rw_out_bytes",
+  osd_plb.add_u64_counter_sharded(l_osd_op_rw_outb,"op_rw_out_bytes",
       "Client read-modify-write operations read out ");  // client rmw out bytes
-  osd_plb.add_time_avg(l_osd_op_rw_rlat,"op_rw_rlat",
+  osd_plb.add_time_avg_sharded(l_osd_op_rw_rlat,"op_rw_rlat",
       "Client read-modify-write operation readable/applied latency");  // client rmw readable/applied latency
-  osd_plb.add_time_avg(l_osd_op_rw_lat, "op_rw_latency",
+  osd_plb.add_time_avg_sharded(l_osd_op_rw_lat, "op_rw_latency",
       "Latency of read-modify-write operation (including queue time)");   // client rmw latency
-  osd_plb.add_time_avg(l_osd_op_rw_process_lat, "op_rw_process_latency",
+  osd_plb.add_time_avg_sharded(l_osd_op_rw_process_lat, "op_rw_process_latency",
       "Latency of read-modify-write operation (excluding queue time)");   // client rmw process latency
-  osd_plb.add_time_avg(l_osd_op_rw_prepare_lat, "op_rw_prepare_latency",
+  osd_plb.add_time_avg_sharded(l_osd_op_rw_prepare_lat, "op_rw_prepare_latency",
       "Latency of read-modify-write operations (excluding queue time and wait for finished)"); // client rmw prepare latency
 
   osd_plb.add_u64_counter(l_osd_sop,       "subop", "Suboperations");         // subops
@@ -2495,6 +2524,10 @@ void OSD::create_logger()
 
   osd_plb.add_u64_counter(l_osd_rop, "recovery_ops",
       "Started recovery operations", "recop");       // recovery ops (started)
+  osd_plb.add_u64(l_osd_rop_max_active, "recovery_max_active",
+      "Current limit on active recovery operations");
+  osd_plb.add_time_avg_sharded(l_osd_op_queue_lat, "op_queue_latency",
+      "Time client operations wait in the op queue before reaching their PG");
 
   osd_plb.add_u64(l_osd_loadavg, "loadavg", "CPU load");
   osd_plb.add_u64(l_osd_buf, "buffer_bytes", "Total allocated buffer size");       // total ceph::buffer bytes
@@ -2688,6 +2721,10 @@ int OSD::shutdown()
   command_tp.stop();
   dout(10) << "command tp stopped" << dendl;
 
+  mapping_tp.drain();
+  mapping_tp.stop();
+  dout(10) << "mapping tp stopped" << dendl;
+
   disk_tp.drain();
   disk_tp.stop();
   dout(10) << "disk tp paused (new)" << dendl;
@@ -4334,6 +4371,7 @@ void OSD::tick()
     check_replay_queue();
 
     service.promote_throttle_recalibrate();
+    service.recovery_throttle_recalibrate();
   }
 
   // only do waiters if dispatch() isn't currently running.  (if it is,
@@ -5962,6 +6000,16 @@ void OSD::ms_fast_dispatch(Message *m)
     m->put();
     return;
   }
+  if (m->get_type() == MSG_OSD_OP_BATCH) {
+    MOSDOpBatch *b = static_cast<MOSDOpBatch*>(m);
+    list<Message*> ops;
+    b->claim_ops(&ops);
+    dout(15) << __func__ << " " << *b << " from " << b->get_source() << dendl;
+    b->put();
+    for (list<Message*>::iterator p = ops.begin(); p != ops.end(); ++p)
+      ms_fast_dispatch(*p);
+    return;
+  }
   OpRequestRef op = op_tracker.create_request<OpRequest, Message*>(m);
   {
 #ifdef WITH_LTTNG
@@ -6673,6 +6721,14 @@ void OSD::trim_maps(epoch_t oldest, int nreceived, bool skip_maps)
   assert(min <= service.map_cache.cached_key_lower_bound());
 }
 
+void OSD::MappingWQ::_process(OSDMapRef m, ThreadPool::TPHandle &)
+{
+  // patched in the meantime, or no longer wanted
+  if (!cct->_conf->osd_map_cache_mapping || m->get_mapping())
+    return;
+  m->publish_mapping(m->build_mapping(cct));
+}
+
 void OSD::handle_osd_map(MOSDMap *m)
 {
   assert(osd_lock.is_locked());
@@ -6753,7 +6809,11 @@ void OSD::handle_osd_map(MOSDMap *m)
 
   ObjectStore::Transaction t;
 
-  // store new maps: queue for disk and put in the osdmap cache
+  // store new maps: queue for disk and put in the osdmap cache.  only
+  // the newest epoch keeps precomputed pg mappings; the epochs in
+  // between just hand the previous mapping on to be patched.  if it
+  // can't be patched, mapping_wq computes it without osd_lock.
+  ceph::shared_ptr<const OSDMapMapping> carry_mapping;
   epoch_t start = MAX(superblock.newest_map + 1, first);
   for (epoch_t e = start; e <= last; e++) {
     map<epoch_t,bufferlist>::iterator p;
@@ -6764,6 +6824,7 @@ void OSD::handle_osd_map(MOSDMap *m)
       bufferlist& bl = p->second;
 
       o->decode(bl);
+      carry_mapping.reset();
 
       ghobject_t fulloid = get_osdmap_pobject_name(e);
       t.write(coll_t::meta(), fulloid, 0, bl.length(), bl);
@@ -6788,6 +6849,14 @@ void OSD::handle_osd_map(MOSDMap *m)
         bool got = get_map_bl(e - 1, obl);
         assert(got);
 	o->decode(obl);
+	// let apply_incremental patch the pg mappings we already have
+	if (carry_mapping) {
+	  o->share_mapping(carry_mapping);
+	} else {
+	  OSDMapRef prev = service.try_get_cached_map(e - 1);
+	  if (prev)
+	    o->share_mapping(*prev);
+	}
       }
 
       OSDMap::Incremental inc;
@@ -6797,6 +6866,8 @@ void OSD::handle_osd_map(MOSDMap *m)
 	derr << "ERROR: bad fsid?  i have " << osdmap->get_fsid() << " and inc has " << inc.fsid << dendl;
 	assert(0 == "bad fsid");
       }
+      if (e != last)
+	carry_mapping = o->take_mapping();
 
       bufferlist fbl;
       o->encode(fbl, inc.encode_features | CEPH_FEATURE_RESERVED);
@@ -6833,6 +6904,10 @@ void OSD::handle_osd_map(MOSDMap *m)
     assert(0 == "MOSDMap lied about what maps it had?");
   }
 
+  if (cct->_conf->osd_map_cache_mapping &&
+      !pinned_maps.empty() && !pinned_maps.back()->get_mapping())
+    mapping_wq.queue(pinned_maps.back());
+
   // even if this map isn't from a mon, we may have satisfied our subscription
   monc->sub_got("osdmap", last);
 
@@ -8350,20 +8425,93 @@ void OSD::check_replay_queue()
 void OSDService::_maybe_queue_recovery() {
   assert(recovery_lock.is_locked_by_me());
   uint64_t available_pushes;
+  // when the limit has been raised, let each pg start proportionally
+  // more objects at once; their pushes then share MOSDPGPush messages
+  uint64_t single_start = cct->_conf->osd_recovery_max_single_start *
+    MAX(_get_recovery_max_active() /
+	MAX(cct->_conf->osd_recovery_max_active, 1), 1);
   while (!awaiting_throttle.empty() &&
 	 _recover_now(&available_pushes)) {
-    uint64_t to_start = MIN(
-      available_pushes,
-      cct->_conf->osd_recovery_max_single_start);
+    uint64_t to_start = MIN(available_pushes, single_start);
     _queue_for_recovery(awaiting_throttle.front(), to_start);
     awaiting_throttle.pop_front();
     recovery_ops_reserved += to_start;
   }
 }
 
+uint64_t OSDService::_get_recovery_max_active()
+{
+  assert(recovery_lock.is_locked_by_me());
+  if (cct->_conf->osd_recovery_client_latency_target > 0)
+    return MAX(recovery_max_active_adapted,
+	       cct->_conf->osd_recovery_max_active);
+  return cct->_conf->osd_recovery_max_active;
+}
+
+/*
+ * With osd_recovery_client_latency_target set, move the limit on
+ * active recovery ops between osd_recovery_max_active and
+ * osd_recovery_max_active_limit: grow it while client ops wait in
+ * the op queue for less than the target, halve it when they don't.
+ * Queue time, unlike op_latency, leaves out time spent waiting on
+ * degraded objects, which more recovery would only shorten.  With
+ * perf counters off, or reset under us, there is nothing to go by.
+ */
+void OSDService::recovery_throttle_recalibrate()
+{
+  double target = cct->_conf->osd_recovery_client_latency_target;
+  uint64_t min = cct->_conf->osd_recovery_max_active;
+  uint64_t max = MAX(cct->_conf->osd_recovery_max_active_limit, min);
+
+  // client op queue latency since the last call; none if the counter
+  // went backwards
+  pair<uint64_t,uint64_t> lat = logger->get_tavg_ms(l_osd_op_queue_lat);
+  uint64_t ops = 0, ms = 0;
+  if (cct->_conf->perf &&
+      lat.first >= recovery_last_client_lat.first &&
+      lat.second >= recovery_last_client_lat.second) {
+    ops = lat.first - recovery_last_client_lat.first;
+    ms = lat.second - recovery_last_client_lat.second;
+  }
+  recovery_last_client_lat = lat;
+
+  Mutex::Locker l(recovery_lock);
+  uint64_t cur = MAX(recovery_max_active_adapted, min);
+  uint64_t next = recovery_max_active_step(cur, min, max, target, ops, ms);
+  if (next != cur)
+    dout(10) << __func__ << " " << ops << " client ops, avg "
+	     << (ops ? (double)ms / ops : 0) << " ms, target "
+	     << target * 1000.0 << " ms: max active " << cur << " -> "
+	     << next << dendl;
+  recovery_max_active_adapted = next;
+  logger->set(l_osd_rop_max_active, next);
+  _maybe_queue_recovery();
+}
+
+/**
+ * One step of the recovery limit: add an eighth (at least one) while
+ * ops average under target seconds in the queue, and halve it when they
+ * don't, within [min, max].  Without ops to measure, go back to min.
+ */
+uint64_t OSDService::recovery_max_active_step(
+  uint64_t cur, uint64_t min, uint64_t max, double target,
+  uint64_t ops, uint64_t ms)
+{
+  if (target <= 0)
+    return min;
+  // a tick without samples can't tell idle clients from disabled or
+  // reset counters, so it is no evidence that recovery may take more
+  if (!ops)
+    return min;
+  cur = MIN(MAX(cur, min), max);
+  if ((double)ms / ops < target * 1000.0)
+    return MIN(cur + MAX(cur / 8, 1), max);
+  return MAX(cur / 2, min);
+}
+
 bool OSDService::_recover_now(uint64_t *available_pushes)
 {
-  uint64_t max = cct->_conf->osd_recovery_max_active;
+  uint64_t max = _get_recovery_max_active();
   if (max <= recovery_ops_active + recovery_ops_reserved) {
     dout(15) << "_recover_now active " << recovery_ops_active
 	     << " + reserved " << recovery_ops_reserved
@@ -8463,7 +8611,7 @@ void OSDService::start_recovery_op(PG *pg, const hobject_t& soid)
   Mutex::Locker l(recovery_lock);
   dout(10) << "start_recovery_op " << *pg << " " << soid
 	   << " (" << recovery_ops_active << "/"
-	   << cct->_conf->osd_recovery_max_active << " rops)"
+	   << _get_recovery_max_active() << " rops)"
 	   << dendl;
   recovery_ops_active++;
 
@@ -8479,7 +8627,7 @@ void OSDService::finish_recovery_op(PG *pg, const hobject_t& soid, bool dequeue)
   Mutex::Locker l(recovery_lock);
   dout(10) << "finish_recovery_op " << *pg << " " << soid
 	   << " dequeue=" << dequeue
-	   << " (" << recovery_ops_active << "/" << cct->_conf->osd_recovery_max_active << " rops)"
+	   << " (" << recovery_ops_active << "/" << _get_recovery_max_active() << " rops)"
 	   << dendl;
 
   // adjust count
@@ -8910,6 +9058,12 @@ void OSD::dequeue_op(
   if (pg->deleting)
     return;
 
+  // only the first trip through the queue; requeues after waiting on
+  // degraded or blocked objects say nothing about our load
+  if (!op->been_reached_pg() &&
+      op->get_req()->get_type() == CEPH_MSG_OSD_OP &&
+      op->get_queued_time() != utime_t())
+    logger->tinc(l_osd_op_queue_lat, now - op->get_queued_time());
   op->mark_reached_pg();
 
   pg->do_request(op, handle);
@@ -47,6 +47,7 @@ using namespace std;
 #include "common/sharedptr_registry.hpp"
 #include "common/WeightedPriorityQueue.h"
 #include "common/PrioritizedQueue.h"
+#include "osd/mClockOpClassQueue.h"
 #include "messages/MOSDOp.h"
 #include "include/Spinlock.h"
 
@@ -67,12 +68,14 @@ enum {
   l_osd_op_r_lat,
   l_osd_op_r_process_lat,
   l_osd_op_r_prepare_lat,
+  l_osd_op_r_lat_outb_hist,
   l_osd_op_w,
   l_osd_op_w_inb,
   l_osd_op_w_rlat,
   l_osd_op_w_lat,
   l_osd_op_w_process_lat,
   l_osd_op_w_prepare_lat,
+  l_osd_op_w_lat_inb_hist,
   l_osd_op_rw,
   l_osd_op_rw_inb,
   l_osd_op_rw_outb,
@@ -98,6 +101,8 @@ enum {
   l_osd_push_outb,
 
   l_osd_rop,
+  l_osd_rop_max_active,
+  l_osd_op_queue_lat,
 
   l_osd_loadavg,
   l_osd_buf,
@@ -374,6 +379,31 @@ class PGQueueable {
     void operator()(const PGScrub &op);
     void operator()(const PGRecovery &op);
   };
+  struct OpClassVis : public boost::static_visitor<osd_op_class_t> {
+    osd_op_class_t operator()(const OpRequestRef &op) const {
+      switch (op->get_req()->get_type()) {
+      case MSG_OSD_PG_PUSH:
+      case MSG_OSD_PG_PULL:
+      case MSG_OSD_PG_PUSH_REPLY:
+      case MSG_OSD_PG_SCAN:
+      case MSG_OSD_PG_BACKFILL:
+	return OSD_OP_CLASS_RECOVERY;
+      case MSG_OSD_REP_SCRUB:
+	return OSD_OP_CLASS_SCRUB;
+      }
+      return op->get_req()->get_source().is_client() ?
+	OSD_OP_CLASS_CLIENT_OP : OSD_OP_CLASS_OSD_SUBOP;
+    }
+    osd_op_class_t operator()(const PGSnapTrim &op) const {
+      return OSD_OP_CLASS_SNAPTRIM;
+    }
+    osd_op_class_t operator()(const PGScrub &op) const {
+      return OSD_OP_CLASS_SCRUB;
+    }
+    osd_op_class_t operator()(const PGRecovery &op) const {
+      return OSD_OP_CLASS_RECOVERY;
+    }
+  };
 public:
   // cppcheck-suppress noExplicitConstructor
   PGQueueable(OpRequestRef op)
@@ -413,6 +443,9 @@ public:
   int get_cost() const { return cost; }
   utime_t get_start_time() const { return start_time; }
   entity_inst_t get_owner() const { return owner; }
+  osd_op_class_t get_op_class() const {
+    return boost::apply_visitor(OpClassVis(), qvariant);
+  }
 };
 
 class OSDService {
@@ -859,6 +892,10 @@ public:
   Mutex backfill_request_lock;
   SafeTimer backfill_request_timer;
 
+  // -- Scrub pauses between chunks, without holding an op thread --
+  Mutex scrub_sleep_lock;
+  SafeTimer scrub_sleep_timer;
+
   // -- tids --
   // for ops i issue
   atomic_t last_tid;
@@ -914,14 +951,23 @@ public:
   utime_t defer_recovery_until;
   uint64_t recovery_ops_active;
   uint64_t recovery_ops_reserved;
+  /// limit on active recovery ops while it adapts to client latency
+  uint64_t recovery_max_active_adapted;
+  /// (count, ms) of client op queue latency at the last recalibration
+  pair<uint64_t,uint64_t> recovery_last_client_lat;
   bool recovery_paused;
 #ifdef DEBUG_RECOVERY_OIDS
   map<spg_t, set<hobject_t, hobject_t::BitwiseComparator> > recovery_oids;
 #endif
   void start_recovery_op(PG *pg, const hobject_t& soid);
   void finish_recovery_op(PG *pg, const hobject_t& soid, bool dequeue);
+  uint64_t _get_recovery_max_active();
   bool _recover_now(uint64_t *available_pushes);
   void _maybe_queue_recovery();
+  void recovery_throttle_recalibrate();
+  static uint64_t recovery_max_active_step(
+    uint64_t cur, uint64_t min, uint64_t max, double target,
+    uint64_t ops, uint64_t ms);
   void release_reserved_pushes(uint64_t pushes) {
     Mutex::Locker l(recovery_lock);
     assert(recovery_ops_reserved >= pushes);
@@ -994,6 +1040,11 @@ public:
   SimpleLRU<epoch_t, bufferlist> map_bl_inc_cache;
 
   OSDMapRef try_get_map(epoch_t e);
+  /// e if it is in the cache, without loading it from disk
+  OSDMapRef try_get_cached_map(epoch_t e) {
+    Mutex::Locker l(map_cache_lock);
+    return map_cache.lookup(e);
+  }
   OSDMapRef get_map(epoch_t e) {
     OSDMapRef ret(try_get_map(e));
     assert(ret);
@@ -1375,6 +1426,7 @@ private:
   ShardedThreadPool osd_op_tp;
   ThreadPool disk_tp;
   ThreadPool command_tp;
+  ThreadPool mapping_tp;
 
   void set_disk_tp_priority();
   void get_latest_osdmap();
@@ -1747,7 +1799,8 @@ private:
   // -- op queue --
   enum io_queue {
     prioritized,
-    weightedpriority};
+    weightedpriority,
+    mclock_opclass};
   const io_queue op_queue;
   const unsigned int op_prio_cutoff;
 
@@ -1771,6 +1824,14 @@ private:
 		<WeightedPriorityQueue< pair<PGRef, PGQueueable>, entity_inst_t>>(
 		  new WeightedPriorityQueue< pair<PGRef, PGQueueable>, entity_inst_t>(
 		    max_tok_per_prio, min_cost));
+	    } else if (opqueue == mclock_opclass) {
+	      pqueue = std::unique_ptr
+		<mClockOpClassQueue< pair<PGRef, PGQueueable>, entity_inst_t>>(
+		  new mClockOpClassQueue< pair<PGRef, PGQueueable>, entity_inst_t>(
+		    cct,
+		    [](const pair<PGRef, PGQueueable>& i) {
+		      return i.second.get_op_class();
+		    }));
 	    } else if (opqueue == prioritized) {
 	      pqueue = std::unique_ptr
 		<PrioritizedQueue< pair<PGRef, PGQueueable>, entity_inst_t>>(
@@ -2375,11 +2436,42 @@ protected:
     }
   } remove_wq;
 
+  // -- pg mappings --
+  /// precomputes the pg mappings of new maps off osd_lock
+  struct MappingWQ : public ThreadPool::WorkQueueVal<OSDMapRef> {
+    CephContext *cct;
+    OSDMapRef next;  ///< only the newest map is worth mapping
+    MappingWQ(CephContext *cct, time_t ti, time_t si, ThreadPool *tp)
+      : ThreadPool::WorkQueueVal<OSDMapRef>("OSD::MappingWQ", ti, si, tp),
+	cct(cct) {}
+
+    bool _empty() {
+      return !next;
+    }
+    void _enqueue(OSDMapRef m) {
+      if (!next || next->get_epoch() < m->get_epoch())
+	next = m;
+    }
+    void _enqueue_front(OSDMapRef m) {
+      _enqueue(m);
+    }
+    OSDMapRef _dequeue() {
+      OSDMapRef m;
+      m.swap(next);
+      return m;
+    }
+    void _process(OSDMapRef m, ThreadPool::TPHandle &) override;
+    void _clear() {
+      next.reset();
+    }
+  } mapping_wq;
+
  private:
   bool ms_can_fast_dispatch_any() const { return true; }
   bool ms_can_fast_dispatch(Message *m) const {
     switch (m->get_type()) {
     case CEPH_MSG_OSD_OP:
+    case MSG_OSD_OP_BATCH:
     case MSG_OSD_SUBOP:
     case MSG_OSD_REPOP:
     case MSG_OSD_SUBOPREPLY:
@@ -2417,9 +2509,15 @@ protected:
   io_queue get_io_queue() const {
     if (cct->_conf->osd_op_queue == "debug_random") {
       srand(time(NULL));
-      return (rand() % 2 < 1) ? prioritized : weightedpriority;
+      switch (rand() % 3) {
+      case 0: return prioritized;
+      case 1: return weightedpriority;
+      default: return mclock_opclass;
+      }
     } else if (cct->_conf->osd_op_queue == "wpq") {
       return weightedpriority;
+    } else if (cct->_conf->osd_op_queue == "mclock_opclass") {
+      return mclock_opclass;
     } else {
       return prioritized;
     }
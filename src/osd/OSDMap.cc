@@ -16,6 +16,7 @@
  */
 
 #include "OSDMap.h"
+#include "OSDMapMapping.h"
 #include <algorithm>
 #include "common/config.h"
 #include "common/Formatter.h"
@@ -927,6 +928,7 @@ void OSDMap::set_max_osd(int m)
   osd_uuid->resize(m);
   if (osd_primary_affinity)
     osd_primary_affinity->resize(m, CEPH_OSD_DEFAULT_PRIMARY_AFFINITY);
+  mapping.reset();
 
   calc_num_osds();
 }
@@ -1452,11 +1454,64 @@ int OSDMap::apply_incremental(const Incremental &inc)
     crush->decode(blp);
   }
 
+  // patch a copy of the previous epoch's pg mappings if only pools and
+  // temp mappings changed; anything else calls for a full recompute.
+  // the copy shares every pool table that the patch doesn't touch.
+  if (mapping) {
+    if (inc.crush.length() ||
+	!inc.new_up_client.empty() ||
+	!inc.new_state.empty() ||
+	!inc.new_weight.empty() ||
+	!inc.new_primary_affinity.empty()) {
+      mapping.reset();
+    } else {
+      OSDMapMapping *m = new OSDMapMapping(*mapping);
+      m->update(*this, inc);
+      mapping.reset(m);
+    }
+  }
+
   calc_num_osds();
   _calc_up_osd_features();
   return 0;
 }
 
+void OSDMap::share_mapping(const ceph::shared_ptr<const OSDMapMapping>& m)
+{
+  if (m && m->get_epoch() == epoch)
+    mapping = m;
+}
+
+void OSDMap::publish_mapping(
+  const ceph::shared_ptr<const OSDMapMapping>& m) const
+{
+  assert(!m || m->get_epoch() == epoch);
+  std::atomic_store(&mapping, m);
+}
+
+ceph::shared_ptr<const OSDMapMapping> OSDMap::build_mapping(
+  CephContext *cct) const
+{
+  utime_t start = ceph_clock_now(cct);
+  OSDMapMapping *m = new OSDMapMapping;
+  m->update(*this, cct->_conf->osd_map_mapping_threads);
+  ldout(cct, 10) << __func__ << " e" << epoch << " mapped "
+		 << m->get_num_pgs() << " pgs in "
+		 << (ceph_clock_now(cct) - start) << dendl;
+  return ceph::shared_ptr<const OSDMapMapping>(m);
+}
+
+void OSDMap::update_mapping(CephContext *cct)
+{
+  if (!cct->_conf->osd_map_cache_mapping) {
+    mapping.reset();
+    return;
+  }
+  if (mapping && mapping->get_epoch() == epoch)
+    return;
+  mapping = build_mapping(cct);
+}
+
 // mapping
 int OSDMap::object_locator_to_pg(
 	const object_t& oid,
@@ -1688,7 +1743,8 @@ void OSDMap::pg_to_raw_up(pg_t pg, vector<int> *up, int *primary) const
 }
   
 void OSDMap::_pg_to_up_acting_osds(const pg_t& pg, vector<int> *up, int *up_primary,
-                                   vector<int> *acting, int *acting_primary) const
+                                   vector<int> *acting, int *acting_primary,
+				   bool use_mapping) const
 {
   const pg_pool_t *pool = get_pg_pool(pg.pool());
   if (!pool) {
@@ -1702,6 +1758,12 @@ void OSDMap::_pg_to_up_acting_osds(const pg_t& pg, vector<int> *up, int *up_prim
       *acting_primary = -1;
     return;
   }
+  if (use_mapping) {
+    ceph::shared_ptr<const OSDMapMapping> m = std::atomic_load(&mapping);
+    if (m && m->get_epoch() == epoch &&
+	m->get(*pool, pg, up, up_primary, acting, acting_primary))
+      return;
+  }
   vector<int> raw;
   vector<int> _up;
   vector<int> _acting;
@@ -2092,6 +2154,8 @@ void OSDMap::decode_classic(bufferlist::iterator& p)
 
 void OSDMap::decode(bufferlist::iterator& bl)
 {
+  mapping.reset();
+
   /**
    * Older encodings of the OSDMap had a single struct_v which
    * covered the whole encoding, and was prior to our modern
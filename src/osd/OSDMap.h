@@ -38,6 +38,7 @@ using namespace std;
 
 //forward declaration
 class CephContext;
+class OSDMapMapping;
 class CrushWrapper;
 /*
  * we track up to two intervals during which the osd was alive and
@@ -246,6 +247,14 @@ private:
   mutable bool crc_defined;
   mutable uint32_t crc;
 
+  /**
+   * precomputed pg -> up/acting mappings for this epoch, if any
+   *
+   * Once the map is shared, the only change allowed is
+   * publish_mapping() giving it one, so readers use std::atomic_load.
+   */
+  mutable ceph::shared_ptr<const OSDMapMapping> mapping;
+
   void _calc_up_osd_features();
 
  public:
@@ -256,6 +265,7 @@ private:
 
   friend class OSDMonitor;
   friend class PGMonitor;
+  friend class OSDMapMapping;
 
  public:
   OSDMap() : epoch(0), 
@@ -364,10 +374,12 @@ public:
   void set_state(int o, unsigned s) {
     assert(o < max_osd);
     osd_state[o] = s;
+    mapping.reset();
   }
   void set_weight(int o, unsigned w) {
     assert(o < max_osd);
     osd_weight[o] = w;
+    mapping.reset();
     if (w)
       osd_state[o] |= CEPH_OSD_EXISTS;
   }
@@ -386,6 +398,7 @@ public:
       osd_primary_affinity.reset(new vector<__u32>(max_osd,
 						   CEPH_OSD_DEFAULT_PRIMARY_AFFINITY));
     (*osd_primary_affinity)[o] = w;
+    mapping.reset();
   }
   unsigned get_primary_affinity(int o) const {
     assert(o < max_osd);
@@ -565,6 +578,37 @@ public:
 
   int apply_incremental(const Incremental &inc);
 
+  /// precomputed pg mappings for this epoch, or NULL
+  const OSDMapMapping *get_mapping() const {
+    return std::atomic_load(&mapping).get();
+  }
+  /// reuse the pg mappings of o, an identical map we decoded separately
+  void share_mapping(const OSDMap& o) {
+    if (o.epoch == epoch)
+      mapping = std::atomic_load(&o.mapping);
+  }
+  /**
+   * give a shared map without mappings the ones computed for it,
+   * e.g. by a background thread, while others may be reading it
+   */
+  void publish_mapping(
+    const ceph::shared_ptr<const OSDMapMapping>& m) const;
+  /// compute the mappings update_mapping() would, without setting them
+  ceph::shared_ptr<const OSDMapMapping> build_mapping(CephContext *cct) const;
+  /// adopt m if it maps this epoch
+  void share_mapping(const ceph::shared_ptr<const OSDMapMapping>& m);
+  /// detach our pg mappings, e.g. to hand them on to the next epoch
+  ceph::shared_ptr<const OSDMapMapping> take_mapping() {
+    ceph::shared_ptr<const OSDMapMapping> m;
+    m.swap(mapping);
+    return m;
+  }
+  /**
+   * precompute the up/acting sets of all pgs if osd_map_cache_mapping
+   * is set and apply_incremental couldn't patch the previous epoch's
+   */
+  void update_mapping(CephContext *cct);
+
   /// try to re-use/reference addrs in oldmap from newmap
   static void dedup(const OSDMap *oldmap, OSDMap *newmap);
 
@@ -635,9 +679,11 @@ private:
 
   /**
    *  map to up and acting. Fills in whatever fields are non-NULL.
+   *  Uses the precomputed mapping, if any, unless use_mapping is false.
    */
   void _pg_to_up_acting_osds(const pg_t& pg, vector<int> *up, int *up_primary,
-                             vector<int> *acting, int *acting_primary) const;
+                             vector<int> *acting, int *acting_primary,
+			     bool use_mapping=true) const;
 
 public:
   /***
@@ -0,0 +1,217 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <atomic>
+#include <thread>
+
+#include "OSDMapMapping.h"
+
+// pgs handed to a mapping thread at a time
+#define PGS_PER_JOB 1024
+
+bool OSDMapMapping::PoolMapping::get(unsigned ps,
+				     vector<int> *up, int *up_primary,
+				     vector<int> *acting,
+				     int *acting_primary) const
+{
+  const int32_t *row = &table[ps * row_size()];
+  if (row[2] < 0)
+    return false;
+  if (acting)
+    acting->assign(row + 4, row + 4 + row[2]);
+  if (up)
+    up->assign(row + 4 + size, row + 4 + size + row[3]);
+  if (acting_primary)
+    *acting_primary = row[0];
+  if (up_primary)
+    *up_primary = row[1];
+  return true;
+}
+
+void OSDMapMapping::PoolMapping::set(unsigned ps,
+				     const vector<int>& up, int up_primary,
+				     const vector<int>& acting,
+				     int acting_primary)
+{
+  int32_t *row = &table[ps * row_size()];
+  if (up.size() > size || acting.size() > size) {
+    row[2] = -1;
+    return;
+  }
+  row[0] = acting_primary;
+  row[1] = up_primary;
+  row[2] = acting.size();
+  row[3] = up.size();
+  std::copy(acting.begin(), acting.end(), row + 4);
+  std::copy(up.begin(), up.end(), row + 4 + size);
+}
+
+unsigned OSDMapMapping::get_num_pgs() const
+{
+  unsigned n = 0;
+  for (map<int64_t,PoolMappingRef>::const_iterator p = pools.begin();
+       p != pools.end();
+       ++p)
+    n += p->second->pg_num;
+  return n;
+}
+
+bool OSDMapMapping::get(const pg_pool_t& pi, pg_t pgid,
+			vector<int> *up, int *up_primary,
+			vector<int> *acting, int *acting_primary) const
+{
+  map<int64_t,PoolMappingRef>::const_iterator p = pools.find(pgid.pool());
+  if (p == pools.end())
+    return false;
+  const PoolMapping& pm = *p->second;
+  if (pm.pg_num != pi.get_pg_num() || pm.size != pi.get_size())
+    return false;
+  // a raw pg maps exactly like the pg it folds into
+  return pm.get(pi.raw_pg_to_pg(pgid).ps(),
+		up, up_primary, acting, acting_primary);
+}
+
+OSDMapMapping::PoolMapping *OSDMapMapping::_init_pool(int64_t pool,
+						      const pg_pool_t& pi)
+{
+  PoolMappingRef& pm = pools[pool];
+  pm.reset(new PoolMapping(pi.get_size(), pi.get_pg_num()));
+  return pm.get();
+}
+
+OSDMapMapping::PoolMapping *OSDMapMapping::_get_private_pool(
+  int64_t pool, set<int64_t> *cloned)
+{
+  map<int64_t,PoolMappingRef>::iterator p = pools.find(pool);
+  if (p == pools.end())
+    return NULL;
+  // the table may still be shared with the epoch we were copied from
+  if (cloned->insert(pool).second)
+    p->second.reset(new PoolMapping(*p->second));
+  return p->second.get();
+}
+
+void OSDMapMapping::_update_range(const OSDMap& osdmap, int64_t pool,
+				  PoolMapping *pm, unsigned begin,
+				  unsigned end)
+{
+  vector<int> up, acting;
+  int up_primary, acting_primary;
+  for (unsigned ps = begin; ps < end; ++ps) {
+    osdmap._pg_to_up_acting_osds(pg_t(ps, pool), &up, &up_primary,
+				 &acting, &acting_primary, false);
+    pm->set(ps, up, up_primary, acting, acting_primary);
+  }
+}
+
+void OSDMapMapping::_update_pg(const OSDMap& osdmap, pg_t pgid,
+			       PoolMapping *pm)
+{
+  if (pgid.ps() >= pm->pg_num)
+    return;
+  _update_range(osdmap, pgid.pool(), pm, pgid.ps(), pgid.ps() + 1);
+}
+
+void OSDMapMapping::update(const OSDMap& osdmap, unsigned threads)
+{
+  struct job_t {
+    int64_t pool;
+    PoolMapping *pm;
+    unsigned begin, end;
+  };
+  vector<job_t> jobs;
+
+  pools.clear();
+  const map<int64_t,pg_pool_t>& pis = osdmap.get_pools();
+  for (map<int64_t,pg_pool_t>::const_iterator p = pis.begin();
+       p != pis.end();
+       ++p) {
+    PoolMapping *pm = _init_pool(p->first, p->second);
+    for (unsigned ps = 0; ps < pm->pg_num; ps += PGS_PER_JOB) {
+      job_t j = { p->first, pm, ps, MIN(ps + PGS_PER_JOB, pm->pg_num) };
+      jobs.push_back(j);
+    }
+  }
+
+  std::atomic<size_t> next(0);
+  auto work = [&jobs, &next](const OSDMap *m) {
+    for (size_t i = next++; i < jobs.size(); i = next++)
+      _update_range(*m, jobs[i].pool, jobs[i].pm, jobs[i].begin, jobs[i].end);
+  };
+
+  // crush_do_rule keeps its permutation scratch space in the buckets,
+  // which is why CrushWrapper serializes mappings on mapper_lock.
+  // Give each helper thread a map with a private copy of the crush
+  // map; everything else is only read and can be shared.
+  if (threads > jobs.size())
+    threads = jobs.size();
+  bufferlist crushbl;
+  if (threads > 1)
+    osdmap.crush->encode(crushbl);
+  vector<OSDMap*> maps;
+  vector<std::thread> workers;
+  for (unsigned i = 1; i < threads; ++i) {
+    OSDMap *m = new OSDMap(osdmap);
+    m->crush.reset(new CrushWrapper);
+    bufferlist::iterator p = crushbl.begin();
+    m->crush->decode(p);
+    maps.push_back(m);
+    workers.push_back(std::thread(work, m));
+  }
+  work(&osdmap);
+  for (unsigned i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+    delete maps[i];
+  }
+
+  epoch = osdmap.get_epoch();
+}
+
+void OSDMapMapping::update(const OSDMap& osdmap,
+			   const OSDMap::Incremental& inc)
+{
+  for (set<int64_t>::const_iterator p = inc.old_pools.begin();
+       p != inc.old_pools.end();
+       ++p)
+    pools.erase(*p);
+
+  // a changed pool may have a new size, pg_num, rule...
+  set<int64_t> cloned;
+  for (map<int64_t,pg_pool_t>::const_iterator p = inc.new_pools.begin();
+       p != inc.new_pools.end();
+       ++p) {
+    const pg_pool_t *pi = osdmap.get_pg_pool(p->first);
+    if (!pi)
+      continue;
+    PoolMapping *pm = _init_pool(p->first, *pi);
+    _update_range(osdmap, p->first, pm, 0, pm->pg_num);
+    cloned.insert(p->first);
+  }
+
+  // ...otherwise only the pgs whose temp mappings moved change
+  for (map<pg_t,vector<int32_t> >::const_iterator p = inc.new_pg_temp.begin();
+       p != inc.new_pg_temp.end();
+       ++p) {
+    PoolMapping *pm = _get_private_pool(p->first.pool(), &cloned);
+    if (pm)
+      _update_pg(osdmap, p->first, pm);
+  }
+  for (map<pg_t,int32_t>::const_iterator p = inc.new_primary_temp.begin();
+       p != inc.new_primary_temp.end();
+       ++p) {
+    PoolMapping *pm = _get_private_pool(p->first.pool(), &cloned);
+    if (pm)
+      _update_pg(osdmap, p->first, pm);
+  }
+
+  epoch = osdmap.get_epoch();
+}
@@ -0,0 +1,100 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSDMAPMAPPING_H
+#define CEPH_OSDMAPMAPPING_H
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "osd/OSDMap.h"
+
+/**
+ * The up and acting sets of every PG of an OSDMap epoch, computed once
+ * so that lookups don't have to run CRUSH.
+ *
+ * Each pool has a table with one fixed size row per PG:
+ *
+ *   [acting_primary, up_primary, num_acting, num_up, acting..., up...]
+ *
+ * with room for pool size OSDs in each set.  A PG whose pg_temp is
+ * longer than that (e.g. while the pool size is being reduced) is
+ * marked with num_acting = -1 and looked up the slow way.
+ *
+ * A mapping is immutable once attached to an OSDMap; the next epoch
+ * gets a patched copy (see update(const OSDMap&, const Incremental&))
+ * or a fresh one.  Copies share the pool tables, and patching clones
+ * only the tables of the pools it touches.
+ */
+class OSDMapMapping {
+  struct PoolMapping {
+    unsigned size;    ///< max OSDs per set
+    unsigned pg_num;
+    std::vector<int32_t> table;
+
+    PoolMapping(unsigned s, unsigned n)
+      : size(s), pg_num(n), table(n * row_size()) {}
+
+    size_t row_size() const {
+      return 4 + 2 * size;
+    }
+
+    bool get(unsigned ps,
+	     vector<int> *up, int *up_primary,
+	     vector<int> *acting, int *acting_primary) const;
+    void set(unsigned ps,
+	     const vector<int>& up, int up_primary,
+	     const vector<int>& acting, int acting_primary);
+  };
+
+  typedef ceph::shared_ptr<PoolMapping> PoolMappingRef;
+
+  epoch_t epoch;
+  std::map<int64_t,PoolMappingRef> pools;
+
+  PoolMapping *_init_pool(int64_t pool, const pg_pool_t& pi);
+  PoolMapping *_get_private_pool(int64_t pool, std::set<int64_t> *cloned);
+  static void _update_range(const OSDMap& osdmap, int64_t pool,
+			    PoolMapping *pm, unsigned begin, unsigned end);
+  static void _update_pg(const OSDMap& osdmap, pg_t pgid, PoolMapping *pm);
+
+public:
+  OSDMapMapping() : epoch(0) {}
+
+  epoch_t get_epoch() const {
+    return epoch;
+  }
+  unsigned get_num_pgs() const;
+
+  /**
+   * map a (possibly raw) pg through the table, filling in whichever
+   * fields are non-NULL
+   *
+   * @return false if the pg is not in the table
+   */
+  bool get(const pg_pool_t& pi, pg_t pgid,
+	   vector<int> *up, int *up_primary,
+	   vector<int> *acting, int *acting_primary) const;
+
+  /// recompute every pg of osdmap using up to threads threads
+  void update(const OSDMap& osdmap, unsigned threads);
+
+  /**
+   * bring a copy of the previous epoch's mapping up to date with
+   * osdmap, the result of applying inc to that epoch.  inc must not
+   * change anything but pools, pg_temp and primary_temp.
+   */
+  void update(const OSDMap& osdmap, const OSDMap::Incremental& inc);
+};
+
+#endif
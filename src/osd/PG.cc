@@ -964,11 +964,15 @@ PG::Scrubber::Scrubber()
    active(false), queue_snap_trim(false),
    waiting_on(0), shallow_errors(0), deep_errors(0), fixed(0),
    must_scrub(false), must_deep_scrub(false), must_repair(false),
+   must_read_all(false),
    auto_repair(false),
    num_digest_updates_pending(0),
    state(INACTIVE),
    deep(false),
-   seed(0)
+   seed(0),
+   last_chunk_duration(0),
+   needs_sleep(true),
+   sleeping(false)
 {}
 
 PG::Scrubber::~Scrubber() {}
@@ -1934,6 +1938,7 @@ void PG::queue_op(OpRequestRef& op)
     return;
   }
   op->mark_queued_for_pg();
+  op->set_queued_time(ceph_clock_now(cct));
   osd->op_wq.queue(make_pair(PGRef(this), op));
   {
     // after queue() to include any locking costs
@@ -2096,10 +2101,12 @@ bool PG::queue_scrub()
   if (scrubber.must_deep_scrub) {
     state_set(PG_STATE_DEEP_SCRUB);
     scrubber.must_deep_scrub = false;
+    scrubber.must_read_all = true;
   }
   if (scrubber.must_repair || scrubber.auto_repair) {
     state_set(PG_STATE_REPAIR);
     scrubber.must_repair = false;
+    scrubber.must_read_all = true;
   }
   requeue_scrub();
   return true;
@@ -3477,11 +3484,49 @@ void PG::sub_op_scrub_map(OpRequestRef op)
   }
 }
 
+deep_scrub_sample_t PG::choose_deep_scrub_sample()
+{
+  deep_scrub_sample_t sample;
+  uint32_t period = cct->_conf->osd_deep_scrub_unchanged_sample_period;
+  if (period <= 1)
+    return sample;
+
+  // read everything if asked to, if the last deep scrub was never
+  // completed or left errors that this one is expected to recheck, or
+  // if copies have been recovered or backfilled since
+  if (scrubber.must_read_all ||
+      info.history.last_deep_scrub == eversion_t() ||
+      info.history.deep_scrub_seq <= info.history.deep_scrub_read_all_seq ||
+      info.stats.stats.sum.num_shallow_scrub_errors ||
+      info.stats.stats.sum.num_deep_scrub_errors) {
+    dout(10) << __func__ << " reading every object" << dendl;
+    return sample;
+  }
+
+  sample.verified_through = info.history.last_deep_scrub;
+  sample.period = period;
+  sample.slot = info.history.deep_scrub_seq % period;
+  dout(10) << __func__ << " " << sample << dendl;
+  return sample;
+}
+
+void PG::reset_deep_scrub_sample()
+{
+  // no deep scrub has read the copies we are about to recover or
+  // backfill; the next one must read them all, not just its sample
+  if (info.history.deep_scrub_read_all_seq == info.history.deep_scrub_seq)
+    return;
+  dout(10) << __func__ << " at deep_scrub_seq "
+	   << info.history.deep_scrub_seq << dendl;
+  info.history.deep_scrub_read_all_seq = info.history.deep_scrub_seq;
+  dirty_info = true;
+}
+
 // send scrub v3 messages (chunky scrub)
 void PG::_request_scrub_map(
   pg_shard_t replica, eversion_t version,
   hobject_t start, hobject_t end,
-  bool deep, uint32_t seed)
+  bool deep, uint32_t seed, const deep_scrub_sample_t& sample)
 {
   assert(replica != pg_whoami);
   dout(10) << "scrub  requesting scrubmap from osd." << replica
@@ -3489,7 +3534,7 @@ void PG::_request_scrub_map(
   MOSDRepScrub *repscrubop = new MOSDRepScrub(
     spg_t(info.pgid.pgid, replica.shard), version,
     get_osdmap()->get_epoch(),
-    start, end, deep, seed);
+    start, end, deep, seed, sample);
   // default priority, we want the rep scrub processed prior to any recovery
   // or client io messages (we are holding a lock!)
   osd->send_message_osd_cluster(
@@ -3749,6 +3794,7 @@ void PG::_scan_snaps(ScrubMap &smap)
 int PG::build_scrub_map_chunk(
   ScrubMap &map,
   hobject_t start, hobject_t end, bool deep, uint32_t seed,
+  const deep_scrub_sample_t& sample,
   ThreadPool::TPHandle &handle)
 {
   dout(10) << __func__ << " [" << start << "," << end << ") "
@@ -3771,7 +3817,7 @@ int PG::build_scrub_map_chunk(
   }
 
 
-  get_pgbackend()->be_scan_list(map, ls, deep, seed, handle);
+  get_pgbackend()->be_scan_list(map, ls, deep, seed, sample, handle);
   _scan_rollback_obs(rollback_obs, handle);
   _scan_snaps(map);
 
@@ -3872,7 +3918,7 @@ void PG::replica_scrub(
   end.pool = info.pgid.pool();
 
   build_scrub_map_chunk(
-    map, start, end, msg->deep, msg->seed,
+    map, start, end, msg->deep, msg->seed, msg->sample,
     handle);
 
   vector<OSDOp> scrub(1);
@@ -3903,24 +3949,44 @@ void PG::replica_scrub(
  */
 void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
 {
-  if (g_conf->osd_scrub_sleep > 0 &&
+  if (pg_has_reset_since(queued)) {
+    return;
+  }
+
+  double sleep = g_conf->osd_scrub_sleep;
+  if (g_conf->osd_scrub_duty_cycle < 1.0 &&
+      scrubber.state == PG::Scrubber::NEW_CHUNK) {
+    // rest (1 - d) / d as long as the last chunk took: when client io
+    // keeps the disks busy, chunks take longer and we back off
+    double d = MAX(g_conf->osd_scrub_duty_cycle, 0.01);
+    double rest = scrubber.last_chunk_duration * (1.0 - d) / d;
+    sleep = MAX(sleep, MIN(rest, g_conf->osd_scrub_max_sleep));
+  }
+  if (scrubber.needs_sleep && sleep > 0 &&
       (scrubber.state == PG::Scrubber::NEW_CHUNK ||
        scrubber.state == PG::Scrubber::INACTIVE)) {
-    dout(20) << __func__ << " state is INACTIVE|NEW_CHUNK, sleeping" << dendl;
-    unlock();
-    utime_t t;
-    t.set_from_double(g_conf->osd_scrub_sleep);
-    handle.suspend_tp_timeout();
-    t.sleep();
-    handle.reset_tp_timeout();
-    lock();
-    dout(20) << __func__ << " slept for " << t << dendl;
-  }
-  if (pg_has_reset_since(queued)) {
+    // don't hold up the op thread: come back once the timer fires.
+    // scrub_queued stays set meanwhile so nobody queues us twice.
+    dout(20) << __func__ << " state is INACTIVE|NEW_CHUNK, sleeping "
+	     << sleep << dendl;
+    PGRef pg(this);
+    Context *wake = new FunctionContext([pg](int r) {
+	pg->lock();
+	if (pg->scrubber.sleeping && pg->scrub_queued && !pg->deleting) {
+	  pg->scrubber.sleeping = false;
+	  pg->scrubber.needs_sleep = false;
+	  pg->osd->queue_for_scrub(pg.get());
+	}
+	pg->unlock();
+      });
+    scrubber.sleeping = true;
+    Mutex::Locker l(osd->scrub_sleep_lock);
+    osd->scrub_sleep_timer.add_event_after(sleep, wake);
     return;
   }
   assert(scrub_queued);
   scrub_queued = false;
+  scrubber.needs_sleep = true;
 
   if (!is_primary() || !is_active() || !is_clean() || !is_scrubbing()) {
     dout(10) << "scrub -- not primary or active or not clean" << dendl;
@@ -3935,6 +4001,8 @@ void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
     assert(backfill_targets.empty());
 
     scrubber.deep = state_test(PG_STATE_DEEP_SCRUB);
+    if (scrubber.deep)
+      scrubber.sample = choose_deep_scrub_sample();
 
     dout(10) << "starting a new chunky scrub" << dendl;
   }
@@ -4045,6 +4113,7 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
         publish_stats_to_osd();
         scrubber.epoch_start = info.history.same_interval_since;
         scrubber.active = true;
+        scrubber.start_version = info.last_update;
 
 	osd->inc_scrubs_active(scrubber.reserved);
 	if (scrubber.reserved) {
@@ -4080,6 +4149,7 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
       case PG::Scrubber::NEW_CHUNK:
         scrubber.primary_scrubmap = ScrubMap();
         scrubber.received_maps.clear();
+	scrubber.chunk_start = ceph_clock_now(cct);
 
         {
 	  hobject_t candidate_end;
@@ -4165,7 +4235,7 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
 	  if (*i == pg_whoami) continue;
           _request_scrub_map(*i, scrubber.subset_last_update,
                              scrubber.start, scrubber.end, scrubber.deep,
-			     scrubber.seed);
+			     scrubber.seed, scrubber.sample);
           scrubber.waiting_on_whom.insert(*i);
           ++scrubber.waiting_on;
         }
@@ -4200,6 +4270,7 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
         ret = build_scrub_map_chunk(scrubber.primary_scrubmap,
                                     scrubber.start, scrubber.end,
                                     scrubber.deep, scrubber.seed,
+				    scrubber.sample,
 				    handle);
         if (ret < 0) {
           dout(5) << "error building scrub map: " << ret << ", aborting" << dendl;
@@ -4248,6 +4319,9 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
 	  break;
 	}
 
+	scrubber.last_chunk_duration =
+	  (double)(ceph_clock_now(cct) - scrubber.chunk_start);
+
 	if (cmp(scrubber.end, hobject_t::get_max(), get_sort_bitwise()) < 0) {
           scrubber.state = PG::Scrubber::NEW_CHUNK;
 	  requeue_scrub();
@@ -4478,8 +4552,11 @@ void PG::scrub_finish()
   info.history.last_scrub = info.last_update;
   info.history.last_scrub_stamp = now;
   if (scrubber.deep) {
-    info.history.last_deep_scrub = info.last_update;
+    // objects written after we started may have changed behind the
+    // chunk that covered them, so only vouch for what came before
+    info.history.last_deep_scrub = scrubber.start_version;
     info.history.last_deep_scrub_stamp = now;
+    ++info.history.deep_scrub_seq;
   }
   // Since we don't know which errors were fixed, we can only clear them
   // when every one has been fixed.
@@ -5010,6 +5087,7 @@ void PG::start_peering_interval(
   actingbackfill.clear();
   snap_trim_queued = false;
   scrub_queued = false;
+  scrubber.sleeping = false;
 
   // reset primary state?
   if (was_old_primary || is_primary()) {
@@ -6019,6 +6097,7 @@ PG::RecoveryState::Backfilling::Backfilling(my_context ctx)
   context< RecoveryMachine >().log_enter(state_name);
   PG *pg = context< RecoveryMachine >().pg;
   pg->backfill_reserved = true;
+  pg->reset_deep_scrub_sample();
   pg->queue_recovery();
   pg->state_clear(PG_STATE_BACKFILL_TOOFULL);
   pg->state_clear(PG_STATE_BACKFILL_WAIT);
@@ -6449,6 +6528,7 @@ PG::RecoveryState::Recovering::Recovering(my_context ctx)
   PG *pg = context< RecoveryMachine >().pg;
   pg->state_clear(PG_STATE_RECOVERY_WAIT);
   pg->state_set(PG_STATE_RECOVERING);
+  pg->reset_deep_scrub_sample();
   pg->queue_recovery();
 }
 
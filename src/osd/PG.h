@@ -507,6 +507,9 @@ public:
   eversion_t  last_update_ondisk;    // last_update that has committed; ONLY DEFINED WHEN is_active()
   eversion_t  last_complete_ondisk;  // last_complete that has committed.
   eversion_t  last_update_applied;
+  // last version handed to a write; ahead of the log while ECBackend
+  // holds writes back to read old stripes
+  eversion_t  projected_last_update;
 
 
   struct C_UpdateLastRollbackInfoTrimmedToApplied : Context {
@@ -932,6 +935,7 @@ public:
     const hobject_t &soid;
     PG *pg;
     ObjectStore::Transaction *t;
+    set<version_t> extent_gens;
     LogEntryTrimmer(const hobject_t &soid, PG *pg, ObjectStore::Transaction *t)
       : soid(soid), pg(pg), t(t) {}
     void rmobject(version_t old_version) {
@@ -940,6 +944,12 @@ public:
 	old_version,
 	t);
     }
+    void rollback_extents(
+      version_t gen,
+      const vector<pair<uint64_t, uint64_t> > &extents) {
+      if (extent_gens.insert(gen).second)
+	pg->get_pgbackend()->trim_stashed_object(soid, gen, t);
+    }
   };
 
   struct SnapRollBacker : public ObjectModDesc::Visitor {
@@ -1146,6 +1156,9 @@ public:
     // flags to indicate explicitly requested scrubs (by admin)
     bool must_scrub, must_deep_scrub, must_repair;
 
+    // set for requested deep scrubs and repairs, which read every object
+    bool must_read_all;
+
     // this flag indicates whether we would like to do auto-repair of the PG or not
     bool auto_repair;
 
@@ -1180,6 +1193,18 @@ public:
     // deep scrub
     bool deep;
     uint32_t seed;
+    deep_scrub_sample_t sample;
+
+    // how long the last chunk took, for osd_scrub_duty_cycle
+    utime_t chunk_start;
+    double last_chunk_duration;
+
+    // pausing between chunks on OSDService::scrub_sleep_timer
+    bool needs_sleep;
+    bool sleeping;
+
+    // every object at or below this was read by this (deep) scrub
+    eversion_t start_version;
 
     list<Context*> callbacks;
     void add_callback(Context *context) {
@@ -1238,6 +1263,7 @@ public:
       must_scrub = false;
       must_deep_scrub = false;
       must_repair = false;
+      must_read_all = false;
       auto_repair = false;
 
       state = PG::Scrubber::INACTIVE;
@@ -1249,6 +1275,12 @@ public:
       fixed = 0;
       deep = false;
       seed = 0;
+      sample = deep_scrub_sample_t();
+      chunk_start = utime_t();
+      last_chunk_duration = 0;
+      needs_sleep = true;
+      sleeping = false;
+      start_version = eversion_t();
       run_callbacks();
       inconsistent.clear();
       missing.clear();
@@ -1283,11 +1315,14 @@ public:
     ThreadPool::TPHandle &handle);
   void _request_scrub_map(pg_shard_t replica, eversion_t version,
                           hobject_t start, hobject_t end, bool deep,
-			  uint32_t seed);
+			  uint32_t seed, const deep_scrub_sample_t& sample);
   int build_scrub_map_chunk(
     ScrubMap &map,
     hobject_t start, hobject_t end, bool deep, uint32_t seed,
+    const deep_scrub_sample_t& sample,
     ThreadPool::TPHandle &handle);
+  deep_scrub_sample_t choose_deep_scrub_sample();
+  void reset_deep_scrub_sample();
   /**
    * returns true if [begin, end) is good to scrub at this time
    * a false return value obliges the implementer to requeue scrub when the
@@ -2221,7 +2256,8 @@ public:
 
   eversion_t get_next_version() const {
     eversion_t at_version(get_osdmap()->get_epoch(),
-			  pg_log.get_head().version+1);
+			  MAX(pg_log.get_head().version,
+			      projected_last_update.version)+1);
     assert(at_version > info.last_update);
     assert(at_version > pg_log.get_head());
     return at_version;
@@ -41,6 +41,7 @@ struct RollbackVisitor : public ObjectModDesc::Visitor {
   const hobject_t &hoid;
   PGBackend *pg;
   ObjectStore::Transaction t;
+  set<version_t> extent_gens;
   RollbackVisitor(
     const hobject_t &hoid,
     PGBackend *pg) : hoid(hoid), pg(pg) {}
@@ -77,6 +78,18 @@ struct RollbackVisitor : public ObjectModDesc::Visitor {
   void update_snaps(set<snapid_t> &snaps) {
     // pass
   }
+  void rollback_extents(
+    version_t gen,
+    const vector<pair<uint64_t, uint64_t> > &extents) {
+    // several ops in one entry may share gen; the first one visited is
+    // rolled back last and removes it
+    ObjectStore::Transaction temp;
+    pg->rollback_extents(gen, extents, hoid, &temp);
+    if (extent_gens.insert(gen).second)
+      pg->trim_stashed_object(hoid, gen, &temp);
+    temp.append(t);
+    temp.swap(t);
+  }
 };
 
 void PGBackend::rollback(
@@ -300,6 +313,25 @@ void PGBackend::rollback_create(
     ghobject_t(hoid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard));
 }
 
+void PGBackend::rollback_extents(
+  version_t gen,
+  const vector<pair<uint64_t, uint64_t> > &extents,
+  const hobject_t &hoid,
+  ObjectStore::Transaction *t) {
+  assert(!hoid.is_temp());
+  for (vector<pair<uint64_t, uint64_t> >::const_iterator i = extents.begin();
+       i != extents.end();
+       ++i) {
+    t->clone_range(
+      coll,
+      ghobject_t(hoid, gen, get_parent()->whoami_shard().shard),
+      ghobject_t(hoid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
+      i->first,
+      i->second,
+      i->first);
+  }
+}
+
 void PGBackend::trim_stashed_object(
   const hobject_t &hoid,
   version_t old_version,
@@ -354,11 +386,15 @@ PGBackend *PGBackend::build_pg_backend(
  */
 void PGBackend::be_scan_list(
   ScrubMap &map, const vector<hobject_t> &ls, bool deep, uint32_t seed,
+  const deep_scrub_sample_t& sample,
   ThreadPool::TPHandle &handle)
 {
   dout(10) << __func__ << " scanning " << ls.size() << " objects"
            << (deep ? " deeply" : "") << dendl;
+  if (deep && sample.period > 1)
+    dout(10) << __func__ << " reading unchanged objects " << sample << dendl;
   int i = 0;
+  int skipped = 0;
   for (vector<hobject_t>::const_iterator p = ls.begin();
        p != ls.end();
        ++p, i++) {
@@ -384,7 +420,10 @@ void PGBackend::be_scan_list(
 
       // calculate the CRC32 on deep scrubs
       if (deep) {
-	be_deep_scrub(*p, seed, o, handle);
+	if (be_deep_scrub_wanted(poid, o, sample))
+	  be_deep_scrub(*p, seed, o, handle);
+	else
+	  ++skipped;
       }
 
       dout(25) << __func__ << "  " << poid << dendl;
@@ -401,6 +440,32 @@ void PGBackend::be_scan_list(
       assert(0);
     }
   }
+  if (skipped)
+    dout(10) << __func__ << " did not read " << skipped
+	     << " unchanged objects" << dendl;
+}
+
+bool PGBackend::be_deep_scrub_wanted(
+  const hobject_t &poid,
+  const ScrubMap::object &o,
+  const deep_scrub_sample_t &sample)
+{
+  if (sample.period <= 1)
+    return true;
+  map<string, bufferptr>::const_iterator i = o.attrs.find(OI_ATTR);
+  if (i == o.attrs.end())
+    return true;
+  bufferlist bl;
+  bl.push_back(i->second);
+  object_info_t oi;
+  try {
+    bufferlist::iterator p = bl.begin();
+    ::decode(oi, p);
+  } catch (buffer::error& e) {
+    // let the comparison complain about it
+    return true;
+  }
+  return sample.should_read(poid, oi.version);
 }
 
 enum scrub_error_type PGBackend::be_compare_scrub_objects(
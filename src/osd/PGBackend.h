@@ -101,6 +101,9 @@ typedef ceph::shared_ptr<const OSDMap> OSDMapRef;
      
      virtual void cancel_pull(const hobject_t &soid) = 0;
 
+     /// Reply r to the write at tid, which was never started
+     virtual void failed_write(ceph_tid_t tid, int r) = 0;
+
      /**
       * Bless a context
       *
@@ -533,6 +536,13 @@ typedef ceph::shared_ptr<const OSDMap> OSDMapRef;
      version_t old_version,
      ObjectStore::Transaction *t);
 
+   /// Clone extents back from the object stashed at gen
+   virtual void rollback_extents(
+     version_t gen,
+     const vector<pair<uint64_t, uint64_t> > &extents,
+     const hobject_t &hoid,
+     ObjectStore::Transaction *t);
+
    /// Delete object to rollback create
    void rollback_create(
      const hobject_t &hoid,
@@ -585,7 +595,13 @@ typedef ceph::shared_ptr<const OSDMap> OSDMapRef;
    virtual bool auto_repair_supported() const = 0;
    void be_scan_list(
      ScrubMap &map, const vector<hobject_t> &ls, bool deep, uint32_t seed,
+     const deep_scrub_sample_t& sample,
      ThreadPool::TPHandle &handle);
+   /// does a deep scrub with this sample need to read poid?
+   static bool be_deep_scrub_wanted(
+     const hobject_t &poid,
+     const ScrubMap::object &o,
+     const deep_scrub_sample_t &sample);
    enum scrub_error_type be_compare_scrub_objects(
      pg_shard_t auth_shard,
      const ScrubMap::object &auth,
@@ -57,7 +57,7 @@ void PGLog::IndexedLog::filter_log(spg_t pgid, const OSDMap &map, const string &
   pg_log_t::filter_log(pgid, map, hit_set_namespace, *this, out, reject);
 
   *this = out;
-  index();
+  index(PGLOG_INDEXED_OBJECTS);
 }
 
 void PGLog::IndexedLog::split_into(
@@ -75,19 +75,19 @@ void PGLog::IndexedLog::split_into(
   for (list<pg_log_entry_t>::iterator i = oldlog.begin();
        i != oldlog.end();
        ) {
+    // move the nodes over rather than copying the entries
     if ((i->soid.get_hash() & mask) == child_pgid.m_seed) {
-      olog->log.push_back(*i);
+      olog->log.splice(olog->log.end(), oldlog, i++);
     } else {
-      log.push_back(*i);
+      log.splice(log.end(), oldlog, i++);
     }
-    oldlog.erase(i++);
   }
 
 
   olog->can_rollback_to = can_rollback_to;
 
-  olog->index();
-  index();
+  olog->index(PGLOG_INDEXED_OBJECTS);
+  index(PGLOG_INDEXED_OBJECTS);
 }
 
 void PGLog::IndexedLog::trim(
@@ -142,6 +142,40 @@ ostream& PGLog::IndexedLog::print(ostream& out) const
   return out;
 }
 
+void PGLog::IndexedLog::dump_memory(Formatter *f) const
+{
+  // list node: the entry plus two pointers; strings and vectors count
+  // what they have allocated, hash maps a node per element plus the
+  // bucket array.
+  uint64_t entry_bytes = 0;
+  for (list<pg_log_entry_t>::const_iterator p = log.begin();
+       p != log.end();
+       ++p) {
+    entry_bytes += sizeof(*p) + 2 * sizeof(void*) +
+      p->soid.oid.name.capacity() +
+      p->soid.get_key().capacity() +
+      p->soid.nspace.capacity() +
+      p->extra_reqids.capacity() * sizeof(p->extra_reqids[0]) +
+      p->snaps.length();
+  }
+  uint64_t index_bytes =
+    objects.size() * (sizeof(*objects.begin()) + 2 * sizeof(void*)) +
+    objects.bucket_count() * sizeof(void*) +
+    caller_ops.size() * (sizeof(*caller_ops.begin()) + 2 * sizeof(void*)) +
+    caller_ops.bucket_count() * sizeof(void*) +
+    extra_caller_ops.size() * (sizeof(*extra_caller_ops.begin()) +
+			       2 * sizeof(void*)) +
+    extra_caller_ops.bucket_count() * sizeof(void*);
+
+  f->dump_unsigned("entries", log.size());
+  f->dump_unsigned("entry_bytes", entry_bytes);
+  f->dump_unsigned("indexed_objects", objects.size());
+  f->dump_unsigned("indexed_caller_ops",
+		   caller_ops.size() + extra_caller_ops.size());
+  f->dump_unsigned("index_bytes", index_bytes);
+  f->dump_unsigned("total_bytes", entry_bytes + index_bytes);
+}
+
 //////////////////// PGLog ////////////////////
 
 void PGLog::reset_backfill()
@@ -275,7 +309,7 @@ void PGLog::proc_replica_log(
 
   IndexedLog folog;
   folog.log.insert(folog.log.begin(), olog.log.begin(), pp);
-  folog.index();
+  folog.index(PGLOG_INDEXED_OBJECTS);
   _merge_divergent_entries(
     folog,
     divergent,
@@ -540,7 +574,7 @@ void PGLog::rewind_divergent_log(ObjectStore::Transaction& t, eversion_t newhead
   if (log.rollback_info_trimmed_to > newhead)
     log.rollback_info_trimmed_to = newhead;
 
-  log.index();
+  log.index(PGLOG_INDEXED_OBJECTS);
 
   map<eversion_t, hobject_t> new_priors;
   _merge_divergent_entries(
@@ -722,7 +756,7 @@ void PGLog::merge_log(ObjectStore::Transaction& t,
       missing,
       rollbacker,
       this);
-    log.index();   
+    log.index(PGLOG_INDEXED_OBJECTS);
 
     info.last_update = log.head = olog.head;
 
@@ -878,12 +912,11 @@ void PGLog::_write_log(
     clear_after(log_keys_debug, dirty_from.get_key_name());
   }
 
+  vector<const pg_log_entry_t*> dirty;
   for (list<pg_log_entry_t>::iterator p = log.log.begin();
        p != log.log.end() && p->version <= dirty_to;
        ++p) {
-    bufferlist bl(sizeof(*p) * 2);
-    p->encode_with_checksum(bl);
-    (*km)[p->get_key_name()].claim(bl);
+    dirty.push_back(&*p);
   }
 
   for (list<pg_log_entry_t>::reverse_iterator p = log.log.rbegin();
@@ -891,9 +924,19 @@ void PGLog::_write_log(
 	 (p->version >= dirty_from || p->version >= writeout_from) &&
 	 p->version >= dirty_to;
        ++p) {
-    bufferlist bl(sizeof(*p) * 2);
-    p->encode_with_checksum(bl);
-    (*km)[p->get_key_name()].claim(bl);
+    dirty.push_back(&*p);
+  }
+
+  // encode the dirty entries into a few shared buffers and hand out
+  // slices of them, instead of allocating buffers for every entry.
+  // Slicing walks the arena from the start, so keep each one short.
+  const unsigned arena_size = 64 << 10;
+  bufferlist arena;
+  for (unsigned i = 0; i < dirty.size(); ++i) {
+    if (i == 0 || arena.length() >= arena_size)
+      arena = bufferlist(MIN(sizeof(pg_log_entry_t) * 2 * (dirty.size() - i),
+			     arena_size));
+    dirty[i]->encode_with_checksum((*km)[dirty[i]->get_key_name()], arena);
   }
 
   if (log_keys_debug) {
@@ -115,7 +115,7 @@ struct PGLog : DoutPrefixProvider {
       head = o.head;
       rollback_info_trimmed_to = head;
       tail = o.tail;
-      index();
+      index(PGLOG_INDEXED_OBJECTS);
     }
 
     void split_into(
@@ -243,32 +243,38 @@ struct PGLog : DoutPrefixProvider {
 	++rollback_info_trimmed_to_riter;
     }
 
-    // indexes objects, caller ops and extra caller ops
-    void index() {
+    /**
+     * rebuild the indices in to_index now and drop the others; those
+     * are rebuilt on first use.  Only the primary ever looks up caller
+     * ops, so replicas that index just the objects never pay for them.
+     */
+    void index(__u16 to_index = PGLOG_INDEXED_ALL) {
       objects.clear();
       caller_ops.clear();
       extra_caller_ops.clear();
       for (list<pg_log_entry_t>::iterator i = log.begin();
              i != log.end();
              ++i) {
-               
-        objects[i->soid] = &(*i);
-        
-        if (i->reqid_is_indexed()) {
+        if (to_index & PGLOG_INDEXED_OBJECTS)
+          objects[i->soid] = &(*i);
+
+        if ((to_index & PGLOG_INDEXED_CALLER_OPS) && i->reqid_is_indexed()) {
         //assert(caller_ops.count(i->reqid) == 0);  // divergent merge_log indexes new before unindexing old
           caller_ops[i->reqid] = &(*i);
         }
-        
-        for (vector<pair<osd_reqid_t, version_t> >::const_iterator j =
-              i->extra_reqids.begin();
-              j != i->extra_reqids.end();
-              ++j) {
+
+        if (to_index & PGLOG_INDEXED_EXTRA_CALLER_OPS) {
+          for (vector<pair<osd_reqid_t, version_t> >::const_iterator j =
+                i->extra_reqids.begin();
+                j != i->extra_reqids.end();
+                ++j) {
             extra_caller_ops.insert(make_pair(j->first, &(*i)));
+          }
         }
       }
-        
+
       reset_riter();
-      indexed_data = PGLOG_INDEXED_ALL;
+      indexed_data = to_index;
       reset_rollback_info_trimmed_to_riter();
     }
 
@@ -419,6 +425,9 @@ struct PGLog : DoutPrefixProvider {
 
     ostream& print(ostream& out) const;
 
+    /// approximate heap usage of the entries and of the indices built
+    void dump_memory(Formatter *f) const;
+
     void filter_log(spg_t pgid, const OSDMap &map, const string &hit_set_namespace);
   };
 
@@ -719,6 +719,10 @@ int ReplicatedPG::do_command(
     info.dump(f.get());
     f->close_section();
 
+    f->open_object_section("pg_log_memory");
+    pg_log.get_log().dump_memory(f.get());
+    f->close_section();
+
     f->open_array_section("peer_info");
     for (map<pg_shard_t, pg_info_t>::iterator p = peer_info.begin();
 	 p != peer_info.end();
@@ -3136,11 +3140,15 @@ void ReplicatedPG::log_op_stats(OpContext *ctx)
     osd->logger->inc(l_osd_op_r_outb, outb);
     osd->logger->tinc(l_osd_op_r_lat, latency);
     osd->logger->tinc(l_osd_op_r_process_lat, process_latency);
+    osd->logger->hinc(l_osd_op_r_lat_outb_hist,
+		      latency.to_nsec() / 1000, outb);
   } else if (op->may_write() || op->may_cache()) {
     osd->logger->inc(l_osd_op_w);
     osd->logger->inc(l_osd_op_w_inb, inb);
     osd->logger->tinc(l_osd_op_w_lat, latency);
     osd->logger->tinc(l_osd_op_w_process_lat, process_latency);
+    osd->logger->hinc(l_osd_op_w_lat_inb_hist,
+		      latency.to_nsec() / 1000, inb);
     if (rlatency != utime_t())
       osd->logger->tinc(l_osd_op_w_rlat, rlatency);
   } else
@@ -4968,20 +4976,30 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	if (pool.info.has_flag(pg_pool_t::FLAG_WRITE_FADVISE_DONTNEED))
 	  op.flags = op.flags | CEPH_OSD_OP_FLAG_FADVISE_DONTNEED;
 
+	bool ec_overwrite = false;
 	if (pool.info.requires_aligned_append() &&
 	    (op.extent.offset % pool.info.required_alignment() != 0)) {
-	  result = -EOPNOTSUPP;
-	  break;
+	  if (!pool.info.allows_ecoverwrites()) {
+	    result = -EOPNOTSUPP;
+	    break;
+	  }
+	  ec_overwrite = true;
 	}
 
 	if (!obs.exists) {
 	  if (pool.info.require_rollback() && op.extent.offset) {
-	    result = -EOPNOTSUPP;
-	    break;
+	    if (!pool.info.allows_ecoverwrites()) {
+	      result = -EOPNOTSUPP;
+	      break;
+	    }
+	    ec_overwrite = true;
 	  }
 	  ctx->mod_desc.create();
-	} else if (op.extent.offset == oi.size) {
+	} else if (op.extent.offset == oi.size && !ec_overwrite) {
 	  ctx->mod_desc.append(oi.size);
+	} else if (pool.info.allows_ecoverwrites()) {
+	  ec_overwrite = true;
+	  ec_log_overwrite(ctx, op.extent.offset, op.extent.length);
 	} else {
 	  ctx->mod_desc.mark_unrollbackable();
 	  if (pool.info.require_rollback()) {
@@ -5023,7 +5041,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	result = check_offset_and_length(op.extent.offset, op.extent.length, cct->_conf->osd_max_object_size);
 	if (result < 0)
 	  break;
-	if (pool.info.require_rollback()) {
+	if (pool.info.require_rollback() && !ec_overwrite) {
 	  t->append(soid, op.extent.offset, op.extent.length, osd_op.indata, op.flags);
 	} else {
 	  t->write(soid, op.extent.offset, op.extent.length, osd_op.indata, op.flags);
@@ -5113,7 +5131,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 
     case CEPH_OSD_OP_ZERO:
       tracepoint(osd, do_osd_op_pre_zero, soid.oid.name.c_str(), soid.snap.val, op.extent.offset, op.extent.length);
-      if (pool.info.require_rollback()) {
+      if (pool.info.require_rollback() && !pool.info.allows_ecoverwrites()) {
 	result = -EOPNOTSUPP;
 	break;
       }
@@ -5123,7 +5141,21 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	if (result < 0)
 	  break;
 	assert(op.extent.length);
-	if (obs.exists && !oi.is_whiteout()) {
+	if (obs.exists && !oi.is_whiteout() && pool.info.require_rollback()) {
+	  // ec: overwrite with zeros, up to the end of the object
+	  if (op.extent.offset < oi.size) {
+	    uint64_t len = MIN(op.extent.length, oi.size - op.extent.offset);
+	    ec_log_overwrite(ctx, op.extent.offset, len);
+	    bufferlist zeros;
+	    zeros.append_zero(len);
+	    t->write(soid, op.extent.offset, len, zeros);
+	    interval_set<uint64_t> ch;
+	    ch.insert(op.extent.offset, len);
+	    ctx->modified_ranges.union_of(ch);
+	    ctx->delta_stats.num_wr++;
+	    oi.clear_data_digest();
+	  }
+	} else if (obs.exists && !oi.is_whiteout()) {
 	  ctx->mod_desc.mark_unrollbackable();
 	  t->zero(soid, op.extent.offset, op.extent.length);
 	  interval_set<uint64_t> ch;
@@ -6428,6 +6460,25 @@ void ReplicatedPG::make_writeable(OpContext *ctx)
   dout(20) << "make_writeable " << soid << " done, snapset=" << ctx->new_snapset << dendl;
 }
 
+void ReplicatedPG::ec_log_overwrite(OpContext *ctx, uint64_t offset,
+				    uint64_t length)
+{
+  // ECBackend writes whole stripes and stashes the old contents of
+  // those that existed before this op at extent_stash_gen(at_version)
+  uint64_t align = pool.info.required_alignment();
+  uint64_t old_end = ROUND_UP_TO(ctx->obs->oi.size, align);
+  uint64_t cur_end = ROUND_UP_TO(ctx->new_obs.oi.size, align);
+  uint64_t start = offset - offset % align;
+  uint64_t end = MIN(ROUND_UP_TO(offset + length, align), old_end);
+  if (offset + length > cur_end)
+    ctx->mod_desc.append(cur_end);
+  if (start < end) {
+    vector<pair<uint64_t, uint64_t> > extents;
+    extents.push_back(make_pair(start, end - start));
+    ctx->mod_desc.rollback_extents(
+      ObjectModDesc::extent_stash_gen(ctx->at_version.version), extents);
+  }
+}
 
 void ReplicatedPG::write_update_size_and_usage(object_stat_sum_t& delta_stats, object_info_t& oi,
 					       interval_set<uint64_t>& modified, uint64_t offset,
@@ -8471,6 +8522,8 @@ void ReplicatedPG::issue_repop(RepGather *repop, OpContext *ctx)
           << dendl;
 
   repop->v = ctx->at_version;
+  if (ctx->at_version > projected_last_update)
+    projected_last_update = ctx->at_version;
   if (ctx->at_version > eversion_t()) {
     for (set<pg_shard_t>::iterator i = actingbackfill.begin();
 	 i != actingbackfill.end();
@@ -8790,7 +8843,7 @@ void ReplicatedPG::populate_obc_watchers(ObjectContextRef obc)
   assert(is_active());
   assert((recovering.count(obc->obs.oi.soid) ||
 	  !is_missing_object(obc->obs.oi.soid)) ||
-	 (pg_log.get_log().objects.count(obc->obs.oi.soid) && // or this is a revert... see recover_primary()
+	 (pg_log.get_log().logged_object(obc->obs.oi.soid) && // or this is a revert... see recover_primary()
 	  pg_log.get_log().objects.find(obc->obs.oi.soid)->second->op ==
 	    pg_log_entry_t::LOST_REVERT &&
 	  pg_log.get_log().objects.find(obc->obs.oi.soid)->second->reverting_to ==
@@ -8918,7 +8971,7 @@ ObjectContextRef ReplicatedPG::get_object_context(const hobject_t& soid,
   assert(
     attrs || !pg_log.get_missing().is_missing(soid) ||
     // or this is a revert... see recover_primary()
-    (pg_log.get_log().objects.count(soid) &&
+    (pg_log.get_log().logged_object(soid) &&
       pg_log.get_log().objects.find(soid)->second->op ==
       pg_log_entry_t::LOST_REVERT));
   ObjectContextRef obc = object_contexts.lookup(soid);
@@ -9000,6 +9053,39 @@ ObjectContextRef ReplicatedPG::get_object_context(const hobject_t& soid,
   return obc;
 }
 
+void ReplicatedPG::reload_object_context(ObjectContextRef obc)
+{
+  const hobject_t &soid = obc->obs.oi.soid;
+  bufferlist bv;
+  if (pgbackend->objects_get_attr(soid, OI_ATTR, &bv) < 0) {
+    obc->obs.oi = object_info_t(soid);
+    obc->obs.exists = false;
+  } else {
+    obc->obs.oi = object_info_t(bv);
+    obc->obs.exists = true;
+  }
+  obc->attr_cache.clear();
+  if (obc->obs.exists && pool.info.require_rollback()) {
+    int r = pgbackend->objects_get_attrs(soid, &obc->attr_cache);
+    assert(r == 0);
+  }
+  if (obc->ssc && soid.is_head()) {
+    bv.clear();
+    int r = pgbackend->objects_get_attr(soid, SS_ATTR, &bv);
+    if (r < 0)
+      r = pgbackend->objects_get_attr(soid.get_snapdir(), SS_ATTR, &bv);
+    if (r < 0) {
+      obc->ssc->snapset = SnapSet();
+      obc->ssc->exists = false;
+    } else {
+      bufferlist::iterator bvp = bv.begin();
+      obc->ssc->snapset.decode(bvp);
+      obc->ssc->exists = true;
+    }
+  }
+  dout(10) << __func__ << ": " << obc << " oi: " << obc->obs.oi << dendl;
+}
+
 void ReplicatedPG::context_registry_on_change()
 {
   pair<hobject_t, ObjectContextRef> i;
@@ -9618,6 +9704,43 @@ void ReplicatedPG::failed_push(pg_shard_t from, const hobject_t &soid)
   finish_recovery_op(soid);  // close out this attempt,
 }
 
+void ReplicatedPG::failed_write(ceph_tid_t tid, int r)
+{
+  // the backend fails writes in order, once those ahead have completed
+  assert(!repop_queue.empty());
+  RepGather *repop = repop_queue.front();
+  assert(repop->rep_tid == tid);
+  dout(0) << __func__ << " " << *repop << ": " << cpp_strerror(r) << dendl;
+  repop_queue.pop_front();
+  repop->rep_aborted = true;
+  repop->on_applied.clear();
+  repop->on_committed.clear();
+  repop->on_success.clear();
+
+  if (repop->op)
+    osd->reply_op_error(repop->op, r);
+  map<eversion_t, list<pair<OpRequestRef, version_t> > >::iterator p =
+    waiting_for_ondisk.find(repop->v);
+  if (p != waiting_for_ondisk.end()) {
+    for (list<pair<OpRequestRef, version_t> >::iterator i = p->second.begin();
+	 i != p->second.end();
+	 ++i) {
+      osd->reply_op_error(i->first, r);
+    }
+    waiting_for_ondisk.erase(p);
+  }
+  waiting_for_ack.erase(repop->v);
+
+  // the cached object state (and that of any clone the write made)
+  // already reflects the write
+  pair<hobject_t, ObjectContextRef> i;
+  while (object_contexts.get_next(i.first, &i)) {
+    if (i.first.get_head() == repop->hoid.get_head())
+      reload_object_context(i.second);
+  }
+  remove_repop(repop);
+}
+
 void ReplicatedPG::sub_op_remove(OpRequestRef op)
 {
   MOSDSubOp *m = static_cast<MOSDSubOp*>(op->get_req());
@@ -10099,6 +10222,7 @@ void ReplicatedPG::_on_new_interval()
 void ReplicatedPG::on_change(ObjectStore::Transaction *t)
 {
   dout(10) << "on_change" << dendl;
+  projected_last_update = eversion_t();
 
   if (hit_set && hit_set->insert_count() == 0) {
     dout(20) << " discarding empty hit_set" << dendl;
@@ -10528,7 +10652,7 @@ uint64_t ReplicatedPG::recover_primary(uint64_t max, ThreadPool::TPHandle &handl
     hobject_t soid;
     version_t v = p->first;
 
-    if (pg_log.get_log().objects.count(p->second)) {
+    if (pg_log.get_log().logged_object(p->second)) {
       latest = pg_log.get_log().objects.find(p->second)->second;
       assert(latest->is_update());
       soid = latest->soid;
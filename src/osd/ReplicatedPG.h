@@ -274,6 +274,7 @@ public:
     const object_stat_sum_t &stat_diff);
   void failed_push(pg_shard_t from, const hobject_t &soid);
   void cancel_pull(const hobject_t &soid);
+  void failed_write(ceph_tid_t tid, int r);
 
   template <typename T>
   class BlessedGenContext : public GenContext<T> {
@@ -985,6 +986,8 @@ protected:
   map<hobject_t, map<client_t, ceph_tid_t>, hobject_t::BitwiseComparator> debug_op_order;
 
   void populate_obc_watchers(ObjectContextRef obc);
+  /// reread the object info and attrs of a cached obc from disk
+  void reload_object_context(ObjectContextRef obc);
   void check_blacklisted_obc_watchers(ObjectContextRef obc);
   void check_blacklisted_watchers();
   void get_watchers(list<obj_watch_item_t> &pg_watchers);
@@ -1157,6 +1160,8 @@ protected:
 				   uint64_t length, bool count_bytes,
 				   bool force_changesize=false);
   void add_interval_usage(interval_set<uint64_t>& s, object_stat_sum_t& st);
+  /// log rollback info for an ec write into existing data
+  void ec_log_overwrite(OpContext *ctx, uint64_t offset, uint64_t length);
 
 
   enum class cache_result_t {
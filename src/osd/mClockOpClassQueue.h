@@ -0,0 +1,131 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_MCLOCKOPCLASSQUEUE_H
+#define CEPH_OSD_MCLOCKOPCLASSQUEUE_H
+
+#include "common/mClockQueue.h"
+#include "common/config.h"
+#include "include/types.h"
+
+enum osd_op_class_t {
+  OSD_OP_CLASS_CLIENT_OP,   ///< ops from clients
+  OSD_OP_CLASS_OSD_SUBOP,   ///< replica writes and other peer ops
+  OSD_OP_CLASS_SNAPTRIM,
+  OSD_OP_CLASS_RECOVERY,    ///< recovery and backfill work and pushes
+  OSD_OP_CLASS_SCRUB,
+};
+
+/**
+ * OpQueue that schedules with mClock per op class.
+ *
+ * Each op class is one mClock stream with the reservation/weight/limit
+ * configured for it (osd_op_queue_mclock_*); ops of a class are served
+ * in order regardless of their owner.  Keying by class rather than by
+ * (class, owner) keeps the client_op reservation a reservation for
+ * client work as a whole: per-owner streams would each have claimed it,
+ * starving recovery and scrub once there were enough clients.  Owners
+ * are kept alongside the items for remove_by_class().
+ */
+template <typename T, typename K>
+class mClockOpClassQueue : public OpQueue<T, K>
+{
+public:
+  typedef std::function<osd_op_class_t(const T&)> classify_func_t;
+
+private:
+  typedef osd_op_class_t Key;
+  typedef std::pair<K, T> Item;
+  typedef mClockQueue<Item, Key> Queue;
+
+  CephContext *cct;
+  classify_func_t classify_f;
+  Queue queue;
+
+  typename Queue::ClientInfo get_info(const Key& k) const {
+    md_config_t *conf = cct->_conf;
+    switch (k) {
+    case OSD_OP_CLASS_CLIENT_OP:
+      return typename Queue::ClientInfo(
+	conf->osd_op_queue_mclock_client_op_res,
+	conf->osd_op_queue_mclock_client_op_wgt,
+	conf->osd_op_queue_mclock_client_op_lim);
+    case OSD_OP_CLASS_OSD_SUBOP:
+      return typename Queue::ClientInfo(
+	conf->osd_op_queue_mclock_osd_subop_res,
+	conf->osd_op_queue_mclock_osd_subop_wgt,
+	conf->osd_op_queue_mclock_osd_subop_lim);
+    case OSD_OP_CLASS_SNAPTRIM:
+      return typename Queue::ClientInfo(
+	conf->osd_op_queue_mclock_snap_res,
+	conf->osd_op_queue_mclock_snap_wgt,
+	conf->osd_op_queue_mclock_snap_lim);
+    case OSD_OP_CLASS_RECOVERY:
+      return typename Queue::ClientInfo(
+	conf->osd_op_queue_mclock_recov_res,
+	conf->osd_op_queue_mclock_recov_wgt,
+	conf->osd_op_queue_mclock_recov_lim);
+    case OSD_OP_CLASS_SCRUB:
+      return typename Queue::ClientInfo(
+	conf->osd_op_queue_mclock_scrub_res,
+	conf->osd_op_queue_mclock_scrub_wgt,
+	conf->osd_op_queue_mclock_scrub_lim);
+    }
+    assert(0 == "unknown op class");
+    return typename Queue::ClientInfo();
+  }
+
+public:
+  mClockOpClassQueue(CephContext *c, classify_func_t f)
+    : cct(c),
+      classify_f(f),
+      queue([this](const Key& k) { return get_info(k); }) {}
+
+  unsigned length() const override final {
+    return queue.length();
+  }
+  void remove_by_filter(std::function<bool (T)> f) override final {
+    queue.remove_by_filter([&f](Item i) { return f(i.second); });
+  }
+  void remove_by_class(K k, std::list<T> *out = 0) override final {
+    std::list<Item> removed;
+    queue.remove_by_filter([&k](Item i) { return i.first == k; },
+			   out ? &removed : NULL);
+    if (out) {
+      for (auto& i : removed)
+	out->push_back(i.second);
+    }
+  }
+  void enqueue_strict(K cl, unsigned p, T item) override final {
+    queue.enqueue_strict(classify_f(item), p, Item(cl, item));
+  }
+  void enqueue_strict_front(K cl, unsigned p, T item) override final {
+    queue.enqueue_strict_front(classify_f(item), p, Item(cl, item));
+  }
+  void enqueue(K cl, unsigned p, unsigned cost, T item) override final {
+    queue.enqueue(classify_f(item), p, cost, Item(cl, item));
+  }
+  void enqueue_front(K cl, unsigned p, unsigned cost, T item) override final {
+    queue.enqueue_front(classify_f(item), p, cost, Item(cl, item));
+  }
+  bool empty() const override final {
+    return queue.empty();
+  }
+  T dequeue() override final {
+    return queue.dequeue().second;
+  }
+  void dump(ceph::Formatter *f) const override final {
+    queue.dump(f);
+  }
+};
+
+#endif
@@ -2664,7 +2664,7 @@ void pool_stat_t::generate_test_instances(list<pool_stat_t*>& o)
 
 void pg_history_t::encode(bufferlist &bl) const
 {
-  ENCODE_START(7, 4, bl);
+  ENCODE_START(9, 4, bl);
   ::encode(epoch_created, bl);
   ::encode(last_epoch_started, bl);
   ::encode(last_epoch_clean, bl);
@@ -2678,12 +2678,14 @@ void pg_history_t::encode(bufferlist &bl) const
   ::encode(last_deep_scrub_stamp, bl);
   ::encode(last_clean_scrub_stamp, bl);
   ::encode(last_epoch_marked_full, bl);
+  ::encode(deep_scrub_seq, bl);
+  ::encode(deep_scrub_read_all_seq, bl);
   ENCODE_FINISH(bl);
 }
 
 void pg_history_t::decode(bufferlist::iterator &bl)
 {
-  DECODE_START_LEGACY_COMPAT_LEN(7, 4, 4, bl);
+  DECODE_START_LEGACY_COMPAT_LEN(9, 4, 4, bl);
   ::decode(epoch_created, bl);
   ::decode(last_epoch_started, bl);
   if (struct_v >= 3)
@@ -2708,6 +2710,12 @@ void pg_history_t::decode(bufferlist::iterator &bl)
   if (struct_v >= 7) {
     ::decode(last_epoch_marked_full, bl);
   }
+  if (struct_v >= 8) {
+    ::decode(deep_scrub_seq, bl);
+  }
+  if (struct_v >= 9) {
+    ::decode(deep_scrub_read_all_seq, bl);
+  }
   DECODE_FINISH(bl);
 }
 
@@ -2726,6 +2734,8 @@ void pg_history_t::dump(Formatter *f) const
   f->dump_stream("last_deep_scrub") << last_deep_scrub;
   f->dump_stream("last_deep_scrub_stamp") << last_deep_scrub_stamp;
   f->dump_stream("last_clean_scrub_stamp") << last_clean_scrub_stamp;
+  f->dump_unsigned("deep_scrub_seq", deep_scrub_seq);
+  f->dump_unsigned("deep_scrub_read_all_seq", deep_scrub_read_all_seq);
 }
 
 void pg_history_t::generate_test_instances(list<pg_history_t*>& o)
@@ -2745,6 +2755,8 @@ void pg_history_t::generate_test_instances(list<pg_history_t*>& o)
   o.back()->last_deep_scrub_stamp = utime_t(14, 15);
   o.back()->last_clean_scrub_stamp = utime_t(16, 17);
   o.back()->last_epoch_marked_full = 18;
+  o.back()->deep_scrub_seq = 19;
+  o.back()->deep_scrub_read_all_seq = 19;
 }
 
 
@@ -3296,6 +3308,14 @@ void ObjectModDesc::visit(Visitor *visitor) const
 	visitor->try_rmobject(old_version);
 	break;
       }
+      case ROLLBACK_EXTENTS: {
+	version_t gen;
+	vector<pair<uint64_t, uint64_t> > extents;
+	::decode(gen, bp);
+	::decode(extents, bp);
+	visitor->rollback_extents(gen, extents);
+	break;
+      }
       default:
 	assert(0 == "Invalid rollback code");
       }
@@ -3344,6 +3364,15 @@ struct DumpVisitor : public ObjectModDesc::Visitor {
     f->dump_stream("snaps") << snaps;
     f->close_section();
   }
+  void rollback_extents(
+    version_t gen,
+    const vector<pair<uint64_t, uint64_t> > &extents) {
+    f->open_object_section("op");
+    f->dump_string("code", "ROLLBACK_EXTENTS");
+    f->dump_unsigned("gen", gen);
+    f->dump_stream("extents") << extents;
+    f->close_section();
+  }
 };
 
 void ObjectModDesc::dump(Formatter *f) const
@@ -3379,6 +3408,9 @@ void ObjectModDesc::generate_test_instances(list<ObjectModDesc*>& o)
   o.back()->setattrs(attrs);
   o.back()->mark_unrollbackable();
   o.back()->append(1000);
+  o.push_back(new ObjectModDesc());
+  o.back()->append(4096);
+  o.back()->rollback_extents(1002, {make_pair(0, 8192)});
 }
 
 void ObjectModDesc::encode(bufferlist &_bl) const
@@ -3414,6 +3446,24 @@ void pg_log_entry_t::encode_with_checksum(bufferlist& bl) const
   ::encode(crc, bl);
 }
 
+void pg_log_entry_t::encode_with_checksum(bufferlist& bl,
+					  bufferlist& arena) const
+{
+  // the length of the entry goes first; fill it in once it is known
+  unsigned off = arena.length();
+  ::encode((__u32)0, arena);
+  encode(arena);
+  unsigned len = arena.length() - off - sizeof(__u32);
+  bufferlist ebl;
+  ebl.substr_of(arena, off + sizeof(__u32), len);
+  __u32 crc = ebl.crc32c(0);
+  ::encode(crc, arena);
+  ceph_le32 elen;
+  elen = len;
+  arena.copy_in(off, sizeof(elen), (const char*)&elen);
+  bl.substr_of(arena, off, arena.length() - off);
+}
+
 void pg_log_entry_t::decode_with_checksum(bufferlist::iterator& p)
 {
   bufferlist bl;
@@ -5239,6 +5289,43 @@ uint64_t PushOp::cost(CephContext *cct) const
   return cost;
 }
 
+// -- deep_scrub_sample_t --
+
+void deep_scrub_sample_t::encode(bufferlist& bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(verified_through, bl);
+  ::encode(period, bl);
+  ::encode(slot, bl);
+  ENCODE_FINISH(bl);
+}
+
+void deep_scrub_sample_t::decode(bufferlist::iterator& bl)
+{
+  DECODE_START(1, bl);
+  ::decode(verified_through, bl);
+  ::decode(period, bl);
+  ::decode(slot, bl);
+  DECODE_FINISH(bl);
+}
+
+void deep_scrub_sample_t::dump(Formatter *f) const
+{
+  f->dump_stream("verified_through") << verified_through;
+  f->dump_unsigned("period", period);
+  f->dump_unsigned("slot", slot);
+}
+
+void deep_scrub_sample_t::generate_test_instances(
+  list<deep_scrub_sample_t*>& o)
+{
+  o.push_back(new deep_scrub_sample_t);
+  o.push_back(new deep_scrub_sample_t);
+  o.back()->verified_through = eversion_t(3, 4);
+  o.back()->period = 8;
+  o.back()->slot = 5;
+}
+
 // -- ScrubMap --
 
 void ScrubMap::merge_incr(const ScrubMap &l)
@@ -1062,6 +1062,7 @@ struct pg_pool_t {
     FLAG_WRITE_FADVISE_DONTNEED = 1<<7, // write mode with LIBRADOS_OP_FLAG_FADVISE_DONTNEED
     FLAG_NOSCRUB = 1<<8, // block periodic scrub
     FLAG_NODEEP_SCRUB = 1<<9, // block periodic deep-scrub
+    FLAG_EC_OVERWRITES = 1<<10, // erasure pool allows partial-stripe overwrites
   };
 
   static const char *get_flag_name(int f) {
@@ -1076,6 +1077,7 @@ struct pg_pool_t {
     case FLAG_WRITE_FADVISE_DONTNEED: return "write_fadvise_dontneed";
     case FLAG_NOSCRUB: return "noscrub";
     case FLAG_NODEEP_SCRUB: return "nodeep-scrub";
+    case FLAG_EC_OVERWRITES: return "ec_overwrites";
     default: return "???";
     }
   }
@@ -1114,6 +1116,8 @@ struct pg_pool_t {
       return FLAG_NOSCRUB;
     if (name == "nodeep-scrub")
       return FLAG_NODEEP_SCRUB;
+    if (name == "ec_overwrites")
+      return FLAG_EC_OVERWRITES;
     return 0;
   }
 
@@ -1381,6 +1385,10 @@ public:
   }
 
   bool requires_aligned_append() const { return is_erasure(); }
+  /// true if writes into existing erasure coded objects are allowed
+  bool allows_ecoverwrites() const {
+    return is_erasure() && has_flag(FLAG_EC_OVERWRITES);
+  }
   uint64_t required_alignment() const { return stripe_width; }
 
   bool can_shift_osds() const {
@@ -2017,12 +2025,15 @@ struct pg_history_t {
   utime_t last_scrub_stamp;
   utime_t last_deep_scrub_stamp;
   utime_t last_clean_scrub_stamp;
+  uint32_t deep_scrub_seq;  ///< deep scrubs completed; see deep_scrub_sample_t
+  uint32_t deep_scrub_read_all_seq;  ///< deep scrubs up to this seq read all
 
   pg_history_t()
     : epoch_created(0),
       last_epoch_started(0), last_epoch_clean(0), last_epoch_split(0),
       last_epoch_marked_full(0),
-      same_up_since(0), same_interval_since(0), same_primary_since(0) {}
+      same_up_since(0), same_interval_since(0), same_primary_since(0),
+      deep_scrub_seq(0), deep_scrub_read_all_seq(0) {}
   
   bool merge(const pg_history_t &other) {
     // Here, we only update the fields which cannot be calculated from the OSDmap.
@@ -2067,6 +2078,14 @@ struct pg_history_t {
       last_clean_scrub_stamp = other.last_clean_scrub_stamp;
       modified = true;
     }
+    if (other.deep_scrub_seq > deep_scrub_seq) {
+      deep_scrub_seq = other.deep_scrub_seq;
+      modified = true;
+    }
+    if (other.deep_scrub_read_all_seq > deep_scrub_read_all_seq) {
+      deep_scrub_read_all_seq = other.deep_scrub_read_all_seq;
+      modified = true;
+    }
     return modified;
   }
 
@@ -2387,6 +2406,10 @@ public:
     }
     virtual void create() {}
     virtual void update_snaps(set<snapid_t> &old_snaps) {}
+    /// old contents of the extents were cloned to the object at gen
+    virtual void rollback_extents(
+      version_t gen,
+      const vector<pair<uint64_t, uint64_t> > &extents) {}
     virtual ~Visitor() {}
   };
   void visit(Visitor *visitor) const;
@@ -2397,7 +2420,8 @@ public:
     DELETE = 3,
     CREATE = 4,
     UPDATE_SNAPS = 5,
-    TRY_DELETE = 6
+    TRY_DELETE = 6,
+    ROLLBACK_EXTENTS = 7
   };
   ObjectModDesc() : can_local_rollback(true), rollback_info_completed(false) {}
   void claim(ObjectModDesc &other) {
@@ -2483,6 +2507,23 @@ public:
     ::encode(old_snaps, bl);
     ENCODE_FINISH(bl);
   }
+  /// generation overwritten extents of the entry at v are stashed
+  /// under, apart from the whole object stashes (delete, writefull,
+  /// rollback, copy-from) that use v itself
+  static version_t extent_stash_gen(version_t v) {
+    return v | (1ull << 63);
+  }
+  void rollback_extents(
+    version_t gen,
+    const vector<pair<uint64_t, uint64_t> > &extents) {
+    if (!can_local_rollback || rollback_info_completed)
+      return;
+    ENCODE_START(1, 1, bl);
+    append_id(ROLLBACK_EXTENTS);
+    ::encode(gen, bl);
+    ::encode(extents, bl);
+    ENCODE_FINISH(bl);
+  }
 
   // cannot be rolled back
   void mark_unrollbackable() {
@@ -2606,6 +2647,8 @@ struct pg_log_entry_t {
 
   string get_key_name() const;
   void encode_with_checksum(bufferlist& bl) const;
+  /// same encoding, but written to the end of arena, bl gets a slice of it
+  void encode_with_checksum(bufferlist& bl, bufferlist& arena) const;
   void decode_with_checksum(bufferlist::iterator& p);
 
   void encode(bufferlist &bl) const;
@@ -3971,6 +4014,48 @@ WRITE_CLASS_ENCODER(PushOp)
 ostream& operator<<(ostream& out, const PushOp &op);
 
 
+/**
+ * deep_scrub_sample_t - which objects a deep scrub reads in full
+ *
+ * An object last modified at or before verified_through was read in
+ * full by an earlier deep scrub.  Of those, a deep scrub only reads the
+ * ones whose hash lands in slot out of period; the primary moves slot
+ * along with every deep scrub, so each unchanged object is still read
+ * at least once every period deep scrubs.  Every shard of a PG picks
+ * the same objects.
+ *
+ * verified_through says nothing of copies recovered or backfilled since,
+ * so the primary reads every object in the first deep scrub after any
+ * recovery or backfill (see pg_history_t::deep_scrub_read_all_seq).
+ */
+struct deep_scrub_sample_t {
+  eversion_t verified_through;
+  uint32_t period;  ///< 1 to read every object
+  uint32_t slot;
+
+  deep_scrub_sample_t() : period(1), slot(0) {}
+
+  bool should_read(const hobject_t& oid, eversion_t version) const {
+    if (period <= 1 || version > verified_through)
+      return true;
+    // the low bits of the hash pick the pg, so use the high ones
+    return (oid.get_hash() >> 16) % period == slot;
+  }
+
+  void encode(bufferlist& bl) const;
+  void decode(bufferlist::iterator& bl);
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<deep_scrub_sample_t*>& o);
+};
+WRITE_CLASS_ENCODER(deep_scrub_sample_t)
+
+inline ostream& operator<<(ostream& out, const deep_scrub_sample_t& s) {
+  if (s.period <= 1)
+    return out << "all";
+  return out << s.slot << "/" << s.period << " through "
+	     << s.verified_through;
+}
+
 /*
  * summarize pg contents for purposes of a scrub
  */
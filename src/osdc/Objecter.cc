@@ -23,6 +23,7 @@
 
 #include "messages/MPing.h"
 #include "messages/MOSDOp.h"
+#include "messages/MOSDOpBatch.h"
 #include "messages/MOSDOpReply.h"
 #include "messages/MOSDMap.h"
 
@@ -79,6 +80,8 @@ enum {
   l_osdc_op_w,
   l_osdc_op_rmw,
   l_osdc_op_pg,
+  l_osdc_op_batch,
+  l_osdc_op_batch_ops,
 
   l_osdc_osdop_stat,
   l_osdc_osdop_create,
@@ -250,6 +253,10 @@ void Objecter::init()
     pcb.add_u64_counter(l_osdc_op_rmw, "op_rmw",
 			"Read-modify-write operations");
     pcb.add_u64_counter(l_osdc_op_pg, "op_pg", "PG operation");
+    pcb.add_u64_counter(l_osdc_op_batch, "op_batch",
+			"Batched operation messages sent");
+    pcb.add_u64_counter(l_osdc_op_batch_ops, "op_batch_ops",
+			"Operations sent in batched messages");
 
     pcb.add_u64_counter(l_osdc_osdop_stat, "osdop_stat", "Stat operations");
     pcb.add_u64_counter(l_osdc_osdop_create, "osdop_create",
@@ -1241,6 +1248,11 @@ void Objecter::handle_osd_map(MOSDMap *m)
     }
   }
 
+  // most clients map few pgs per epoch, so only precompute all of them
+  // (once for the newest epoch, not per epoch) if asked to
+  if (cct->_conf->objecter_cache_mapping)
+    osdmap->update_mapping(cct);
+
   bool pauserd = osdmap->test_flag(CEPH_OSDMAP_PAUSERD);
   bool pausewr = osdmap->test_flag(CEPH_OSDMAP_PAUSEWR) || _osdmap_full_flag()
     || _osdmap_has_pool_full();
@@ -1422,7 +1434,7 @@ int Objecter::pool_snap_list(int64_t poolid, vector<uint64_t> *snaps)
 }
 
 // sl may be unlocked.
-void Objecter::_check_op_pool_dne(Op *op, unique_lock& sl)
+void Objecter::_check_op_pool_dne(Op *op, OSDSession::unique_lock& sl)
 {
   // rwlock is locked unique
 
@@ -2161,9 +2173,88 @@ void Objecter::op_submit(Op *op, ceph_tid_t *ptid, int *ctx_budget)
   _op_submit_with_budget(op, rl, ptid, ctx_budget);
 }
 
+void Objecter::op_submit_batch(const vector<Op*>& ops,
+			       const vector<ceph_tid_t*>& ptids)
+{
+  assert(ptids.empty() || ptids.size() == ops.size());
+  shunique_lock rl(rwlock, ceph::acquire_shared);
+
+  ldout(cct, 10) << __func__ << " " << ops.size() << " ops" << dendl;
+  OpBatch batch;
+  for (size_t i = 0; i < ops.size(); ++i) {
+    ceph_tid_t tid = 0;
+    _op_submit_with_budget(ops[i], rl, ptids.empty() ? &tid : ptids[i],
+			   NULL, &batch);
+    // _op_submit may have needed the lock exclusively; don't hold
+    // up everyone else for the rest of the batch
+    if (rl.owns_lock()) {
+      rl.unlock();
+      rl.lock_shared();
+    }
+  }
+  _flush_op_batch(batch);
+}
+
+void Objecter::_flush_op_batch(OpBatch& batch)
+{
+  // rwlock is locked
+  for (map<OSDSession*, OpBatch::SessionOps>::iterator p =
+	 batch.sessions.begin();
+       p != batch.sessions.end();
+       ++p) {
+    OSDSession::unique_lock sl(p->first->lock);
+    _send_op_batch(p->first, p->second);
+    sl.unlock();
+    put_session(p->first);
+  }
+  batch.sessions.clear();
+}
+
+void Objecter::_send_op_batch(OSDSession *s, OpBatch::SessionOps& ops)
+{
+  // rwlock is locked
+  // s->lock is locked
+
+  // while held back, an op may have finished, or been resent to this or
+  // another session; the message we hold for it is stale then
+  vector<MOSDOp*> to_send;
+  for (vector<OpBatch::Pending>::iterator p = ops.pending.begin();
+       p != ops.pending.end();
+       ++p) {
+    map<ceph_tid_t, Op*>::iterator i = s->ops.find(p->tid);
+    if (s->con != ops.con || i == s->ops.end() ||
+	i->second->attempts != p->attempts) {
+      ldout(cct, 20) << __func__ << " dropping stale tid " << p->tid
+		     << dendl;
+      p->m->put();
+      continue;
+    }
+    to_send.push_back(p->m);
+  }
+  ops.pending.clear();
+  if (to_send.empty())
+    return;
+
+  ldout(cct, 15) << __func__ << " " << to_send.size() << " ops to osd."
+		 << s->osd << dendl;
+  if (to_send.size() == 1) {
+    ops.con->send_message(to_send.front());
+    return;
+  }
+  MOSDOpBatch *b = new MOSDOpBatch;
+  for (vector<MOSDOp*>::iterator p = to_send.begin();
+       p != to_send.end();
+       ++p)
+    b->add_op(*p, ops.con->get_features());
+  logger->inc(l_osdc_op_batch);
+  logger->inc(l_osdc_op_batch_ops, to_send.size());
+  ops.con->send_message(b);
+}
+
 void Objecter::_op_submit_with_budget(Op *op, shunique_lock& sul,
 				      ceph_tid_t *ptid,
-				      int *ctx_budget)
+				      int *ctx_budget,
+				      OpBatch *batch)
 {
   assert(initialized.read());
 
@@ -2174,7 +2265,7 @@ void Objecter::_op_submit_with_budget(Op *op, shunique_lock& sul,
   // throttle.  before we look at any state, because
   // _take_op_budget() may drop our lock while it blocks.
   if (!op->ctx_budgeted || (ctx_budget && (*ctx_budget == -1))) {
-    int op_budget = _take_op_budget(op, sul);
+    int op_budget = _take_op_budget(op, sul, batch);
     // take and pass out the budget for the first OP
     // in the context session
     if (ctx_budget && (*ctx_budget == -1)) {
@@ -2191,7 +2282,7 @@ void Objecter::_op_submit_with_budget(Op *op, shunique_lock& sul,
 				      op_cancel(tid, -ETIMEDOUT); });
   }
 
-  _op_submit(op, sul, ptid);
+  _op_submit(op, sul, ptid, batch);
 }
 
 void Objecter::_send_op_account(Op *op)
@@ -2273,7 +2364,8 @@ void Objecter::_send_op_account(Op *op)
   }
 }
 
-void Objecter::_op_submit(Op *op, shunique_lock& sul, ceph_tid_t *ptid)
+void Objecter::_op_submit(Op *op, shunique_lock& sul, ceph_tid_t *ptid,
+			  OpBatch *batch)
 {
   // rwlock is locked
 
@@ -2357,7 +2449,7 @@ void Objecter::_op_submit(Op *op, shunique_lock& sul, ceph_tid_t *ptid)
   _session_op_assign(s, op);
 
   if (need_send) {
-    _send_op(op, m);
+    _send_op(op, m, batch);
   }
 
   // Last chance to touch Op here, after giving up session lock it can
@@ -3062,7 +3154,7 @@ MOSDOp *Objecter::_prepare_osd_op(Op *op)
   return m;
 }
 
-void Objecter::_send_op(Op *op, MOSDOp *m)
+void Objecter::_send_op(Op *op, MOSDOp *m, OpBatch *batch)
 {
   // rwlock is locked
   // op->session->lock is locked
@@ -3097,6 +3189,24 @@ void Objecter::_send_op(Op *op, MOSDOp *m)
 
   m->set_tid(op->tid);
 
+  if (batch && con->has_feature(CEPH_FEATURE_OSD_OP_BATCH)) {
+    OpBatch::SessionOps& ops = batch->sessions[op->session];
+    if (!ops.con) {
+      get_session(op->session);
+      ops.con = con;
+    } else if (ops.con != con) {
+      // reopened since; what we hold for it is stale
+      _send_op_batch(op->session, ops);
+      ops.con = con;
+    }
+    OpBatch::Pending p = { op->tid, op->attempts, m };
+    ops.pending.push_back(p);
+    if (ops.pending.size() >=
+	(unsigned)cct->_conf->objecter_op_batch_max_ops)
+      _send_op_batch(op->session, ops);
+    return;
+  }
+
   op->session->con->send_message(m);
 }
 
@@ -3122,14 +3232,19 @@ int Objecter::calc_op_budget(Op *op)
 
 void Objecter::_throttle_op(Op *op,
 			    shunique_lock& sul,
-			    int op_budget)
+			    int op_budget,
+			    OpBatch *batch)
 {
   assert(sul && sul.mutex() == &rwlock);
   bool locked_for_write = sul.owns_lock();
 
   if (!op_budget)
     op_budget = calc_op_budget(op);
+  // ops a batch holds back can't complete and give their budget back,
+  // so send them before we wait for it
   if (!op_throttle_bytes.get_or_fail(op_budget)) { //couldn't take right now
+    if (batch)
+      _flush_op_batch(*batch);
     sul.unlock();
     op_throttle_bytes.get(op_budget);
     if (locked_for_write)
@@ -3138,6 +3253,8 @@ void Objecter::_throttle_op(Op *op,
       sul.lock_shared();
   }
   if (!op_throttle_ops.get_or_fail(1)) { //couldn't take right now
+    if (batch)
+      _flush_op_batch(*batch);
     sul.unlock();
     op_throttle_ops.get(1);
     if (locked_for_write)
@@ -34,6 +34,7 @@
 #include "common/ceph_time.h"
 #include "common/ceph_timer.h"
 #include "common/Finisher.h"
+#include "common/sharded_shared_mutex.h"
 #include "common/shunique_lock.h"
 
 #include "messages/MOSDOp.h"
@@ -1138,7 +1139,9 @@ private:
   version_t last_seen_osdmap_version;
   version_t last_seen_pgmap_version;
 
-  mutable boost::shared_mutex rwlock;
+  // taken shared by every op submission and reply, exclusive only for
+  // map changes and session setup
+  mutable ceph::sharded_shared_mutex<> rwlock;
   using lock_guard = std::unique_lock<decltype(rwlock)>;
   using unique_lock = std::unique_lock<decltype(rwlock)>;
   using shared_lock = boost::shared_lock<decltype(rwlock)>;
@@ -1779,6 +1782,20 @@ public:
   };
   map<int,OSDSession*> osd_sessions;
 
+  /// MOSDOps that op_submit_batch holds back to send together
+  struct OpBatch {
+    struct Pending {
+      ceph_tid_t tid;
+      int attempts;  ///< op->attempts once m was prepared
+      MOSDOp *m;
+    };
+    struct SessionOps {
+      ConnectionRef con;
+      vector<Pending> pending;
+    };
+    map<OSDSession*, SessionOps> sessions;  ///< each holds a ref
+  };
+
   bool osdmap_full_flag() const;
   bool osdmap_pool_full(const int64_t pool_id) const;
 
@@ -1817,7 +1834,9 @@ public:
   ceph::timespan osd_timeout;
 
   MOSDOp *_prepare_osd_op(Op *op);
-  void _send_op(Op *op, MOSDOp *m = NULL);
+  void _send_op(Op *op, MOSDOp *m = NULL, OpBatch *batch = NULL);
+  void _send_op_batch(OSDSession *s, OpBatch::SessionOps& ops);
+  void _flush_op_batch(OpBatch& batch);
   void _send_op_account(Op *op);
   void _cancel_linger_op(Op *op);
   void finish_op(OSDSession *session, ceph_tid_t tid);
@@ -1872,7 +1891,7 @@ public:
   }
 
 private:
-  void _check_op_pool_dne(Op *op, unique_lock& sl);
+  void _check_op_pool_dne(Op *op, OSDSession::unique_lock& sl);
   void _send_op_map_check(Op *op);
   void _op_cancel_map_check(Op *op);
   void _check_linger_pool_dne(LingerOp *op, bool *need_unregister);
@@ -1906,12 +1925,13 @@ private:
    * If throttle_op needs to throttle it will unlock client_lock.
    */
   int calc_op_budget(Op *op);
-  void _throttle_op(Op *op, shunique_lock& sul, int op_size = 0);
-  int _take_op_budget(Op *op, shunique_lock& sul) {
+  void _throttle_op(Op *op, shunique_lock& sul, int op_size = 0,
+		    OpBatch *batch = NULL);
+  int _take_op_budget(Op *op, shunique_lock& sul, OpBatch *batch = NULL) {
     assert(sul && sul.mutex() == &rwlock);
     int op_budget = calc_op_budget(op);
     if (keep_balanced_budget) {
-      _throttle_op(op, sul, op_budget);
+      _throttle_op(op, sul, op_budget, batch);
     } else {
       op_throttle_bytes.take(op_budget);
       op_throttle_ops.take(1);
@@ -1931,7 +1951,8 @@ private:
   }
   void put_list_context_budget(ListContext *list_context);
   void put_nlist_context_budget(NListContext *list_context);
-  Throttle op_throttle_bytes, op_throttle_ops;
+  // every op takes and puts budget, so keep it per-thread sharded
+  ShardedThrottle op_throttle_bytes, op_throttle_ops;
 
  public:
   Objecter(CephContext *cct_, Messenger *m, MonClient *mc,
@@ -2055,15 +2076,29 @@ private:
 private:
 
   // low-level
-  void _op_submit(Op *op, shunique_lock& lc, ceph_tid_t *ptid);
+  void _op_submit(Op *op, shunique_lock& lc, ceph_tid_t *ptid,
+		  OpBatch *batch = NULL);
   void _op_submit_with_budget(Op *op, shunique_lock& lc,
 			      ceph_tid_t *ptid,
-			      int *ctx_budget = NULL);
+			      int *ctx_budget = NULL,
+			      OpBatch *batch = NULL);
   inline void unregister_op(Op *op);
 
   // public interface
 public:
   void op_submit(Op *op, ceph_tid_t *ptid = NULL, int *ctx_budget = NULL);
+  /**
+   * submit many ops, in order, under one acquisition of rwlock
+   *
+   * The ops are grouped by OSD session.  Sessions whose OSD has
+   * CEPH_FEATURE_OSD_OP_BATCH get theirs in MOSDOpBatch messages of up
+   * to objecter_op_batch_max_ops; others get one MOSDOp each.  Every
+   * op still completes on its own.
+   *
+   * @param ptids where to store each op's tid; empty, or one per op
+   */
+  void op_submit_batch(const vector<Op*>& ops,
+		       const vector<ceph_tid_t*>& ptids);
   bool is_active() {
     shared_lock l(rwlock);
     return !((!inflight_ops.read()) && linger_ops.empty() &&
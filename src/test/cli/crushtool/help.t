@@ -58,6 +58,16 @@
                            reweight a given item (and adjust ancestor
                            weights as needed)
      -i mapfn --reweight   recalculate all bucket weights
+     -i mapfn --optimize-weights
+                           adjust device weights to even out the
+                           placements of --rule/--num-rep over the
+                           --min-x..--max-x inputs
+        [--optimize-iterations n]
+                           number of passes (default 20)
+        [--optimize-max-change f]
+                           max weight change per pass (default 0.05)
+        [--optimize-threads n]
+                           threads used for mapping (default 4)
   
   Options for the display/test stage
   
@@ -83,6 +93,7 @@
      --show-mappings       show mappings
      --show-bad-mappings   show bad mappings
      --show-choose-tries   show choose tries histogram
+     --show-timing         show mapping time and mappings/sec
      --output-name name
                            prepend the data file(s) generated during the
                            testing routine with name
@@ -0,0 +1,15 @@
+  $ CEPH_ARGS="--debug-crush 0" crushtool --outfn map --build --num_osds 20 host straw2 4 root straw2 0
+  $ crushtool -i map --add-item 20 1.0 osd.20 --loc root spare -o map > /dev/null
+
+#
+# the placements get more even
+#
+  $ crushtool -i map --optimize-weights -o opt 2>&1 | awk '/^before:/ {b = $3 + 0} /^after:/ {a = $3 + 0} END {print (a < b) ? "stddev dropped" : "stddev did not drop"}'
+  stddev dropped
+
+#
+# devices the rule cannot reach keep their weight
+#
+  $ crushtool -d opt | grep "item osd.20 "
+  \titem osd.20 weight 1.000 (esc)
+  $ rm map opt
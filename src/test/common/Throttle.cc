@@ -414,6 +414,94 @@ TEST(BackoffThrottle, oversaturated)
   ASSERT_GT(results.second.count(), 0.0005);
 }
 
+TEST(ShardedThrottle, get_or_fail)
+{
+  int64_t throttle_max = 1000;
+  ShardedThrottle throttle(g_ceph_context, "throttle", throttle_max);
+  ASSERT_EQ(throttle_max, throttle.get_max());
+  for (int64_t i = 0; i < throttle_max; ++i)
+    ASSERT_TRUE(throttle.get_or_fail(1));
+  ASSERT_EQ(throttle_max, throttle.get_current());
+  ASSERT_FALSE(throttle.get_or_fail(1));
+
+  // slots put back by another thread are available again
+  std::thread([&] { throttle.put(10); }).join();
+  ASSERT_EQ(throttle_max - 10, throttle.get_current());
+  ASSERT_FALSE(throttle.get(10));
+  ASSERT_FALSE(throttle.get_or_fail(1));
+  throttle.put(throttle_max);
+  ASSERT_EQ(0, throttle.get_current());
+}
+
+TEST(ShardedThrottle, spares_dont_block)
+{
+  int64_t throttle_max = 1000;
+  ShardedThrottle throttle(g_ceph_context, "throttle", throttle_max);
+
+  // leave spare slots behind in the shards of other threads
+  vector<std::thread> threads;
+  for (int i = 0; i < 16; ++i)
+    threads.push_back(std::thread([&] {
+	  for (int j = 0; j < 10; ++j) {
+	    ASSERT_TRUE(throttle.get_or_fail(5));
+	    throttle.put(5);
+	  }
+	}));
+  for (auto& t : threads)
+    t.join();
+  ASSERT_EQ(0, throttle.get_current());
+
+  // ...which a blocking get reclaims instead of waiting forever
+  throttle.get(throttle_max);
+  ASSERT_EQ(throttle_max, throttle.get_current());
+  throttle.put(throttle_max);
+}
+
+TEST(ShardedThrottle, get)
+{
+  int64_t throttle_max = 100;
+  ShardedThrottle throttle(g_ceph_context, "throttle", throttle_max);
+  ASSERT_FALSE(throttle.get(throttle_max));
+
+  std::atomic<bool> got(false);
+  std::thread waiter([&] {
+      throttle.get(10);
+      got = true;
+    });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  ASSERT_FALSE(got);
+  throttle.put(10);
+  waiter.join();
+  ASSERT_TRUE(got);
+  ASSERT_EQ(throttle_max, throttle.get_current());
+  throttle.put(throttle_max);
+  ASSERT_EQ(0, throttle.get_current());
+}
+
+TEST(ShardedThrottle, concurrent)
+{
+  const int64_t throttle_max = 64;
+  ShardedThrottle throttle(g_ceph_context, "throttle", throttle_max);
+  std::atomic<int64_t> held(0);
+  std::atomic<bool> over(false);
+
+  vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i)
+    threads.push_back(std::thread([&] {
+	  for (int j = 0; j < 10000; ++j) {
+	    throttle.get(3);
+	    if ((held += 3) > throttle_max)
+	      over = true;
+	    held -= 3;
+	    throttle.put(3);
+	  }
+	}));
+  for (auto& t : threads)
+    t.join();
+  ASSERT_FALSE(over);
+  ASSERT_EQ(0, throttle.get_current());
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
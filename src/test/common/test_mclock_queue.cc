@@ -0,0 +1,177 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "gtest/gtest.h"
+#include "common/mClockQueue.h"
+
+#include <map>
+
+class mClockQueueTest : public testing::Test
+{
+protected:
+  typedef int Klass;
+  typedef unsigned Item;
+  typedef mClockQueue<Item, Klass> MQ;
+
+  double now = 0;
+  std::map<Klass, MQ::ClientInfo> info;
+
+  MQ make_queue(double idle_age = 300) {
+    return MQ([this](const Klass& k) { return info[k]; },
+	      [this]() { return now; },
+	      idle_age, 2 * idle_age);
+  }
+
+  /// dequeue n items, advancing the clock by 1/iops per item, and
+  /// count how many each client got
+  std::map<Klass, unsigned> run(MQ& q, unsigned n, double iops) {
+    std::map<Klass, unsigned> served;
+    for (unsigned i = 0; i < n && !q.empty(); ++i) {
+      ++served[q.dequeue() / 100000];
+      now += 1.0 / iops;
+    }
+    return served;
+  }
+
+  /// queue n items for client k; item ids encode the client
+  void fill(MQ& q, Klass k, unsigned n) {
+    for (unsigned i = 0; i < n; ++i) {
+      q.enqueue(k, 0, 0, Item(k * 100000 + i));
+    }
+  }
+};
+
+TEST_F(mClockQueueTest, strict_and_fifo) {
+  info[1] = MQ::ClientInfo(0, 1, 0);
+  MQ q = make_queue();
+  EXPECT_TRUE(q.empty());
+  q.enqueue(1, 0, 0, Item(1));
+  q.enqueue(1, 0, 0, Item(2));
+  q.enqueue_front(1, 0, 0, Item(0));
+  q.enqueue_strict(2, 10, Item(10));
+  q.enqueue_strict(2, 20, Item(20));
+  q.enqueue_strict_front(2, 10, Item(9));
+  EXPECT_EQ(6u, q.length());
+  EXPECT_EQ(Item(20), q.dequeue());
+  EXPECT_EQ(Item(9), q.dequeue());
+  EXPECT_EQ(Item(10), q.dequeue());
+  EXPECT_EQ(Item(0), q.dequeue());
+  EXPECT_EQ(Item(1), q.dequeue());
+  EXPECT_EQ(Item(2), q.dequeue());
+  EXPECT_TRUE(q.empty());
+}
+
+TEST_F(mClockQueueTest, weight) {
+  info[1] = MQ::ClientInfo(0, 1, 0);
+  info[2] = MQ::ClientInfo(0, 3, 0);
+  MQ q = make_queue();
+  fill(q, 1, 1000);
+  fill(q, 2, 1000);
+  std::map<Klass, unsigned> served = run(q, 400, 100);
+  EXPECT_NEAR(100u, served[1], 5);
+  EXPECT_NEAR(300u, served[2], 5);
+}
+
+TEST_F(mClockQueueTest, reservation) {
+  // client 1 has a tiny weight but is guaranteed 20 ops/sec
+  info[1] = MQ::ClientInfo(20, 1, 0);
+  info[2] = MQ::ClientInfo(0, 1000, 0);
+  MQ q = make_queue();
+  fill(q, 1, 1000);
+  fill(q, 2, 1000);
+  std::map<Klass, unsigned> served = run(q, 1000, 100);  // 10 seconds
+  EXPECT_GE(served[1], 195u);
+  EXPECT_LE(served[1], 215u);
+}
+
+TEST_F(mClockQueueTest, limit) {
+  // client 1 would get half by weight but is capped at 10 ops/sec
+  info[1] = MQ::ClientInfo(0, 1, 10);
+  info[2] = MQ::ClientInfo(0, 1, 0);
+  MQ q = make_queue();
+  fill(q, 1, 1000);
+  fill(q, 2, 1000);
+  std::map<Klass, unsigned> served = run(q, 1000, 100);  // 10 seconds
+  EXPECT_LE(served[1], 102u);
+  EXPECT_GE(served[2], 898u);
+}
+
+TEST_F(mClockQueueTest, work_conserving) {
+  info[1] = MQ::ClientInfo(0, 1, 1);
+  MQ q = make_queue();
+  fill(q, 1, 10);
+  std::map<Klass, unsigned> served = run(q, 10, 1000);
+  EXPECT_EQ(10u, served[1]);
+  EXPECT_TRUE(q.empty());
+}
+
+TEST_F(mClockQueueTest, runtime_change) {
+  info[1] = MQ::ClientInfo(0, 1, 0);
+  info[2] = MQ::ClientInfo(0, 1, 0);
+  MQ q = make_queue();
+  fill(q, 1, 1000);
+  fill(q, 2, 1000);
+  std::map<Klass, unsigned> served = run(q, 200, 100);
+  EXPECT_NEAR(100u, served[1], 2);
+  info[2].weight = 4;
+  served = run(q, 500, 100);
+  EXPECT_NEAR(100u, served[1], 5);
+  EXPECT_NEAR(400u, served[2], 5);
+}
+
+TEST_F(mClockQueueTest, idle_client_returns) {
+  info[1] = MQ::ClientInfo(0, 1, 0);
+  info[2] = MQ::ClientInfo(0, 1, 0);
+  MQ q = make_queue(1);
+  fill(q, 1, 2000);
+  fill(q, 2, 10);
+  // client 2 drains and stays idle while client 1's tags run far ahead
+  // of the clock
+  std::map<Klass, unsigned> served = run(q, 500, 100);
+  EXPECT_EQ(10u, served[2]);
+  // when it comes back it shares evenly instead of being served until
+  // it has caught up with client 1's tags
+  fill(q, 2, 1000);
+  served = run(q, 200, 100);
+  EXPECT_NEAR(100u, served[1], 5);
+  EXPECT_NEAR(100u, served[2], 5);
+}
+
+TEST_F(mClockQueueTest, idle_keeps_tags) {
+  info[1] = MQ::ClientInfo(0, 1, 0);
+  info[2] = MQ::ClientInfo(0, 1, 0);
+  MQ q = make_queue();
+  fill(q, 1, 1000);
+  fill(q, 2, 1000);
+  std::map<Klass, unsigned> served = run(q, 100, 100);
+  EXPECT_NEAR(50u, served[2], 1);
+  // client 2 briefly has nothing queued; that must not reset its tags
+  // ahead of client 1
+  std::list<Item> removed;
+  q.remove_by_class(2, &removed);
+  served = run(q, 1, 100);
+  fill(q, 2, 1000);
+  served = run(q, 100, 100);
+  EXPECT_NEAR(50u, served[1], 2);
+  EXPECT_NEAR(50u, served[2], 2);
+}
+
+TEST_F(mClockQueueTest, remove) {
+  info[1] = MQ::ClientInfo(0, 1, 0);
+  info[2] = MQ::ClientInfo(0, 1, 0);
+  MQ q = make_queue();
+  fill(q, 1, 10);
+  fill(q, 2, 10);
+  q.enqueue_strict(2, 1, Item(200100));
+  std::list<Item> removed;
+  q.remove_by_class(2, &removed);
+  EXPECT_EQ(11u, removed.size());
+  EXPECT_EQ(10u, q.length());
+  q.remove_by_filter([](Item i) { return i % 2 == 0; });
+  EXPECT_EQ(5u, q.length());
+  while (!q.empty()) {
+    Item i = q.dequeue();
+    EXPECT_EQ(1u, i / 100000);
+    EXPECT_EQ(1u, i % 2);
+  }
+}
@@ -0,0 +1,99 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/sharded_shared_mutex.h"
+#include "common/shunique_lock.h"
+
+#include "gtest/gtest.h"
+
+typedef ceph::sharded_shared_mutex<4> test_mutex;
+
+static bool try_lock(test_mutex *m) {
+  if (!m->try_lock())
+    return false;
+  m->unlock();
+  return true;
+}
+
+static bool try_lock_shared(test_mutex *m) {
+  if (!m->try_lock_shared())
+    return false;
+  m->unlock_shared();
+  return true;
+}
+
+TEST(ShardedSharedMutex, Conflicts) {
+  test_mutex m;
+
+  m.lock();
+  ASSERT_FALSE(std::async(std::launch::async, try_lock, &m).get());
+  ASSERT_FALSE(std::async(std::launch::async, try_lock_shared, &m).get());
+  m.unlock();
+
+  // more readers than shards, so some of them share a shard
+  std::vector<std::thread> readers;
+  std::promise<void> release;
+  std::shared_future<void> released(release.get_future());
+  std::vector<std::promise<void> > locked(8);
+  for (int i = 0; i < 8; ++i) {
+    readers.push_back(std::thread([&m, &locked, released, i]() {
+	  m.lock_shared();
+	  locked[i].set_value();
+	  released.wait();
+	  m.unlock_shared();
+	}));
+  }
+  for (auto& l : locked)
+    l.get_future().wait();
+  ASSERT_FALSE(std::async(std::launch::async, try_lock, &m).get());
+  ASSERT_TRUE(std::async(std::launch::async, try_lock_shared, &m).get());
+  release.set_value();
+  for (auto& t : readers)
+    t.join();
+
+  ASSERT_TRUE(try_lock(&m));
+  ASSERT_TRUE(try_lock_shared(&m));
+}
+
+TEST(ShardedSharedMutex, Exclusion) {
+  test_mutex m;
+  int a = 0, b = 0;
+  std::atomic<bool> torn(false);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.push_back(std::thread([&m, &a, &b]() {
+	  for (int j = 0; j < 10000; ++j) {
+	    std::unique_lock<test_mutex> l(m);
+	    ++a;
+	    ++b;
+	  }
+	}));
+    threads.push_back(std::thread([&m, &a, &b, &torn]() {
+	  for (int j = 0; j < 10000; ++j) {
+	    ceph::shunique_lock<test_mutex> l(m, ceph::acquire_shared);
+	    if (a != b)
+	      torn = true;
+	  }
+	}));
+  }
+  for (auto& t : threads)
+    t.join();
+  ASSERT_FALSE(torn);
+  ASSERT_EQ(40000, a);
+}
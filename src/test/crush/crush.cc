@@ -510,6 +510,22 @@ TEST(CRUSH, straw2_stddev)
   }
 }
 
+TEST(CRUSH, straw2_batch_hash) {
+  // the (possibly vectorized) batch hash used by straw2 must match
+  // crush_hash32_3 bit for bit, whatever the batch length
+  __s32 items[200];
+  __u32 hashes[200];
+  for (int i = 0; i < 200; ++i)
+    items[i] = rand() - RAND_MAX / 2;
+  for (unsigned n = 0; n <= 200; ++n) {
+    __u32 x = rand(), r = rand() % 10;
+    crush_hash32_3_batch(CRUSH_HASH_RJENKINS1, x, items, r, n, hashes);
+    for (unsigned i = 0; i < n; ++i)
+      ASSERT_EQ(crush_hash32_3(CRUSH_HASH_RJENKINS1, x, items[i], r),
+		hashes[i]);
+  }
+}
+
 TEST(CRUSH, straw2_reweight) {
   // when we adjust the weight of an item in a straw2 bucket,
   // we should *only* see movement from or to that item, never
@@ -81,6 +81,7 @@ TYPE(object_info_t)
 TYPE(SnapSet)
 TYPE(ObjectRecoveryInfo)
 TYPE(ObjectRecoveryProgress)
+TYPE(deep_scrub_sample_t)
 TYPE(ScrubMap::object)
 TYPE(ScrubMap)
 TYPE(pg_hit_set_info_t)
@@ -543,6 +544,8 @@ MESSAGE(MOSDMap)
 MESSAGE(MOSDOp)
 #include "messages/MOSDOpReply.h"
 MESSAGE(MOSDOpReply)
+#include "messages/MOSDOpBatch.h"
+MESSAGE(MOSDOpBatch)
 #include "messages/MOSDPGBackfill.h"
 MESSAGE(MOSDPGBackfill)
 #include "messages/MOSDPGCreate.h"
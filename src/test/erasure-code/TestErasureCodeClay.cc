@@ -0,0 +1,179 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "crush/CrushWrapper.h"
+#include "include/stringify.h"
+#include "global/global_init.h"
+#include "erasure-code/clay/ErasureCodeClay.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "common/config.h"
+#include "gtest/gtest.h"
+
+static void encode_random(ErasureCodeClay &clay, unsigned length,
+			  map<int, bufferlist> *encoded)
+{
+  bufferlist in;
+  for (unsigned i = 0; i < length; ++i)
+    in.append((char)rand());
+  set<int> want;
+  for (unsigned i = 0; i < clay.get_chunk_count(); ++i)
+    want.insert(i);
+  EXPECT_EQ(0, clay.encode(want, in, encoded));
+  // data chunks are stored verbatim
+  bufferlist data;
+  for (unsigned i = 0; i < clay.get_data_chunk_count(); ++i)
+    data.append((*encoded)[i]);
+  EXPECT_EQ(0, memcmp(data.c_str(), in.c_str(), length));
+}
+
+TEST(ErasureCodeClay, parse)
+{
+  {
+    ErasureCodeClay clay(g_conf->erasure_code_dir);
+    ErasureCodeProfile profile;
+    profile["k"] = "8";
+    profile["m"] = "3";
+    EXPECT_EQ(0, clay.init(profile, &cerr));
+    EXPECT_EQ(10, clay.d);
+    EXPECT_EQ(3, clay.q);
+    EXPECT_EQ(1, clay.nu);
+    EXPECT_EQ(4, clay.t);
+    EXPECT_EQ(81, clay.get_sub_chunk_count());
+    EXPECT_EQ(0u, clay.get_chunk_size(1) % 81);
+  }
+  {
+    ErasureCodeClay clay(g_conf->erasure_code_dir);
+    ErasureCodeProfile profile;
+    profile["k"] = "4";
+    profile["m"] = "2";
+    profile["d"] = "6";
+    EXPECT_EQ(-EINVAL, clay.init(profile, &cerr));
+  }
+  {
+    ErasureCodeClay clay(g_conf->erasure_code_dir);
+    ErasureCodeProfile profile;
+    profile["k"] = "4";
+    profile["m"] = "2";
+    profile["mapping"] = "DD_DD_";
+    EXPECT_EQ(-EINVAL, clay.init(profile, &cerr));
+  }
+}
+
+TEST(ErasureCodeClay, encode_decode)
+{
+  ErasureCodeClay clay(g_conf->erasure_code_dir);
+  ErasureCodeProfile profile;
+  profile["k"] = "4";
+  profile["m"] = "3";
+  EXPECT_EQ(0, clay.init(profile, &cerr));
+  map<int, bufferlist> encoded;
+  encode_random(clay, clay.get_chunk_size(1) * 4 * 3 - 11, &encoded);
+
+  // every combination of up to m lost chunks
+  for (int lost = 1; lost < (1 << 7); ++lost) {
+    set<int> want;
+    map<int, bufferlist> chunks;
+    for (int i = 0; i < 7; ++i) {
+      if (lost & (1 << i))
+	want.insert(i);
+      else
+	chunks[i] = encoded[i];
+    }
+    if (want.size() > 3)
+      continue;
+    map<int, bufferlist> decoded;
+    EXPECT_EQ(0, clay.decode(want, chunks, &decoded));
+    for (set<int>::iterator i = want.begin(); i != want.end(); ++i)
+      EXPECT_TRUE(decoded[*i].contents_equal(encoded[*i]));
+  }
+}
+
+TEST(ErasureCodeClay, repair)
+{
+  // d = k + m - 1 reads from everyone, the smaller d leaves some aloof
+  for (int d = 6; d <= 8; ++d) {
+    ErasureCodeClay clay(g_conf->erasure_code_dir);
+    ErasureCodeProfile profile;
+    profile["k"] = "6";
+    profile["m"] = "3";
+    profile["d"] = stringify(d);
+    EXPECT_EQ(0, clay.init(profile, &cerr));
+    map<int, bufferlist> encoded;
+    encode_random(clay, clay.get_chunk_size(1) * 6, &encoded);
+    unsigned chunk_size = encoded[0].length();
+    unsigned sub_size = chunk_size / clay.get_sub_chunk_count();
+
+    for (int lost = 0; lost < 9; ++lost) {
+      set<int> want;
+      want.insert(lost);
+      map<int, int> available;
+      for (int i = 0; i < 9; ++i)
+	if (i != lost)
+	  available[i] = 0;
+      map<int, vector<pair<int, int> > > minimum;
+      EXPECT_EQ(0, clay.minimum_to_decode_with_cost(want, available,
+						    &minimum));
+      EXPECT_EQ((unsigned)d, minimum.size());
+
+      map<int, bufferlist> chunks;
+      unsigned read = 0;
+      for (map<int, vector<pair<int, int> > >::iterator i = minimum.begin();
+	   i != minimum.end();
+	   ++i) {
+	for (vector<pair<int, int> >::iterator j = i->second.begin();
+	     j != i->second.end();
+	     ++j) {
+	  bufferlist bl;
+	  bl.substr_of(encoded[i->first], j->first * sub_size,
+		       j->second * sub_size);
+	  chunks[i->first].append(bl);
+	}
+	read += chunks[i->first].length();
+      }
+      // d / (d - k + 1) chunks instead of k
+      EXPECT_EQ(d * chunk_size / (d - 6 + 1), read);
+
+      map<int, bufferlist> decoded;
+      EXPECT_EQ(0, clay.decode(want, chunks, &decoded, chunk_size));
+      EXPECT_TRUE(decoded[lost].contents_equal(encoded[lost]));
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  const char* env = getenv("CEPH_LIB");
+  string directory(env ? env : ".libs");
+  g_conf->set_val("erasure_code_dir", directory, false, false);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+/*
+ * Local Variables:
+ * compile-command: "cd ../.. ;
+ *   make -j4 unittest_erasure_code_clay && valgrind --tool=memcheck \
+ *      ./unittest_erasure_code_clay \
+ *      --gtest_filter=*.* --log-to-stderr=true --debug-osd=20"
+ * End:
+ */
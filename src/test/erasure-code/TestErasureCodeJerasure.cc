@@ -130,6 +130,45 @@ TYPED_TEST(ErasureCodeTest, encode_decode)
   }
 }
 
+TYPED_TEST(ErasureCodeTest, encode_stripes)
+{
+  TypeParam jerasure;
+  ErasureCodeProfile profile;
+  profile["k"] = "2";
+  profile["m"] = "2";
+  profile["packetsize"] = "8";
+  jerasure.init(profile, &cerr);
+
+  unsigned stripe_width = jerasure.get_chunk_size(4096) * 2;
+  // enough stripes to span more than one batch
+  unsigned stripe_count = ErasureCode::ENCODE_BATCH_SIZE / stripe_width * 2 + 3;
+  bufferlist in;
+  for (unsigned i = 0; i < stripe_width * stripe_count; i++)
+    in.append((char)(i * 7 + i / 251));
+
+  int want_to_encode[] = { 0, 2, 3 };
+  set<int> want(want_to_encode, want_to_encode + 3);
+  map<int, bufferlist> expected;
+  for (unsigned s = 0; s < stripe_count; s++) {
+    bufferlist stripe;
+    stripe.substr_of(in, s * stripe_width, stripe_width);
+    map<int, bufferlist> encoded;
+    EXPECT_EQ(0, jerasure.encode(want, stripe, &encoded));
+    for (map<int, bufferlist>::iterator i = encoded.begin();
+	 i != encoded.end();
+	 ++i)
+      expected[i->first].claim_append(i->second);
+  }
+
+  map<int, bufferlist> encoded;
+  EXPECT_EQ(0, jerasure.encode_stripes(want, in, stripe_count, &encoded));
+  EXPECT_EQ(3u, encoded.size());
+  for (set<int>::iterator i = want.begin(); i != want.end(); ++i) {
+    EXPECT_EQ(stripe_count * stripe_width / 2, encoded[*i].length());
+    EXPECT_TRUE(expected[*i].contents_equal(encoded[*i]));
+  }
+}
+
 TYPED_TEST(ErasureCodeTest, minimum_to_decode)
 {
   TypeParam jerasure;
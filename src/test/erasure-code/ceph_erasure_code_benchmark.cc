@@ -49,7 +49,10 @@ int ErasureCodeBench::setup(int argc, char** argv) {
     ("plugin,p", po::value<string>()->default_value("jerasure"),
      "erasure code plugin name")
     ("workload,w", po::value<string>()->default_value("encode"),
-     "run either encode or decode")
+     "run either encode, encode_stripes or decode")
+    ("stripe-width,S", po::value<int>()->default_value(4096),
+     "stripe width used by the encode_stripes workload, rounded up "
+     "to a multiple of the chunk alignment")
     ("erasures,e", po::value<int>()->default_value(1),
      "number of erasures when decoding")
     ("erased", po::value<vector<int> >(),
@@ -112,6 +115,7 @@ int ErasureCodeBench::setup(int argc, char** argv) {
   max_iterations = vm["iterations"].as<int>();
   plugin = vm["plugin"].as<string>();
   workload = vm["workload"].as<string>();
+  stripe_width = vm["stripe-width"].as<int>();
   erasures = vm["erasures"].as<int>();
   if (vm.count("erasures-generation") > 0 &&
       vm["erasures-generation"].as<string>() == "exhaustive")
@@ -143,6 +147,8 @@ int ErasureCodeBench::run() {
 
   if (workload == "encode")
     return encode();
+  else if (workload == "encode_stripes")
+    return encode_stripes();
   else
     return decode();
 }
@@ -188,6 +194,55 @@ int ErasureCodeBench::encode()
   return 0;
 }
 
+int ErasureCodeBench::encode_stripes()
+{
+  ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
+  ErasureCodeInterfaceRef erasure_code;
+  stringstream messages;
+  int code = instance.factory(plugin,
+			      g_conf->erasure_code_dir,
+			      profile, &erasure_code, &messages);
+  if (code) {
+    cerr << messages.str() << endl;
+    return code;
+  }
+
+  unsigned width = erasure_code->get_chunk_size(stripe_width) * k;
+  unsigned stripe_count = in_size / width;
+  if (stripe_count == 0) {
+    cerr << "--size " << in_size << " is smaller than a stripe of "
+	 << width << " bytes" << endl;
+    return -EINVAL;
+  }
+
+  bufferlist in;
+  in.append(string(stripe_count * width, 'X'));
+  in.rebuild_aligned(ErasureCode::SIMD_ALIGN);
+  set<int> want_to_encode;
+  for (int i = 0; i < k + m; i++) {
+    want_to_encode.insert(i);
+  }
+  utime_t begin_time = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < max_iterations; i++) {
+    map<int,bufferlist> encoded;
+    code = erasure_code->encode_stripes(want_to_encode, in, stripe_count,
+					&encoded);
+    if (code)
+      return code;
+  }
+  utime_t end_time = ceph_clock_now(g_ceph_context);
+  cout << (end_time - begin_time) << "\t"
+       << (max_iterations * (in.length() / 1024)) << endl;
+  if (verbose) {
+    double seconds = (double)(end_time - begin_time);
+    cout << stripe_count << " stripes of " << width << " bytes, "
+	 << (seconds > 0 ?
+	     max_iterations * (double)in.length() / seconds / (1 << 30) : 0)
+	 << " GB/s" << endl;
+  }
+  return 0;
+}
+
 static void display_chunks(const map<int,bufferlist> &chunks,
 			   unsigned int chunk_count) {
   cout << "chunks ";
@@ -24,6 +24,7 @@ using namespace std;
 
 class ErasureCodeBench {
   int in_size;
+  int stripe_width;
   int max_iterations;
   int erasures;
   int k;
@@ -48,6 +49,7 @@ public:
 		      ErasureCodeInterfaceRef erasure_code);
   int decode();
   int encode();
+  int encode_stripes();
 };
 
 #endif
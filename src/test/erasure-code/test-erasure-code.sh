@@ -231,6 +231,46 @@ function TEST_rados_put_get_jerasure() {
     ceph osd erasure-code-profile rm $profile
 }
 
+function TEST_rados_put_get_clay() {
+    local dir=$1
+    local poolname=pool-clay
+    local profile=profile-clay
+    local objname=SOMETHING
+
+    ceph osd erasure-code-profile set $profile \
+        plugin=clay \
+        k=4 m=2 d=5 \
+        ruleset-failure-domain=osd || return 1
+    ceph osd pool create $poolname 12 12 erasure $profile \
+        || return 1
+
+    rados_put_get $dir $poolname || return 1
+
+    #
+    # rebuild each chunk in turn. With d=5 a lost chunk is repaired from
+    # sub-chunks of the others, at offsets that depend on its position.
+    #
+    for marker in JJJ KKK LLLL MMMM ; do
+        printf "%*s" 1024 $marker
+    done > $dir/ORIGINAL
+    rados --pool $poolname put $objname $dir/ORIGINAL || return 1
+    wait_for_clean || return 1
+    local -a osds=($(get_osds $poolname $objname))
+    for (( i = 0; i < ${#osds[@]}; i++ )) ; do
+        ceph osd out ${osds[$i]} || return 1
+        wait_for_clean || return 1
+        rados --pool $poolname get $objname $dir/COPY || return 1
+        diff $dir/ORIGINAL $dir/COPY || return 1
+        rm $dir/COPY
+        ceph osd in ${osds[$i]} || return 1
+        wait_for_clean || return 1
+    done
+    rm $dir/ORIGINAL
+
+    delete_pool $poolname
+    ceph osd erasure-code-profile rm $profile
+}
+
 function TEST_rados_put_get_shec() {
     local dir=$1
 
@@ -266,6 +306,64 @@ function TEST_alignment_constraints() {
     rm $dir/ORIGINAL
 }
 
+function TEST_ec_overwrite_rollback() {
+    local dir=$1
+    local poolname=pool-overwrites
+    local objname=OVERWRITTEN
+
+    ceph osd pool create $poolname 1 1 erasure myprofile || return 1
+    ceph osd pool set $poolname allow_ec_overwrites true || return 1
+    wait_for_clean || return 1
+
+    for marker in AAA BBB CCCC DDDD ; do
+        printf "%*s" 1024 $marker
+    done > $dir/ORIGINAL
+    rados --pool $poolname put $objname $dir/ORIGINAL || return 1
+
+    #
+    # overwrite the middle of the object and read it back
+    #
+    printf "%*s" 100 EEEE > $dir/PATCH
+    rados --pool $poolname put $objname $dir/PATCH --offset 1000 || return 1
+    dd if=$dir/PATCH of=$dir/ORIGINAL bs=1 seek=1000 conv=notrunc || return 1
+    rados --pool $poolname get $objname $dir/COPY || return 1
+    diff $dir/ORIGINAL $dir/COPY || return 1
+    rm $dir/COPY
+
+    #
+    # freeze the OSD of the last shard so that the next overwrite is
+    # applied by the other shards but never commits, then kill the
+    # client and the primary. The shard that applied the overwrite
+    # must roll it back when the PG peers again.
+    #
+    local -a osds=($(get_osds $poolname $objname))
+    local primary=${osds[0]}
+    local frozen=${osds[2]}
+    kill -STOP $(cat $dir/osd.$frozen.pid) || return 1
+    printf "%*s" 100 FFFF > $dir/PATCH
+    rados --pool $poolname put $objname $dir/PATCH --offset 2000 &
+    local writer=$!
+    sleep 5
+    kill -KILL $writer
+    kill -KILL $(cat $dir/osd.$primary.pid) || return 1
+    ceph osd down $primary || return 1
+    ceph osd out $primary || return 1
+    kill -CONT $(cat $dir/osd.$frozen.pid) || return 1
+    wait_for_clean || return 1
+
+    rados --pool $poolname get $objname $dir/COPY || return 1
+    diff $dir/ORIGINAL $dir/COPY || return 1
+
+    activate_osd $dir $primary || return 1
+    ceph osd in $primary || return 1
+    wait_for_clean || return 1
+    rados --pool $poolname get $objname $dir/COPY || return 1
+    diff $dir/ORIGINAL $dir/COPY || return 1
+
+    delete_pool $poolname
+    rm $dir/ORIGINAL $dir/COPY $dir/PATCH
+}
+
 function chunk_size() {
     local stripe_width=$(ceph-conf --show-config-value osd_pool_erasure_code_stripe_width)
     eval local $(ceph osd erasure-code-profile get default | grep k=)
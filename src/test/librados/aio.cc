@@ -1827,6 +1827,58 @@ TEST(LibRadosAio, MultiWrite) {
   rados_aio_release(my_completion3);
 }
 
+TEST(LibRadosAio, BatchOperatePP) {
+  AioTestDataPP test_data;
+  ASSERT_EQ("", test_data.init());
+
+  const int num = 64;
+  std::vector<std::string> oids;
+  std::vector<AioCompletion*> cs;
+  std::vector<ObjectWriteOperation*> wops;
+  for (int i = 0; i < num; ++i) {
+    oids.push_back("batch_" + stringify(i));
+    cs.push_back(test_data.m_cluster.aio_create_completion(0, 0, 0));
+    bufferlist bl;
+    bl.append(oids.back());
+    wops.push_back(new ObjectWriteOperation);
+    wops.back()->write_full(bl);
+  }
+  ASSERT_EQ(-EINVAL, test_data.m_ioctx.aio_operate_batch(
+	      oids, std::vector<AioCompletion*>(), wops, 0));
+  ASSERT_EQ(0, test_data.m_ioctx.aio_operate_batch(oids, cs, wops, 0));
+  for (int i = 0; i < num; ++i) {
+    {
+      TestAlarm alarm;
+      ASSERT_EQ(0, cs[i]->wait_for_complete());
+    }
+    ASSERT_EQ(0, cs[i]->get_return_value());
+    cs[i]->release();
+    delete wops[i];
+  }
+
+  cs.clear();
+  std::vector<ObjectReadOperation*> rops;
+  std::vector<bufferlist> bls(num);
+  std::vector<bufferlist*> pbls;
+  for (int i = 0; i < num; ++i) {
+    cs.push_back(test_data.m_cluster.aio_create_completion(0, 0, 0));
+    rops.push_back(new ObjectReadOperation);
+    rops.back()->read(0, 0, NULL, NULL);
+    pbls.push_back(&bls[i]);
+  }
+  ASSERT_EQ(0, test_data.m_ioctx.aio_operate_batch(oids, cs, rops, 0, pbls));
+  for (int i = 0; i < num; ++i) {
+    {
+      TestAlarm alarm;
+      ASSERT_EQ(0, cs[i]->wait_for_complete());
+    }
+    ASSERT_EQ(0, cs[i]->get_return_value());
+    ASSERT_EQ(oids[i], std::string(bls[i].c_str(), bls[i].length()));
+    cs[i]->release();
+    delete rops[i];
+  }
+}
+
 TEST(LibRadosAio, MultiWritePP) {
   AioTestDataPP test_data;
   ASSERT_EQ("", test_data.init());
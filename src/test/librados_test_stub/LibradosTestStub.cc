@@ -409,6 +409,46 @@ int IoCtx::aio_operate(const std::string& oid, AioCompletion *c,
   return ctx->aio_operate(oid, *ops, c->pc, &snapc, 0);
 }
 
+int IoCtx::aio_operate_batch(const std::vector<std::string>& oids,
+                             const std::vector<AioCompletion*>& cs,
+                             const std::vector<ObjectWriteOperation*>& ops,
+                             int flags) {
+  if (cs.size() != oids.size() || ops.size() != oids.size()) {
+    return -EINVAL;
+  }
+  TestIoCtxImpl *ctx = reinterpret_cast<TestIoCtxImpl*>(io_ctx_impl);
+  for (size_t i = 0; i < oids.size(); ++i) {
+    TestObjectOperationImpl *o =
+      reinterpret_cast<TestObjectOperationImpl*>(ops[i]->impl);
+    int r = ctx->aio_operate(oids[i], *o, cs[i]->pc, NULL, flags);
+    if (r < 0) {
+      return r;
+    }
+  }
+  return 0;
+}
+
+int IoCtx::aio_operate_batch(const std::vector<std::string>& oids,
+                             const std::vector<AioCompletion*>& cs,
+                             const std::vector<ObjectReadOperation*>& ops,
+                             int flags,
+                             const std::vector<bufferlist*>& pbls) {
+  if (cs.size() != oids.size() || ops.size() != oids.size() ||
+      pbls.size() != oids.size()) {
+    return -EINVAL;
+  }
+  TestIoCtxImpl *ctx = reinterpret_cast<TestIoCtxImpl*>(io_ctx_impl);
+  for (size_t i = 0; i < oids.size(); ++i) {
+    TestObjectOperationImpl *o =
+      reinterpret_cast<TestObjectOperationImpl*>(ops[i]->impl);
+    int r = ctx->aio_operate_read(oids[i], *o, cs[i]->pc, flags, pbls[i]);
+    if (r < 0) {
+      return r;
+    }
+  }
+  return 0;
+}
+
 int IoCtx::aio_remove(const std::string& oid, AioCompletion *c) {
   TestIoCtxImpl *ctx = reinterpret_cast<TestIoCtxImpl*>(io_ctx_impl);
   return ctx->aio_remove(oid, c->pc);
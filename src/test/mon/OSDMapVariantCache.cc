@@ -0,0 +1,159 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "mon/OSDMapVariantCache.h"
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "gtest/gtest.h"
+
+// a firefly-era peer: no OSDMAP_ENC
+static const uint64_t old_features =
+  CEPH_FEATURES_ALL & ~CEPH_FEATURE_OSDMAP_ENC;
+// an older one still, with the classic pg_pool_t encoding
+static const uint64_t older_features =
+  old_features & ~CEPH_FEATURE_OSD_POOLRESEND;
+// and an old_client one
+static const uint64_t oldest_features = CEPH_FEATURE_NOSRCADDR;
+
+class OSDMapVariantCacheTest : public ::testing::Test {
+public:
+  uuid_d fsid;
+  epoch_t epoch;
+  map<epoch_t, bufferlist> full, inc;
+  int reads;
+
+  OSDMapVariantCacheTest() : epoch(0), reads(0) {}
+
+  void SetUp() {
+    fsid.generate_random();
+    OSDMap osdmap;
+    osdmap.build_simple(g_ceph_context, 0, fsid, 3, 6, 6);
+    OSDMap::Incremental i(osdmap.get_epoch() + 1);
+    i.fsid = fsid;
+    for (int o = 0; o < 3; ++o) {
+      i.new_state[o] = CEPH_OSD_EXISTS | CEPH_OSD_NEW;
+      i.new_weight[o] = CEPH_OSD_IN;
+    }
+    osdmap.apply_incremental(i);
+    epoch = osdmap.get_epoch();
+    // as the monitor stores them
+    i.encode(inc[epoch], CEPH_FEATURES_ALL | CEPH_FEATURE_RESERVED);
+    osdmap.encode(full[epoch], CEPH_FEATURES_ALL | CEPH_FEATURE_RESERVED);
+  }
+
+  int get_stored(map<epoch_t, bufferlist>& m, version_t v, bufferlist& bl) {
+    ++reads;
+    if (!m.count(v))
+      return -ENOENT;
+    bl = m[v];
+    return 0;
+  }
+  int get_full(OSDMapVariantCache& c, uint64_t features, bufferlist& bl) {
+    return c.get_full(epoch, features, bl,
+		      [this](version_t v, bufferlist& b) {
+			return get_stored(full, v, b);
+		      });
+  }
+  int get_inc(OSDMapVariantCache& c, uint64_t features, bufferlist& bl) {
+    return c.get_incremental(epoch, features, bl,
+			     [this](version_t v, bufferlist& b) {
+			       return get_stored(inc, v, b);
+			     });
+  }
+};
+
+TEST_F(OSDMapVariantCacheTest, encoded_once) {
+  OSDMapVariantCache c(10);
+  bufferlist a, b;
+  ASSERT_EQ(0, get_full(c, old_features, a));
+  ASSERT_EQ(0, get_full(c, old_features, b));
+  ASSERT_EQ(1, reads);
+  ASSERT_EQ(1u, c.get_num_encoded());
+  ASSERT_TRUE(a.contents_equal(b));
+  ASSERT_FALSE(a.contents_equal(full[epoch]));
+
+  // bits the old encodings don't look at share the variant
+  bufferlist d;
+  ASSERT_EQ(0, get_full(c, old_features & ~CEPH_FEATURE_MSG_AUTH, d));
+  ASSERT_EQ(1u, c.get_num_encoded());
+  ASSERT_TRUE(a.contents_equal(d));
+
+  // those they do don't
+  ASSERT_EQ(0, get_full(c, older_features, d));
+  ASSERT_EQ(2u, c.get_num_encoded());
+  ASSERT_FALSE(a.contents_equal(d));
+
+  // incrementals are kept apart from full maps
+  ASSERT_EQ(0, get_inc(c, old_features, d));
+  ASSERT_EQ(3u, c.get_num_encoded());
+}
+
+TEST_F(OSDMapVariantCacheTest, missing) {
+  OSDMapVariantCache c(10);
+  bufferlist bl;
+  ++epoch;
+  ASSERT_EQ(-ENOENT, get_inc(c, old_features, bl));
+  ASSERT_EQ(-ENOENT, get_inc(c, old_features, bl));
+  ASSERT_EQ(2, reads);
+  ASSERT_EQ(0u, c.get_num_encoded());
+}
+
+TEST_F(OSDMapVariantCacheTest, bounded) {
+  OSDMapVariantCache c(2);
+  bufferlist bl;
+  ASSERT_EQ(0, get_full(c, old_features, bl));
+  ASSERT_EQ(0, get_full(c, older_features, bl));
+  ASSERT_EQ(0, get_full(c, oldest_features, bl));
+  ASSERT_EQ(3u, c.get_num_encoded());
+  ASSERT_EQ(0, get_full(c, oldest_features, bl));
+  ASSERT_EQ(3u, c.get_num_encoded());
+  ASSERT_EQ(0, get_full(c, old_features, bl));
+  ASSERT_EQ(4u, c.get_num_encoded());
+}
+
+TEST_F(OSDMapVariantCacheTest, matches_encode_payload) {
+  const uint64_t features[] = { old_features, older_features,
+				oldest_features };
+  OSDMapVariantCache c(10);
+  for (unsigned i = 0; i < sizeof(features) / sizeof(features[0]); ++i) {
+    uint64_t f = features[i];
+
+    // what MOSDMap sends when it re-encodes the maps as stored itself
+    MOSDMap *plain = new MOSDMap(fsid);
+    plain->maps[epoch] = full[epoch];
+    plain->incremental_maps[epoch] = inc[epoch];
+    plain->encode_payload(f);
+
+    MOSDMap *cached = new MOSDMap(fsid);
+    ASSERT_EQ(0, get_full(c, f, cached->maps[epoch]));
+    ASSERT_EQ(0, get_inc(c, f, cached->incremental_maps[epoch]));
+    cached->encode_features = f;
+    cached->encode_payload(f);
+
+    ASSERT_EQ(plain->get_header().version, cached->get_header().version);
+    ASSERT_TRUE(plain->get_payload().contents_equal(cached->get_payload()));
+    plain->put();
+    cached->put();
+  }
+  ASSERT_EQ(6u, c.get_num_encoded());
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
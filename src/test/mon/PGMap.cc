@@ -12,6 +12,7 @@
  */
 
 #include "mon/PGMap.h"
+#include "mon/PGStatAggregator.h"
 #include "gtest/gtest.h"
 
 #include "common/ceph_argparse.h"
@@ -116,6 +117,133 @@ TEST(pgmap, calc_stats)
   }
 }
 
+TEST(pgmap, apply_incremental_matches_calc_stats)
+{
+  PGMap pg_map;
+  osd_stat_t os;
+  version_t v = 0;
+
+  // pgs across two pools, then a report that only moves counters, one
+  // that changes the acting set and one that removes a pg
+  {
+    PGMap::Incremental inc;
+    inc.version = ++v;
+    for (unsigned i = 0; i < 8; ++i) {
+      pg_stat_t ps;
+      ps.state = PG_STATE_ACTIVE | PG_STATE_CLEAN;
+      ps.up.push_back(i % 3);
+      ps.up.push_back((i + 1) % 3);
+      ps.acting = ps.up;
+      ps.stats.sum.num_objects = i;
+      inc.pg_stat_updates[pg_t(i, 1 + i % 2)] = ps;
+    }
+    for (int osd = 0; osd < 3; ++osd)
+      inc.update_stat(osd, 10, os);
+    pg_map.apply_incremental(g_ceph_context, inc);
+  }
+  {
+    PGMap::Incremental inc;
+    inc.version = ++v;
+    pg_stat_t ps = pg_map.pg_stat[pg_t(2, 1)];
+    ps.stats.sum.num_objects = 100;
+    ps.state = PG_STATE_ACTIVE;
+    inc.pg_stat_updates[pg_t(2, 1)] = ps;
+    ps = pg_map.pg_stat[pg_t(3, 2)];
+    ps.acting[0] = 2;
+    ps.blocked_by.push_back(1);
+    inc.pg_stat_updates[pg_t(3, 2)] = ps;
+    pg_map.apply_incremental(g_ceph_context, inc);
+  }
+  {
+    PGMap::Incremental inc;
+    inc.version = ++v;
+    inc.pg_remove.insert(pg_t(5, 2));
+    pg_map.apply_incremental(g_ceph_context, inc);
+  }
+
+  PGMap fresh = pg_map;
+  fresh.calc_stats();
+  ASSERT_EQ(fresh.num_pg, pg_map.num_pg);
+  ASSERT_EQ(fresh.num_pg_by_state, pg_map.num_pg_by_state);
+  ASSERT_EQ(fresh.pg_by_osd, pg_map.pg_by_osd);
+  ASSERT_EQ(fresh.blocked_by_sum, pg_map.blocked_by_sum);
+  ASSERT_EQ(fresh.pg_sum.stats.sum.num_objects,
+	    pg_map.pg_sum.stats.sum.num_objects);
+  ASSERT_EQ(fresh.get_min_last_epoch_clean(),
+	    pg_map.get_min_last_epoch_clean());
+}
+
+TEST(pgmap, aggregator_follows_updates)
+{
+  // pgs stuck in each state, for longer and longer
+  PGMap pg_map;
+  {
+    PGMap::Incremental inc;
+    inc.version = 1;
+    const int states[] = {
+      PG_STATE_PEERING,
+      PG_STATE_ACTIVE,
+      PG_STATE_ACTIVE | PG_STATE_CLEAN | PG_STATE_DEGRADED,
+      PG_STATE_ACTIVE | PG_STATE_CLEAN | PG_STATE_UNDERSIZED,
+      PG_STATE_ACTIVE | PG_STATE_CLEAN | PG_STATE_STALE,
+      PG_STATE_ACTIVE | PG_STATE_CLEAN,
+    };
+    for (unsigned i = 0; i < 60; ++i) {
+      pg_stat_t ps;
+      ps.state = states[i % 6];
+      ps.last_active = ps.last_clean = ps.last_undegraded =
+	ps.last_fullsized = ps.last_unstale = utime_t(1000 + i * 10, 0);
+      inc.pg_stat_updates[pg_t(i, 1 + i % 2)] = ps;
+    }
+    pg_map.apply_incremental(g_ceph_context, inc);
+  }
+
+  PGStatAggregator agg(g_ceph_context);
+  agg.start();
+  agg.reset(pg_map);
+
+  // a version that moves one pg and removes another, as PGMonitor
+  // applies it to both maps
+  vector<pair<pg_t,bufferlist> > pgs;
+  vector<pair<int32_t,bufferlist> > osds;
+  pg_stat_t ps = pg_map.pg_stat[pg_t(5, 2)];
+  ps.state = PG_STATE_PEERING;
+  ps.last_active = utime_t(1, 0);
+  pgs.push_back(make_pair(pg_t(5, 2), bufferlist()));
+  ::encode(ps, pgs.back().second);
+  pgs.push_back(make_pair(pg_t(6, 1), bufferlist()));
+  osds.push_back(make_pair(0, bufferlist()));
+  ::encode(osd_stat_t(), osds.back().second);
+  pg_map.apply_dirty(g_ceph_context, 2, utime_t(5000, 0), pgs, osds);
+  agg.queue_update([pgs, osds](PGMap& m) {
+      m.apply_dirty(g_ceph_context, 2, utime_t(5000, 0), pgs, osds);
+    });
+
+  version_t read_version = 0;
+  int64_t read_num_pg = 0;
+  agg.queue_read([&](const PGMap& m) {
+      read_version = m.version;
+      read_num_pg = m.num_pg;
+    });
+  agg.stop();
+
+  ASSERT_EQ(2u, pg_map.version);
+  ASSERT_EQ(59, pg_map.num_pg);
+  ASSERT_EQ(1u, pg_map.osd_stat.size());
+  ASSERT_EQ(pg_map.version, read_version);
+  ASSERT_EQ(pg_map.num_pg, read_num_pg);
+
+  PGStatAggregator::SnapshotRef snap = agg.get_snapshot();
+  ASSERT_TRUE(snap);
+  ASSERT_EQ(2u, snap->version);
+  for (unsigned t = 0; t < 1700; t += 50) {
+    map<string,int> expected, got;
+    ASSERT_EQ(pg_map.get_stuck_counts(utime_t(t, 0), expected),
+	      snap->get_stuck_counts(utime_t(t, 0), got));
+    ASSERT_EQ(expected, got);
+  }
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -0,0 +1,140 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Measure how long the monitor takes to apply a round of pg stat
+ * reports to a PGMap, and then to look up min_last_epoch_clean the way
+ * OSDMonitor::get_trim_to() does on every osdmap proposal.
+ *
+ * Each round is one PGMap::Incremental carrying a report from every
+ * osd, as PGMonitor batches them between proposals.  The reports only
+ * move counters and epochs; acting sets stay put, as they do outside
+ * of peering.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "mon/PGMap.h"
+
+static void populate(CephContext *cct, PGMap& pg_map, int num_osds,
+		     int num_pgs, int size)
+{
+  PGMap::Incremental inc;
+  inc.version = pg_map.version + 1;
+  for (int i = 0; i < num_pgs; ++i) {
+    pg_stat_t ps;
+    ps.state = PG_STATE_ACTIVE | PG_STATE_CLEAN;
+    ps.reported_epoch = 1;
+    ps.last_epoch_clean = 1;
+    for (int r = 0; r < size; ++r)
+      ps.up.push_back((i + r * 7) % num_osds);
+    ps.acting = ps.up;
+    inc.pg_stat_updates[pg_t(i, 1)] = ps;
+  }
+  for (int osd = 0; osd < num_osds; ++osd)
+    inc.update_stat(osd, 1, osd_stat_t());
+  pg_map.apply_incremental(cct, inc);
+}
+
+/// apply rounds of reports; returns seconds per round
+static double run(CephContext *cct, PGMap& pg_map, int num_osds,
+		  int pgs_per_round, int rounds)
+{
+  int num_pgs = pg_map.pg_stat.size();
+  int next = 0;
+  epoch_t epoch = 1;
+  epoch_t floor = 0;
+  std::chrono::duration<double> elapsed(0);
+  for (int r = 0; r < rounds; ++r) {
+    ++epoch;
+    PGMap::Incremental inc;
+    inc.version = pg_map.version + 1;
+    for (int i = 0; i < pgs_per_round; ++i) {
+      pg_t pgid(next, 1);
+      next = (next + 1) % num_pgs;
+      pg_stat_t ps = pg_map.pg_stat[pgid];
+      ps.reported_epoch = epoch;
+      ps.reported_seq++;
+      ps.stats.sum.num_objects++;
+      ps.stats.sum.num_bytes += 4096;
+      inc.pg_stat_updates[pgid] = ps;
+    }
+    for (int osd = 0; osd < num_osds; ++osd)
+      inc.update_stat(osd, epoch, osd_stat_t());
+
+    auto start = std::chrono::steady_clock::now();
+    pg_map.apply_incremental(cct, inc);
+    floor += pg_map.get_min_last_epoch_clean();
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+  if (!floor)
+    std::cerr << "min_last_epoch_clean never set" << std::endl;
+  return elapsed.count() / rounds;
+}
+
+static void usage()
+{
+  std::cout << "usage: ceph_test_pgmap_bench [--osds n] [--pgs n]"
+	    << " [--size n] [--pgs-per-round n] [--rounds n]" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  int osds = 1000;
+  int pgs = 65536;
+  int size = 3;
+  int pgs_per_round = 16384;
+  int rounds = 50;
+  std::ostringstream err;
+  for (auto i = args.begin(); i != args.end();) {
+    if (ceph_argparse_witharg(args, i, &osds, err, "--osds", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &pgs, err,
+				     "--pgs", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &size, err,
+				     "--size", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &pgs_per_round, err,
+				     "--pgs-per-round", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &rounds, err,
+				     "--rounds", (char*)NULL)) {
+    } else {
+      usage();
+      return 1;
+    }
+    if (!err.str().empty()) {
+      std::cerr << err.str() << std::endl;
+      return 1;
+    }
+  }
+  if (osds < size || pgs < 1 || pgs_per_round < 1 || rounds < 1) {
+    usage();
+    return 1;
+  }
+
+  PGMap pg_map;
+  populate(g_ceph_context, pg_map, osds, pgs, size);
+  double s = run(g_ceph_context, pg_map, osds, pgs_per_round, rounds);
+  std::cout << osds << " osds, " << pgs << " pgs, " << pgs_per_round
+	    << " pgs per round: " << s * 1000.0 << " ms per round"
+	    << std::endl;
+  return 0;
+}
@@ -1102,6 +1102,44 @@ TEST_P(MessengerTest, SyntheticStressTest1) {
   test_msg.wait_for_done();
 }
 
+TEST_P(MessengerTest, SyntheticZeroCopyTest) {
+  g_ceph_context->_conf->set_val("ms_async_zerocopy_min_bytes", "4096");
+  // loopback copies, which would turn zerocopy off after the first
+  // completion; keep it on, and break sockets so that reconnects and
+  // connection replacement happen with zerocopy sends in flight
+  g_ceph_context->_conf->set_val("ms_async_zerocopy_debug_keep_copied", "true");
+  g_ceph_context->_conf->set_val("ms_inject_socket_failures", "30");
+  SyntheticWorkload test_msg(16, 32, GetParam(), 100,
+                             Messenger::Policy::lossless_peer_reuse(0, 0),
+                             Messenger::Policy::lossless_peer_reuse(0, 0));
+  for (int i = 0; i < 10; ++i) {
+    if (!(i % 10)) cerr << "seeding connection " << i << std::endl;
+    test_msg.generate_connection();
+  }
+  gen_type rng(time(NULL));
+  for (int i = 0; i < 2000; ++i) {
+    if (!(i % 10)) {
+      cerr << "Op " << i << ": ";
+      test_msg.print_internal_state();
+    }
+    boost::uniform_int<> true_false(0, 99);
+    int val = true_false(rng);
+    if (val > 90) {
+      test_msg.generate_connection();
+    } else if (val > 80) {
+      test_msg.drop_connection();
+    } else if (val > 10) {
+      test_msg.send_message();
+    } else {
+      usleep(rand() % 1000 + 500);
+    }
+  }
+  test_msg.wait_for_done();
+  g_ceph_context->_conf->set_val("ms_async_zerocopy_min_bytes", "0");
+  g_ceph_context->_conf->set_val("ms_async_zerocopy_debug_keep_copied", "false");
+  g_ceph_context->_conf->set_val("ms_inject_socket_failures", "0");
+}
+
 
 TEST_P(MessengerTest, SyntheticInjectTest) {
   g_ceph_context->_conf->set_val("ms_inject_socket_failures", "30");
@@ -0,0 +1,209 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Compare BlueStore allocators under concurrent alloc/release churn on
+ * a pre-fragmented device.
+ *
+ *  ceph_perf_allocator [--types stupid,bitmap,sharded] [--threads 8]
+ *                      [--ops 100000] [--size 10G] [--fill .8]
+ */
+
+#include <stdlib.h>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/ceph_argparse.h"
+#include "common/debug.h"
+#include "common/Clock.h"
+#include "common/strtol.h"
+#include "global/global_init.h"
+#include "include/str_list.h"
+#include "os/bluestore/Allocator.h"
+
+using namespace std;
+
+struct held_t {
+  uint64_t offset;
+  uint32_t length;
+};
+
+static uint64_t alloc_unit;
+
+/// allocate len bytes (possibly in pieces); return the number of pieces
+static int do_alloc(Allocator *a, uint64_t len, vector<held_t> *held)
+{
+  if (a->reserve(len) < 0)
+    return -ENOSPC;
+  int pieces = 0;
+  while (len > 0) {
+    held_t h;
+    int r = a->allocate(len, alloc_unit, 0, &h.offset, &h.length);
+    assert(r == 0);
+    held->push_back(h);
+    len -= MIN(len, h.length);
+    ++pieces;
+  }
+  return pieces;
+}
+
+static void usage(const char *name)
+{
+  cout << "usage: " << name
+       << " [--types stupid,bitmap,sharded] [--threads n] [--ops n]"
+       << " [--size bytes] [--fill ratio]" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+  env_to_vec(args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  string types = "stupid,bitmap,sharded";
+  int num_threads = 8;
+  uint64_t ops = 100000;
+  uint64_t size = 10ull << 30;
+  double fill = .8;
+  string val;
+  for (auto i = args.begin(); i != args.end();) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage(argv[0]);
+      return 0;
+    } else if (ceph_argparse_witharg(args, i, &val, "--types", (char*)NULL)) {
+      types = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--threads", (char*)NULL)) {
+      num_threads = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--ops", (char*)NULL)) {
+      ops = strtoull(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_witharg(args, i, &val, "--size", (char*)NULL)) {
+      string err;
+      size = strict_sistrtoll(val.c_str(), &err);
+      if (!err.empty()) {
+	cerr << "bad --size: " << err << std::endl;
+	return 1;
+      }
+    } else if (ceph_argparse_witharg(args, i, &val, "--fill", (char*)NULL)) {
+      fill = atof(val.c_str());
+    } else {
+      cerr << "unrecognized arg " << *i << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  alloc_unit = g_conf->bluestore_min_alloc_size;
+  size -= size % alloc_unit;
+
+  list<string> type_list;
+  get_str_list(types, type_list);
+  for (auto& type : type_list) {
+    Allocator *a = Allocator::create(type, size);
+    if (!a) {
+      cerr << "unknown allocator " << type << std::endl;
+      return 1;
+    }
+    a->init_add_free(0, size);
+
+    // fragment: fill the device with small and large extents and then
+    // free every other one.
+    srand(0);
+    vector<held_t> frag;
+    uint64_t used = 0;
+    while (used < size * fill) {
+      uint64_t len = alloc_unit * (1 + rand() % 16);
+      if (do_alloc(a, len, &frag) < 0)
+	break;
+      used += len;
+    }
+    a->commit_start();
+    for (unsigned i = 0; i < frag.size(); i += 2)
+      a->release(frag[i].offset, frag[i].length);
+    a->commit_finish();
+    a->commit_start();
+    a->commit_finish();
+    uint64_t start_free = a->get_free();
+
+    // churn: every thread allocates 1-16 units and releases an older
+    // extent, keeping its footprint roughly constant.  a separate
+    // thread plays kv_sync_thread and commits releases.
+    std::atomic<bool> stop = {false};
+    std::atomic<uint64_t> total_pieces = {0}, total_allocs = {0};
+    std::atomic<uint64_t> enospc = {0};
+    std::thread committer([&] {
+	while (!stop) {
+	  a->commit_start();
+	  usleep(1000);
+	  a->commit_finish();
+	}
+      });
+    utime_t begin = ceph_clock_now(g_ceph_context);
+    vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+      threads.push_back(std::thread([&, t] {
+	    unsigned seed = t;
+	    vector<held_t> held;
+	    uint64_t pieces = 0, allocs = 0;
+	    for (uint64_t i = 0; i < ops / num_threads; ++i) {
+	      uint64_t len = alloc_unit * (1 + rand_r(&seed) % 16);
+	      int r = do_alloc(a, len, &held);
+	      if (r < 0) {
+		++enospc;
+	      } else {
+		pieces += r;
+		++allocs;
+	      }
+	      while (held.size() > 32 || (r < 0 && !held.empty())) {
+		unsigned victim = rand_r(&seed) % held.size();
+		a->release(held[victim].offset, held[victim].length);
+		held[victim] = held.back();
+		held.pop_back();
+		if (r >= 0)
+		  break;
+	      }
+	    }
+	    for (auto& h : held)
+	      a->release(h.offset, h.length);
+	    total_pieces += pieces;
+	    total_allocs += allocs;
+	  }));
+    }
+    for (auto& t : threads)
+      t.join();
+    utime_t elapsed = ceph_clock_now(g_ceph_context) - begin;
+    stop = true;
+    committer.join();
+
+    double secs = (double)elapsed;
+    cout << type
+	 << ": " << total_allocs.load() << " allocs by " << num_threads
+	 << " threads in " << elapsed
+	 << "s (" << (uint64_t)(total_allocs.load() / secs) << " allocs/s)"
+	 << ", " << (double)total_pieces.load() / total_allocs.load()
+	 << " extents/alloc"
+	 << ", " << enospc.load() << " ENOSPC"
+	 << ", free " << start_free << " at start"
+	 << std::endl;
+
+    a->shutdown();
+    delete a;
+  }
+  return 0;
+}
@@ -647,6 +647,256 @@ TEST_P(StoreTest, SmallSkipFront) {
   }
 }
 
+TEST_P(StoreTest, ReadAfterOverwrite) {
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  ghobject_t a(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    cerr << "Creating collection " << cid << std::endl;
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bufferlist expected;
+  {
+    bufferptr bp(65536);
+    memset(bp.c_str(), 1, bp.length());
+    expected.append(bp);
+    bufferlist bl;
+    bl.append(bp.c_str(), bp.length());
+    ObjectStore::Transaction t;
+    t.write(cid, a, 0, bl.length(), bl);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    // read twice so that the second read may be served from cache
+    bufferlist bl;
+    ASSERT_EQ(65536, store->read(cid, a, 0, 65536, bl));
+    ASSERT_TRUE(bl.contents_equal(expected));
+    bl.clear();
+    ASSERT_EQ(65536, store->read(cid, a, 0, 65536, bl));
+    ASSERT_TRUE(bl.contents_equal(expected));
+  }
+  {
+    bufferlist bl;
+    bufferptr bp(5000);
+    memset(bp.c_str(), 2, bp.length());
+    bl.append(bp);
+    ObjectStore::Transaction t;
+    t.write(cid, a, 10000, bl.length(), bl);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+    memset(expected.c_str() + 10000, 2, bl.length());
+  }
+  {
+    ObjectStore::Transaction t;
+    t.zero(cid, a, 30000, 3000);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+    memset(expected.c_str() + 30000, 0, 3000);
+  }
+  {
+    bufferlist bl;
+    ASSERT_EQ(65536, store->read(cid, a, 0, 65536, bl));
+    ASSERT_TRUE(bl.contents_equal(expected));
+    bl.clear();
+    ASSERT_EQ(4000, store->read(cid, a, 9000, 4000, bl));
+    bufferlist e;
+    e.substr_of(expected, 9000, 4000);
+    ASSERT_TRUE(bl.contents_equal(e));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.truncate(cid, a, 20000);
+    t.truncate(cid, a, 65536);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+    memset(expected.c_str() + 20000, 0, 65536 - 20000);
+  }
+  {
+    bufferlist bl;
+    ASSERT_EQ(65536, store->read(cid, a, 0, 65536, bl));
+    ASSERT_TRUE(bl.contents_equal(expected));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, a);
+    t.remove_collection(cid);
+    cerr << "Cleaning" << std::endl;
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTest, CompressedOverwrite) {
+  if (GetParam() != string("bluestore"))
+    return;
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  ghobject_t a(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  ghobject_t b(hobject_t(sobject_t("Object 2", CEPH_NOSNAP)));
+  g_conf->set_val("bluestore_compression", "force");
+  g_ceph_context->_conf->apply_changes(NULL);
+  store->umount();
+  ASSERT_EQ(0, store->mount());
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    cerr << "Creating collection " << cid << std::endl;
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  unsigned len = g_conf->bluestore_compression_max_blob_size * 2;
+  bufferlist expected;
+  {
+    bufferptr bp(len);
+    for (unsigned i = 0; i < len; ++i)
+      bp[i] = 'a' + (i / 1000) % 4;
+    expected.append(bp);
+    bufferlist bl;
+    bl.append(bp.c_str(), bp.length());
+    ObjectStore::Transaction t;
+    t.write(cid, a, 0, bl.length(), bl);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    bufferlist bl;
+    ASSERT_EQ((int)len, store->read(cid, a, 0, len, bl,
+				    CEPH_OSD_OP_FLAG_FADVISE_NOCACHE));
+    ASSERT_TRUE(bl.contents_equal(expected));
+  }
+  {
+    // overwrite part of the first extent and span into the second
+    bufferlist bl;
+    bufferptr bp(len / 2 + 5000);
+    memset(bp.c_str(), 2, bp.length());
+    bl.append(bp);
+    ObjectStore::Transaction t;
+    t.write(cid, a, 3000, bl.length(), bl);
+    t.zero(cid, a, len - 10000, 3000);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+    memset(expected.c_str() + 3000, 2, bl.length());
+    memset(expected.c_str() + len - 10000, 0, 3000);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.clone(cid, a, b);
+    t.truncate(cid, a, len - 20000);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    bufferlist bl;
+    ASSERT_EQ((int)len, store->read(cid, b, 0, len, bl,
+				    CEPH_OSD_OP_FLAG_FADVISE_NOCACHE));
+    ASSERT_TRUE(bl.contents_equal(expected));
+    bl.clear();
+    ASSERT_EQ((int)len - 20000,
+	      store->read(cid, a, 0, len, bl,
+			  CEPH_OSD_OP_FLAG_FADVISE_NOCACHE));
+    bufferlist e;
+    e.substr_of(expected, 0, len - 20000);
+    ASSERT_TRUE(bl.contents_equal(e));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, a);
+    t.remove(cid, b);
+    t.remove_collection(cid);
+    cerr << "Cleaning" << std::endl;
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  g_conf->set_val("bluestore_compression", "none");
+  g_ceph_context->_conf->apply_changes(NULL);
+}
+
+TEST_P(StoreTest, WALBatchOverlappingWrites) {
+  if (GetParam() != string("bluestore"))
+    return;
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  g_conf->set_val("bluestore_wal_batch_bytes", "1048576");
+  g_conf->set_val("bluestore_wal_batch_max_delay", ".05");
+  // verify what reached the device, not what the cache remembers
+  g_conf->set_val("bluestore_buffer_cache_writes", "false");
+  g_ceph_context->_conf->apply_changes(NULL);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    cerr << "Creating collection " << cid << std::endl;
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  const unsigned num_objects = 4;
+  const unsigned len = 65536;
+  vector<ghobject_t> objs;
+  vector<bufferlist> expected(num_objects);
+  for (unsigned i = 0; i < num_objects; ++i) {
+    objs.push_back(ghobject_t(hobject_t(sobject_t(
+      "Object " + stringify(i), CEPH_NOSNAP))));
+    bufferptr bp(len);
+    memset(bp.c_str(), 'a' + i, len);
+    expected[i].append(bp);
+    bufferlist bl;
+    bl.append(bp.c_str(), len);
+    ObjectStore::Transaction t;
+    t.write(cid, objs[i], 0, len, bl);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // queue many small, unaligned, overlapping overwrites (and a zero)
+  // without waiting so that they land in the same wal batch
+  for (unsigned n = 0; n < 64; ++n) {
+    unsigned i = n % num_objects;
+    unsigned off = (n * 1237) % (len - 5000);
+    unsigned l = 100 + (n * 31) % 3000;
+    ObjectStore::Transaction t;
+    if (n % 7 == 6) {
+      t.zero(cid, objs[i], off, l);
+      memset(expected[i].c_str() + off, 0, l);
+    } else {
+      bufferlist bl;
+      bufferptr bp(l);
+      memset(bp.c_str(), n, l);
+      bl.append(bp);
+      t.write(cid, objs[i], off, l, bl);
+      memset(expected[i].c_str() + off, n, l);
+    }
+    r = store->queue_transaction(&osr, std::move(t), NULL);
+    ASSERT_EQ(r, 0);
+  }
+  osr.flush();
+  store->umount();
+  r = store->mount();
+  ASSERT_EQ(0, r);
+  for (unsigned i = 0; i < num_objects; ++i) {
+    bufferlist bl;
+    ASSERT_EQ((int)len, store->read(cid, objs[i], 0, len, bl,
+				    CEPH_OSD_OP_FLAG_FADVISE_NOCACHE));
+    ASSERT_TRUE(bl.contents_equal(expected[i]));
+  }
+  {
+    ObjectStore::Transaction t;
+    for (auto& o : objs)
+      t.remove(cid, o);
+    t.remove_collection(cid);
+    cerr << "Cleaning" << std::endl;
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  g_conf->set_val("bluestore_wal_batch_bytes", "0");
+  g_conf->set_val("bluestore_buffer_cache_writes", "true");
+  g_ceph_context->_conf->apply_changes(NULL);
+}
+
 TEST_P(StoreTest, AppendWalVsTailCache) {
   ObjectStore::Sequencer osr("test");
   int r;
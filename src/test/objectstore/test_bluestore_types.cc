@@ -155,3 +155,126 @@ TEST(bluestore_extent_ref_map_t, contains)
   ASSERT_FALSE(m.contains(40, 3000));
   ASSERT_FALSE(m.contains(4000, 30));
 }
+
+static unsigned count_csums(const bluestore_extent_t& e)
+{
+  unsigned n = 0;
+  for (unsigned i = 0; i < e.get_csum_count(); ++i)
+    if (e.has_csum(i))
+      ++n;
+  return n;
+}
+
+TEST(bluestore_extent_t, csum_update)
+{
+  bluestore_extent_t e(0, 4 * 4096);
+  bufferlist bl;
+  bl.append_zero(3 * 4096 + 100);
+
+  // only whole chunks get a checksum
+  e.csum_update(100, bl, bluestore_extent_t::CSUM_CRC32C, 12);
+  ASSERT_TRUE(e.has_flag(bluestore_extent_t::FLAG_CSUM));
+  ASSERT_EQ(2u, count_csums(e));
+  ASSERT_TRUE(e.has_csum(1));
+  ASSERT_TRUE(e.has_csum(2));
+
+  e.csum_update(0, bl, bluestore_extent_t::CSUM_CRC32C, 12);
+  ASSERT_EQ(3u, count_csums(e));
+
+  // a partial overwrite invalidates the chunk
+  bufferlist small;
+  small.append("foo");
+  e.csum_update(4096 + 10, small, bluestore_extent_t::CSUM_CRC32C, 12);
+  ASSERT_EQ(2u, count_csums(e));
+  ASSERT_FALSE(e.has_csum(1));
+
+  e.csum_discard(8191, 2);
+  ASSERT_EQ(1u, count_csums(e));
+  ASSERT_TRUE(e.has_csum(0));
+
+  // the extent keeps its type until all checksums are gone
+  e.csum_update(0, bl, bluestore_extent_t::CSUM_XXHASH64, 13);
+  ASSERT_EQ(bluestore_extent_t::CSUM_CRC32C, e.csum_type);
+  e.csum_discard(0, e.length);
+  ASSERT_FALSE(e.has_flag(bluestore_extent_t::FLAG_CSUM));
+  e.csum_update(0, bl, bluestore_extent_t::CSUM_NONE, 12);
+  ASSERT_FALSE(e.has_flag(bluestore_extent_t::FLAG_CSUM));
+}
+
+TEST(bluestore_extent_t, csum_trim)
+{
+  bufferptr bp(8 * 4096);
+  for (unsigned i = 0; i < bp.length(); ++i)
+    bp[i] = i * 7;
+  bufferlist bl;
+  bl.append(bp);
+  bluestore_extent_t e(1 << 20, 8 * 4096);
+  e.csum_update(0, bl, bluestore_extent_t::CSUM_XXHASH32, 12);
+  ASSERT_EQ(8u, count_csums(e));
+  uint64_t v3 = e.get_csum(3);
+
+  // aligned head trim rebases the checksums
+  bluestore_extent_t h = e;
+  h.trim(2 * 4096, 4 * 4096 + 100);
+  ASSERT_EQ((1u << 20) + 2 * 4096, h.offset);
+  ASSERT_EQ(4u * 4096 + 100, h.length);
+  ASSERT_EQ(4u, count_csums(h));  // the partial tail chunk is dropped
+  ASSERT_EQ(v3, h.get_csum(1));
+
+  // unaligned head trim drops them
+  h = e;
+  h.trim(100, 4096);
+  ASSERT_FALSE(h.has_flag(bluestore_extent_t::FLAG_CSUM));
+  ASSERT_EQ(0u, h.get_csum_count());
+
+  // and the encoding round-trips
+  bufferlist enc;
+  ::encode(e, enc);
+  bluestore_extent_t d;
+  bufferlist::iterator p = enc.begin();
+  ::decode(d, p);
+  ASSERT_EQ(e.csum_type, d.csum_type);
+  ASSERT_EQ(e.csum_chunk_order, d.csum_chunk_order);
+  ASSERT_EQ(e.csum_data, d.csum_data);
+  ASSERT_EQ(e.csum_valid, d.csum_valid);
+}
+
+TEST(bluestore_onode_t, csum_verify)
+{
+  for (unsigned type : { bluestore_extent_t::CSUM_CRC32C,
+			 bluestore_extent_t::CSUM_XXHASH32,
+			 bluestore_extent_t::CSUM_XXHASH64 }) {
+    bluestore_onode_t on;
+    on.block_map[0] = bluestore_extent_t(65536, 2 * 4096);
+    on.block_map[2 * 4096] = bluestore_extent_t(262144, 2 * 4096);
+    bufferptr bp(4 * 4096);
+    for (unsigned i = 0; i < bp.length(); ++i)
+      bp[i] = i;
+    bufferlist bl;
+    bl.append(bp);
+    on.csum_update(0, bl, type, 12);
+    ASSERT_EQ(2u, count_csums(on.block_map[0]));
+    ASSERT_EQ(2u, count_csums(on.block_map[2 * 4096]));
+
+    bufferlist second;
+    second.substr_of(bl, 2 * 4096, 2 * 4096);
+    uint64_t bad = 0;
+    ASSERT_EQ(0, on.csum_verify(2 * 4096, second, &bad));
+
+    // partial chunks are not verified
+    bufferlist t;
+    t.substr_of(bl, 100, 4096);
+    ASSERT_EQ(0, on.csum_verify(100, t, &bad));
+
+    // corrupt a chunk
+    bufferlist c;
+    c.append(second.c_str(), second.length());
+    c.c_str()[4096 + 7] ^= 1;
+    ASSERT_EQ(-EIO, on.csum_verify(2 * 4096, c, &bad));
+    ASSERT_EQ(3u * 4096, bad);
+
+    // unless an overlay shadows it
+    on.overlay_map[3 * 4096 + 1000] = bluestore_overlay_t(1, 0, 10);
+    ASSERT_EQ(0, on.csum_verify(2 * 4096, c, &bad));
+  }
+}
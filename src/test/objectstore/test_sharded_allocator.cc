@@ -0,0 +1,194 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "common/config.h"
+#include "common/ceph_argparse.h"
+#include "include/interval_set.h"
+#include "include/stringify.h"
+#include <gtest/gtest.h>
+
+#include "os/bluestore/ShardedAllocator.h"
+
+static const uint64_t unit = 65536;          // bluestore_min_alloc_size
+static const uint64_t zone = 16 * unit;
+static const unsigned num_zones = 4;
+
+/// the zone this thread allocates from first
+static unsigned home_zone()
+{
+  ShardedAllocator a(num_zones * zone, num_zones);
+  a.init_add_free(0, num_zones * zone);
+  EXPECT_EQ(0, a.reserve(unit));
+  uint64_t off;
+  uint32_t len;
+  EXPECT_EQ(0, a.allocate(unit, unit, 0, &off, &len));
+  return off / zone;
+}
+
+TEST(ShardedAllocator, release_across_zones)
+{
+  ShardedAllocator a(num_zones * zone, num_zones);
+  a.init_add_free(0, num_zones * zone);
+  a.init_rm_free(0, num_zones * zone);
+  ASSERT_EQ(0u, a.get_free());
+
+  // straddle the boundary between zones 1 and 2
+  a.release(2 * zone - unit, 2 * unit);
+  ASSERT_EQ(0u, a.get_free());
+  a.commit_start();
+  ASSERT_EQ(0u, a.get_free());
+  a.commit_finish();
+  ASSERT_EQ(2 * unit, a.get_free());
+
+  ASSERT_EQ(0, a.reserve(2 * unit));
+  interval_set<uint64_t> got;
+  for (int i = 0; i < 2; ++i) {
+    uint64_t off;
+    uint32_t len;
+    ASSERT_EQ(0, a.allocate(2 * unit, unit, 0, &off, &len));
+    ASSERT_EQ(unit, len);  // no allocation spans two zones
+    got.insert(off, len);
+  }
+  ASSERT_EQ(1u, got.num_intervals());
+  ASSERT_EQ(2 * zone - unit, got.range_start());
+  ASSERT_EQ(2 * unit, got.size());
+  ASSERT_EQ(0u, a.get_free());
+}
+
+TEST(ShardedAllocator, steal)
+{
+  unsigned other = (home_zone() + 1) % num_zones;
+  ShardedAllocator a(num_zones * zone, num_zones);
+  a.init_add_free(other * zone, zone);
+
+  // our own zone is empty; everything comes from the other one
+  ASSERT_EQ(0, a.reserve(zone));
+  for (uint64_t i = 0; i < zone / unit; ++i) {
+    uint64_t off;
+    uint32_t len;
+    ASSERT_EQ(0, a.allocate(unit, unit, 0, &off, &len));
+    ASSERT_EQ(other, off / zone);
+    ASSERT_EQ(unit, len);
+  }
+  ASSERT_EQ(0u, a.get_free());
+  ASSERT_EQ(-ENOSPC, a.reserve(unit));
+}
+
+TEST(ShardedAllocator, reserve)
+{
+  ShardedAllocator a(num_zones * zone, num_zones);
+  a.init_add_free(0, 4 * unit);
+
+  ASSERT_EQ(-ENOSPC, a.reserve(5 * unit));
+  ASSERT_EQ(0, a.reserve(3 * unit));
+  ASSERT_EQ(-ENOSPC, a.reserve(2 * unit));
+  ASSERT_EQ(0, a.reserve(unit));
+  ASSERT_EQ(-ENOSPC, a.reserve(1));
+
+  a.unreserve(2 * unit);
+  ASSERT_EQ(0, a.reserve(2 * unit));
+  a.unreserve(2 * unit);
+
+  // allocating consumes both free space and the reservation
+  uint64_t off;
+  uint32_t len;
+  ASSERT_EQ(0, a.allocate(unit, unit, 0, &off, &len));
+  ASSERT_EQ(3 * unit, a.get_free());
+  ASSERT_EQ(-ENOSPC, a.reserve(3 * unit));
+  ASSERT_EQ(0, a.reserve(2 * unit));
+
+  // released space is not reservable until committed
+  a.release(off, len);
+  ASSERT_EQ(-ENOSPC, a.reserve(unit));
+  a.commit_start();
+  a.commit_finish();
+  ASSERT_EQ(0, a.reserve(unit));
+}
+
+TEST(ShardedAllocator, concurrent)
+{
+  const unsigned num_threads = 8;
+  const unsigned ops = 2000;
+  ShardedAllocator a(num_zones * zone, num_zones);
+  a.init_add_free(0, num_zones * zone);
+
+  std::mutex lock;
+  interval_set<uint64_t> in_use;
+  bool overlap = false;
+  std::atomic<bool> done = {false};
+
+  // keep space flowing back like the kv_sync_thread would
+  std::thread committer([&] {
+      while (!done) {
+	a.commit_start();
+	a.commit_finish();
+	std::this_thread::yield();
+      }
+    });
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < num_threads; ++t) {
+    threads.push_back(std::thread([&] {
+	  std::vector<std::pair<uint64_t,uint32_t>> mine;
+	  for (unsigned i = 0; i < ops; ++i) {
+	    if (a.reserve(unit) == 0) {
+	      uint64_t off;
+	      uint32_t len;
+	      EXPECT_EQ(0, a.allocate(unit, unit, 0, &off, &len));
+	      std::lock_guard<std::mutex> l(lock);
+	      if (in_use.intersects(off, len))
+		overlap = true;
+	      else
+		in_use.insert(off, len);
+	      mine.push_back(std::make_pair(off, len));
+	    }
+	    if (!mine.empty() && (i % 3 == 0 || mine.size() > 8)) {
+	      std::pair<uint64_t,uint32_t> e = mine.front();
+	      mine.erase(mine.begin());
+	      {
+		std::lock_guard<std::mutex> l(lock);
+		in_use.erase(e.first, e.second);
+	      }
+	      a.release(e.first, e.second);
+	    }
+	  }
+	  for (auto& e : mine) {
+	    {
+	      std::lock_guard<std::mutex> l(lock);
+	      in_use.erase(e.first, e.second);
+	    }
+	    a.release(e.first, e.second);
+	  }
+	}));
+  }
+  for (auto& t : threads)
+    t.join();
+  done = true;
+  committer.join();
+  a.commit_start();
+  a.commit_finish();
+
+  ASSERT_FALSE(overlap);
+  ASSERT_TRUE(in_use.empty());
+  ASSERT_EQ(num_zones * zone, a.get_free());
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+  env_to_vec(args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+  g_conf->set_val("bluestore_min_alloc_size", stringify(unit));
+  g_conf->apply_changes(NULL);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -58,3 +58,145 @@ TEST(ECUtil, stripe_info_t)
             make_pair((uint64_t)0, 2*swidth));
 }
 
+
+TEST(ECUtil, StripeCache)
+{
+  const uint64_t swidth = 4096;
+  ECUtil::StripeCache c(swidth, 2*swidth);
+  hobject_t a(object_t("a"), "", CEPH_NOSNAP, 0, 1, "");
+  hobject_t b(object_t("b"), "", CEPH_NOSNAP, 0, 1, "");
+  bufferlist bl, out;
+  bl.append_zero(swidth);
+
+  // untracked objects report their on-disk size
+  ASSERT_EQ(c.get_projected_size(a, 3*swidth), 3*swidth);
+
+  c.reserve(1, a, 3*swidth, 3*swidth);
+  ASSERT_EQ(c.get_projected_size(a, 0), 4*swidth);
+  ASSERT_TRUE(c.have(a, 3*swidth));
+  ASSERT_FALSE(c.get(a, 3*swidth, &out));
+  c.fill(1, a, 3*swidth, bl);
+  ASSERT_TRUE(c.get(a, 3*swidth, &out));
+  ASSERT_EQ(out.length(), swidth);
+
+  // pinned stripes are never trimmed
+  c.set_max_bytes(0);
+  ASSERT_TRUE(c.have(a, 3*swidth));
+  c.release(1);
+  ASSERT_FALSE(c.have(a, 3*swidth));
+  ASSERT_EQ(c.get_bytes(), 0u);
+
+  // unpinned stripes are kept up to max_bytes, lru first out
+  c.set_max_bytes(2*swidth);
+  for (uint64_t i = 0; i < 3; ++i) {
+    c.reserve(2, a, i*swidth, 0);
+    c.fill(2, a, i*swidth, bl);
+  }
+  c.release(2);
+  ASSERT_EQ(c.get_bytes(), 2*swidth);
+  ASSERT_FALSE(c.have(a, 0));
+  ASSERT_TRUE(c.have(a, swidth));
+
+  // a reserved but unfilled stripe is dropped on release
+  c.reserve(3, b, 0, 0);
+  c.release(3);
+  ASSERT_FALSE(c.have(b, 0));
+
+  // barriers drop the object and block it until released
+  c.add_barrier(4, a);
+  ASSERT_TRUE(c.blocked(a));
+  ASSERT_FALSE(c.have(a, swidth));
+  ASSERT_EQ(c.get_bytes(), 0u);
+  c.release(4);
+  ASSERT_FALSE(c.blocked(a));
+  ASSERT_EQ(c.get_projected_size(a, 5*swidth), 5*swidth);
+}
+
+static map<int, bufferlist> make_chunks(unsigned n, unsigned len, char seed)
+{
+  map<int, bufferlist> chunks;
+  for (unsigned i = 0; i < n; ++i) {
+    bufferptr p(len);
+    for (unsigned j = 0; j < len; ++j)
+      p[j] = seed + i * 31 + j * 7;
+    chunks[i].append(p);
+  }
+  return chunks;
+}
+
+/// write chunks into the shards at offset, zero filling any hole
+static void splice(map<int, bufferlist> &shards, uint64_t offset,
+		   map<int, bufferlist> &chunks)
+{
+  for (map<int, bufferlist>::iterator i = chunks.begin();
+       i != chunks.end();
+       ++i) {
+    bufferlist &s = shards[i->first];
+    if (s.length() < offset)
+      s.append_zero(offset - s.length());
+    bufferlist bl;
+    bl.substr_of(s, 0, offset);
+    bl.append(i->second);
+    if (offset + i->second.length() < s.length()) {
+      bufferlist tail;
+      tail.substr_of(s, offset + i->second.length(),
+		     s.length() - offset - i->second.length());
+      bl.claim_append(tail);
+    }
+    s.swap(bl);
+  }
+}
+
+/// what overwrite() is told the chunks held before
+static map<int, bufferlist> old_chunks(map<int, bufferlist> &shards,
+				       uint64_t offset, uint64_t len)
+{
+  map<int, bufferlist> chunks;
+  for (map<int, bufferlist>::iterator i = shards.begin();
+       i != shards.end();
+       ++i) {
+    if (offset >= i->second.length())
+      continue;
+    chunks[i->first].substr_of(
+      i->second, offset, MIN(len, i->second.length() - offset));
+  }
+  return chunks;
+}
+
+TEST(ECUtil, HashInfo_overwrite)
+{
+  const unsigned n = 3;
+  const unsigned csize = 4096;
+  ECUtil::HashInfo h(n);
+  map<int, bufferlist> shards = make_chunks(n, 4*csize, 1);
+  h.append(0, shards);
+
+  struct {
+    uint64_t offset;
+    unsigned len;
+  } writes[] = {
+    { csize, csize },       // within
+    { 0, 4*csize },         // all of it
+    { 3*csize, 2*csize },   // across the end
+    { 7*csize, csize },     // past the end, leaving a hole
+  };
+  for (unsigned w = 0; w < sizeof(writes) / sizeof(writes[0]); ++w) {
+    map<int, bufferlist> chunks = make_chunks(n, writes[w].len, w + 2);
+    map<int, bufferlist> old = old_chunks(shards, writes[w].offset,
+					  writes[w].len);
+    h.overwrite(writes[w].offset, old, chunks);
+    splice(shards, writes[w].offset, chunks);
+    ASSERT_TRUE(h.has_chunk_hash());
+    ASSERT_EQ(shards[0].length(), h.get_total_chunk_size());
+    for (unsigned i = 0; i < n; ++i)
+      ASSERT_EQ(shards[i].crc32c(-1), h.get_chunk_hash(i)) << "write " << w;
+  }
+
+  // objects that lost their hashes only track the size
+  ECUtil::HashInfo none;
+  map<int, bufferlist> chunks = make_chunks(n, csize, 9);
+  map<int, bufferlist> old;
+  none.overwrite(2*csize, old, chunks);
+  ASSERT_FALSE(none.has_chunk_hash());
+  ASSERT_EQ(3*csize, none.get_total_chunk_size());
+}
@@ -411,3 +411,111 @@ TEST_F(OSDMapTest, PrimaryAffinity) {
     osdmap.set_primary_affinity(1, 0x10000);
   }
 }
+
+TEST_F(OSDMapTest, PrecomputedMapping) {
+  set_up_map();
+
+  // a copy that maps everything the slow way
+  bufferlist bl;
+  osdmap.encode(bl);
+  OSDMap plain;
+  plain.decode(bl);
+
+  osdmap.update_mapping(g_ceph_context);
+  ASSERT_TRUE(osdmap.get_mapping());
+  ASSERT_FALSE(plain.get_mapping());
+
+  const map<int64_t,pg_pool_t>& pools = osdmap.get_pools();
+  pg_t pgid(0, pools.begin()->first);
+  vector<int> up, acting;
+  int up_primary, acting_primary;
+  osdmap.pg_to_up_acting_osds(pgid, &up, &up_primary,
+			      &acting, &acting_primary);
+
+  // temp mappings only: the mapping is patched, not dropped
+  OSDMap prev(osdmap);
+  ASSERT_EQ(osdmap.get_mapping(), prev.get_mapping());
+  OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+  inc.fsid = osdmap.get_fsid();
+  vector<int> new_acting(acting.rbegin(), acting.rend());
+  inc.new_pg_temp[pgid] = new_acting;
+  inc.new_primary_temp[pg_t(1, pgid.pool())] = acting[1];
+  osdmap.apply_incremental(inc);
+  plain.apply_incremental(inc);
+  ASSERT_TRUE(osdmap.get_mapping());
+  ASSERT_NE(osdmap.get_mapping(), prev.get_mapping());
+
+  // ...without touching the previous epoch's tables it shares
+  {
+    vector<int> up2, acting2;
+    int up_primary2, acting_primary2;
+    prev.pg_to_up_acting_osds(pgid, &up2, &up_primary2,
+			      &acting2, &acting_primary2);
+    ASSERT_EQ(acting, acting2);
+    ASSERT_EQ(acting_primary, acting_primary2);
+    osdmap.pg_to_up_acting_osds(pgid, NULL, NULL, &acting2, NULL);
+    ASSERT_EQ(new_acting, acting2);
+  }
+
+  for (int pass = 0; pass < 2; ++pass) {
+    for (map<int64_t,pg_pool_t>::const_iterator p = pools.begin();
+	 p != pools.end();
+	 ++p) {
+      // raw pgs past pg_num fold into the same rows
+      for (unsigned ps = 0; ps < p->second.get_pg_num() * 4; ++ps) {
+	vector<int> up2, acting2;
+	int up_primary2, acting_primary2;
+	osdmap.pg_to_up_acting_osds(pg_t(ps, p->first), &up, &up_primary,
+				    &acting, &acting_primary);
+	plain.pg_to_up_acting_osds(pg_t(ps, p->first), &up2, &up_primary2,
+				   &acting2, &acting_primary2);
+	ASSERT_EQ(up2, up);
+	ASSERT_EQ(up_primary2, up_primary);
+	ASSERT_EQ(acting2, acting);
+	ASSERT_EQ(acting_primary2, acting_primary);
+      }
+    }
+
+    // anything else invalidates it
+    OSDMap::Incremental inc2(osdmap.get_epoch() + 1);
+    inc2.fsid = osdmap.get_fsid();
+    inc2.new_weight[0] = CEPH_OSD_OUT;
+    osdmap.apply_incremental(inc2);
+    plain.apply_incremental(inc2);
+    ASSERT_FALSE(osdmap.get_mapping());
+    osdmap.update_mapping(g_ceph_context);
+  }
+}
+
+TEST_F(OSDMapTest, PublishMapping) {
+  set_up_map();
+  ceph::shared_ptr<const OSDMap> shared(new OSDMap(osdmap));
+  ASSERT_FALSE(shared->get_mapping());
+
+  // built on the side, as OSD::MappingWQ does, and only then published
+  ceph::shared_ptr<const OSDMapMapping> m =
+    shared->build_mapping(g_ceph_context);
+  ASSERT_FALSE(shared->get_mapping());
+  shared->publish_mapping(m);
+  ASSERT_EQ(m.get(), shared->get_mapping());
+
+  pg_t pgid(0, osdmap.get_pools().begin()->first);
+  vector<int> up, acting, up2, acting2;
+  int up_primary, acting_primary, up_primary2, acting_primary2;
+  shared->pg_to_up_acting_osds(pgid, &up, &up_primary,
+			       &acting, &acting_primary);
+  osdmap.pg_to_up_acting_osds(pgid, &up2, &up_primary2,
+			      &acting2, &acting_primary2);
+  ASSERT_EQ(up2, up);
+  ASSERT_EQ(up_primary2, up_primary);
+  ASSERT_EQ(acting2, acting);
+  ASSERT_EQ(acting_primary2, acting_primary);
+
+  // a map decoded separately picks it up
+  bufferlist bl;
+  shared->encode(bl);
+  OSDMap other;
+  other.decode(bl);
+  other.share_mapping(*shared);
+  ASSERT_EQ(m.get(), other.get_mapping());
+}
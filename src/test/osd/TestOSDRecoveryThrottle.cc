@@ -0,0 +1,92 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "osd/OSD.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include <gtest/gtest.h>
+
+static uint64_t step(uint64_t cur, uint64_t ops, uint64_t ms)
+{
+  // osd_recovery_max_active 3, limit 32, target 10ms
+  return OSDService::recovery_max_active_step(cur, 3, 32, .01, ops, ms);
+}
+
+TEST(RecoveryThrottle, disabled)
+{
+  ASSERT_EQ(3u, OSDService::recovery_max_active_step(20, 3, 32, 0, 10, 0));
+}
+
+TEST(RecoveryThrottle, within_target)
+{
+  // 5ms average: grow by an eighth, at least one
+  ASSERT_EQ(4u, step(3, 100, 500));
+  ASSERT_EQ(18u, step(16, 100, 500));
+  ASSERT_EQ(32u, step(30, 100, 500));
+  ASSERT_EQ(32u, step(32, 100, 500));
+}
+
+TEST(RecoveryThrottle, over_target)
+{
+  // 20ms average: halve, but never below osd_recovery_max_active
+  ASSERT_EQ(16u, step(32, 100, 2000));
+  ASSERT_EQ(3u, step(5, 100, 2000));
+  ASSERT_EQ(3u, step(3, 100, 2000));
+  // exactly on target counts as over
+  ASSERT_EQ(8u, step(16, 100, 1000));
+}
+
+TEST(RecoveryThrottle, no_client_io)
+{
+  // no latency sample (idle, perf off, or counters reset): hold at
+  // osd_recovery_max_active, however long it lasts
+  ASSERT_EQ(3u, step(3, 0, 0));
+  ASSERT_EQ(3u, step(20, 0, 0));
+  uint64_t cur = 3;
+  for (int i = 0; i < 20; ++i)
+    cur = step(cur, 0, 0);
+  ASSERT_EQ(3u, cur);
+}
+
+TEST(RecoveryThrottle, clamp)
+{
+  // a limit lowered under us is honoured right away
+  ASSERT_EQ(32u, step(64, 100, 500));
+  ASSERT_EQ(4u, step(1, 100, 500));
+}
+
+TEST(RecoveryThrottle, recovers)
+{
+  // a burst of slow ops halves the limit; fast ones grow it back
+  uint64_t cur = 32;
+  cur = step(cur, 100, 5000);
+  cur = step(cur, 100, 5000);
+  ASSERT_EQ(8u, cur);
+  int ticks = 0;
+  while (cur < 32) {
+    cur = step(cur, 100, 100);
+    ++ticks;
+  }
+  ASSERT_EQ(32u, cur);
+  ASSERT_GT(ticks, 5);
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
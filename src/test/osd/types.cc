@@ -1528,6 +1528,77 @@ TEST(pool_opts_t, deep_scrub_interval) {
   EXPECT_FALSE(opts.is_set(pool_opts_t::DEEP_SCRUB_INTERVAL));
 }
 
+TEST(deep_scrub_sample_t, should_read) {
+  deep_scrub_sample_t all;
+  hobject_t oid(object_t("foo"), "", CEPH_NOSNAP, 0x12345678, 1, "");
+  EXPECT_TRUE(all.should_read(oid, eversion_t(1, 1)));
+
+  // objects written since the last deep scrub are always read
+  deep_scrub_sample_t s;
+  s.verified_through = eversion_t(10, 100);
+  s.period = 4;
+  for (s.slot = 0; s.slot < s.period; ++s.slot)
+    EXPECT_TRUE(s.should_read(oid, eversion_t(10, 101)));
+
+  // every unchanged object is read exactly once in period deep scrubs,
+  // even though all objects of a pg share the low bits of their hash
+  for (unsigned i = 0; i < 1000; ++i) {
+    hobject_t o(object_t("obj" + stringify(i)), "", CEPH_NOSNAP,
+		(i * 2654435761u) << 8 | 0x17, 1, "");
+    unsigned reads = 0;
+    for (s.slot = 0; s.slot < s.period; ++s.slot)
+      if (s.should_read(o, eversion_t(10, 50)))
+	++reads;
+    EXPECT_EQ(1u, reads);
+  }
+}
+
+TEST(pg_history_t, merge_deep_scrub_read_all_seq) {
+  // a primary that recovered a shard marks the next deep scrub; whoever
+  // is primary next must still see the mark
+  pg_history_t recovered, other;
+  recovered.deep_scrub_seq = other.deep_scrub_seq = 5;
+  recovered.deep_scrub_read_all_seq = 5;
+  other.deep_scrub_read_all_seq = 2;
+  EXPECT_TRUE(other.merge(recovered));
+  EXPECT_EQ(5u, other.deep_scrub_read_all_seq);
+  EXPECT_FALSE(recovered.merge(other));
+
+  bufferlist bl;
+  ::encode(recovered, bl);
+  pg_history_t decoded;
+  bufferlist::iterator p = bl.begin();
+  ::decode(decoded, p);
+  EXPECT_EQ(5u, decoded.deep_scrub_read_all_seq);
+}
+
+TEST(pg_log_entry_t, encode_with_checksum_arena) {
+  bufferlist arena;
+  vector<bufferlist> slices(50);
+  for (unsigned i = 0; i < slices.size(); ++i) {
+    hobject_t oid(object_t("obj" + stringify(i)), "", CEPH_NOSNAP, i, 1, "");
+    pg_log_entry_t e(pg_log_entry_t::MODIFY, oid, eversion_t(1, i + 1),
+		     eversion_t(1, i), i,
+		     osd_reqid_t(entity_name_t::CLIENT(777), 8, i),
+		     utime_t(8, 9));
+    e.snaps.append(string(i * 10, 'x'));
+
+    bufferlist expected;
+    e.encode_with_checksum(expected);
+    e.encode_with_checksum(slices[i], arena);
+    ASSERT_TRUE(expected.contents_equal(slices[i]));
+  }
+
+  // the slices stay intact while the arena grows after them
+  for (unsigned i = 0; i < slices.size(); ++i) {
+    bufferlist::iterator p = slices[i].begin();
+    pg_log_entry_t e;
+    e.decode_with_checksum(p);
+    EXPECT_EQ(eversion_t(1, i + 1), e.version);
+    EXPECT_EQ(i * 10, e.snaps.length());
+  }
+}
+
 /*
  * Local Variables:
  * compile-command: "cd ../.. ;
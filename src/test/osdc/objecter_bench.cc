@@ -0,0 +1,236 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Measure how op submission and completion in the Objecter scale with
+ * the number of client threads.
+ *
+ * Every op goes through Objecter::op_submit, over a real messenger to
+ * an in-process fake OSD that replies right away, and back through
+ * Objecter::handle_osd_op_reply.  The budget is balanced like it is
+ * for librados, so each op gets and puts the op and byte throttles.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "common/Cond.h"
+#include "common/Finisher.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "messages/MOSDMap.h"
+#include "messages/MOSDOp.h"
+#include "messages/MOSDOpReply.h"
+#include "mon/MonClient.h"
+#include "msg/Messenger.h"
+#include "osd/OSDMap.h"
+#include "osdc/Objecter.h"
+
+/// an OSD that completes every op as soon as it arrives
+class FakeOSD : public Dispatcher {
+public:
+  explicit FakeOSD(CephContext *cct) : Dispatcher(cct) {}
+
+  bool ms_can_fast_dispatch_any() const { return true; }
+  bool ms_can_fast_dispatch(Message *m) const {
+    return m->get_type() == CEPH_MSG_OSD_OP;
+  }
+  void ms_fast_dispatch(Message *m) {
+    MOSDOp *op = static_cast<MOSDOp*>(m);
+    op->finish_decode();
+    MOSDOpReply *reply = new MOSDOpReply(
+      op, 0, op->get_map_epoch(), CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK,
+      true);
+    m->get_connection()->send_message(reply);
+    m->put();
+  }
+  bool ms_dispatch(Message *m) {
+    m->put();
+    return true;
+  }
+  bool ms_handle_reset(Connection *con) { return true; }
+  void ms_handle_remote_reset(Connection *con) {}
+  bool ms_verify_authorizer(Connection *con, int peer_type, int protocol,
+			    bufferlist& authorizer,
+			    bufferlist& authorizer_reply,
+			    bool& isvalid, CryptoKey& session_key) {
+    isvalid = true;
+    return true;
+  }
+};
+
+/// answers for the MonClient we never connect, so the Objecter
+/// doesn't ask it for an authorizer
+class NoAuth : public Dispatcher {
+public:
+  explicit NoAuth(CephContext *cct) : Dispatcher(cct) {}
+
+  bool ms_dispatch(Message *m) { return false; }
+  bool ms_handle_reset(Connection *con) { return false; }
+  void ms_handle_remote_reset(Connection *con) {}
+  bool ms_get_authorizer(int dest_type, AuthAuthorizer **a, bool force_new) {
+    *a = NULL;
+    return true;
+  }
+};
+
+static double run(Objecter *objecter, int64_t pool, int num_threads,
+		  int depth, int seconds)
+{
+  std::atomic<bool> stop(false);
+  std::vector<uint64_t> done(num_threads);
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < num_threads; ++i) {
+    threads.push_back(std::thread([&, i]() {
+	  object_locator_t oloc(pool);
+	  uint64_t n = 0;
+	  while (!stop.load(std::memory_order_relaxed)) {
+	    // keep depth ops in flight, like an aio client would
+	    std::vector<C_SaferCond> conds(depth);
+	    std::vector<bufferlist> bls(depth);
+	    for (int j = 0; j < depth; ++j) {
+	      std::ostringstream oid;
+	      oid << "bench." << i << "." << (n + j);
+	      objecter->read(object_t(oid.str()), oloc, 0, 4096, CEPH_NOSNAP,
+			     &bls[j], 0, &conds[j]);
+	    }
+	    for (int j = 0; j < depth; ++j)
+	      conds[j].wait();
+	    n += depth;
+	  }
+	  done[i] = n;
+	}));
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  stop = true;
+  for (auto& t : threads)
+    t.join();
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  uint64_t total = 0;
+  for (auto n : done)
+    total += n;
+  return total / elapsed.count();
+}
+
+static void usage()
+{
+  std::cout << "usage: ceph_test_objecter_bench [--max-threads n]"
+	    << " [--depth n] [--seconds n]" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  int max_threads = 16;
+  int depth = 8;
+  int seconds = 5;
+  std::ostringstream err;
+  for (auto i = args.begin(); i != args.end();) {
+    if (ceph_argparse_witharg(args, i, &max_threads, err,
+			      "--max-threads", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &depth, err,
+				     "--depth", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &seconds, err,
+				     "--seconds", (char*)NULL)) {
+    } else {
+      usage();
+      return 1;
+    }
+    if (!err.str().empty()) {
+      std::cerr << err.str() << std::endl;
+      return 1;
+    }
+  }
+
+  // the osd
+  FakeOSD osd(g_ceph_context);
+  Messenger *osd_msgr = Messenger::create(
+    g_ceph_context, g_conf->ms_type, entity_name_t::OSD(0), "osd", 0);
+  osd_msgr->set_default_policy(Messenger::Policy::stateless_server(0, 0));
+  entity_addr_t addr;
+  addr.parse("127.0.0.1:0");
+  if (osd_msgr->bind(addr) < 0) {
+    std::cerr << "failed to bind the fake osd" << std::endl;
+    return 1;
+  }
+  osd_msgr->add_dispatcher_head(&osd);
+  osd_msgr->start();
+
+  // the client
+  Messenger *msgr = Messenger::create(
+    g_ceph_context, g_conf->ms_type, entity_name_t::CLIENT(-1), "client",
+    getpid());
+  msgr->set_default_policy(
+    Messenger::Policy::lossy_client(0, CEPH_FEATURE_OSDREPLYMUX));
+  MonClient monc(g_ceph_context);
+  Finisher finisher(g_ceph_context);
+  finisher.start();
+  Objecter *objecter = new Objecter(g_ceph_context, msgr, &monc, &finisher,
+				    0, 0);
+  objecter->set_balanced_budget();
+  objecter->set_client_incarnation(0);
+  objecter->init();
+  NoAuth noauth(g_ceph_context);
+  msgr->add_dispatcher_head(objecter);
+  msgr->add_dispatcher_head(&noauth);
+  msgr->start();
+
+  // a map with just the fake osd, handed straight to the objecter.
+  // the fsid stays zero, like that of our unconnected MonClient.
+  uuid_d fsid;
+  OSDMap osdmap;
+  osdmap.build_simple(g_ceph_context, 0, fsid, 1, 6, 6);
+  OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+  inc.fsid = fsid;
+  inc.new_state[0] = CEPH_OSD_EXISTS | CEPH_OSD_NEW;
+  inc.new_up_client[0] = osd_msgr->get_myaddr();
+  inc.new_weight[0] = CEPH_OSD_IN;
+  osdmap.apply_incremental(inc);
+  MOSDMap *m = new MOSDMap(fsid);
+  osdmap.encode(m->maps[osdmap.get_epoch()],
+		CEPH_FEATURES_ALL | CEPH_FEATURE_RESERVED);
+  m->oldest_map = m->newest_map = osdmap.get_epoch();
+  objecter->handle_osd_map(m);
+  m->put();
+  int64_t pool = osdmap.lookup_pg_pool_name("rbd");
+
+  std::cout << "threads\tops/s" << std::endl;
+  for (int t = 1; t <= max_threads; t *= 2) {
+    double ops = run(objecter, pool, t, depth, seconds);
+    std::cout << t << "\t" << (uint64_t)ops << std::endl;
+  }
+
+  objecter->shutdown();
+  msgr->shutdown();
+  msgr->wait();
+  osd_msgr->shutdown();
+  osd_msgr->wait();
+  finisher.stop();
+  delete objecter;
+  delete msgr;
+  delete osd_msgr;
+  return 0;
+}
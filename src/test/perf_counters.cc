@@ -40,6 +40,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#include <thread>
 #include <time.h>
 #include <unistd.h>
 
@@ -200,3 +201,70 @@ TEST(PerfCounters, CephContextPerfCounters) {
   // Restore to avoid impact to other test cases
   g_ceph_context->disable_perf_counter();
 }
+
+enum {
+  TEST_PERFCOUNTERS3_ELEMENT_FIRST = 600,
+  TEST_PERFCOUNTERS3_ELEMENT_OPS,
+  TEST_PERFCOUNTERS3_ELEMENT_LAT,
+  TEST_PERFCOUNTERS3_ELEMENT_HIST,
+  TEST_PERFCOUNTERS3_ELEMENT_LAST,
+};
+
+static PerfCounters* setup_test_perfcounter3(CephContext *cct)
+{
+  PerfHistogram::axis_config_d lat = {
+    "lat", PerfHistogram::SCALE_LOG2, 0, 10, 4
+  };
+  PerfHistogram::axis_config_d size = {
+    "size", PerfHistogram::SCALE_LINEAR, 0, 100, 3
+  };
+  PerfCountersBuilder bld(cct, "test_perfcounter_3",
+	  TEST_PERFCOUNTERS3_ELEMENT_FIRST, TEST_PERFCOUNTERS3_ELEMENT_LAST);
+  bld.add_u64_counter_sharded(TEST_PERFCOUNTERS3_ELEMENT_OPS, "ops");
+  bld.add_time_avg_sharded(TEST_PERFCOUNTERS3_ELEMENT_LAT, "lat");
+  bld.add_histogram(TEST_PERFCOUNTERS3_ELEMENT_HIST, "hist", lat, size);
+  return bld.create_perf_counters();
+}
+
+TEST(PerfCounters, ShardedAndHistogram) {
+  PerfCountersCollection *coll = g_ceph_context->get_perfcounters_collection();
+  coll->clear();
+  PerfCounters* fake_pf = setup_test_perfcounter3(g_ceph_context);
+  coll->add(fake_pf);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 20; ++t) {
+    threads.push_back(std::thread([fake_pf]() {
+	  for (int i = 0; i < 1000; ++i) {
+	    fake_pf->inc(TEST_PERFCOUNTERS3_ELEMENT_OPS);
+	    fake_pf->tinc(TEST_PERFCOUNTERS3_ELEMENT_LAT, utime_t(0, 1000));
+	  }
+	}));
+  }
+  for (auto& t : threads)
+    t.join();
+  fake_pf->dec(TEST_PERFCOUNTERS3_ELEMENT_OPS, 5);
+  ASSERT_EQ(19995u, fake_pf->get(TEST_PERFCOUNTERS3_ELEMENT_OPS));
+
+  // lat: [0,10) [10,20) [20,+), size: <0 [0,100) [100,+)
+  fake_pf->hinc(TEST_PERFCOUNTERS3_ELEMENT_HIST, 5, 50);
+  fake_pf->hinc(TEST_PERFCOUNTERS3_ELEMENT_HIST, 15, 150);
+  fake_pf->hinc(TEST_PERFCOUNTERS3_ELEMENT_HIST, 1000, 150);
+  fake_pf->hinc(TEST_PERFCOUNTERS3_ELEMENT_HIST, 1000, 150);
+
+  AdminSocketClient client(get_rand_socket_path());
+  std::string msg;
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf dump\", \"format\": \"json\" }", &msg));
+  ASSERT_EQ(sd("{\"test_perfcounter_3\":{\"ops\":19995,"
+	    "\"lat\":{\"avgcount\":20000,\"sum\":0.020000000}}}"), msg);
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf histogram dump\", \"format\": \"json\" }", &msg));
+  ASSERT_EQ(sd("{\"test_perfcounter_3\":{\"hist\":{\"values\":"
+	    "[[0,0,0],[0,1,0],[0,0,1],[0,0,2]]}}}"), msg);
+
+  coll->reset(string("all"));
+  ASSERT_EQ(0u, fake_pf->get(TEST_PERFCOUNTERS3_ELEMENT_OPS));
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf histogram dump\", \"format\": \"json\" }", &msg));
+  ASSERT_EQ(sd("{\"test_perfcounter_3\":{\"hist\":{\"values\":"
+	    "[[0,0,0],[0,0,0],[0,0,0],[0,0,0]]}}}"), msg);
+  coll->clear();
+}
@@ -164,6 +164,16 @@ void usage()
   cout << "                         reweight a given item (and adjust ancestor\n"
        << "                         weights as needed)\n";
   cout << "   -i mapfn --reweight   recalculate all bucket weights\n";
+  cout << "   -i mapfn --optimize-weights\n";
+  cout << "                         adjust device weights to even out the\n"
+       << "                         placements of --rule/--num-rep over the\n"
+       << "                         --min-x..--max-x inputs\n";
+  cout << "      [--optimize-iterations n]\n";
+  cout << "                         number of passes (default 20)\n";
+  cout << "      [--optimize-max-change f]\n";
+  cout << "                         max weight change per pass (default 0.05)\n";
+  cout << "      [--optimize-threads n]\n";
+  cout << "                         threads used for mapping (default 4)\n";
   cout << "\n";
   cout << "Options for the display/test stage\n";
   cout << "\n";
@@ -189,6 +199,7 @@ void usage()
   cout << "   --show-mappings       show mappings\n";
   cout << "   --show-bad-mappings   show bad mappings\n";
   cout << "   --show-choose-tries   show choose tries histogram\n";
+  cout << "   --show-timing         show mapping time and mappings/sec\n";
   cout << "   --output-name name\n";
   cout << "                         prepend the data file(s) generated during the\n";
   cout << "                         testing routine with name\n";
@@ -242,6 +253,10 @@ int main(int argc, const char **argv)
   bool unsafe_tunables = false;
 
   bool reweight = false;
+  bool optimize = false;
+  int optimize_iterations = 20;
+  float optimize_max_change = 0.05;
+  int optimize_threads = 4;
   int add_item = -1;
   bool update_item = false;
   float add_weight = 0;
@@ -317,6 +332,9 @@ int main(int argc, const char **argv)
     } else if (ceph_argparse_flag(args, i, "--show_choose_tries", (char*)NULL)) {
       display = true;
       tester.set_output_choose_tries(true);
+    } else if (ceph_argparse_flag(args, i, "--show_timing", (char*)NULL)) {
+      display = true;
+      tester.set_output_timing(true);
     } else if (ceph_argparse_witharg(args, i, &val, "-c", "--compile", (char*)NULL)) {
       srcfn = val;
       compile = true;
@@ -355,6 +373,26 @@ int main(int argc, const char **argv)
       adjust = true;
     } else if (ceph_argparse_flag(args, i, "--reweight", (char*)NULL)) {
       reweight = true;
+    } else if (ceph_argparse_flag(args, i, "--optimize_weights", (char*)NULL)) {
+      optimize = true;
+    } else if (ceph_argparse_witharg(args, i, &optimize_iterations, err,
+				     "--optimize_iterations", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	exit(EXIT_FAILURE);
+      }
+    } else if (ceph_argparse_witharg(args, i, &optimize_max_change, err,
+				     "--optimize_max_change", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	exit(EXIT_FAILURE);
+      }
+    } else if (ceph_argparse_witharg(args, i, &optimize_threads, err,
+				     "--optimize_threads", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	exit(EXIT_FAILURE);
+      }
     } else if (ceph_argparse_witharg(args, i, &add_item, err, "--add_item", (char*)NULL)) {
       if (!err.str().empty()) {
 	cerr << err.str() << std::endl;
@@ -531,7 +569,7 @@ int main(int argc, const char **argv)
     cerr << "cannot specify more than one of compile, decompile, and build" << std::endl;
     exit(EXIT_FAILURE);
   }
-  if (!check && !compile && !decompile && !build && !test && !reweight && !adjust && !tree &&
+  if (!check && !compile && !decompile && !build && !test && !reweight && !optimize && !adjust && !tree &&
       add_item < 0 && full_location < 0 &&
       remove_name.empty() && reweight_name.empty()) {
     cerr << "no action specified; -h for help" << std::endl;
@@ -829,6 +867,17 @@ int main(int argc, const char **argv)
     modified = true;
   }
 
+  if (optimize) {
+    int r = tester.optimize_weights(g_ceph_context, optimize_iterations,
+				    optimize_max_change, optimize_threads);
+    if (r < 0) {
+      cerr << me << " " << cpp_strerror(r) << std::endl;
+      exit(1);
+    }
+    if (r > 0)
+      modified = true;
+  }
+
 
   // display ---
   if (full_location >= 0) {